@@ -0,0 +1,284 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../Libraries/GPIO/GPIO.h"
+#include "../Libraries/GPIO/GPIOEventLoop.h"
+#include "../Libraries/GPIO/GPIOFakeBackend.h"
+#include "../Libraries/GPIO/GPIOMmapBackend.h"
+
+#define DEFAULT_ROUNDS 1000000
+#define ELISION_PIN 44
+#define ELISION_REPEATS 10
+#define EVENT_PINS 3
+#define EVENT_WAIT_MS 100
+#define REGISTERS_TEMPLATE "/tmp/GPIOBench.XXXXXX"
+
+using namespace std;
+
+// Bank offsets within the register file.
+static const off_t bankOffsets[AM335X_GPIO_BANKS] = {
+   0, AM335X_GPIO_BANK_SIZE, 2 * AM335X_GPIO_BANK_SIZE,
+   3 * AM335X_GPIO_BANK_SIZE
+};
+
+// Returns register reg of bank as stored in the file.
+static uint32_t fileRegister(int fd, int bank, int reg) {
+   uint32_t value = 0;
+   if (pread(fd, &value, sizeof(value), bankOffsets[bank] + reg) !=
+         sizeof(value)) {
+      return 0xDEADBEEF;
+   }
+   return value;
+}
+
+// Stores value into register reg of bank in the file.
+static void setFileRegister(int fd, int bank, int reg, uint32_t value) {
+   if (pwrite(fd, &value, sizeof(value), bankOffsets[bank] + reg) !=
+         sizeof(value)) {
+      fprintf(stderr, "Could not write the register file.\n");
+   }
+}
+
+// Compares register reg of bank in the file against expected.
+static bool expectRegister(int fd, int bank, int reg, uint32_t expected,
+      const char *name) {
+   uint32_t value = fileRegister(fd, bank, reg);
+   if (value != expected) {
+      fprintf(stderr, "gpio%d %s is 0x%08x, expected 0x%08x.\n", bank, name,
+            value, expected);
+      return false;
+   }
+   return true;
+}
+
+// Points GPIOMmapBackend at a plain file holding the 4 register banks, with
+// every pin an input as after reset, and checks the words it stores for
+// direction changes, batched writes and raw bank writes.
+static bool runMmap(int rounds) {
+   char path[] = REGISTERS_TEMPLATE;
+   int fd = mkstemp(path);
+   if (fd < 0 || ftruncate(fd, AM335X_GPIO_BANKS * AM335X_GPIO_BANK_SIZE) <
+         0) {
+      fprintf(stderr, "Could not create the register file.\n");
+      return false;
+   }
+   int bank;
+   for (bank = 0; bank < AM335X_GPIO_BANKS; ++bank) {
+      setFileRegister(fd, bank, AM335X_GPIO_OE, 0xFFFFFFFF);
+   }
+
+   GPIOMmapBackend backend(path, bankOffsets);
+   bool ok = backend.isMapped();
+
+   // Pins 60 and 61 are bits 28 and 29 of gpio1, pin 33 bit 1.
+   int pins[] = {60, 33, 61};
+   ok = ok && backend.setDirections(pins, 3, GPIO_DIR_OUT) == 3 &&
+      expectRegister(fd, 1, AM335X_GPIO_OE, 0xCFFFFFFD, "OE");
+
+   ok = ok && backend.setValues(pins, 3, 0x3) == 3 &&
+      expectRegister(fd, 1, AM335X_GPIO_SETDATAOUT, 0x10000002,
+            "SETDATAOUT") &&
+      expectRegister(fd, 1, AM335X_GPIO_CLEARDATAOUT, 0x20000000,
+            "CLEARDATAOUT") &&
+      expectRegister(fd, 0, AM335X_GPIO_SETDATAOUT, 0, "SETDATAOUT") &&
+      expectRegister(fd, 0, AM335X_GPIO_CLEARDATAOUT, 0, "CLEARDATAOUT");
+
+   // An empty mask is not stored at all.
+   setFileRegister(fd, 2, AM335X_GPIO_SETDATAOUT, 0x12345678);
+   backend.writeBank(2, 0, 0x0000A000);
+   ok = ok && expectRegister(fd, 2, AM335X_GPIO_SETDATAOUT, 0x12345678,
+         "SETDATAOUT") &&
+      expectRegister(fd, 2, AM335X_GPIO_CLEARDATAOUT, 0x0000A000,
+            "CLEARDATAOUT");
+   backend.writeBank(2, 0x00000005, 0);
+   ok = ok && expectRegister(fd, 2, AM335X_GPIO_SETDATAOUT, 0x00000005,
+         "SETDATAOUT");
+
+   // Inputs read DATAIN, outputs DATAOUT.
+   setFileRegister(fd, 1, AM335X_GPIO_DATAIN, 1U << 2);
+   setFileRegister(fd, 1, AM335X_GPIO_DATAOUT, 1U << 28);
+   ok = ok && backend.getValue(34) == 1 && backend.getValue(35) == 0 &&
+      backend.getValue(60) == 1 && backend.getValue(61) == 0;
+
+   ok = ok && backend.setDirections(pins, 3, GPIO_DIR_IN) == 3 &&
+      expectRegister(fd, 1, AM335X_GPIO_OE, 0xFFFFFFFF, "OE");
+
+   // A batch spread over two banks costs one store per bank and mask.
+   int batch[] = {60, 61, 62, 63, 64, 65, 66, 67};
+   uint64_t start = GPIOBackend::monotonicNow();
+   int round;
+   for (round = 0; ok && round < rounds; ++round) {
+      backend.setValues(batch, 8, round);
+   }
+   uint64_t elapsed = GPIOBackend::monotonicNow() - start;
+
+   close(fd);
+   unlink(path);
+
+   printf("mmap registers: %.1f ns per batch of 8 pins%s\n",
+         (double)elapsed / rounds, ok ? "" : " FAILED");
+   return ok;
+}
+
+// Checks that GPIO hands a direction or value write to the backend only when
+// it changes the pin, that every change reaches the backend, and that the
+// issued and elided counters agree with the writes the backend saw.
+static bool runElision() {
+   GPIOFakeBackend backend;
+   GPIO::resetTotalWrites();
+   GPIO pin(ELISION_PIN, &backend);
+   backend.resetCounts();
+   unsigned long issued = pin.getIssuedWrites();
+   unsigned long elided = pin.getElidedWrites();
+
+   // The pin was exported as a low output: one write for the new value, the
+   // repeats reach nothing.
+   bool ok = true;
+   int round;
+   for (round = 0; round < ELISION_REPEATS; ++round) {
+      ok = ok && pin.setDirection("out") > 0 && pin.setValue(1) > 0;
+   }
+   ok = ok && backend.writeCount() == 1 && backend.getValue(ELISION_PIN) == 1;
+   elided += 2 * ELISION_REPEATS - 1;
+
+   // Every real change is passed on.
+   for (round = 0; round < ELISION_REPEATS; ++round) {
+      ok = ok && pin.setValue(round % 2) > 0 &&
+         backend.getValue(ELISION_PIN) == round % 2;
+   }
+   ok = ok && pin.setDirection("in") > 0 &&
+      backend.getDirection(ELISION_PIN) == GPIO_DIR_IN &&
+      pin.setDirection("out") > 0 &&
+      backend.getDirection(ELISION_PIN) == GPIO_DIR_OUT;
+
+   // Switching to "out" forgets the value, so writing the old one again is
+   // not elided.
+   ok = ok && pin.setValue(1) > 0 && backend.getValue(ELISION_PIN) == 1;
+
+   unsigned long writes = backend.writeCount();
+   ok = ok && writes == 1 + ELISION_REPEATS + 2 + 1 &&
+      pin.getIssuedWrites() - issued == writes &&
+      pin.getElidedWrites() == elided &&
+      GPIO::getTotalIssuedWrites() == pin.getIssuedWrites() &&
+      GPIO::getTotalElidedWrites() == pin.getElidedWrites();
+
+   printf("write elision: %lu writes issued, %lu elided, %lu reached the "
+         "backend%s\n", pin.getIssuedWrites() - issued, pin.getElidedWrites(),
+         writes, ok ? "" : " FAILED");
+   return ok;
+}
+
+// Collects every edge the loop has pending into counts and values, indexed by
+// position in pins. Returns false if an edge names a pin which is not watched.
+static bool collectEvents(GPIOEventLoop *loop, const int *pins, int *counts,
+      int *values) {
+   GPIOEvent events[GPIO_EVENT_LOOP_MAX_PINS];
+   int timeoutMs = EVENT_WAIT_MS;
+   int numEvents;
+   while ((numEvents = loop->wait(events, GPIO_EVENT_LOOP_MAX_PINS,
+               timeoutMs)) > 0) {
+      int event;
+      for (event = 0; event < numEvents; ++event) {
+         int index;
+         for (index = 0; index < EVENT_PINS; ++index) {
+            if (pins[index] == events[event].pin) {
+               break;
+            }
+         }
+         if (index == EVENT_PINS) {
+            fprintf(stderr, "Edge on unwatched pin %d.\n", events[event].pin);
+            return false;
+         }
+         ++counts[index];
+         values[index] = events[event].value;
+      }
+      timeoutMs = 0;
+   }
+   return numEvents == 0;
+}
+
+// Compares the edges collected for each pin against one edge with the level
+// in expected, or none where expected is -1.
+static bool expectEvents(const int *pins, const int *counts, const int *values,
+      const int *expected) {
+   bool ok = true;
+   int index;
+   for (index = 0; index < EVENT_PINS; ++index) {
+      int wanted = expected[index] < 0 ? 0 : 1;
+      if (counts[index] != wanted ||
+            (wanted && values[index] != expected[index])) {
+         fprintf(stderr, "Pin %d got %d edges (last level %d), expected %d "
+               "(level %d).\n", pins[index], counts[index], values[index],
+               wanted, expected[index]);
+         ok = false;
+      }
+   }
+   return ok;
+}
+
+// Watches pins for rising, falling and both edges on the fake backend, drives
+// each of them and checks that the loop dispatches every selected edge once,
+// with the right pin and level, and nothing for the edges not selected.
+static bool runEventLoop() {
+   static const int pins[EVENT_PINS] = {45, 46, 47};
+   static const char *edges[EVENT_PINS] = {"rising", "falling", "both"};
+
+   GPIOFakeBackend backend;
+   GPIO *gpios[EVENT_PINS];
+   GPIOEventLoop loop;
+   bool ok = true;
+   int index;
+   for (index = 0; index < EVENT_PINS; ++index) {
+      gpios[index] = new GPIO(pins[index], &backend);
+      ok = loop.add(gpios[index], edges[index]) && ok;
+   }
+
+   // Raise every pin: the falling pin stays quiet.
+   int counts[EVENT_PINS] = {0, 0, 0};
+   int values[EVENT_PINS] = {-1, -1, -1};
+   for (index = 0; index < EVENT_PINS; ++index) {
+      backend.drive(pins[index], 1);
+   }
+   int raised[EVENT_PINS] = {1, -1, 1};
+   ok = ok && collectEvents(&loop, pins, counts, values) &&
+      expectEvents(pins, counts, values, raised);
+   int dispatched = counts[0] + counts[1] + counts[2];
+
+   // Lower every pin: the rising pin stays quiet.
+   int lowered[EVENT_PINS] = {-1, 0, 0};
+   memset(counts, 0, sizeof(counts));
+   for (index = 0; index < EVENT_PINS; ++index) {
+      backend.drive(pins[index], 0);
+   }
+   ok = ok && collectEvents(&loop, pins, counts, values) &&
+      expectEvents(pins, counts, values, lowered);
+   dispatched += counts[0] + counts[1] + counts[2];
+
+   for (index = 0; index < EVENT_PINS; ++index) {
+      loop.remove(gpios[index]);
+      delete gpios[index];
+   }
+
+   printf("event loop: %d edges dispatched on %d pins%s\n", dispatched,
+         EVENT_PINS, ok ? "" : " FAILED");
+   return ok;
+}
+
+// Checks the register writes of the mmap backend against a plain file, so it
+// runs without hardware, and times its batched writes. Also checks the write
+// elision of GPIO and the edge dispatch of GPIOEventLoop on the fake backend.
+int main(int argc, char **argv) {
+   int rounds = argc > 1 ? atoi(argv[1]) : DEFAULT_ROUNDS;
+   if (rounds <= 0) {
+      fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+      return 2;
+   }
+
+   bool passed = runMmap(rounds);
+   passed = runElision() && passed;
+   passed = runEventLoop() && passed;
+
+   return passed ? 0 : 1;
+}
@@ -0,0 +1,762 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../Libraries/GPIO/GPIOProfile.h"
+#include "../Libraries/LCD/AsyncLCD.h"
+#include "../Libraries/LCD/BigDigits.h"
+#include "../Libraries/LCD/HD44780Sim.h"
+#include "../Libraries/LCD/LCDBus.h"
+#include "../Libraries/LCD/Marquee.h"
+#include "../Libraries/LCD/StaticLCD.h"
+
+#define DEFAULT_ROUNDS 20
+#define LINE_TEXT "Squawk 12:34:56 "
+#define LINE_WIDTH 16
+#define BUS_DISPLAYS 2
+#define ASYNC_ROUNDS 200
+#define MARQUEE_TEXT "Squawk ready, all sensors good"
+#define MARQUEE_STATIC "12:34"
+#define MARQUEE_FRAMES 50
+#define MARQUEE_STEP_INSTRUCTIONS 3
+#define FORMAT_LINE_CELLS 40
+#define FORMAT_LONG_TEXT 150
+
+// Posts taking longer than this waited for the render thread to make room.
+#define ASYNC_POST_NS 10000
+
+using namespace std;
+
+static const char *waitNames[] = {"busy-flag", "timed", "hybrid"};
+
+// Pins of the benchmarked display, as used by runBench.
+struct BenchPins4 {
+   static constexpr int rs = 30, rw = 31, e = 48;
+   static constexpr int data[4] = {60, 61, 62, 63};
+};
+
+struct BenchPins8 {
+   static constexpr int rs = 30, rw = 31, e = 48;
+   static constexpr int data[8] = {60, 61, 62, 63, 64, 65, 66, 67};
+};
+
+// Two HD44780 models on one set of RS, RW and data pins, each with its own E
+// pin. Writes reach both models, reads are answered by the one selected.
+class SharedBusSim : public GPIOBackend {
+   public:
+      SharedBusSim(HD44780Sim *first, HD44780Sim *second, int secondE) {
+         sims[0] = first;
+         sims[1] = second;
+         secondEnable = secondE;
+      }
+
+      bool exportPin(int pin) {
+         return sims[0]->exportPin(pin) && sims[1]->exportPin(pin);
+      }
+
+      bool unexportPin(int pin) {
+         return sims[0]->unexportPin(pin) && sims[1]->unexportPin(pin);
+      }
+
+      int getDirection(int pin) {
+         return sims[0]->getDirection(pin);
+      }
+
+      int setDirection(int pin, int direction) {
+         return setDirections(&pin, 1, direction);
+      }
+
+      int setDirections(const int *pins, int count, int direction) {
+         int result = sims[0]->setDirections(pins, count, direction);
+         return sims[1]->setDirections(pins, count, direction) > 0 ? result : 0;
+      }
+
+      int getValue(int pin) {
+         uint32_t value = 0;
+         return getValues(&pin, 1, &value) > 0 ? (int)value : -1;
+      }
+
+      int setValue(int pin, int value) {
+         return setValues(&pin, 1, value ? 1 : 0);
+      }
+
+      int setValues(const int *pins, int count, uint32_t values) {
+         int result = sims[0]->setValues(pins, count, values);
+         return sims[1]->setValues(pins, count, values) > 0 ? result : 0;
+      }
+
+      int getValues(const int *pins, int count, uint32_t *values) {
+         return selected()->getValues(pins, count, values);
+      }
+
+   private:
+      // Returns the model whose E is high, the first one if neither is.
+      HD44780Sim *selected() {
+         return sims[1]->getValue(secondEnable) == 1 ? sims[1] : sims[0];
+      }
+
+      HD44780Sim *sims[BUS_DISPLAYS];
+      int secondEnable;
+};
+
+// Latencies of the LCD calls of one configuration.
+typedef struct {
+   GPIOHistogram print;
+   GPIOHistogram clear;
+   GPIOHistogram moveCursor;
+   GPIOHistogram flush;
+   unsigned long chars;
+   uint64_t printNs;
+   unsigned long printOps;
+} BenchResult;
+
+// Runs the benchmark on an LCD of dataPins data pins in waitMode. Returns
+// false if the display content is wrong or the protocol was violated.
+static bool runBench(int dataPins, int waitMode, int rounds,
+      BenchResult *result) {
+   unsigned char data[] = {60, 61, 62, 63, 64, 65, 66, 67};
+   LCDpins pins = {30, 31, 48, data};
+   HD44780Sim sim(&pins, dataPins, NULL);
+   GPIOBackend::setDefault(&sim);
+
+   memset(result, 0, sizeof(*result));
+   bool passed = true;
+   {
+      LCD lcd(&pins, dataPins, 1, waitMode, NULL);
+      sim.resetStats();
+
+      int round;
+      for (round = 0; round < rounds; ++round) {
+         uint64_t start = GPIOBackend::monotonicNow();
+         lcd.moveCursor(round % 2 * ROW_SHIFT);
+         gpioHistogramAdd(&result->moveCursor,
+               GPIOBackend::monotonicNow() - start);
+
+         unsigned long ops = sim.readCount() + sim.writeCount();
+         start = GPIOBackend::monotonicNow();
+         lcd.print(LINE_TEXT);
+         uint64_t elapsed = GPIOBackend::monotonicNow() - start;
+         gpioHistogramAdd(&result->print, elapsed);
+         result->printNs += elapsed;
+         result->printOps += sim.readCount() + sim.writeCount() - ops;
+         result->chars += strlen(LINE_TEXT);
+      }
+
+      char line[LINE_WIDTH + 1];
+      sim.readLine(0, line, LINE_WIDTH);
+      passed = passed && strcmp(line, LINE_TEXT) == 0;
+
+      // A clock redrawn every second through the framebuffer.
+      lcd.clear();
+      for (round = 0; round < rounds; ++round) {
+         lcd.draw(0, 0, "12:34:");
+         lcd.drawNumber(0, 6, round % 60, 2, true);
+
+         uint64_t start = GPIOBackend::monotonicNow();
+         lcd.flush();
+         gpioHistogramAdd(&result->flush, GPIOBackend::monotonicNow() - start);
+      }
+
+      for (round = 0; round < rounds; ++round) {
+         uint64_t start = GPIOBackend::monotonicNow();
+         lcd.clear();
+         gpioHistogramAdd(&result->clear, GPIOBackend::monotonicNow() - start);
+      }
+
+      sim.readLine(0, line, LINE_WIDTH);
+      passed = passed && strcmp(line, "                ") == 0;
+   }
+
+   if (sim.violationCount() > 0) {
+      fprintf(stderr, "%lu protocol violations, last: %s.\n",
+            sim.violationCount(), sim.lastViolation());
+      passed = false;
+   }
+
+   GPIOBackend::setDefault(NULL);
+   return passed;
+}
+
+// Runs the print part of the benchmark on a StaticLCD. Returns false if the
+// display content is wrong or the protocol was violated.
+template <unsigned char Mode, typename PinMap, unsigned char WaitMode>
+static bool runStaticBench(int rounds, BenchResult *result) {
+   unsigned char data[] = {60, 61, 62, 63, 64, 65, 66, 67};
+   LCDpins pins = {30, 31, 48, data};
+   HD44780Sim sim(&pins, Mode, NULL);
+
+   memset(result, 0, sizeof(*result));
+   StaticLCD<Mode, 1, PinMap, WaitMode> lcd(&sim);
+   sim.resetStats();
+
+   int round;
+   for (round = 0; round < rounds; ++round) {
+      uint64_t start = GPIOBackend::monotonicNow();
+      lcd.moveCursor(0x00);
+      gpioHistogramAdd(&result->moveCursor,
+            GPIOBackend::monotonicNow() - start);
+
+      unsigned long ops = sim.readCount() + sim.writeCount();
+      start = GPIOBackend::monotonicNow();
+      lcd.print(LINE_TEXT);
+      uint64_t elapsed = GPIOBackend::monotonicNow() - start;
+      gpioHistogramAdd(&result->print, elapsed);
+      result->printNs += elapsed;
+      result->printOps += sim.readCount() + sim.writeCount() - ops;
+      result->chars += strlen(LINE_TEXT);
+   }
+
+   char line[LINE_WIDTH + 1];
+   sim.readLine(0, line, LINE_WIDTH);
+   bool passed = strcmp(line, LINE_TEXT) == 0;
+
+   if (sim.violationCount() > 0) {
+      fprintf(stderr, "%lu protocol violations, last: %s.\n",
+            sim.violationCount(), sim.lastViolation());
+      passed = false;
+   }
+   return passed;
+}
+
+// Runs runStaticBench with the bus width and wait mode given at run time.
+static bool runStatic(int dataPins, int waitMode, int rounds,
+      BenchResult *result) {
+   switch (dataPins * 10 + waitMode) {
+      case 40:
+         return runStaticBench<4, BenchPins4, LCD_WAIT_BUSY_FLAG>(rounds,
+               result);
+      case 41:
+         return runStaticBench<4, BenchPins4, LCD_WAIT_TIMED>(rounds, result);
+      case 42:
+         return runStaticBench<4, BenchPins4, LCD_WAIT_HYBRID>(rounds, result);
+      case 80:
+         return runStaticBench<8, BenchPins8, LCD_WAIT_BUSY_FLAG>(rounds,
+               result);
+      case 81:
+         return runStaticBench<8, BenchPins8, LCD_WAIT_TIMED>(rounds, result);
+      default:
+         return runStaticBench<8, BenchPins8, LCD_WAIT_HYBRID>(rounds, result);
+   }
+}
+
+// Rewrites both lines of BUS_DISPLAYS displays sharing a bus, one flush after
+// the other or interleaved by LCDBus::flush(), and stores the cells written per
+// second in cellsPerSecond. Returns false if the display content is wrong or
+// the protocol was violated.
+static bool runBusBench(int dataPins, int waitMode, int rounds,
+      bool interleaved, double *cellsPerSecond) {
+   unsigned char data[] = {60, 61, 62, 63, 64, 65, 66, 67};
+   unsigned char enables[BUS_DISPLAYS] = {48, 49};
+   LCDpins firstPins = {30, 31, enables[0], data};
+   LCDpins secondPins = {30, 31, enables[1], data};
+   HD44780Sim first(&firstPins, dataPins, NULL);
+   HD44780Sim second(&secondPins, dataPins, NULL);
+   SharedBusSim sim(&first, &second, enables[1]);
+   GPIOBackend::setDefault(&sim);
+
+   bool passed = true;
+   {
+      LCDBus bus(30, 31, data, dataPins, enables, BUS_DISPLAYS);
+      LCD clock(&bus, enables[0], 1, waitMode, NULL);
+      LCD status(&bus, enables[1], 1, waitMode, NULL);
+
+      unsigned long cells = 0;
+      uint64_t elapsed = 0;
+      int round;
+      for (round = 0; round < rounds; ++round) {
+         const char *text = round % 2 ? LINE_TEXT : "Status: all good";
+         clock.draw(0, 0, text);
+         clock.draw(1, 0, text);
+         status.draw(0, 0, text);
+         status.draw(1, 0, text);
+
+         uint64_t start = GPIOBackend::monotonicNow();
+         if (interleaved) {
+            cells += bus.flush();
+         } else {
+            cells += clock.flush();
+            cells += status.flush();
+         }
+         elapsed += GPIOBackend::monotonicNow() - start;
+      }
+      *cellsPerSecond = cells * 1e9 / (elapsed ? elapsed : 1);
+
+      char line[LINE_WIDTH + 1];
+      first.readLine(1, line, LINE_WIDTH);
+      passed = passed && strcmp(line, rounds % 2 ? "Status: all good" :
+            LINE_TEXT) == 0;
+      second.readLine(0, line, LINE_WIDTH);
+      passed = passed && strcmp(line, rounds % 2 ? "Status: all good" :
+            LINE_TEXT) == 0;
+   }
+
+   HD44780Sim *sims[BUS_DISPLAYS] = {&first, &second};
+   int index;
+   for (index = 0; index < BUS_DISPLAYS; ++index) {
+      if (sims[index]->violationCount() > 0) {
+         fprintf(stderr, "%lu protocol violations, last: %s.\n",
+               sims[index]->violationCount(), sims[index]->lastViolation());
+         passed = false;
+      }
+   }
+
+   GPIOBackend::setDefault(NULL);
+   return passed;
+}
+
+// Copies what the cells of both lines show into cells, replacing the codes
+// of custom glyphs by their rows so displays which loaded the same glyphs
+// into other slots compare equal.
+static void readCells(HD44780Sim *sim,
+      unsigned char cells[2][LINE_WIDTH][LCD_GLYPH_ROWS + 1]) {
+   int line;
+   int col;
+   for (line = 0; line < 2; ++line) {
+      for (col = 0; col < LINE_WIDTH; ++col) {
+         unsigned char code = sim->getDDRAM(line * ROW_SHIFT + col);
+         memset(cells[line][col], 0, LCD_GLYPH_ROWS + 1);
+         cells[line][col][0] = code;
+         if (code < LCD_GLYPH_SLOTS) {
+            cells[line][col][0] = 0;
+            memcpy(&cells[line][col][1], sim->getGlyph(code), LCD_GLYPH_ROWS);
+         }
+      }
+   }
+}
+
+// Draws big text on a 2 line display, optionally over longer big text drawn
+// before, and reads back what the display shows. Returns false if the
+// protocol was violated.
+static bool drawBig(const char *before, const char *text,
+      unsigned char cells[2][LINE_WIDTH][LCD_GLYPH_ROWS + 1]) {
+   unsigned char data[] = {60, 61, 62, 63, 64, 65, 66, 67};
+   LCDpins pins = {30, 31, 48, data};
+   HD44780Sim sim(&pins, 8, NULL);
+   GPIOBackend::setDefault(&sim);
+   {
+      LCD lcd(&pins, 8, 2, LCD_WAIT_BUSY_FLAG, NULL);
+      BigDigits digits(&lcd, 0);
+      if (before) {
+         digits.draw(before);
+         lcd.flush();
+      }
+      digits.draw(text);
+      lcd.flush();
+   }
+   readCells(&sim, cells);
+   GPIOBackend::setDefault(NULL);
+   return sim.violationCount() == 0;
+}
+
+// Checks that big text drawn over longer text shows the same as when drawn
+// on an empty display, with the columns of the longer text blanked.
+static bool runBigDigits() {
+   unsigned char expected[2][LINE_WIDTH][LCD_GLYPH_ROWS + 1];
+   unsigned char shrunk[2][LINE_WIDTH][LCD_GLYPH_ROWS + 1];
+   bool ok = drawBig(NULL, "9:00", expected) &&
+      drawBig("10:00", "9:00", shrunk) &&
+      memcmp(expected, shrunk, sizeof(expected)) == 0;
+
+   printf("big digits shrink from 10:00 to 9:00%s\n", ok ? "" : " FAILED");
+   return ok;
+}
+
+// Returns true if the display cell at address shows codePoint as translated
+// for the A00 ROM, comparing the rows of glyphs it falls back to.
+static bool cellShows(HD44780Sim *sim, unsigned char address,
+      uint32_t codePoint) {
+   unsigned char code = sim->getDDRAM(address);
+   uint16_t expected = lcdTranslate(codePoint, LCD_ROM_A00);
+   if (expected < LCD_CODE_GLYPH) {
+      return code == expected;
+   }
+   return code < LCD_GLYPH_SLOTS && memcmp(sim->getGlyph(code),
+         lcdFallbackGlyphs[expected - LCD_CODE_GLYPH].rows,
+         LCD_GLYPH_ROWS) == 0;
+}
+
+// Checks that glyphs of printed text are not taken over by text printed
+// after it, and that text needing more glyphs than there are slots shows
+// LCD_CODE_UNKNOWN for the rest, printed in two calls or in one.
+static bool runGlyphs() {
+   static const uint32_t expected[] = {0x2191, 0x2193, 0x20AC, 0x00C4, 0x00D6,
+      0x00DC, 0x005C, 0x007E, LCD_CODE_UNKNOWN};
+   unsigned char data[] = {60, 61, 62, 63, 64, 65, 66, 67};
+   LCDpins pins = {30, 31, 48, data};
+   HD44780Sim sim(&pins, 8, NULL);
+   GPIOBackend::setDefault(&sim);
+
+   bool ok = true;
+   {
+      LCD lcd(&pins, 8, 2, LCD_WAIT_BUSY_FLAG, NULL);
+      int pass;
+      for (pass = 0; pass < 2; ++pass) {
+         lcd.clear();
+         lcd.moveCursor(0x00);
+         if (pass == 0) {
+            lcd.printText(lcdText<LCD_ROM_A00>("↑↓"));
+            lcd.printText(lcdText<LCD_ROM_A00>("€ÄÖÜ\\~à"));
+         } else {
+            lcd.printText(lcdText<LCD_ROM_A00>("↑↓€ÄÖÜ\\~à"));
+         }
+
+         unsigned char address;
+         for (address = 0; address < sizeof(expected) / sizeof(expected[0]);
+               ++address) {
+            ok = ok && cellShows(&sim, address, expected[address]);
+         }
+      }
+   }
+   ok = ok && sim.violationCount() == 0;
+   GPIOBackend::setDefault(NULL);
+
+   printf("printed glyphs kept, 9 distinct glyphs%s\n", ok ? "" : " FAILED");
+   return ok;
+}
+
+// Posts overlapping draws and prints to an AsyncLCD, several times what its
+// queue holds, and checks that sync() leaves the display showing the last of
+// them, that the render thread coalesced them into fewer data writes than
+// characters posted, and that nine posts in ten return within
+// ASYNC_POST_NS, the rest waiting for room in the queue.
+static bool runAsync() {
+   unsigned char data[] = {60, 61, 62, 63, 64, 65, 66, 67};
+   LCDpins pins = {30, 31, 48, data};
+   HD44780Sim sim(&pins, 4, NULL);
+   GPIOBackend::setDefault(&sim);
+
+   GPIOHistogram posts;
+   memset(&posts, 0, sizeof(posts));
+   unsigned long posted = 0;
+   unsigned long waited = 0;
+   uint64_t syncNs = 0;
+   char lines[2][LINE_WIDTH + 1];
+   {
+      LCD lcd(&pins, 4, 2, LCD_WAIT_BUSY_FLAG, NULL);
+      sim.resetStats();
+      AsyncLCD async(&lcd);
+
+      int round;
+      for (round = 0; round < ASYNC_ROUNDS; ++round) {
+         char clock[LINE_WIDTH + 1];
+         snprintf(clock, sizeof(clock), "12:34:%02d", round % 60);
+         const char *status = round % 2 ? "Status: busy" : "Status: idle";
+
+         uint64_t start = GPIOBackend::monotonicNow();
+         async.draw(0, 0, clock);
+         uint64_t drawn = GPIOBackend::monotonicNow();
+         async.moveCursor(ROW_SHIFT);
+         uint64_t moved = GPIOBackend::monotonicNow();
+         async.print(status);
+         uint64_t printed = GPIOBackend::monotonicNow();
+
+         uint64_t latencies[] = {drawn - start, moved - drawn, printed - moved};
+         int index;
+         for (index = 0; index < 3; ++index) {
+            gpioHistogramAdd(&posts, latencies[index]);
+            waited += latencies[index] > ASYNC_POST_NS;
+         }
+         posted += strlen(clock) + strlen(status);
+      }
+      async.draw(1, 8, "done");
+
+      uint64_t start = GPIOBackend::monotonicNow();
+      async.sync();
+      syncNs = GPIOBackend::monotonicNow() - start;
+
+      sim.readLine(0, lines[0], LINE_WIDTH);
+      sim.readLine(1, lines[1], LINE_WIDTH);
+   }
+   GPIOBackend::setDefault(NULL);
+
+   char clock[LINE_WIDTH + 1];
+   snprintf(clock, sizeof(clock), "12:34:%02d        ",
+         (ASYNC_ROUNDS - 1) % 60);
+   bool ok = strcmp(lines[0], clock) == 0 &&
+      strcmp(lines[1], "Status: done    ") == 0 &&
+      sim.dataWriteCount() < posted && waited * 10 < posts.count &&
+      sim.violationCount() == 0;
+
+   printf("async: %lu chars posted, %lu written, %lu of %lu posts waited for "
+         "room, %.1f us sync%s\n", posted, sim.dataWriteCount(), waited,
+         posts.count, syncNs / 1e3, ok ? "" : " FAILED");
+   gpioHistogramPrint(stdout, "  post", &posts);
+   return ok;
+}
+
+// Steps a marquee scrolling line 0 by the display shift over a static line 1,
+// past one whole turn of the data RAM line, and checks the visible text of
+// every frame and the transfers each step() costs: the shift instruction,
+// and for line 1 the address and its text rewritten one cell on, along with
+// the cell it left.
+static bool runMarquee() {
+   unsigned char data[] = {60, 61, 62, 63, 64, 65, 66, 67};
+   LCDpins pins = {30, 31, 48, data};
+   HD44780Sim sim(&pins, 4, NULL);
+   GPIOBackend::setDefault(&sim);
+
+   unsigned long wrongFrames = 0;
+   unsigned long violations = 0;
+   unsigned long maxInstructions = 0;
+   unsigned long maxWrites = 0;
+   unsigned long instructions = 0;
+   unsigned long writes = 0;
+   {
+      LCD lcd(&pins, 4, 2, LCD_WAIT_BUSY_FLAG, NULL);
+      Marquee marquee(&lcd, LINE_WIDTH);
+      marquee.setLine(0, MARQUEE_TEXT, true);
+      marquee.setLine(1, MARQUEE_STATIC, false);
+      int cells = lcd.getLineCells();
+      int length = strlen(MARQUEE_TEXT);
+
+      int frame;
+      for (frame = 1; frame <= MARQUEE_FRAMES; ++frame) {
+         sim.resetStats();
+         marquee.step();
+         unsigned long stepInstructions = sim.instructionCount();
+         unsigned long stepWrites = sim.dataWriteCount();
+         violations += sim.violationCount();
+         instructions += stepInstructions;
+         writes += stepWrites;
+         maxInstructions = stepInstructions > maxInstructions ?
+            stepInstructions : maxInstructions;
+         maxWrites = stepWrites > maxWrites ? stepWrites : maxWrites;
+
+         char expected[2][LINE_WIDTH + 1];
+         int column;
+         for (column = 0; column < LINE_WIDTH; ++column) {
+            int position = (frame + column) % cells;
+            expected[0][column] = position < length ?
+               MARQUEE_TEXT[position] : ' ';
+         }
+         snprintf(expected[1], sizeof(expected[1]), "%-*s", LINE_WIDTH,
+               MARQUEE_STATIC);
+         expected[0][LINE_WIDTH] = '\0';
+
+         char shown[2][LINE_WIDTH + 1];
+         sim.readLine(0, shown[0], LINE_WIDTH);
+         sim.readLine(1, shown[1], LINE_WIDTH);
+         if (strcmp(shown[0], expected[0]) != 0 ||
+               strcmp(shown[1], expected[1]) != 0) {
+            ++wrongFrames;
+         }
+      }
+   }
+   GPIOBackend::setDefault(NULL);
+
+   bool ok = wrongFrames == 0 && violations == 0 &&
+      maxInstructions <= MARQUEE_STEP_INSTRUCTIONS &&
+      maxWrites <= strlen(MARQUEE_STATIC) + 1;
+   printf("marquee: %lu frames wrong, %.1f instructions (max %lu) and %.1f "
+         "data writes (max %lu) per step%s\n", wrongFrames,
+         (double)instructions / MARQUEE_FRAMES, maxInstructions,
+         (double)writes / MARQUEE_FRAMES, maxWrites, ok ? "" : " FAILED");
+   return ok;
+}
+
+// Compares both data RAM lines of a 2 line display against first and second,
+// padded with spaces to FORMAT_LINE_CELLS.
+static bool linesShow(HD44780Sim *sim, const char *name, const char *first,
+      const char *second) {
+   const char *expected[2] = {first, second};
+   bool ok = true;
+   int line;
+   for (line = 0; line < 2; ++line) {
+      char padded[FORMAT_LINE_CELLS + 1];
+      char shown[FORMAT_LINE_CELLS + 1];
+      snprintf(padded, sizeof(padded), "%-*.*s", FORMAT_LINE_CELLS,
+            FORMAT_LINE_CELLS, expected[line]);
+      sim->readLine(line, shown, FORMAT_LINE_CELLS);
+      if (strcmp(shown, padded) != 0) {
+         fprintf(stderr, "%s line %d shows \"%s\", expected \"%s\".\n", name,
+               line, shown, padded);
+         ok = false;
+      }
+   }
+   return ok;
+}
+
+// Checks the text printf(), printNumber(), printFixed(), drawf(),
+// drawNumber() and drawFixed() put on the display: padding, signs, decimals,
+// decimals beyond LCD_MAX_DECIMALS, and text longer than 127 bytes, which
+// print() takes whole and the formatted calls cut to the data RAM or line.
+static bool runFormatted() {
+   unsigned char data[] = {60, 61, 62, 63, 64, 65, 66, 67};
+   LCDpins pins = {30, 31, 48, data};
+   HD44780Sim sim(&pins, 8, NULL);
+   GPIOBackend::setDefault(&sim);
+
+   char text[FORMAT_LONG_TEXT + 1];
+   int index;
+   for (index = 0; index < FORMAT_LONG_TEXT; ++index) {
+      text[index] = 'a' + index % 26;
+   }
+   text[FORMAT_LONG_TEXT] = '\0';
+
+   // print() wraps through the data RAM, so each cell ends up with the last
+   // character which reached it.
+   char wrapped[2][FORMAT_LINE_CELLS + 1];
+   for (index = 0; index < LCD_DDRAM_SIZE; ++index) {
+      wrapped[index / FORMAT_LINE_CELLS][index % FORMAT_LINE_CELLS] =
+         text[index + (FORMAT_LONG_TEXT - 1 - index) / LCD_DDRAM_SIZE *
+         LCD_DDRAM_SIZE];
+   }
+   wrapped[0][FORMAT_LINE_CELLS] = '\0';
+   wrapped[1][FORMAT_LINE_CELLS] = '\0';
+
+   char zeros[FORMAT_LINE_CELLS + 1];
+   memset(zeros, '0', FORMAT_LINE_CELLS);
+   zeros[FORMAT_LINE_CELLS] = '\0';
+   char clamped[FORMAT_LINE_CELLS + 1];
+   memcpy(clamped, "-0.", 3);
+   memset(clamped + 3, '0', FORMAT_LINE_CELLS - 3);
+   clamped[FORMAT_LINE_CELLS] = '\0';
+
+   bool ok = true;
+   unsigned long written = 0;
+   {
+      LCD lcd(&pins, 8, 2, LCD_WAIT_BUSY_FLAG, NULL);
+
+      lcd.clear();
+      lcd.moveCursor(0x00);
+      lcd.printf("%s %+d%%", "Load", -5);
+      lcd.moveCursor(ROW_SHIFT);
+      lcd.printf("%5.1f|%-4s|", 3.14159, "ab");
+      ok = linesShow(&sim, "printf", "Load -5%", "  3.1|ab  |") && ok;
+
+      lcd.clear();
+      lcd.moveCursor(0x00);
+      lcd.printNumber(7, 2, true);
+      lcd.print("|");
+      lcd.printNumber(-7, 4, true);
+      lcd.print("|");
+      lcd.printNumber(42, 5, false);
+      lcd.print("|");
+      lcd.printNumber(-42, 0, false);
+      lcd.moveCursor(ROW_SHIFT);
+      lcd.printNumber(1234567, 3, false);
+      ok = linesShow(&sim, "printNumber", "07|-007|   42|-42", "1234567") &&
+         ok;
+
+      lcd.clear();
+      lcd.moveCursor(0x00);
+      lcd.printFixed(235, 1, 6);
+      lcd.print("|");
+      lcd.printFixed(-5, 2, 6);
+      lcd.print("|");
+      lcd.printFixed(7, 1, 0);
+      lcd.print("|");
+      lcd.printFixed(-1234, 3, 0);
+      lcd.moveCursor(ROW_SHIFT);
+      lcd.printFixed(5, 0, 3);
+      ok = linesShow(&sim, "printFixed", "  23.5| -0.05|0.7|-1.234", "  5") &&
+         ok;
+
+      // Decimals beyond LCD_MAX_DECIMALS are clamped, and the text is cut to
+      // the data RAM, dropping the last digit.
+      lcd.clear();
+      lcd.moveCursor(0x00);
+      lcd.printFixed(-1, 200, 0);
+      ok = linesShow(&sim, "printFixed clamped", clamped, zeros) && ok;
+
+      lcd.clear();
+      lcd.moveCursor(0x00);
+      unsigned long before = sim.dataWriteCount();
+      lcd.print(text);
+      written = sim.dataWriteCount() - before;
+      ok = written == FORMAT_LONG_TEXT &&
+         linesShow(&sim, "long print", wrapped[0], wrapped[1]) && ok;
+
+      lcd.clear();
+      lcd.moveCursor(0x00);
+      lcd.printf("%s", text);
+      ok = linesShow(&sim, "long printf", text, text + FORMAT_LINE_CELLS) &&
+         ok;
+
+      lcd.clear();
+      lcd.clearFrame();
+      lcd.drawf(0, 0, "%s", text);
+      lcd.drawNumber(1, 0, 9, 3, true);
+      lcd.drawFixed(1, 4, -125, 1, 6);
+      lcd.drawf(1, 11, "%-4s|", "ab");
+      lcd.drawFixed(1, 20, 3, 200, 0);
+      lcd.flush();
+      ok = linesShow(&sim, "draw", text,
+            "009  -12.5 ab  |    0.000000000000000000") && ok;
+   }
+   ok = ok && sim.violationCount() == 0;
+   GPIOBackend::setDefault(NULL);
+
+   printf("formatted text: %lu of %d characters of a long print written%s\n",
+         written, FORMAT_LONG_TEXT, ok ? "" : " FAILED");
+   return ok;
+}
+
+// Prints the print throughput line of a configuration.
+static void printThroughput(int dataPins, int waitMode, const char *variant,
+      const BenchResult *result, bool ok) {
+   printf("%d-bit %s%s: %.0f chars/s, %.1f gpio ops/char%s\n", dataPins,
+         waitNames[waitMode], variant,
+         result->chars * 1e9 / (result->printNs ? result->printNs : 1),
+         (double)result->printOps / result->chars, ok ? "" : " FAILED");
+}
+
+// Benchmarks the LCD on the HD44780 model in every bus width and wait mode.
+int main(int argc, char **argv) {
+   int rounds = argc > 1 ? atoi(argv[1]) : DEFAULT_ROUNDS;
+   if (rounds <= 0) {
+      fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+      return 2;
+   }
+
+   bool passed = true;
+   int dataPins;
+   for (dataPins = 4; dataPins <= 8; dataPins += 4) {
+      int waitMode;
+      for (waitMode = LCD_WAIT_BUSY_FLAG; waitMode <= LCD_WAIT_HYBRID;
+            ++waitMode) {
+         BenchResult result;
+         GPIOBackend::resetStartupStats();
+         bool ok = runBench(dataPins, waitMode, rounds, &result);
+         passed = passed && ok;
+
+         printThroughput(dataPins, waitMode, "", &result, ok);
+         GPIOBackend::printStartupStats(stdout, "  startup");
+         gpioHistogramPrint(stdout, "  print", &result.print);
+         gpioHistogramPrint(stdout, "  moveCursor", &result.moveCursor);
+         gpioHistogramPrint(stdout, "  flush", &result.flush);
+         gpioHistogramPrint(stdout, "  clear", &result.clear);
+
+         // Specializing must not cost GPIO operations.
+         double runtimeOps = (double)result.printOps / result.chars;
+         ok = runStatic(dataPins, waitMode, rounds, &result);
+         if ((double)result.printOps / result.chars > runtimeOps) {
+            fprintf(stderr, "StaticLCD needs more gpio ops per char than "
+                  "LCD.\n");
+            ok = false;
+         }
+         passed = passed && ok;
+
+         printThroughput(dataPins, waitMode, " static", &result, ok);
+         gpioHistogramPrint(stdout, "  print", &result.print);
+         gpioHistogramPrint(stdout, "  moveCursor", &result.moveCursor);
+
+         double sequential = 0;
+         double interleaved = 0;
+         ok = runBusBench(dataPins, waitMode, rounds, false, &sequential) &&
+            runBusBench(dataPins, waitMode, rounds, true, &interleaved);
+         passed = passed && ok;
+
+         printf("%d-bit %s bus of %d: %.0f cells/s one after the other, "
+               "%.0f cells/s interleaved%s\n", dataPins, waitNames[waitMode],
+               BUS_DISPLAYS, sequential, interleaved, ok ? "" : " FAILED");
+      }
+   }
+
+   passed = runBigDigits() && passed;
+   passed = runGlyphs() && passed;
+   passed = runAsync() && passed;
+   passed = runMarquee() && passed;
+   passed = runFormatted() && passed;
+
+   return passed ? 0 : 1;
+}
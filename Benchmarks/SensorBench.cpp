@@ -0,0 +1,375 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "../Libraries/GPIO/GPIO.h"
+#include "../Libraries/LSM303/LSM303.h"
+#include "../Libraries/LSM303/LSM303Sampler.h"
+#include "../Libraries/LSM303/LSM303Sim.h"
+
+#define BUS 1
+#define INT1_PIN 60
+#define POLLED_READS 400
+#define FIFO_MASK 0x97
+#define FIFO_WATERMARK 16
+#define FIFO_MS 500
+#define FIFO_MAX_TRANSACTIONS 0.1
+#define MOTION_MASK 0x77
+#define MOTION_THRESHOLD_MG 250
+#define MOTION_DELAY_MS 200
+#define CLICK_MASK 0x77
+#define CLICK_THRESHOLD_MG 1000
+#define CLICK_TIME_LIMIT 4
+#define CLICK_LATENCY 8
+#define CLICK_WINDOW 40
+#define CLICK_DELAY_MS 100
+#define CLICK_TIMEOUT_MS 1000
+#define TAPS 4
+#define TAP_SAMPLES 2
+#define ERROR_READS 500
+#define ERROR_RATE 0.01
+#define SAMPLER_MASK 0x77
+#define SAMPLER_MS 300
+#define SAMPLER_ERROR_RATE 0.05
+
+// Time for the first samples after power up at 100 Hz or faster.
+#define SETTLE_US 20000
+
+using namespace std;
+
+// Waveform state shared with the simulator's sample thread.
+typedef struct Stimulus {
+   uint64_t bumpSample;
+   uint64_t bumpNs;
+} Stimulus;
+
+// Returns CLOCK_MONOTONIC in nanoseconds.
+static uint64_t monotonicNs() {
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// Numbers each sample on the x axis so lost or repeated samples show up as
+// gaps, with the sensor lying flat.
+static void counter(uint64_t sample, Acceleration *value, void *context) {
+   value->xVal = (short) sample;
+   value->yVal = (short) -sample;
+   value->zVal = ACCEL_CALIBRATION;
+}
+
+// A sensor lying flat which is knocked sideways by 1 g from bumpSample on,
+// noting when the knock was produced.
+static void bump(uint64_t sample, Acceleration *value, void *context) {
+   Stimulus *stimulus = (Stimulus *)context;
+   value->xVal = 0;
+   value->yVal = 0;
+   value->zVal = ACCEL_CALIBRATION;
+   if (sample >= stimulus->bumpSample) {
+      value->xVal = ACCEL_CALIBRATION;
+      if (sample == stimulus->bumpSample) {
+         stimulus->bumpNs = monotonicNs();
+      }
+   }
+}
+
+// A sensor lying flat which is tapped for TAP_SAMPLES samples at a time from
+// bumpSample on: once along x, once along y, and twice down along z, 20
+// samples apart.
+static void taps(uint64_t sample, Acceleration *value, void *context) {
+   Stimulus *stimulus = (Stimulus *)context;
+   value->xVal = 0;
+   value->yVal = 0;
+   value->zVal = ACCEL_CALIBRATION;
+
+   int tap;
+   for (tap = 0; tap < TAPS; ++tap) {
+      uint64_t start = stimulus->bumpSample + tap * 20;
+      if (sample < start || sample >= start + TAP_SAMPLES) {
+         continue;
+      }
+      if (tap == 0) {
+         value->xVal = 2 * ACCEL_CALIBRATION;
+      } else if (tap == 1) {
+         value->yVal = 2 * ACCEL_CALIBRATION;
+      } else {
+         value->zVal = -ACCEL_CALIBRATION;
+      }
+   }
+}
+
+// Polls readAcceleration with combined or plain write / read transfers on a
+// 400 kHz bus.
+static bool runPolled(bool combined) {
+   LSM303Sim sim;
+   sim.setLatency(LSM303_SIM_400KHZ_TRANSACTION_NS, LSM303_SIM_400KHZ_BYTE_NS);
+   LSM303 sensor(BUS, &sim);
+   sensor.setCombined(combined);
+   bool ok = sensor.init(INIT_MASK);
+   usleep(SETTLE_US);
+   sensor.resetTiming();
+   sim.resetStats();
+
+   uint64_t start = monotonicNs();
+   int index;
+   for (index = 0; ok && index < POLLED_READS; ++index) {
+      Acceleration value;
+      sensor.readAcceleration(&value);
+      ok = value.xVal == 0 && value.yVal == 0 &&
+         value.zVal == ACCEL_CALIBRATION;
+   }
+   uint64_t elapsed = monotonicNs() - start;
+   LSM303Timing timing = sensor.getTiming();
+   ok = ok && timing.failures == 0;
+
+   printf("polled %s: %.0f reads/s, %.1f us/read, %.1f transactions/read, "
+         "%.1f - %.1f us/transaction%s\n", combined ? "combined" : "write/read",
+         POLLED_READS * 1e9 / elapsed, elapsed / 1e3 / POLLED_READS,
+         (double) sim.getTransactionCount() / POLLED_READS,
+         timing.minNs / 1e3, timing.maxNs / 1e3, ok ? "" : " FAILED");
+   return ok;
+}
+
+// Drains the FIFO at 1344 Hz on each watermark interrupt and checks that
+// every sample arrives once, in order, with less than a tenth of the
+// transactions of polling.
+static bool runFifo() {
+   LSM303Sim sim;
+   sim.setLatency(LSM303_SIM_400KHZ_TRANSACTION_NS, LSM303_SIM_400KHZ_BYTE_NS);
+   sim.setWaveform(counter, NULL);
+   GPIOFakeBackend backend;
+   sim.connectInterrupt(LSM303_INT1, &backend, INT1_PIN);
+   GPIO int1(INT1_PIN, &backend);
+   LSM303 sensor(BUS, &sim);
+
+   bool ok = int1.exportPin() && int1.setDirection("in") > 0 &&
+      int1.setEdge("rising") > 0 && sensor.init(FIFO_MASK) &&
+      sensor.enableFifo(FIFO_WATERMARK, true);
+   sim.resetStats();
+
+   Acceleration samples[FIFO_DEPTH];
+   unsigned long received = 0;
+   unsigned long gaps = 0;
+   unsigned long drains = 0;
+   short expected = 0;
+   bool first = true;
+   uint64_t start = monotonicNs();
+   uint64_t end = start + FIFO_MS * 1000000ULL;
+   while (ok && monotonicNs() < end) {
+      int woken = int1.waitForEdge("rising", 100, NULL);
+      int count = woken > 0 ? sensor.drainFifo(samples, FIFO_DEPTH, NULL) :
+         sensor.readFifo(samples, FIFO_DEPTH, NULL);
+      if (woken < 0 || count < 0) {
+         ok = false;
+         break;
+      }
+      if (count > 0) {
+         ++drains;
+      }
+      int index;
+      for (index = 0; index < count; ++index) {
+         if (!first && samples[index].xVal != expected) {
+            ++gaps;
+         }
+         first = false;
+         expected = samples[index].xVal + 1;
+         ++received;
+      }
+   }
+   uint64_t elapsed = monotonicNs() - start;
+   double transactions = received ?
+      (double) sim.getTransactionCount() / received : 0.0;
+   ok = ok && gaps == 0 && sim.getLostCount() == 0 &&
+      sensor.getFifoOverruns() == 0 && received > 0 &&
+      transactions < FIFO_MAX_TRANSACTIONS;
+
+   printf("fifo 1344 Hz: %.0f samples/s, %.1f samples/drain, "
+         "%.3f transactions/sample, %.1f bytes/sample, %lu gaps, "
+         "%llu lost%s\n", received * 1e9 / elapsed,
+         drains ? (double) received / drains : 0.0, transactions,
+         received ? (double) sim.getByteCount() / received : 0.0, gaps,
+         (unsigned long long) sim.getLostCount(), ok ? "" : " FAILED");
+   return ok;
+}
+
+// Waits for the motion interrupt while the simulated sensor is knocked, and
+// measures the time from the knocked sample to waitForMotion returning.
+static bool runMotion() {
+   LSM303Sim sim;
+   sim.setLatency(LSM303_SIM_400KHZ_TRANSACTION_NS, LSM303_SIM_400KHZ_BYTE_NS);
+   Stimulus stimulus = {~0ULL, 0};
+   sim.setWaveform(bump, &stimulus);
+   GPIOFakeBackend backend;
+   sim.connectInterrupt(LSM303_INT1, &backend, INT1_PIN);
+   GPIO int1(INT1_PIN, &backend);
+   LSM303 sensor(BUS, &sim);
+
+   bool ok = int1.exportPin() && sensor.init(MOTION_MASK);
+   usleep(SETTLE_US);
+   ok = ok && sensor.enableMotionInterrupt(MOTION_THRESHOLD_MG, 0, INT_CFG_HIGH_ALL);
+
+   // Arm the knock MOTION_DELAY_MS of samples (at 400 Hz) from now, with the
+   // waveform detached so the sample thread does not see it change.
+   sim.setWaveform(NULL, NULL);
+   stimulus.bumpSample = sim.getSampleCount() + MOTION_DELAY_MS * 400 / 1000;
+   sim.setWaveform(bump, &stimulus);
+   sim.resetStats();
+
+   int events = ok ? sensor.waitForMotion(&int1, 2000) : -1;
+   uint64_t woken = monotonicNs();
+   unsigned long transactions = sim.getTransactionCount();
+   ok = ok && events > 0 && (events & INT_CFG_XHIE) && stimulus.bumpNs != 0;
+   double latencyUs = ok ? (woken - stimulus.bumpNs) / 1e3 : 0;
+
+   printf("motion interrupt: %.1f us from sample to wake, %lu transactions "
+         "while waiting, events 0x%02x%s\n", latencyUs, transactions,
+         events > 0 ? events : 0, ok ? "" : " FAILED");
+   return ok;
+}
+
+// Watches for single clicks on x and double clicks on z while the simulated
+// sensor is tapped, and checks that waitForClick reports the x tap as a
+// positive single click, ignores the y tap, and reports the two z taps as one
+// negative double click, after which readClick finds nothing.
+static bool runClick() {
+   LSM303Sim sim;
+   Stimulus stimulus = {~0ULL, 0};
+   sim.setWaveform(taps, &stimulus);
+   GPIOFakeBackend backend;
+   sim.connectInterrupt(LSM303_INT1, &backend, INT1_PIN);
+   GPIO int1(INT1_PIN, &backend);
+   LSM303 sensor(BUS, &sim);
+
+   bool ok = int1.exportPin() && sensor.init(CLICK_MASK);
+   usleep(SETTLE_US);
+   ok = ok && sensor.enableClick(CLICK_CFG_XS | CLICK_CFG_ZD,
+         CLICK_THRESHOLD_MG, CLICK_TIME_LIMIT, CLICK_LATENCY, CLICK_WINDOW,
+         LSM303_INT1);
+
+   LSM303Click none;
+   ok = ok && sensor.readClick(&none) == 0;
+
+   // Start tapping CLICK_DELAY_MS of samples (at 400 Hz) from now.
+   sim.setWaveform(NULL, NULL);
+   stimulus.bumpSample = sim.getSampleCount() + CLICK_DELAY_MS * 400 / 1000;
+   sim.setWaveform(taps, &stimulus);
+
+   LSM303Click single = {0, 0, false};
+   LSM303Click twice = {0, 0, false};
+   ok = ok && sensor.waitForClick(&int1, CLICK_TIMEOUT_MS, &single) == 1 &&
+      single.type == CLICK_SINGLE && single.axes == CLICK_SRC_X &&
+      !single.negative;
+   ok = ok && sensor.waitForClick(&int1, CLICK_TIMEOUT_MS, &twice) == 1 &&
+      twice.type == CLICK_DOUBLE && twice.axes == CLICK_SRC_Z &&
+      twice.negative;
+   ok = ok && sensor.readClick(&none) == 0 && sensor.disableClick();
+
+   printf("click: single axes 0x%x%s, double axes 0x%x%s%s\n", single.axes,
+         single.negative ? " down" : " up", twice.axes,
+         twice.negative ? " down" : " up", ok ? "" : " FAILED");
+   return ok;
+}
+
+// Reads with failures injected and checks that the driver counts each one.
+static bool runErrors() {
+   LSM303Sim sim;
+   LSM303 sensor(BUS, &sim);
+   bool ok = sensor.init(INIT_MASK);
+   sensor.resetTiming();
+   sim.resetStats();
+   sim.setErrorRate(ERROR_RATE);
+
+   int index;
+   for (index = 0; index < ERROR_READS; ++index) {
+      Acceleration value;
+      sensor.readAcceleration(&value);
+   }
+   LSM303Timing timing = sensor.getTiming();
+   ok = ok && timing.failures == sim.getErrorCount() && timing.failures > 0;
+
+   printf("errors: %lu of %lu transactions failed, %lu counted by the "
+         "driver%s\n", sim.getErrorCount(), sim.getTransactionCount(),
+         timing.failures, ok ? "" : " FAILED");
+   return ok;
+}
+
+// Runs the acquisition thread at 400 Hz with failures injected, draining its
+// queue in batches, and checks that every sample taken arrives once, in
+// order, and that failed reads are counted rather than published.
+static bool runSampler() {
+   LSM303Sim sim;
+   sim.setLatency(LSM303_SIM_400KHZ_TRANSACTION_NS, LSM303_SIM_400KHZ_BYTE_NS);
+   sim.setWaveform(counter, NULL);
+   LSM303 sensor(BUS, &sim);
+   bool ok = sensor.init(SAMPLER_MASK);
+   usleep(SETTLE_US);
+   sim.resetStats();
+   sim.setErrorRate(SAMPLER_ERROR_RATE);
+
+   LSM303Sampler sampler(&sensor, LSM303Sampler::periodFor(SAMPLER_MASK));
+   ok = ok && sampler.start(0, -1);
+
+   LSM303Sample samples[SAMPLER_QUEUE];
+   LSM303Sample last = {{0, 0, 0}, 0};
+   unsigned long received = 0;
+   unsigned long disordered = 0;
+   unsigned long corrupted = 0;
+   uint64_t end = monotonicNs() + SAMPLER_MS * 1000000ULL;
+   bool running = ok;
+   while (running) {
+      // The last batch is drained after the thread stopped.
+      running = monotonicNs() < end;
+      if (!running) {
+         sampler.stop();
+      }
+
+      int count = sampler.read(samples, SAMPLER_QUEUE);
+      int index;
+      for (index = 0; index < count; ++index) {
+         LSM303Sample *sample = &samples[index];
+         if (sample->value.yVal != (short) -sample->value.xVal ||
+               sample->value.zVal != ACCEL_CALIBRATION) {
+            ++corrupted;
+         }
+         if (received > 0 && (sample->timeNs <= last.timeNs ||
+                  sample->value.xVal < last.value.xVal)) {
+            ++disordered;
+         }
+         last = *sample;
+         ++received;
+      }
+
+      if (running) {
+         sampler.wait(-1);
+      }
+   }
+
+   LSM303SamplerStats stats = sampler.getStats();
+   ok = ok && received > 0 && received == stats.samples &&
+      stats.dropped == 0 && stats.failed == sim.getErrorCount() &&
+      disordered == 0 && corrupted == 0;
+
+   printf("sampler 400 Hz: %lu samples, %lu failed reads, %lu dropped, "
+         "%lu missed, %lu out of order, %lu corrupted, %.1f us mean / "
+         "%.1f us max jitter%s\n", received, stats.failed, stats.dropped,
+         stats.missed, disordered, corrupted, stats.meanJitterNs / 1e3,
+         stats.maxJitterNs / 1e3, ok ? "" : " FAILED");
+   return ok;
+}
+
+// Benchmarks the LSM303 driver against the simulated device on a 400 kHz
+// bus: polled reads, interrupt driven FIFO draining, motion wake latency,
+// click detection, bus error accounting and the acquisition thread. Fails if samples are lost or
+// corrupted.
+int main(int argc, char **argv) {
+   bool passed = runPolled(true);
+   passed = runPolled(false) && passed;
+   passed = runFifo() && passed;
+   passed = runMotion() && passed;
+   passed = runClick() && passed;
+   passed = runErrors() && passed;
+   passed = runSampler() && passed;
+
+   return passed ? 0 : 1;
+}
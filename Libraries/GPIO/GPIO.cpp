@@ -1,190 +1,397 @@
-#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
-#include <unistd.h>
 #include "GPIO.h"
 
 using namespace std;
 
 static const char *directions[] = {"in", "out"};
-static const char *values[] = {"0", "1"};
+static const char *edges[] = {"none", "rising", "falling", "both"};
 
-// Checks to see if a directory exists for the given pin number. Returns true if
-// the directory exists.
-static bool dirExists(int pinNum) {
-   bool dirExists = false;
+unsigned long GPIO::totalIssued = 0;
+unsigned long GPIO::totalElided = 0;
 
-   char gpioDirPath[STR_LEN] = {0};
-   sprintf(gpioDirPath, GPIO_PATH "gpio%d", pinNum);
+// Returns true if every pin in the batch is driven by the same backend.
+static bool sharedBackend(GPIO **pins, int count) {
+   int index;
+   for (index = 1; index < count; ++index) {
+      if (pins[index]->getBackend() != pins[0]->getBackend()) {
+         return false;
+      }
+   }
+   return true;
+}
+
+// Instantiates a GPIO object referencing a specified GPIO pin.
+GPIO::GPIO(int gpioPin) {
+   pin = gpioPin;
+   backend = GPIOBackend::getDefault();
+   dir = NULL;
+   val = -1;
+   edge = -1;
+   issued = 0;
+   elided = 0;
+   exportPin();
+}
+
+// Instantiates a GPIO object driven by a specific backend.
+GPIO::GPIO(int gpioPin, GPIOBackend *gpioBackend) {
+   pin = gpioPin;
+   backend = gpioBackend ? gpioBackend : GPIOBackend::getDefault();
+   dir = NULL;
+   val = -1;
+   edge = -1;
+   issued = 0;
+   elided = 0;
+   exportPin();
+}
+
+// GPIO destructor (empty and just added for completeness).
+GPIO::~GPIO() {
+}
 
-   int pinFd = open(gpioDirPath, O_DIRECTORY);
+// Exports the gpio pin through the backend and sets it up as a low output with
+// a single backend call.
+bool GPIO::exportPin() {
+   bool exported = backend->exportPin(pin);
+
+   if (exported) {
+      uint64_t start = GPIOBackend::monotonicNow();
 
-   if (pinFd > 0) {
-      dirExists = true;
+      ++issued;
+      ++totalIssued;
+      bool configured = backend->setOutput(pin, 0) > 0;
+      dir = configured ? directions[GPIO_DIR_OUT] : NULL;
+      val = configured ? 0 : -1;
+
+      GPIOBackend::getStartupStats()->configureNs +=
+         GPIOBackend::monotonicNow() - start;
    }
 
-   close(pinFd);
+   return exported;
+}
 
-   return dirExists;
+// Exports a batch of pins through the backend.
+bool GPIO::exportPins(const int *pinNums, int count, GPIOBackend *gpioBackend) {
+   if (gpioBackend == NULL) {
+      gpioBackend = GPIOBackend::getDefault();
+   }
+   return gpioBackend->exportPins(pinNums, count);
 }
 
-// Opens the file specified in path using the specified flags. Returns the file
-// descriptor which references the file.
-static int openFile(char *path, int flags) {
-   int fd = open(path, flags);
+// Unexports a specified gpio pin, forgetting the shadow state.
+bool GPIO::unexportPin() {
+   dir = NULL;
+   val = -1;
+   edge = -1;
+   return backend->unexportPin(pin);
+}
+
+// Returns the number of the pin.
+int GPIO::getPin() {
+   return pin;
+}
 
-   if (fd < 0) {
-      fprintf(stderr, "Could not open file %s\n", path);
+// Returns the backend driving the pin.
+GPIOBackend *GPIO::getBackend() {
+   return backend;
+}
+
+// Retrieves the current direction of the specified gpio pin, only reading the
+// backend when the direction is not known yet.
+const char * GPIO::getDirection() {
+   if (dir == NULL) {
+      int direction = backend->getDirection(pin);
+      dir = direction < 0 ? NULL : directions[direction];
    }
+   return dir;
+}
 
-   return fd;
+// Retrieves the current value of the specified gpio pin. The shadow value is
+// only valid while the pin is an output.
+int GPIO::getValue() {
+   if (dir == directions[GPIO_DIR_OUT] && val >= 0) {
+      return val;
+   }
+   return backend->getValue(pin);
 }
 
-// Reads numBytes from the front of the file specified by the file descriptor fd
-// and stores that contents in buf. Returns the number of bytes read.
-static int readFile(int fd, char *buf, int numBytes) {
-   lseek(fd, 0, SEEK_SET);
-   int numRead = read(fd, buf, numBytes);
+// Sets the current direction of the specified gpio pin to the value of
+// newDirection. Changing direction invalidates the shadow value since some
+// backends (sysfs) reset the output level when switching to "out".
+int GPIO::setDirection(const char *newDirection) {
+   int direction = strcmp(newDirection, directions[GPIO_DIR_OUT]) == 0 ?
+      GPIO_DIR_OUT : GPIO_DIR_IN;
 
-   if (numRead <= 0) {
-      fprintf(stderr, "Could not read from file\n");
+   if (dir == directions[direction]) {
+      ++elided;
+      ++totalElided;
+      return 1;
    }
 
-   return numRead;
+   ++issued;
+   ++totalIssued;
+   int written = backend->setDirection(pin, direction);
+   dir = written > 0 ? directions[direction] : NULL;
+   val = -1;
+   return written;
 }
 
-// Writes numBytes from the content referenced by  data to the file referenced
-// by the file descriptor fd. Returns the number of bytes written.
-static int writeFile(int fd, const void *data, int numBytes) {
-   lseek(fd, 0, SEEK_SET);
-   int written = write(fd, data, numBytes);
+// Sets the current value of the specified gpio pin to either 1 (high) or 0
+// (low), skipping the backend if the pin already holds the value.
+int GPIO::setValue(int newValue) {
+   newValue = newValue != 0;
 
-   if (written <= 0) {
-      fprintf(stderr, "Could not write to file\n");
+   if (dir == directions[GPIO_DIR_OUT] && val == newValue) {
+      ++elided;
+      ++totalElided;
+      return 1;
    }
 
+   ++issued;
+   ++totalIssued;
+   int written = backend->setValue(pin, newValue);
+   val = written > 0 ? newValue : -1;
    return written;
 }
 
-// Instantiates a GPIO object referencing a specified GPIO pin.
-GPIO::GPIO(int gpioPin) {
-   pin = gpioPin;
-   sprintf(path, GPIO_PATH "gpio%d", pin);
-   exportPin();
-}
+// Selects which edges of the pin generate events, skipping the backend if the
+// edge setting is unchanged.
+int GPIO::setEdge(const char *newEdge) {
+   int index;
+   for (index = GPIO_EDGE_NONE; index <= GPIO_EDGE_BOTH; ++index) {
+      if (strcmp(newEdge, edges[index]) == 0) {
+         break;
+      }
+   }
 
-// GPIO destructor (empty and just added for completeness).
-GPIO::~GPIO() {
+   if (index > GPIO_EDGE_BOTH) {
+      fprintf(stderr, "Invalid edge %s for pin %d.\n", newEdge, pin);
+      return 0;
+   }
+   if (index == edge) {
+      return 1;
+   }
+
+   int written = backend->setEdge(pin, index);
+   edge = written > 0 ? index : -1;
+   return written;
 }
 
-// Exports the gpio pin specified by pin by writing the number of the pin to the
-// file /sys/class/gpio/export. Returns true if the directory is created/exists.
-bool GPIO::exportPin() {
-   bool dirCreated = false;
-
-   // If the gpio is not currently exported, export it
-   if (!dirExists(pin)) {
-      char num[STR_LEN] = {0};
-      sprintf(num, "%d", pin);
-      char exportPath[] = {GPIO_PATH "export"};
-
-      int exportFd = openFile(exportPath, O_WRONLY);
-      if (exportFd) {
-         writeFile(exportFd, &num, strlen(num)); 
-         close(exportFd);
+// Waits in poll() on the backend's event descriptor until an edge of the pin
+// arrives or the timeout expires.
+int GPIO::waitForEdge(const char *newEdge, int timeoutMs, GPIOEvent *event) {
+   if (setDirection("in") <= 0 || setEdge(newEdge) <= 0) {
+      return -1;
+   }
+
+   struct pollfd waitFd;
+   waitFd.fd = backend->getEventFd(pin, &waitFd.events);
+   if (waitFd.fd < 0) {
+      return -1;
+   }
+
+   uint64_t deadline = GPIOBackend::monotonicNow() +
+      (uint64_t)timeoutMs * 1000000ULL;
+   GPIOEvent received;
+   int remaining = timeoutMs;
+
+   while (true) {
+      // The descriptor may be shared with other pins (character device), so an
+      // edge may already be queued from an earlier read.
+      int status = backend->readEvent(pin, &received);
+      if (status != 0) {
+         if (status > 0 && event != NULL) {
+            *event = received;
+         }
+         return status;
+      }
+
+      if (timeoutMs >= 0) {
+         uint64_t now = GPIOBackend::monotonicNow();
+         if (now >= deadline) {
+            return 0;
+         }
+         remaining = (int)((deadline - now + 999999ULL) / 1000000ULL);
+      }
+
+      int ready = poll(&waitFd, 1, remaining);
+      if (ready < 0) {
+         fprintf(stderr, "Could not wait for an edge on pin %d.\n", pin);
+         return -1;
+      }
+      if (ready == 0) {
+         return 0;
       }
    }
+}
+
+// Returns the shadow output value.
+int GPIO::shadowValue() {
+   return dir == directions[GPIO_DIR_OUT] ? val : -1;
+}
 
-   dirCreated = dirExists(pin);
+// Updates the shadow value and counters after an external batch write.
+void GPIO::recordWrite(int value) {
+   val = value;
+   ++issued;
+   ++totalIssued;
+}
 
-   // Populate GPIO 
-   if (dirCreated) {
-      char direction[STR_LEN] = {0};
-      strncpy(direction, path, strlen(path));
-      strcat(direction, "/direction");
+// Returns the number of writes passed on to the backend.
+unsigned long GPIO::getIssuedWrites() {
+   return issued;
+}
 
-      char value[STR_LEN] = {0};
-      strncpy(value, path, strlen(path));
-      strcat(value, "/value");
+// Returns the number of writes elided.
+unsigned long GPIO::getElidedWrites() {
+   return elided;
+}
 
-      dirFd = openFile(direction, O_RDWR);
-      valFd = openFile(value, O_RDWR);
-      setDirection("out");
-      getDirection();      
-      setValue(0);
-      getValue();      
-   } 
+// Returns the number of writes passed on to the backend by every pin.
+unsigned long GPIO::getTotalIssuedWrites() {
+   return totalIssued;
+}
 
-   return dirCreated;
+// Returns the number of writes elided by every pin.
+unsigned long GPIO::getTotalElidedWrites() {
+   return totalElided;
 }
 
-// Unexports a specified gpio pin.  
-bool GPIO::unexportPin() {
-   if (dirExists(pin)) {
-      char num[STR_LEN] = {0};
-      sprintf(num, "%d", pin);
-      char unexportPath[] = {GPIO_PATH "unexport"};
-
-      int unexportFd = openFile(unexportPath, O_WRONLY);
-      if (unexportFd) {
-         writeFile(unexportFd, &num, strlen(num)); 
-         close(unexportFd);
+// Resets the summed write counters.
+void GPIO::resetTotalWrites() {
+   totalIssued = 0;
+   totalElided = 0;
+}
+
+// Writes a batch of pins, handing the pins which change to the backend in one
+// call when possible.
+int GPIO::setValues(GPIO **pins, int count, uint32_t values) {
+   if (count <= 0 || count > GPIO_MAX_BATCH) {
+      fprintf(stderr, "Invalid gpio batch size %d.\n", count);
+      return 0;
+   }
+
+   int index;
+   if (!sharedBackend(pins, count)) {
+      for (index = 0; index < count; ++index) {
+         if (pins[index]->setValue(values >> index & 1) <= 0) {
+            return 0;
+         }
       }
+      return count;
    }
 
-   close(dirFd);
-   close(valFd);
+   GPIO *changed[GPIO_MAX_BATCH];
+   int pinNums[GPIO_MAX_BATCH];
+   uint32_t changedValues = 0;
+   int numChanged = 0;
+
+   for (index = 0; index < count; ++index) {
+      GPIO *gpio = pins[index];
+      int value = values >> index & 1;
+
+      if (gpio->dir == directions[GPIO_DIR_OUT] && gpio->val == value) {
+         ++gpio->elided;
+         ++totalElided;
+      } else {
+         changed[numChanged] = gpio;
+         pinNums[numChanged] = gpio->pin;
+         changedValues |= (uint32_t)value << numChanged++;
+      }
+   }
 
-   return !dirExists(pin);
-}
+   if (numChanged == 0) {
+      return count;
+   }
 
-// Retrieves the current direction of the specified gpio pin.
-const char * GPIO::getDirection() {
-   dir = NULL;
-   char buffer[STR_LEN] = {0};
+   int written = pins[0]->backend->setValues(pinNums, numChanged,
+         changedValues);
 
-   if (readFile(dirFd, buffer, STR_LEN)) { 
+   for (index = 0; index < numChanged; ++index) {
+      ++changed[index]->issued;
+      ++totalIssued;
+      changed[index]->val = written > 0 ? (int)(changedValues >> index & 1) : -1;
+   }
 
-      // Drop random newline added to end of buffer during read
-      buffer[strlen(buffer) - 1] = '\0';
+   return written > 0 ? count : 0;
+}
 
-      if (strcmp(buffer, directions[0]) == 0) {
-         dir = directions[0];
-      } else if (strcmp(buffer, directions[1]) == 0) {
-         dir = directions[1];
+// Reads a batch of pins, handing it to the backend in one call when possible.
+int GPIO::getValues(GPIO **pins, int count, uint32_t *values) {
+   if (count <= 0 || count > GPIO_MAX_BATCH) {
+      fprintf(stderr, "Invalid gpio batch size %d.\n", count);
+      return 0;
+   }
+
+   int index;
+   if (!sharedBackend(pins, count)) {
+      uint32_t result = 0;
+      for (index = 0; index < count; ++index) {
+         int value = pins[index]->getValue();
+         if (value < 0) {
+            return 0;
+         }
+         result |= (uint32_t)value << index;
       }
+      *values = result;
+      return count;
    }
 
-   return dir;
+   int pinNums[GPIO_MAX_BATCH];
+   for (index = 0; index < count; ++index) {
+      pinNums[index] = pins[index]->pin;
+   }
+   return pins[0]->backend->getValues(pinNums, count, values);
 }
 
-// Retrieves the current value of the specified gpio pin.
-int GPIO::getValue() {
-   val = -1;
-   char buffer[STR_LEN] = {0};
-   if (readFile(valFd, buffer, STR_LEN)) {
-      val = atoi(buffer);
+// Changes the direction of a batch of pins, handing the pins which change to
+// the backend in one call when possible.
+int GPIO::setDirections(GPIO **pins, int count, const char *newDirection) {
+   if (count <= 0 || count > GPIO_MAX_BATCH) {
+      fprintf(stderr, "Invalid gpio batch size %d.\n", count);
+      return 0;
    }
-   return val;
-}
 
-// Sets the current direction of the specified gpio pin to the value of          
-// newDirection. 
-int GPIO::setDirection(const char *newDirection) {
-   int written = writeFile(dirFd, newDirection, strlen(newDirection));
-   // Using fsync to ensure that the buffer is flushed.
-   fsync(dirFd);
-   return written;
-}
+   int index;
+   if (!sharedBackend(pins, count)) {
+      for (index = 0; index < count; ++index) {
+         if (pins[index]->setDirection(newDirection) <= 0) {
+            return 0;
+         }
+      }
+      return count;
+   }
 
-// Sets the current value of the specified gpio pin to either 1 (high) or 0
-// (low). Uses the global value's array as static values to use for writeFile.
-int GPIO::setValue(int newValue) {
-   const char *value = newValue == 0 ? values[0] : values[1];
-   int written = writeFile(valFd, value, strlen(value));
-   // Using fsync to ensure that the buffer is flushed.
-   fsync(valFd);
-   return written;
+   int direction = strcmp(newDirection, directions[GPIO_DIR_OUT]) == 0 ?
+      GPIO_DIR_OUT : GPIO_DIR_IN;
+   GPIO *changed[GPIO_MAX_BATCH];
+   int pinNums[GPIO_MAX_BATCH];
+   int numChanged = 0;
+
+   for (index = 0; index < count; ++index) {
+      if (pins[index]->dir == directions[direction]) {
+         ++pins[index]->elided;
+         ++totalElided;
+      } else {
+         changed[numChanged] = pins[index];
+         pinNums[numChanged++] = pins[index]->pin;
+      }
+   }
+
+   if (numChanged == 0) {
+      return count;
+   }
+
+   int written = pins[0]->backend->setDirections(pinNums, numChanged,
+         direction);
+
+   for (index = 0; index < numChanged; ++index) {
+      ++changed[index]->issued;
+      ++totalIssued;
+      changed[index]->dir = written > 0 ? directions[direction] : NULL;
+      changed[index]->val = -1;
+   }
+
+   return written > 0 ? count : 0;
 }
@@ -1,58 +1,145 @@
 #if !defined(GPIO_H)
 #define GPIO_H
 
-#define GPIO_PATH "/sys/class/gpio/"
-#define STR_LEN 64 
+#include "GPIOBackend.h"
 
 // Class to encapsulate all of the functionality of a GPIO pin on a
-// microcontroller. This source file is configured to work with a
+// microcontroller. The pin itself is driven through a GPIOBackend. By default
+// this is the sysfs backend, which is configured to work with a
 // BeagleBoneBlack and as such exports and unexports pins by writing to the
-// /sys/class/gpio/ directory. If this class is to be ported to other devices,
-// the export path should be confirmed/altered for the new hardware.
+// /sys/class/gpio/ directory. Other backends (character device, in-memory fake)
+// can be passed to the constructor or installed with GPIOBackend::setDefault.
+//
+// Each GPIO keeps a shadow copy of the direction and output value last written
+// to the pin. Writes which would not change the pin are elided without calling
+// the backend, and reads of an output pin are answered from the shadow copy.
+// This assumes nothing else drives the pin's direction or output value while
+// the object is alive.
 class GPIO {
+   friend class GPIOBank;
+   friend class GPIOEventLoop;
+
    private:
       int pin;
-      char path[STR_LEN];
-      int dirFd;
-      int valFd;
+      GPIOBackend *backend;
       const char *dir;
       int val;
+      int edge;
+      unsigned long issued;
+      unsigned long elided;
+
+      static unsigned long totalIssued;
+      static unsigned long totalElided;
+
+      // Returns the shadow output value, or -1 if the pin is not a known
+      // output.
+      int shadowValue();
+
+      // Records that value was written to the pin by a batch operation which
+      // bypassed setValue.
+      void recordWrite(int value);
 
    public:
-      // Constructor
+      // Constructor, uses the default backend.
       GPIO(int gpioPin);
 
+      // Constructor, drives the pin through the specified backend.
+      GPIO(int gpioPin, GPIOBackend *gpioBackend);
+
       // Destructor
       ~GPIO();
 
-      // Exports the gpio pin specified by pin by writing the number of the pin
-      // to the file /sys/class/gpio/export. Returns true if the directory is
-      // created/exists.
+      // Exports the gpio pin specified by pin through the backend, which for
+      // sysfs means writing the number of the pin to the file
+      // /sys/class/gpio/export, and makes it a low output. Nothing is read
+      // back from the pin. Returns true if the pin is ready for use.
       bool exportPin();
 
-      // Unexports a specified gpio pin. Returns true if the directory is
-      // unexported or if the directory did not exists to begin with.
+      // Exports count pins through backend (the default backend if NULL) in
+      // one batch, ahead of constructing their GPIO objects, so the export
+      // work and the wait for udev are shared by all of them. Returns true if
+      // every pin is ready for use.
+      static bool exportPins(const int *pinNums, int count,
+            GPIOBackend *gpioBackend);
+
+      // Unexports a specified gpio pin. Returns true if the pin is unexported
+      // or if it was not exported to begin with.
       bool unexportPin();
 
+      // Returns the number of the pin.
+      int getPin();
+
+      // Returns the backend driving the pin.
+      GPIOBackend *getBackend();
+
       // Retrieves the current direction of the specified gpio pin. Returns "in"
       // if the pin is set for input, "out" if the pin is set for output, or
-      // NULL if the internal readFile call is unsuccessful.
+      // NULL if the backend call is unsuccessful. Only the first call reaches
+      // the backend, later calls return the shadow copy.
       const char *getDirection();
 
-      // Retrieves the current value of the specified gpio pin. Returns 1 if the 
-      // pin is high, 0 if the pin is low, or -1 if the readFile call is 
-      // unsuccessful.
+      // Retrieves the current value of the specified gpio pin. Returns 1 if the
+      // pin is high, 0 if the pin is low, or -1 if the backend call is
+      // unsuccessful. The value of an output pin is returned from the shadow
+      // copy, input pins are always read from the backend.
       int getValue();
 
       // Sets the current direction of the specified gpio pin to the value of
       // newDirection. The value of newDirection can be "in" to set the pin as an
-      // input, or "out" to set the pin as an output. Returns the number of bytes
-      // written.
+      // input, or "out" to set the pin as an output. Returns a positive value
+      // on success (including when the write is elided).
       int setDirection(const char *direction);
 
       // Sets the current value of the specified gpio pin to either 1 (high) or
-      // 0 (low). Returns the number of bytes written.
+      // 0 (low). Returns a positive value on success (including when the write
+      // is elided).
       int setValue(int value);
+
+      // Selects which edges of the pin generate events. The value of newEdge
+      // can be "none", "rising", "falling" or "both". Returns a positive value
+      // on success.
+      int setEdge(const char *newEdge);
+
+      // Blocks until the pin sees an edge of the kind given by newEdge ("rising",
+      // "falling" or "both") or timeoutMs milliseconds pass (a negative timeout
+      // waits forever). The pin is switched to an input if needed. The thread
+      // sleeps in poll() while waiting, so no CPU is used. If event is not NULL
+      // it is filled with the edge's level and timestamp. Returns 1 if an edge
+      // was seen, 0 on timeout or -1 on failure.
+      int waitForEdge(const char *newEdge, int timeoutMs, GPIOEvent *event);
+
+      // Returns the number of direction/value writes of this pin which were
+      // passed on to the backend.
+      unsigned long getIssuedWrites();
+
+      // Returns the number of direction/value writes of this pin which were
+      // elided because the pin already held the requested state.
+      unsigned long getElidedWrites();
+
+      // Returns the issued/elided write counts summed over every GPIO object.
+      static unsigned long getTotalIssuedWrites();
+      static unsigned long getTotalElidedWrites();
+
+      // Resets the summed issued/elided write counts to 0.
+      static void resetTotalWrites();
+
+      // Sets the value of count pins at once, bit i of values is written to
+      // pins[i]. Only the pins whose value changes are passed on, and when all
+      // of them share a backend they are handed to it in one call (a single
+      // ioctl per chip for the character device backend). At most
+      // GPIO_MAX_BATCH pins may be written per call. Returns a positive value
+      // on success.
+      static int setValues(GPIO **pins, int count, uint32_t values);
+
+      // Reads count pins at once into values, bit i of values holds the value
+      // of pins[i]. Returns a positive value on success.
+      static int getValues(GPIO **pins, int count, uint32_t *values);
+
+      // Sets the direction of count pins at once to "in" or "out". Pins which
+      // already have the direction are skipped, the rest are handed to the
+      // backend in one call when they share it. Returns a positive value on
+      // success.
+      static int setDirections(GPIO **pins, int count, const char *direction);
 };
 
 #endif
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "GPIOBackend.h"
+#include "GPIOSysfsBackend.h"
+
+using namespace std;
+
+static GPIOBackend *defaultBackend = NULL;
+static GPIOStartupStats startupStats;
+
+// Claims the pins one at a time.
+bool GPIOBackend::exportPins(const int *pins, int count) {
+   bool exported = true;
+   int index;
+   for (index = 0; index < count; ++index) {
+      exported = exportPin(pins[index]) && exported;
+   }
+   return exported;
+}
+
+// Sets the direction and then the value.
+int GPIOBackend::setOutput(int pin, int value) {
+   if (setDirection(pin, GPIO_DIR_OUT) <= 0) {
+      return 0;
+   }
+   return setValue(pin, value);
+}
+
+// Writes the pins one at a time.
+int GPIOBackend::setValues(const int *pins, int count, uint32_t values) {
+   int index;
+   for (index = 0; index < count; ++index) {
+      if (setValue(pins[index], values >> index & 1) <= 0) {
+         return 0;
+      }
+   }
+   return count;
+}
+
+// Reads the pins one at a time.
+int GPIOBackend::getValues(const int *pins, int count, uint32_t *values) {
+   uint32_t result = 0;
+   int index;
+   for (index = 0; index < count; ++index) {
+      int value = getValue(pins[index]);
+      if (value < 0) {
+         return 0;
+      }
+      result |= (uint32_t)value << index;
+   }
+   *values = result;
+   return count;
+}
+
+// Changes the pins one at a time.
+int GPIOBackend::setDirections(const int *pins, int count, int direction) {
+   int index;
+   for (index = 0; index < count; ++index) {
+      if (setDirection(pins[index], direction) <= 0) {
+         return 0;
+      }
+   }
+   return count;
+}
+
+// Port access is not supported unless overridden.
+bool GPIOBackend::getPort(int pin, int *port, int *bit) {
+   return false;
+}
+
+// Port access is not supported unless overridden.
+int GPIOBackend::writePort(int port, uint64_t mask, uint64_t bits) {
+   return 0;
+}
+
+// Port access is not supported unless overridden.
+int GPIOBackend::readPort(int port, uint64_t mask, uint64_t *bits) {
+   return 0;
+}
+
+// Edge detection is not supported unless overridden.
+int GPIOBackend::setEdge(int pin, int edge) {
+   fprintf(stderr, "Edge detection is not supported for pin %d.\n", pin);
+   return 0;
+}
+
+// Edge detection is not supported unless overridden.
+int GPIOBackend::getEventFd(int pin, short *pollEvents) {
+   return -1;
+}
+
+// Edge detection is not supported unless overridden.
+int GPIOBackend::readEvent(int pin, GPIOEvent *event) {
+   return -1;
+}
+
+// Returns the current monotonic time in nanoseconds.
+uint64_t GPIOBackend::monotonicNow() {
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// Returns the startup time breakdown.
+GPIOStartupStats *GPIOBackend::getStartupStats() {
+   return &startupStats;
+}
+
+// Prints a one line summary of the startup time breakdown.
+void GPIOBackend::printStartupStats(FILE *out, const char *label) {
+   uint64_t totalNs = startupStats.exportNs + startupStats.udevWaitNs +
+      startupStats.openNs + startupStats.configureNs;
+
+   fprintf(out, "%-20s pins %u export %lluns udev %lluns open %lluns "
+         "configure %lluns total %lluns\n", label, startupStats.pinsExported,
+         (unsigned long long)startupStats.exportNs,
+         (unsigned long long)startupStats.udevWaitNs,
+         (unsigned long long)startupStats.openNs,
+         (unsigned long long)startupStats.configureNs,
+         (unsigned long long)totalNs);
+}
+
+// Resets the startup time breakdown.
+void GPIOBackend::resetStartupStats() {
+   memset(&startupStats, 0, sizeof(startupStats));
+}
+
+// Returns the default backend, creating the sysfs backend on first use.
+GPIOBackend *GPIOBackend::getDefault() {
+   if (defaultBackend == NULL) {
+      static GPIOSysfsBackend sysfs;
+      defaultBackend = &sysfs;
+   }
+   return defaultBackend;
+}
+
+// Replaces the default backend.
+void GPIOBackend::setDefault(GPIOBackend *backend) {
+   defaultBackend = backend;
+}
@@ -0,0 +1,155 @@
+#if !defined(GPIO_BACKEND_H)
+#define GPIO_BACKEND_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define GPIO_DIR_IN 0
+#define GPIO_DIR_OUT 1
+
+// Largest pin number (exclusive) a backend keeps per-pin state for. The
+// BeagleBoneBlack exposes 4 banks of 32 pins, numbered 0 - 127.
+#define GPIO_MAX_PINS 128
+
+#define GPIO_EDGE_NONE 0
+#define GPIO_EDGE_RISING 1
+#define GPIO_EDGE_FALLING 2
+#define GPIO_EDGE_BOTH 3
+
+// Largest number of pins that can be handled by a single batched call. Bit i
+// of a batch value mask corresponds to the i'th pin of the batch.
+#define GPIO_MAX_BATCH 32
+
+// Edge detected on an input pin.
+typedef struct {
+   int pin;
+   // Level of the pin right after the edge (1 for rising, 0 for falling).
+   int value;
+   // CLOCK_MONOTONIC time of the edge in nanoseconds.
+   uint64_t timestamp;
+} GPIOEvent;
+
+// Time spent bringing pins up, summed over every pin since the last reset.
+typedef struct {
+   // Pins exported (claimed) through a backend.
+   unsigned int pinsExported;
+   // Writing export requests / issuing line requests.
+   uint64_t exportNs;
+   // Waiting for udev to grant access to newly exported pins.
+   uint64_t udevWaitNs;
+   // Opening the per-pin files.
+   uint64_t openNs;
+   // Setting up the initial direction and value of pins.
+   uint64_t configureNs;
+} GPIOStartupStats;
+
+// Interface to the mechanism used to drive the physical pins. A GPIO object
+// forwards every pin operation to a backend, which allows the same GPIO/LCD
+// code to run on top of the sysfs files, the /dev/gpiochipN character device
+// or an in-memory fake (for running without hardware). Pins are always
+// referred to by their global gpio number (bank * 32 + line on the BBB).
+class GPIOBackend {
+   public:
+      virtual ~GPIOBackend() {}
+
+      // Claims the pin for use through this backend. Returns true if the pin
+      // is ready to be used.
+      virtual bool exportPin(int pin) = 0;
+
+      // Claims count pins at once. Backends which can share work between the
+      // pins override this, the default implementation claims them one at a
+      // time. Returns true if every pin is ready to be used.
+      virtual bool exportPins(const int *pins, int count);
+
+      // Releases a pin claimed with exportPin. Returns true if the pin was
+      // released or was never claimed.
+      virtual bool unexportPin(int pin) = 0;
+
+      // Returns GPIO_DIR_IN or GPIO_DIR_OUT, or -1 if the direction could not
+      // be read.
+      virtual int getDirection(int pin) = 0;
+
+      // Sets the direction of the pin to GPIO_DIR_IN or GPIO_DIR_OUT. Returns a
+      // positive value on success.
+      virtual int setDirection(int pin, int direction) = 0;
+
+      // Returns the current value of the pin (0 or 1), or -1 on failure.
+      virtual int getValue(int pin) = 0;
+
+      // Drives the pin to value (0 or 1). Returns a positive value on success.
+      virtual int setValue(int pin, int value) = 0;
+
+      // Drives count pins at once, bit i of values is written to pins[i].
+      // Backends that can update several lines in one operation override this,
+      // the default implementation writes the pins one at a time. Returns a
+      // positive value on success.
+      virtual int setValues(const int *pins, int count, uint32_t values);
+
+      // Reads count pins at once into values, bit i of values holds the value
+      // of pins[i]. Returns a positive value on success.
+      virtual int getValues(const int *pins, int count, uint32_t *values);
+
+      // Makes the pin an output driven to value. Backends which can do this in
+      // one operation override this, the default implementation sets the
+      // direction and then the value. Returns a positive value on success.
+      virtual int setOutput(int pin, int value);
+
+      // Sets the direction of count pins at once. Backends which can change
+      // several lines in one operation override this, the default
+      // implementation changes the pins one at a time. Returns a positive
+      // value on success.
+      virtual int setDirections(const int *pins, int count, int direction);
+
+      // Locates pin within a port: a group of pins (a chip or register bank)
+      // which the backend can read or write with a single operation. Stores
+      // the port number and the pin's bit within the port and returns true,
+      // or returns false if the backend has no port access (the default).
+      virtual bool getPort(int pin, int *port, int *bit);
+
+      // Drives the pins of port selected by mask to the matching bits of bits
+      // in one operation. Returns a positive value on success.
+      virtual int writePort(int port, uint64_t mask, uint64_t bits);
+
+      // Reads the pins of port selected by mask in one operation. Returns a
+      // positive value on success.
+      virtual int readPort(int port, uint64_t mask, uint64_t *bits);
+
+      // Selects which edges (GPIO_EDGE_*) of an input pin generate events.
+      // Returns a positive value on success, backends without edge detection
+      // return 0.
+      virtual int setEdge(int pin, int edge);
+
+      // Returns a file descriptor which becomes ready when an edge is pending
+      // on pin and stores the poll events to wait for in pollEvents. Several
+      // pins may share a descriptor. Returns -1 if edges are not supported.
+      virtual int getEventFd(int pin, short *pollEvents);
+
+      // Consumes the next pending edge of pin without blocking. Returns 1 if
+      // event was filled in, 0 if no edge is pending or -1 on failure.
+      virtual int readEvent(int pin, GPIOEvent *event);
+
+      // Returns the current CLOCK_MONOTONIC time in nanoseconds, the time base
+      // of GPIOEvent timestamps.
+      static uint64_t monotonicNow();
+
+      // Returns the startup time breakdown accumulated by every backend.
+      static GPIOStartupStats *getStartupStats();
+
+      // Prints a one line summary of the startup time breakdown (pins, then
+      // time spent exporting, waiting for udev, opening and configuring).
+      static void printStartupStats(FILE *out, const char *label);
+
+      // Resets the startup time breakdown to 0.
+      static void resetStartupStats();
+
+      // Returns the backend used by GPIO objects constructed without an
+      // explicit backend. This is the sysfs backend unless changed with
+      // setDefault.
+      static GPIOBackend *getDefault();
+
+      // Changes the backend used by GPIO objects constructed without an
+      // explicit backend. Passing NULL restores the sysfs backend.
+      static void setDefault(GPIOBackend *backend);
+};
+
+#endif
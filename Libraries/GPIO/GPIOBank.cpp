@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "GPIOBank.h"
+
+#define BITS_PER_LANE 8
+#define LANE_VALUES 256
+
+using namespace std;
+
+// Constructor, uses the default backend.
+GPIOBank::GPIOBank(const int *pinNums, int numPins) {
+   init(pinNums, numPins, GPIOBackend::getDefault());
+}
+
+// Constructor, uses the specified backend.
+GPIOBank::GPIOBank(const int *pinNums, int numPins, GPIOBackend *gpioBackend) {
+   init(pinNums, numPins, gpioBackend ? gpioBackend :
+         GPIOBackend::getDefault());
+}
+
+// Destructor.
+GPIOBank::~GPIOBank() {
+   int index;
+   for (index = 0; index < count; ++index) {
+      delete(pins[index]);
+   }
+   free(pins);
+   free(portTables);
+}
+
+// Creates the pins and precomputes the port tables.
+void GPIOBank::init(const int *pinNums, int numPins, GPIOBackend *gpioBackend) {
+   backend = gpioBackend;
+   portTables = NULL;
+   numPorts = 0;
+
+   if (numPins < 0 || numPins > GPIO_MAX_BATCH) {
+      fprintf(stderr, "A gpio bank holds at most %d pins.\n", GPIO_MAX_BATCH);
+      numPins = 0;
+   }
+
+   count = numPins;
+   numLanes = (count + BITS_PER_LANE - 1) / BITS_PER_LANE;
+   allMask = count == 32 ? 0xFFFFFFFFU : (1U << count) - 1;
+   pins = (GPIO **)calloc(count > 0 ? count : 1, sizeof(GPIO *));
+   backend->exportPins(pinNums, count);
+
+   int index;
+   for (index = 0; index < count; ++index) {
+      pins[index] = new GPIO(pinNums[index], backend);
+   }
+
+   buildTables();
+}
+
+// Locates every pin's port and builds, for each port and byte lane, the port
+// bits set by each of the 256 lane values.
+void GPIOBank::buildTables() {
+   int index;
+   for (index = 0; index < count; ++index) {
+      int port;
+      int bit;
+      if (!backend->getPort(pins[index]->getPin(), &port, &bit)) {
+         numPorts = 0;
+         return;
+      }
+
+      int slot;
+      for (slot = 0; slot < numPorts && portIds[slot] != port; ++slot) {
+      }
+
+      if (slot == numPorts) {
+         if (numPorts == GPIO_BANK_MAX_PORTS) {
+            numPorts = 0;
+            return;
+         }
+         portIds[numPorts] = port;
+         portMasks[numPorts++] = 0;
+      }
+
+      pinPort[index] = slot;
+      pinBit[index] = bit;
+      portMasks[slot] |= 1ULL << bit;
+   }
+
+   portTables = (uint64_t (*)[GPIO_BANK_LANES][LANE_VALUES])calloc(
+         numPorts > 0 ? numPorts : 1, sizeof(*portTables));
+
+   for (index = 0; index < count; ++index) {
+      int lane = index / BITS_PER_LANE;
+      int laneBit = index % BITS_PER_LANE;
+
+      int value;
+      for (value = 0; value < LANE_VALUES; ++value) {
+         if (value >> laneBit & 1) {
+            portTables[pinPort[index]][lane][value] |= 1ULL << pinBit[index];
+         }
+      }
+   }
+}
+
+// Returns the number of pins in the bank.
+int GPIOBank::getCount() {
+   return count;
+}
+
+// Returns the GPIO object of bit index.
+GPIO *GPIOBank::getPin(int index) {
+   return index >= 0 && index < count ? pins[index] : NULL;
+}
+
+// Collects the shadow values of the pins.
+uint32_t GPIOBank::shadowWord(uint32_t *known) {
+   uint32_t word = 0;
+   uint32_t valid = 0;
+
+   int index;
+   for (index = 0; index < count; ++index) {
+      int value = pins[index]->shadowValue();
+      if (value >= 0) {
+         valid |= 1U << index;
+         word |= (uint32_t)value << index;
+      }
+   }
+
+   *known = valid;
+   return word;
+}
+
+// Gathers the pins selected by mask.
+int GPIOBank::selectPins(uint32_t mask, GPIO **selected) {
+   int numSelected = 0;
+   int index;
+   for (index = 0; index < count; ++index) {
+      if (mask >> index & 1) {
+         selected[numSelected++] = pins[index];
+      }
+   }
+   return numSelected;
+}
+
+// Drives every pin of the bank.
+int GPIOBank::writeWord(uint32_t word) {
+   return writeBits(allMask, word);
+}
+
+// Drives the pins selected by mask, writing only those which change.
+int GPIOBank::writeBits(uint32_t mask, uint32_t word) {
+   mask &= allMask;
+
+   if (numPorts == 0) {
+      GPIO *selected[GPIO_MAX_BATCH];
+      uint32_t values = 0;
+      int numSelected = 0;
+
+      int index;
+      for (index = 0; index < count; ++index) {
+         if (mask >> index & 1) {
+            selected[numSelected] = pins[index];
+            values |= (word >> index & 1) << numSelected++;
+         }
+      }
+      return numSelected == 0 ? 1 :
+         GPIO::setValues(selected, numSelected, values);
+   }
+
+   uint32_t known;
+   uint32_t current = shadowWord(&known);
+   uint32_t changed = ((word ^ current) | ~known) & mask;
+
+   if (changed == 0) {
+      int index;
+      for (index = 0; index < count; ++index) {
+         if (mask >> index & 1) {
+            ++pins[index]->elided;
+            ++GPIO::totalElided;
+         }
+      }
+      return 1;
+   }
+
+   int port;
+   for (port = 0; port < numPorts; ++port) {
+      uint64_t portMask = 0;
+      uint64_t portBits = 0;
+
+      int lane;
+      for (lane = 0; lane < numLanes; ++lane) {
+         int shift = lane * BITS_PER_LANE;
+         portMask |= portTables[port][lane][changed >> shift & 0xFF];
+         portBits |= portTables[port][lane][word >> shift & 0xFF];
+      }
+
+      if (portMask != 0 && backend->writePort(portIds[port], portMask,
+               portBits & portMask) <= 0) {
+         return 0;
+      }
+   }
+
+   int index;
+   for (index = 0; index < count; ++index) {
+      if (changed >> index & 1) {
+         pins[index]->recordWrite(word >> index & 1);
+      } else if (mask >> index & 1) {
+         ++pins[index]->elided;
+         ++GPIO::totalElided;
+      }
+   }
+
+   return 1;
+}
+
+// Reads every pin of the bank with one backend operation per port.
+int GPIOBank::readWord(uint32_t *word) {
+   if (numPorts == 0) {
+      return count == 0 ? 0 : GPIO::getValues(pins, count, word);
+   }
+
+   uint64_t portBits[GPIO_BANK_MAX_PORTS];
+   int port;
+   for (port = 0; port < numPorts; ++port) {
+      if (backend->readPort(portIds[port], portMasks[port],
+               &portBits[port]) <= 0) {
+         return 0;
+      }
+   }
+
+   uint32_t result = 0;
+   int index;
+   for (index = 0; index < count; ++index) {
+      result |= (uint32_t)(portBits[pinPort[index]] >> pinBit[index] & 1) <<
+         index;
+   }
+
+   *word = result;
+   return 1;
+}
+
+// Sets the direction of every pin of the bank.
+int GPIOBank::setDirectionAll(const char *direction) {
+   return setDirectionMask(allMask, direction);
+}
+
+// Sets the direction of the selected pins with one batched call.
+int GPIOBank::setDirectionMask(uint32_t mask, const char *direction) {
+   GPIO *selected[GPIO_MAX_BATCH];
+   int numSelected = selectPins(mask & allMask, selected);
+   return numSelected == 0 ? 1 :
+      GPIO::setDirections(selected, numSelected, direction);
+}
@@ -0,0 +1,87 @@
+#if !defined(GPIO_BANK_H)
+#define GPIO_BANK_H
+
+#include "GPIO.h"
+
+// Largest number of ports (chips/register banks) a GPIOBank can span.
+#define GPIO_BANK_MAX_PORTS 4
+
+// Number of byte lanes in a bank word.
+#define GPIO_BANK_LANES 4
+
+// A parallel bus of up to 32 pins which is written and read as one word, bit i
+// of a word belonging to the i'th pin. The bank owns its GPIO objects.
+//
+// When the backend offers port access (character device, mmap and fake
+// backends) the bank precomputes, for every port and byte lane of the word, a
+// table mapping each byte value to the port bits it sets. A write is then a
+// table lookup per lane and a single backend operation per port touched. Only
+// the pins whose value changes are written. Other backends fall back to a
+// batched GPIO::setValues.
+class GPIOBank {
+   public:
+      // Constructor, exports count pins (pinNums[0] becomes bit 0) through the
+      // default backend.
+      GPIOBank(const int *pinNums, int count);
+
+      // Constructor, exports count pins through the specified backend.
+      GPIOBank(const int *pinNums, int count, GPIOBackend *gpioBackend);
+
+      // Destructor, deletes the bank's GPIO objects.
+      ~GPIOBank();
+
+      // Returns the number of pins in the bank.
+      int getCount();
+
+      // Returns the GPIO object of bit index of the bank.
+      GPIO *getPin(int index);
+
+      // Drives every pin of the bank to its bit of word. Returns a positive
+      // value on success.
+      int writeWord(uint32_t word);
+
+      // Drives only the pins selected by mask to their bit of word. Returns a
+      // positive value on success.
+      int writeBits(uint32_t mask, uint32_t word);
+
+      // Reads every pin of the bank into word. Returns a positive value on
+      // success.
+      int readWord(uint32_t *word);
+
+      // Sets the direction of every pin of the bank to "in" or "out". Returns a
+      // positive value on success.
+      int setDirectionAll(const char *direction);
+
+      // Sets the direction of the pins selected by mask to "in" or "out".
+      // Returns a positive value on success.
+      int setDirectionMask(uint32_t mask, const char *direction);
+
+   private:
+      // Creates the pins and the port tables.
+      void init(const int *pinNums, int count, GPIOBackend *gpioBackend);
+
+      // Looks up the port of every pin and fills portTables. Leaves numPorts
+      // at 0 if the backend has no port access.
+      void buildTables();
+
+      // Returns the shadow value of the pins as a word and stores the mask of
+      // pins whose shadow value is known in known.
+      uint32_t shadowWord(uint32_t *known);
+
+      // Gathers the pins selected by mask into selected. Returns their count.
+      int selectPins(uint32_t mask, GPIO **selected);
+
+      GPIO **pins;
+      int count;
+      int numLanes;
+      uint32_t allMask;
+      GPIOBackend *backend;
+      int numPorts;
+      int portIds[GPIO_BANK_MAX_PORTS];
+      uint64_t portMasks[GPIO_BANK_MAX_PORTS];
+      unsigned char pinPort[GPIO_MAX_BATCH];
+      unsigned char pinBit[GPIO_MAX_BATCH];
+      uint64_t (*portTables)[GPIO_BANK_LANES][256];
+};
+
+#endif
@@ -0,0 +1,581 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include "GPIOCharDevBackend.h"
+
+#define PATH_LEN 32
+
+using namespace std;
+
+// Returns true if pin can be tracked by this backend.
+static bool validPin(int pin) {
+   if (pin < 0 || pin >= GPIO_MAX_PINS) {
+      fprintf(stderr, "Pin %d is outside of the supported range 0 - %d.\n",
+            pin, GPIO_MAX_PINS - 1);
+      return false;
+   }
+   return true;
+}
+
+// Removes bit index from mask, shifting the higher bits down by one.
+static uint64_t dropBit(uint64_t mask, int index) {
+   uint64_t low = mask & ((1ULL << index) - 1);
+   uint64_t high = (mask >> 1) & ~((1ULL << index) - 1);
+   return low | high;
+}
+
+// Constructor.
+GPIOCharDevBackend::GPIOCharDevBackend() {
+   int index;
+   for (index = 0; index < GPIO_MAX_CHIPS; ++index) {
+      memset(&chips[index], 0, sizeof(Chip));
+      chips[index].chipFd = -1;
+      chips[index].requestFd = -1;
+   }
+   for (index = 0; index < GPIO_MAX_PINS; ++index) {
+      lineIndex[index] = -1;
+   }
+}
+
+// Destructor.
+GPIOCharDevBackend::~GPIOCharDevBackend() {
+   int index;
+   for (index = 0; index < GPIO_MAX_CHIPS; ++index) {
+      if (chips[index].requestFd >= 0) {
+         close(chips[index].requestFd);
+      }
+      if (chips[index].chipFd >= 0) {
+         close(chips[index].chipFd);
+      }
+   }
+}
+
+// Appends a flags attribute covering the lines in mask to config.
+static void addFlags(struct gpio_v2_line_config *config, uint64_t flags,
+      uint64_t mask) {
+   if (mask) {
+      struct gpio_v2_line_config_attribute *attr =
+         &config->attrs[config->num_attrs++];
+      attr->attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+      attr->attr.flags = flags;
+      attr->mask = mask;
+   }
+}
+
+// Builds the line configuration: every line defaults to input, the lines in
+// outputMask are outputs driven to their bit of outputValues and the inputs in
+// risingMask/fallingMask report edges.
+void GPIOCharDevBackend::buildConfig(Chip *chip,
+      struct gpio_v2_line_config *config) {
+   memset(config, 0, sizeof(*config));
+   config->flags = GPIO_V2_LINE_FLAG_INPUT;
+
+   if (chip->outputMask) {
+      addFlags(config, GPIO_V2_LINE_FLAG_OUTPUT, chip->outputMask);
+
+      struct gpio_v2_line_config_attribute *attr =
+         &config->attrs[config->num_attrs++];
+      attr->attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+      attr->attr.values = chip->outputValues;
+      attr->mask = chip->outputMask;
+   }
+
+   uint64_t rising = chip->risingMask & ~chip->outputMask;
+   uint64_t falling = chip->fallingMask & ~chip->outputMask;
+   addFlags(config, GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING |
+         GPIO_V2_LINE_FLAG_EDGE_FALLING, rising & falling);
+   addFlags(config, GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING,
+         rising & ~falling);
+   addFlags(config, GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_FALLING,
+         falling & ~rising);
+}
+
+// Releases the current line request of the chip and requests its full set of
+// lines again.
+bool GPIOCharDevBackend::request(Chip *chip) {
+   if (chip->requestFd >= 0) {
+      close(chip->requestFd);
+      chip->requestFd = -1;
+   }
+
+   if (chip->numLines == 0) {
+      return true;
+   }
+
+   struct gpio_v2_line_request req;
+   memset(&req, 0, sizeof(req));
+   memcpy(req.offsets, chip->offsets, chip->numLines * sizeof(unsigned int));
+   strncpy(req.consumer, GPIO_CONSUMER, GPIO_MAX_NAME_SIZE - 1);
+   buildConfig(chip, &req.config);
+   req.num_lines = chip->numLines;
+
+   if (ioctl(chip->chipFd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+      fprintf(stderr, "Could not request %d lines from gpio chip.\n",
+            chip->numLines);
+      return false;
+   }
+
+   chip->requestFd = req.fd;
+   chip->numEvents = 0;
+   fcntl(chip->requestFd, F_SETFL, O_NONBLOCK);
+   return true;
+}
+
+// Claims the lines added to chip since its last request, from index oldLines
+// on. The kernel refuses a request overlapping lines the chip's current
+// request holds, so the new lines are first claimed on their own, and the
+// current request is only released once they are known to be free. If they
+// are not, they are dropped again and the lines held before keep working.
+bool GPIOCharDevBackend::extend(Chip *chip, int oldLines) {
+   int added = chip->numLines - oldLines;
+   bool claimed = true;
+
+   if (oldLines > 0) {
+      struct gpio_v2_line_request req;
+      memset(&req, 0, sizeof(req));
+      memcpy(req.offsets, chip->offsets + oldLines,
+            added * sizeof(unsigned int));
+      strncpy(req.consumer, GPIO_CONSUMER, GPIO_MAX_NAME_SIZE - 1);
+      req.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+      req.num_lines = added;
+
+      if (ioctl(chip->chipFd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+         fprintf(stderr, "Could not request %d lines from gpio chip.\n",
+               added);
+         claimed = false;
+      } else {
+         close(req.fd);
+      }
+   }
+
+   if (claimed && request(chip)) {
+      return true;
+   }
+
+   int base = (chip - chips) * GPIO_LINES_PER_CHIP;
+   int index;
+   for (index = oldLines; index < chip->numLines; ++index) {
+      lineIndex[base + chip->offsets[index]] = -1;
+   }
+   chip->numLines = oldLines;
+   getStartupStats()->pinsExported -= added;
+
+   if (!claimed || request(chip)) {
+      return false;
+   }
+   fprintf(stderr, "Lost the lines already requested from gpio chip.\n");
+   return false;
+}
+
+// Applies the current line configuration to the existing line request.
+bool GPIOCharDevBackend::configure(Chip *chip) {
+   struct gpio_v2_line_config config;
+   buildConfig(chip, &config);
+
+   if (ioctl(chip->requestFd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) < 0) {
+      fprintf(stderr, "Could not configure gpio lines.\n");
+      return false;
+   }
+   return true;
+}
+
+// Returns the chip holding pin.
+GPIOCharDevBackend::Chip *GPIOCharDevBackend::chipOf(int pin) {
+   if (!validPin(pin) || lineIndex[pin] < 0) {
+      return NULL;
+   }
+   return &chips[pin / GPIO_LINES_PER_CHIP];
+}
+
+// Adds the pin's line to the line request of its chip.
+bool GPIOCharDevBackend::exportPin(int pin) {
+   return exportPins(&pin, 1);
+}
+
+// Adds the lines of every pin and re-issues the line request of each chip
+// involved once.
+bool GPIOCharDevBackend::exportPins(const int *pins, int count) {
+   GPIOStartupStats *stats = getStartupStats();
+   uint64_t start = monotonicNow();
+   int oldLines[GPIO_MAX_CHIPS];
+   bool ready = true;
+
+   int index;
+   for (index = 0; index < GPIO_MAX_CHIPS; ++index) {
+      oldLines[index] = chips[index].numLines;
+   }
+   for (index = 0; index < count; ++index) {
+      int pin = pins[index];
+      if (!validPin(pin)) {
+         ready = false;
+         continue;
+      }
+      if (lineIndex[pin] >= 0) {
+         continue;
+      }
+
+      Chip *chip = &chips[pin / GPIO_LINES_PER_CHIP];
+      if (chip->chipFd < 0) {
+         char path[PATH_LEN] = {0};
+         snprintf(path, sizeof(path), GPIO_CHIP_PATH "%d",
+               pin / GPIO_LINES_PER_CHIP);
+         chip->chipFd = open(path, O_RDWR | O_CLOEXEC);
+
+         if (chip->chipFd < 0) {
+            fprintf(stderr, "Could not open file %s\n", path);
+            ready = false;
+            continue;
+         }
+      }
+
+      chip->offsets[chip->numLines] = pin % GPIO_LINES_PER_CHIP;
+      lineIndex[pin] = chip->numLines++;
+      ++stats->pinsExported;
+   }
+
+   for (index = 0; index < GPIO_MAX_CHIPS; ++index) {
+      if (chips[index].numLines > oldLines[index] &&
+            !extend(&chips[index], oldLines[index])) {
+         ready = false;
+      }
+   }
+
+   stats->exportNs += monotonicNow() - start;
+   return ready;
+}
+
+// Removes the pin's line from the line request of its chip.
+bool GPIOCharDevBackend::unexportPin(int pin) {
+   Chip *chip = chipOf(pin);
+   if (chip == NULL) {
+      return true;
+   }
+
+   int removed = lineIndex[pin];
+   lineIndex[pin] = -1;
+
+   int index;
+   for (index = removed; index < chip->numLines - 1; ++index) {
+      chip->offsets[index] = chip->offsets[index + 1];
+   }
+   --chip->numLines;
+   chip->outputMask = dropBit(chip->outputMask, removed);
+   chip->outputValues = dropBit(chip->outputValues, removed);
+   chip->risingMask = dropBit(chip->risingMask, removed);
+   chip->fallingMask = dropBit(chip->fallingMask, removed);
+
+   int base = pin - pin % GPIO_LINES_PER_CHIP;
+   for (index = base; index < base + GPIO_LINES_PER_CHIP; ++index) {
+      if (lineIndex[index] > removed) {
+         --lineIndex[index];
+      }
+   }
+
+   return request(chip);
+}
+
+// Returns the direction the line is configured with.
+int GPIOCharDevBackend::getDirection(int pin) {
+   Chip *chip = chipOf(pin);
+   if (chip == NULL) {
+      return -1;
+   }
+   return chip->outputMask >> lineIndex[pin] & 1 ? GPIO_DIR_OUT : GPIO_DIR_IN;
+}
+
+// Reconfigures the line as an input or an output.
+int GPIOCharDevBackend::setDirection(int pin, int direction) {
+   Chip *chip = chipOf(pin);
+   if (chip == NULL) {
+      return 0;
+   }
+
+   uint64_t bit = 1ULL << lineIndex[pin];
+   if (direction == GPIO_DIR_OUT) {
+      chip->outputMask |= bit;
+   } else {
+      chip->outputMask &= ~bit;
+   }
+   return configure(chip) ? 1 : 0;
+}
+
+// Groups the batch by chip and reconfigures each chip once.
+int GPIOCharDevBackend::setDirections(const int *pins, int count,
+      int direction) {
+   uint64_t masks[GPIO_MAX_CHIPS] = {0};
+
+   int index;
+   for (index = 0; index < count; ++index) {
+      if (chipOf(pins[index]) == NULL) {
+         fprintf(stderr, "Pin %d has not been exported.\n", pins[index]);
+         return 0;
+      }
+      masks[pins[index] / GPIO_LINES_PER_CHIP] |= 1ULL << lineIndex[pins[index]];
+   }
+
+   for (index = 0; index < GPIO_MAX_CHIPS; ++index) {
+      if (masks[index] == 0) {
+         continue;
+      }
+
+      Chip *chip = &chips[index];
+      if (direction == GPIO_DIR_OUT) {
+         chip->outputMask |= masks[index];
+      } else {
+         chip->outputMask &= ~masks[index];
+      }
+      if (!configure(chip)) {
+         return 0;
+      }
+   }
+   return count;
+}
+
+// Returns the chip of the pin and its index in the chip's line request.
+bool GPIOCharDevBackend::getPort(int pin, int *port, int *bit) {
+   if (chipOf(pin) == NULL) {
+      return false;
+   }
+   *port = pin / GPIO_LINES_PER_CHIP;
+   *bit = lineIndex[pin];
+   return true;
+}
+
+// Writes the lines of a chip with one ioctl.
+int GPIOCharDevBackend::writePort(int port, uint64_t mask, uint64_t bits) {
+   if (port < 0 || port >= GPIO_MAX_CHIPS || chips[port].requestFd < 0) {
+      return 0;
+   }
+   if (mask == 0) {
+      return 1;
+   }
+
+   Chip *chip = &chips[port];
+   struct gpio_v2_line_values lineValues;
+   lineValues.mask = mask;
+   lineValues.bits = bits & mask;
+
+   if (ioctl(chip->requestFd, GPIO_V2_LINE_SET_VALUES_IOCTL, &lineValues) < 0) {
+      fprintf(stderr, "Could not write gpio lines.\n");
+      return 0;
+   }
+   chip->outputValues = (chip->outputValues & ~mask) | (bits & mask);
+   return 1;
+}
+
+// Reads the lines of a chip with one ioctl.
+int GPIOCharDevBackend::readPort(int port, uint64_t mask, uint64_t *bits) {
+   if (port < 0 || port >= GPIO_MAX_CHIPS || chips[port].requestFd < 0) {
+      return 0;
+   }
+
+   struct gpio_v2_line_values lineValues;
+   lineValues.mask = mask;
+   lineValues.bits = 0;
+
+   if (ioctl(chips[port].requestFd, GPIO_V2_LINE_GET_VALUES_IOCTL,
+            &lineValues) < 0) {
+      fprintf(stderr, "Could not read gpio lines.\n");
+      return 0;
+   }
+   *bits = lineValues.bits;
+   return 1;
+}
+
+// Reads a single line.
+int GPIOCharDevBackend::getValue(int pin) {
+   uint32_t value;
+   return getValues(&pin, 1, &value) > 0 ? (int)value : -1;
+}
+
+// Writes a single line.
+int GPIOCharDevBackend::setValue(int pin, int value) {
+   return setValues(&pin, 1, value ? 1 : 0);
+}
+
+// Switches the line to output and sets its value in one reconfiguration.
+int GPIOCharDevBackend::setOutput(int pin, int value) {
+   Chip *chip = chipOf(pin);
+   if (chip == NULL) {
+      return 0;
+   }
+
+   uint64_t bit = 1ULL << lineIndex[pin];
+   chip->outputMask |= bit;
+   if (value) {
+      chip->outputValues |= bit;
+   } else {
+      chip->outputValues &= ~bit;
+   }
+   return configure(chip) ? 1 : 0;
+}
+
+// Groups the batch by chip and writes each group with a single ioctl.
+int GPIOCharDevBackend::setValues(const int *pins, int count, uint32_t values) {
+   uint64_t masks[GPIO_MAX_CHIPS] = {0};
+   uint64_t bits[GPIO_MAX_CHIPS] = {0};
+
+   int index;
+   for (index = 0; index < count; ++index) {
+      if (chipOf(pins[index]) == NULL) {
+         fprintf(stderr, "Pin %d has not been exported.\n", pins[index]);
+         return 0;
+      }
+
+      int chip = pins[index] / GPIO_LINES_PER_CHIP;
+      uint64_t bit = 1ULL << lineIndex[pins[index]];
+      masks[chip] |= bit;
+      if (values >> index & 1) {
+         bits[chip] |= bit;
+      }
+   }
+
+   for (index = 0; index < GPIO_MAX_CHIPS; ++index) {
+      if (masks[index] == 0) {
+         continue;
+      }
+
+      Chip *chip = &chips[index];
+      struct gpio_v2_line_values lineValues;
+      lineValues.mask = masks[index];
+      lineValues.bits = bits[index];
+
+      if (ioctl(chip->requestFd, GPIO_V2_LINE_SET_VALUES_IOCTL,
+               &lineValues) < 0) {
+         fprintf(stderr, "Could not write gpio lines.\n");
+         return 0;
+      }
+      chip->outputValues = (chip->outputValues & ~masks[index]) | bits[index];
+   }
+
+   return count;
+}
+
+// Groups the batch by chip and reads each group with a single ioctl.
+int GPIOCharDevBackend::getValues(const int *pins, int count,
+      uint32_t *values) {
+   uint64_t masks[GPIO_MAX_CHIPS] = {0};
+   uint64_t bits[GPIO_MAX_CHIPS] = {0};
+
+   int index;
+   for (index = 0; index < count; ++index) {
+      if (chipOf(pins[index]) == NULL) {
+         fprintf(stderr, "Pin %d has not been exported.\n", pins[index]);
+         return 0;
+      }
+      masks[pins[index] / GPIO_LINES_PER_CHIP] |= 1ULL << lineIndex[pins[index]];
+   }
+
+   for (index = 0; index < GPIO_MAX_CHIPS; ++index) {
+      if (masks[index] == 0) {
+         continue;
+      }
+
+      struct gpio_v2_line_values lineValues;
+      lineValues.mask = masks[index];
+      lineValues.bits = 0;
+
+      if (ioctl(chips[index].requestFd, GPIO_V2_LINE_GET_VALUES_IOCTL,
+               &lineValues) < 0) {
+         fprintf(stderr, "Could not read gpio lines.\n");
+         return 0;
+      }
+      bits[index] = lineValues.bits;
+   }
+
+   uint32_t result = 0;
+   for (index = 0; index < count; ++index) {
+      int chip = pins[index] / GPIO_LINES_PER_CHIP;
+      if (bits[chip] >> lineIndex[pins[index]] & 1) {
+         result |= 1U << index;
+      }
+   }
+   *values = result;
+
+   return count;
+}
+
+// Enables edge detection of the line in the kernel.
+int GPIOCharDevBackend::setEdge(int pin, int edge) {
+   Chip *chip = chipOf(pin);
+   if (chip == NULL) {
+      return 0;
+   }
+
+   uint64_t bit = 1ULL << lineIndex[pin];
+   chip->risingMask &= ~bit;
+   chip->fallingMask &= ~bit;
+   if (edge & GPIO_EDGE_RISING) {
+      chip->risingMask |= bit;
+   }
+   if (edge & GPIO_EDGE_FALLING) {
+      chip->fallingMask |= bit;
+   }
+   return configure(chip) ? 1 : 0;
+}
+
+// Returns the line request of the pin's chip.
+int GPIOCharDevBackend::getEventFd(int pin, short *pollEvents) {
+   Chip *chip = chipOf(pin);
+   if (chip == NULL) {
+      return -1;
+   }
+   *pollEvents = POLLIN;
+   return chip->requestFd;
+}
+
+// Removes the oldest queued event of pin.
+bool GPIOCharDevBackend::dequeueEvent(Chip *chip, int pin, GPIOEvent *event) {
+   int index;
+   for (index = 0; index < chip->numEvents; ++index) {
+      if (chip->events[index].pin == pin) {
+         *event = chip->events[index];
+         memmove(&chip->events[index], &chip->events[index + 1],
+               (chip->numEvents - index - 1) * sizeof(GPIOEvent));
+         --chip->numEvents;
+         return true;
+      }
+   }
+   return false;
+}
+
+// Returns a queued edge of the pin, reading more edges from the line request
+// if none is queued. When the queue is full the oldest edge is dropped.
+int GPIOCharDevBackend::readEvent(int pin, GPIOEvent *event) {
+   Chip *chip = chipOf(pin);
+   if (chip == NULL) {
+      return -1;
+   }
+
+   if (dequeueEvent(chip, pin, event)) {
+      return 1;
+   }
+
+   struct gpio_v2_line_event lineEvents[GPIO_EVENT_QUEUE];
+   int numRead = read(chip->requestFd, lineEvents, sizeof(lineEvents));
+   if (numRead < 0) {
+      return errno == EAGAIN ? 0 : -1;
+   }
+
+   int base = pin - pin % GPIO_LINES_PER_CHIP;
+   int index;
+   for (index = 0; index < numRead / (int)sizeof(lineEvents[0]); ++index) {
+      if (chip->numEvents == GPIO_EVENT_QUEUE) {
+         memmove(&chip->events[0], &chip->events[1],
+               (GPIO_EVENT_QUEUE - 1) * sizeof(GPIOEvent));
+         --chip->numEvents;
+      }
+
+      GPIOEvent *queued = &chip->events[chip->numEvents++];
+      queued->pin = base + lineEvents[index].offset;
+      queued->value = lineEvents[index].id == GPIO_V2_LINE_EVENT_RISING_EDGE;
+      queued->timestamp = lineEvents[index].timestamp_ns;
+   }
+
+   return dequeueEvent(chip, pin, event) ? 1 : 0;
+}
@@ -0,0 +1,120 @@
+#if !defined(GPIO_CHARDEV_BACKEND_H)
+#define GPIO_CHARDEV_BACKEND_H
+
+#include "GPIOBackend.h"
+
+#define GPIO_CHIP_PATH "/dev/gpiochip"
+#define GPIO_LINES_PER_CHIP 32
+#define GPIO_MAX_CHIPS (GPIO_MAX_PINS / GPIO_LINES_PER_CHIP)
+#define GPIO_CONSUMER "squawk"
+#define GPIO_EVENT_QUEUE 16
+
+struct gpio_v2_line_config;
+
+// Backend which drives pins through the /dev/gpiochipN character devices using
+// the GPIO v2 line request ioctls. All of the lines claimed on one chip share a
+// single line request, so a batch of pins on the same chip is read or written
+// with one ioctl. Global pin numbers map to /dev/gpiochip(pin / 32) line
+// (pin % 32), which matches the bank layout of the BeagleBoneBlack.
+//
+// Claiming a new line re-issues the chip's line request, so all pins should be
+// claimed (constructed) before they are driven or waited on. Edge events are
+// timestamped by the kernel and delivered on the request's file descriptor,
+// which is shared by every line of the chip.
+class GPIOCharDevBackend : public GPIOBackend {
+   public:
+      // Constructor
+      GPIOCharDevBackend();
+
+      // Destructor, releases every line request and chip.
+      ~GPIOCharDevBackend();
+
+      // Adds the pin's line to its chip's line request, as an input. Returns
+      // true if the line was claimed.
+      bool exportPin(int pin);
+
+      // Adds every pin's line to its chip's line request and then issues the
+      // request once per chip involved.
+      bool exportPins(const int *pins, int count);
+
+      // Removes the pin's line from its chip's line request.
+      bool unexportPin(int pin);
+
+      int getDirection(int pin);
+      int setDirection(int pin, int direction);
+      int getValue(int pin);
+      int setValue(int pin, int value);
+
+      // Makes the line an output driven to value with one ioctl.
+      int setOutput(int pin, int value);
+
+      // Writes every pin of the batch with one ioctl per chip involved.
+      int setValues(const int *pins, int count, uint32_t values);
+
+      // Reads every pin of the batch with one ioctl per chip involved.
+      int getValues(const int *pins, int count, uint32_t *values);
+
+      // Reconfigures every pin of the batch with one ioctl per chip involved.
+      int setDirections(const int *pins, int count, int direction);
+
+      // Ports are chips, a pin's bit is its index in the chip's line request.
+      // The bits of a port are only stable while no pin of the chip is
+      // unexported.
+      bool getPort(int pin, int *port, int *bit);
+      int writePort(int port, uint64_t mask, uint64_t bits);
+      int readPort(int port, uint64_t mask, uint64_t *bits);
+
+      // Enables kernel edge detection for the line.
+      int setEdge(int pin, int edge);
+
+      // Returns the line request of the pin's chip, which signals POLLIN when
+      // an edge of any of its lines is pending.
+      int getEventFd(int pin, short *pollEvents);
+
+      // Returns the oldest pending edge of the pin. Edges of other lines read
+      // along the way are queued for later calls.
+      int readEvent(int pin, GPIOEvent *event);
+
+   private:
+      // State of one /dev/gpiochipN and its line request. Bit i of the masks
+      // refers to offsets[i], the i'th line of the request.
+      typedef struct {
+         int chipFd;
+         int requestFd;
+         int numLines;
+         unsigned int offsets[GPIO_LINES_PER_CHIP];
+         uint64_t outputMask;
+         uint64_t outputValues;
+         uint64_t risingMask;
+         uint64_t fallingMask;
+         GPIOEvent events[GPIO_EVENT_QUEUE];
+         int numEvents;
+      } Chip;
+
+      // Fills config with the direction and output value of every line of chip.
+      void buildConfig(Chip *chip, struct gpio_v2_line_config *config);
+
+      // Releases and re-issues the line request of chip. Returns true on
+      // success.
+      bool request(Chip *chip);
+
+      // Claims the lines of chip from index oldLines on and re-issues its
+      // request. On failure the new lines are forgotten and the request of
+      // the old ones is kept. Returns true on success.
+      bool extend(Chip *chip, int oldLines);
+
+      // Pushes the current line configuration of chip to the kernel.
+      bool configure(Chip *chip);
+
+      // Removes the oldest queued event of pin from chip into event. Returns
+      // true if one was found.
+      bool dequeueEvent(Chip *chip, int pin, GPIOEvent *event);
+
+      // Returns the chip holding pin, or NULL if the pin was never claimed.
+      Chip *chipOf(int pin);
+
+      Chip chips[GPIO_MAX_CHIPS];
+      signed char lineIndex[GPIO_MAX_PINS];
+};
+
+#endif
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include "GPIOEventLoop.h"
+
+using namespace std;
+
+// Constructor.
+GPIOEventLoop::GPIOEventLoop() {
+   numPins = 0;
+   epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+   if (epollFd < 0) {
+      fprintf(stderr, "Could not create epoll instance.\n");
+   }
+}
+
+// Destructor.
+GPIOEventLoop::~GPIOEventLoop() {
+   if (epollFd >= 0) {
+      close(epollFd);
+   }
+}
+
+// Returns the number of watched pins using fd.
+int GPIOEventLoop::fdUsers(int fd) {
+   int users = 0;
+   int index;
+   for (index = 0; index < numPins; ++index) {
+      if (fds[index] == fd) {
+         ++users;
+      }
+   }
+   return users;
+}
+
+// Configures the pin for edges and registers its event descriptor, unless the
+// descriptor is already registered through another pin sharing it.
+bool GPIOEventLoop::add(GPIO *gpio, const char *edge) {
+   if (epollFd < 0 || numPins == GPIO_EVENT_LOOP_MAX_PINS) {
+      fprintf(stderr, "Could not watch pin %d.\n", gpio->getPin());
+      return false;
+   }
+
+   if (gpio->setDirection("in") <= 0 || gpio->setEdge(edge) <= 0) {
+      return false;
+   }
+
+   short pollEvents;
+   int fd = gpio->backend->getEventFd(gpio->pin, &pollEvents);
+   if (fd < 0) {
+      return false;
+   }
+
+   if (fdUsers(fd) == 0) {
+      struct epoll_event watch;
+      watch.events = pollEvents;
+      watch.data.fd = fd;
+
+      if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &watch) < 0) {
+         fprintf(stderr, "Could not watch pin %d.\n", gpio->getPin());
+         return false;
+      }
+   }
+
+   pins[numPins] = gpio;
+   fds[numPins++] = fd;
+   return true;
+}
+
+// Unregisters the pin, and its descriptor once no other pin uses it.
+bool GPIOEventLoop::remove(GPIO *gpio) {
+   int index;
+   for (index = 0; index < numPins; ++index) {
+      if (pins[index] == gpio) {
+         break;
+      }
+   }
+
+   if (index == numPins) {
+      return false;
+   }
+
+   int fd = fds[index];
+   pins[index] = pins[numPins - 1];
+   fds[index] = fds[numPins - 1];
+   --numPins;
+
+   if (fdUsers(fd) == 0) {
+      epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+   }
+   return true;
+}
+
+// Sleeps in epoll_wait until a watched descriptor is ready, then collects the
+// pending edges of every pin using that descriptor.
+int GPIOEventLoop::wait(GPIOEvent *events, int maxEvents, int timeoutMs) {
+   struct epoll_event ready[GPIO_EVENT_LOOP_MAX_PINS];
+   uint64_t deadline = GPIOBackend::monotonicNow() +
+      (uint64_t)timeoutMs * 1000000ULL;
+   int remaining = timeoutMs;
+   int count = 0;
+
+   while (count == 0) {
+      int numReady = epoll_wait(epollFd, ready, GPIO_EVENT_LOOP_MAX_PINS,
+            remaining);
+      if (numReady < 0) {
+         fprintf(stderr, "Could not wait for gpio events.\n");
+         return -1;
+      }
+      if (numReady == 0) {
+         return 0;
+      }
+
+      int readyIndex;
+      for (readyIndex = 0; readyIndex < numReady; ++readyIndex) {
+         int index;
+         for (index = 0; index < numPins && count < maxEvents; ++index) {
+            if (fds[index] != ready[readyIndex].data.fd) {
+               continue;
+            }
+
+            GPIO *gpio = pins[index];
+            while (count < maxEvents &&
+                  gpio->backend->readEvent(gpio->pin, &events[count]) > 0) {
+               ++count;
+            }
+         }
+      }
+
+      // Nothing was consumed (spurious wakeup), keep waiting for the rest of
+      // the timeout.
+      if (count == 0 && timeoutMs >= 0) {
+         uint64_t now = GPIOBackend::monotonicNow();
+         if (now >= deadline) {
+            return 0;
+         }
+         remaining = (int)((deadline - now + 999999ULL) / 1000000ULL);
+      }
+   }
+
+   return count;
+}
@@ -0,0 +1,45 @@
+#if !defined(GPIO_EVENT_LOOP_H)
+#define GPIO_EVENT_LOOP_H
+
+#include "GPIO.h"
+
+// Largest number of pins a single event loop can watch.
+#define GPIO_EVENT_LOOP_MAX_PINS 32
+
+// Waits for edges on many pins at once. Every watched pin's event descriptor is
+// registered with one epoll instance, so a single thread can sleep until any
+// button, sensor interrupt line or other input changes, and receive each edge
+// with its pin number and timestamp. Pins must stay alive while watched.
+class GPIOEventLoop {
+   public:
+      // Constructor
+      GPIOEventLoop();
+
+      // Destructor, closes the epoll instance.
+      ~GPIOEventLoop();
+
+      // Starts watching gpio for edges of the kind given by edge ("rising",
+      // "falling" or "both"). The pin is switched to an input. Returns true if
+      // the pin is being watched.
+      bool add(GPIO *gpio, const char *edge);
+
+      // Stops watching gpio. Returns true if the pin was being watched.
+      bool remove(GPIO *gpio);
+
+      // Blocks until at least one edge arrives on a watched pin or timeoutMs
+      // milliseconds pass (a negative timeout waits forever). Up to maxEvents
+      // edges are stored in events, oldest first per pin. Returns the number of
+      // edges stored, 0 on timeout or -1 on failure.
+      int wait(GPIOEvent *events, int maxEvents, int timeoutMs);
+
+   private:
+      // Returns the number of watched pins using fd.
+      int fdUsers(int fd);
+
+      int epollFd;
+      int numPins;
+      GPIO *pins[GPIO_EVENT_LOOP_MAX_PINS];
+      int fds[GPIO_EVENT_LOOP_MAX_PINS];
+};
+
+#endif
@@ -0,0 +1,286 @@
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "GPIOFakeBackend.h"
+
+using namespace std;
+
+// Constructor, every pin starts unexported as a low input.
+GPIOFakeBackend::GPIOFakeBackend() {
+   memset(exported, 0, sizeof(exported));
+   memset(directions, GPIO_DIR_IN, sizeof(directions));
+   memset(outputs, 0, sizeof(outputs));
+   memset(inputs, 0, sizeof(inputs));
+   memset(edges, GPIO_EDGE_NONE, sizeof(edges));
+   memset(pending, 0, sizeof(pending));
+   reads = 0;
+   writes = 0;
+
+   int index;
+   for (index = 0; index < GPIO_MAX_PINS; ++index) {
+      eventFds[index] = -1;
+   }
+}
+
+// Destructor.
+GPIOFakeBackend::~GPIOFakeBackend() {
+   int index;
+   for (index = 0; index < GPIO_MAX_PINS; ++index) {
+      if (eventFds[index] >= 0) {
+         close(eventFds[index]);
+      }
+   }
+}
+
+// Returns true if pin is exported.
+bool GPIOFakeBackend::checkPin(int pin) {
+   if (!isExported(pin)) {
+      fprintf(stderr, "Pin %d has not been exported.\n", pin);
+      return false;
+   }
+   return true;
+}
+
+// Marks the pin as exported.
+bool GPIOFakeBackend::exportPin(int pin) {
+   if (pin < 0 || pin >= GPIO_MAX_PINS) {
+      fprintf(stderr, "Pin %d is outside of the supported range 0 - %d.\n",
+            pin, GPIO_MAX_PINS - 1);
+      return false;
+   }
+   if (!exported[pin]) {
+      ++getStartupStats()->pinsExported;
+   }
+   exported[pin] = true;
+   return true;
+}
+
+// Marks the pin as unexported.
+bool GPIOFakeBackend::unexportPin(int pin) {
+   if (isExported(pin)) {
+      exported[pin] = false;
+      directions[pin] = GPIO_DIR_IN;
+   }
+   return true;
+}
+
+// Returns the simulated direction of the pin.
+int GPIOFakeBackend::getDirection(int pin) {
+   if (!checkPin(pin)) {
+      return -1;
+   }
+   ++reads;
+   return directions[pin];
+}
+
+// Changes the simulated direction of the pin.
+int GPIOFakeBackend::setDirection(int pin, int direction) {
+   if (!checkPin(pin)) {
+      return 0;
+   }
+   ++writes;
+   directions[pin] = direction == GPIO_DIR_OUT ? GPIO_DIR_OUT : GPIO_DIR_IN;
+   return 1;
+}
+
+// Returns the output latch of an output pin or the driven level of an input.
+int GPIOFakeBackend::getValue(int pin) {
+   uint32_t value;
+   return getValues(&pin, 1, &value) > 0 ? (int)value : -1;
+}
+
+// Writes the output latch of the pin.
+int GPIOFakeBackend::setValue(int pin, int value) {
+   return setValues(&pin, 1, value ? 1 : 0);
+}
+
+// Writes the output latches of the batch as a single operation.
+int GPIOFakeBackend::setValues(const int *pins, int count, uint32_t values) {
+   int index;
+   for (index = 0; index < count; ++index) {
+      if (!checkPin(pins[index])) {
+         return 0;
+      }
+   }
+
+   ++writes;
+   for (index = 0; index < count; ++index) {
+      outputs[pins[index]] = values >> index & 1;
+   }
+   return count;
+}
+
+// Reads the batch as a single operation.
+int GPIOFakeBackend::getValues(const int *pins, int count, uint32_t *values) {
+   uint32_t result = 0;
+   int index;
+   for (index = 0; index < count; ++index) {
+      int pin = pins[index];
+      if (!checkPin(pin)) {
+         return 0;
+      }
+
+      int level = directions[pin] == GPIO_DIR_OUT ? outputs[pin] : inputs[pin];
+      result |= (uint32_t)level << index;
+   }
+
+   ++reads;
+   *values = result;
+   return count;
+}
+
+// Changes the simulated direction of the batch as a single operation.
+int GPIOFakeBackend::setDirections(const int *pins, int count, int direction) {
+   int index;
+   for (index = 0; index < count; ++index) {
+      if (!checkPin(pins[index])) {
+         return 0;
+      }
+   }
+
+   ++writes;
+   for (index = 0; index < count; ++index) {
+      directions[pins[index]] = direction == GPIO_DIR_OUT ? GPIO_DIR_OUT :
+         GPIO_DIR_IN;
+   }
+   return count;
+}
+
+// Returns the group of 32 pins holding pin.
+bool GPIOFakeBackend::getPort(int pin, int *port, int *bit) {
+   if (!checkPin(pin)) {
+      return false;
+   }
+   *port = pin / GPIO_FAKE_PORT_PINS;
+   *bit = pin % GPIO_FAKE_PORT_PINS;
+   return true;
+}
+
+// Writes the selected pins of a port as a single operation.
+int GPIOFakeBackend::writePort(int port, uint64_t mask, uint64_t bits) {
+   int pins[GPIO_FAKE_PORT_PINS];
+   uint32_t values = 0;
+   int count = 0;
+
+   int bit;
+   for (bit = 0; bit < GPIO_FAKE_PORT_PINS; ++bit) {
+      if (mask >> bit & 1) {
+         pins[count] = port * GPIO_FAKE_PORT_PINS + bit;
+         values |= (uint32_t)(bits >> bit & 1) << count++;
+      }
+   }
+   return count == 0 ? 1 : setValues(pins, count, values);
+}
+
+// Reads the selected pins of a port as a single operation.
+int GPIOFakeBackend::readPort(int port, uint64_t mask, uint64_t *bits) {
+   int pins[GPIO_FAKE_PORT_PINS];
+   int count = 0;
+
+   int bit;
+   for (bit = 0; bit < GPIO_FAKE_PORT_PINS; ++bit) {
+      if (mask >> bit & 1) {
+         pins[count++] = port * GPIO_FAKE_PORT_PINS + bit;
+      }
+   }
+
+   uint32_t values = 0;
+   if (count > 0 && getValues(pins, count, &values) <= 0) {
+      return 0;
+   }
+
+   uint64_t result = 0;
+   int index = 0;
+   for (bit = 0; bit < GPIO_FAKE_PORT_PINS; ++bit) {
+      if (mask >> bit & 1) {
+         result |= (uint64_t)(values >> index++ & 1) << bit;
+      }
+   }
+   *bits = result;
+   return 1;
+}
+
+// Selects the edges of the pin which signal its eventfd.
+int GPIOFakeBackend::setEdge(int pin, int edge) {
+   if (!checkPin(pin)) {
+      return 0;
+   }
+
+   if (eventFds[pin] < 0) {
+      eventFds[pin] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (eventFds[pin] < 0) {
+         fprintf(stderr, "Could not create eventfd for pin %d.\n", pin);
+         return 0;
+      }
+   }
+
+   edges[pin] = edge;
+   return 1;
+}
+
+// Returns the eventfd of the pin.
+int GPIOFakeBackend::getEventFd(int pin, short *pollEvents) {
+   if (!checkPin(pin)) {
+      return -1;
+   }
+   *pollEvents = POLLIN;
+   return eventFds[pin];
+}
+
+// Consumes the pending edge of the pin.
+int GPIOFakeBackend::readEvent(int pin, GPIOEvent *event) {
+   if (!checkPin(pin) || eventFds[pin] < 0) {
+      return -1;
+   }
+
+   eventfd_t count;
+   if (eventfd_read(eventFds[pin], &count) < 0) {
+      return 0;
+   }
+
+   *event = pending[pin];
+   return 1;
+}
+
+// Sets the externally driven level of the pin, signalling an edge if needed.
+void GPIOFakeBackend::drive(int pin, int value) {
+   if (pin < 0 || pin >= GPIO_MAX_PINS) {
+      return;
+   }
+
+   value = value ? 1 : 0;
+   int edge = value ? GPIO_EDGE_RISING : GPIO_EDGE_FALLING;
+   bool changed = inputs[pin] != value;
+   inputs[pin] = value;
+
+   if (changed && (edges[pin] & edge) && eventFds[pin] >= 0 &&
+         directions[pin] == GPIO_DIR_IN) {
+      pending[pin].pin = pin;
+      pending[pin].value = value;
+      pending[pin].timestamp = monotonicNow();
+      eventfd_write(eventFds[pin], 1);
+   }
+}
+
+// Returns true if pin is exported.
+bool GPIOFakeBackend::isExported(int pin) {
+   return pin >= 0 && pin < GPIO_MAX_PINS && exported[pin];
+}
+
+// Returns the number of read operations.
+unsigned long GPIOFakeBackend::readCount() {
+   return reads;
+}
+
+// Returns the number of write operations.
+unsigned long GPIOFakeBackend::writeCount() {
+   return writes;
+}
+
+// Resets the operation counters.
+void GPIOFakeBackend::resetCounts() {
+   reads = 0;
+   writes = 0;
+}
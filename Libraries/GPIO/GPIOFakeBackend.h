@@ -0,0 +1,72 @@
+#if !defined(GPIO_FAKE_BACKEND_H)
+#define GPIO_FAKE_BACKEND_H
+
+#include "GPIOBackend.h"
+
+#define GPIO_FAKE_PORT_PINS 32
+
+// In-memory backend which simulates the pins, allowing GPIO users such as LCD
+// to run without hardware. Output pins read back the last value written to
+// them, input pins read back the level last applied with drive(). Every call
+// is counted so tests can check how much work a piece of code generates.
+// Edges applied with drive() are reported through an eventfd per pin; edges
+// not yet consumed are coalesced into the most recent one.
+class GPIOFakeBackend : public GPIOBackend {
+   public:
+      // Constructor
+      GPIOFakeBackend();
+
+      // Destructor, closes the event descriptors.
+      virtual ~GPIOFakeBackend();
+
+      bool exportPin(int pin);
+      bool unexportPin(int pin);
+      int getDirection(int pin);
+      int setDirection(int pin, int direction);
+      int getValue(int pin);
+      int setValue(int pin, int value);
+      int setValues(const int *pins, int count, uint32_t values);
+      int getValues(const int *pins, int count, uint32_t *values);
+      int setDirections(const int *pins, int count, int direction);
+
+      // Ports are groups of 32 pins (pin / 32), a pin's bit is pin % 32.
+      bool getPort(int pin, int *port, int *bit);
+      int writePort(int port, uint64_t mask, uint64_t bits);
+      int readPort(int port, uint64_t mask, uint64_t *bits);
+
+      int setEdge(int pin, int edge);
+      int getEventFd(int pin, short *pollEvents);
+      int readEvent(int pin, GPIOEvent *event);
+
+      // Sets the level seen on pin when it is configured as an input, as if
+      // driven by an external device. Signals an edge event if the level
+      // changes in a direction selected with setEdge.
+      void drive(int pin, int value);
+
+      // Returns true if pin is currently exported.
+      bool isExported(int pin);
+
+      // Returns the number of backend calls which read or wrote pin state.
+      // Batched calls count once regardless of their size.
+      unsigned long readCount();
+      unsigned long writeCount();
+
+      // Resets the read and write counters to 0.
+      void resetCounts();
+
+   protected:
+      // Returns true if pin is exported, printing an error otherwise.
+      bool checkPin(int pin);
+
+      bool exported[GPIO_MAX_PINS];
+      unsigned char directions[GPIO_MAX_PINS];
+      unsigned char outputs[GPIO_MAX_PINS];
+      unsigned char inputs[GPIO_MAX_PINS];
+      unsigned char edges[GPIO_MAX_PINS];
+      int eventFds[GPIO_MAX_PINS];
+      GPIOEvent pending[GPIO_MAX_PINS];
+      unsigned long reads;
+      unsigned long writes;
+};
+
+#endif
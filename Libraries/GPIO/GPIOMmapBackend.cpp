@@ -0,0 +1,265 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "GPIOMmapBackend.h"
+
+#define PINS_PER_BANK 32
+
+using namespace std;
+
+static const off_t physicalBases[AM335X_GPIO_BANKS] = {
+   AM335X_GPIO0_BASE, AM335X_GPIO1_BASE, AM335X_GPIO2_BASE, AM335X_GPIO3_BASE
+};
+
+// Constructor, maps the banks from /dev/mem.
+GPIOMmapBackend::GPIOMmapBackend() {
+   map(GPIO_MEM_PATH, physicalBases);
+}
+
+// Constructor, maps the banks from path.
+GPIOMmapBackend::GPIOMmapBackend(const char *path, const off_t *bankOffsets) {
+   map(path, bankOffsets);
+}
+
+// Destructor.
+GPIOMmapBackend::~GPIOMmapBackend() {
+   int bank;
+   for (bank = 0; bank < AM335X_GPIO_BANKS; ++bank) {
+      if (banks[bank] != NULL) {
+         munmap((void *)banks[bank], AM335X_GPIO_BANK_SIZE);
+      }
+   }
+}
+
+// Maps every bank. The descriptor can be closed once the mappings exist.
+void GPIOMmapBackend::map(const char *path, const off_t *bankOffsets) {
+   int bank;
+   for (bank = 0; bank < AM335X_GPIO_BANKS; ++bank) {
+      banks[bank] = NULL;
+   }
+
+   int fd = open(path, O_RDWR | O_SYNC);
+   if (fd < 0) {
+      fprintf(stderr, "Could not open file %s\n", path);
+      return;
+   }
+
+   for (bank = 0; bank < AM335X_GPIO_BANKS; ++bank) {
+      void *base = mmap(NULL, AM335X_GPIO_BANK_SIZE, PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, bankOffsets[bank]);
+
+      if (base == MAP_FAILED) {
+         fprintf(stderr, "Could not map gpio bank %d from %s\n", bank, path);
+      } else {
+         banks[bank] = (volatile unsigned char *)base;
+      }
+   }
+
+   close(fd);
+}
+
+// Returns a pointer to a register of a bank.
+volatile uint32_t *GPIOMmapBackend::reg(int bank, int offset) {
+   return (volatile uint32_t *)(banks[bank] + offset);
+}
+
+// Returns true if every bank was mapped.
+bool GPIOMmapBackend::isMapped() {
+   int bank;
+   for (bank = 0; bank < AM335X_GPIO_BANKS; ++bank) {
+      if (banks[bank] == NULL) {
+         return false;
+      }
+   }
+   return true;
+}
+
+// Claims the pin if its bank is mapped.
+bool GPIOMmapBackend::exportPin(int pin) {
+   if (pin < 0 || pin >= AM335X_GPIO_BANKS * PINS_PER_BANK ||
+         banks[pin / PINS_PER_BANK] == NULL) {
+      fprintf(stderr, "Pin %d is not in a mapped gpio bank.\n", pin);
+      return false;
+   }
+   return true;
+}
+
+// Nothing to release, the bank stays mapped.
+bool GPIOMmapBackend::unexportPin(int pin) {
+   return true;
+}
+
+// Reads the OE bit of the pin.
+int GPIOMmapBackend::getDirection(int pin) {
+   if (!exportPin(pin)) {
+      return -1;
+   }
+   uint32_t oe = *reg(pin / PINS_PER_BANK, AM335X_GPIO_OE);
+   return oe >> (pin % PINS_PER_BANK) & 1 ? GPIO_DIR_IN : GPIO_DIR_OUT;
+}
+
+// Updates the OE bit of the pin.
+int GPIOMmapBackend::setDirection(int pin, int direction) {
+   if (!exportPin(pin)) {
+      return 0;
+   }
+
+   volatile uint32_t *oe = reg(pin / PINS_PER_BANK, AM335X_GPIO_OE);
+   uint32_t bit = 1U << (pin % PINS_PER_BANK);
+   if (direction == GPIO_DIR_OUT) {
+      *oe &= ~bit;
+   } else {
+      *oe |= bit;
+   }
+   return 1;
+}
+
+// Reads the pin's level.
+int GPIOMmapBackend::getValue(int pin) {
+   uint32_t value;
+   return getValues(&pin, 1, &value) > 0 ? (int)value : -1;
+}
+
+// Drives the pin.
+int GPIOMmapBackend::setValue(int pin, int value) {
+   if (!exportPin(pin)) {
+      return 0;
+   }
+
+   uint32_t bit = 1U << (pin % PINS_PER_BANK);
+   writeBank(pin / PINS_PER_BANK, value ? bit : 0, value ? 0 : bit);
+   return 1;
+}
+
+// Collects the batch into per bank set/clear masks and stores each once.
+int GPIOMmapBackend::setValues(const int *pins, int count, uint32_t values) {
+   uint32_t setMasks[AM335X_GPIO_BANKS] = {0};
+   uint32_t clearMasks[AM335X_GPIO_BANKS] = {0};
+
+   int index;
+   for (index = 0; index < count; ++index) {
+      if (!exportPin(pins[index])) {
+         return 0;
+      }
+
+      uint32_t bit = 1U << (pins[index] % PINS_PER_BANK);
+      if (values >> index & 1) {
+         setMasks[pins[index] / PINS_PER_BANK] |= bit;
+      } else {
+         clearMasks[pins[index] / PINS_PER_BANK] |= bit;
+      }
+   }
+
+   int bank;
+   for (bank = 0; bank < AM335X_GPIO_BANKS; ++bank) {
+      writeBank(bank, setMasks[bank], clearMasks[bank]);
+   }
+   return count;
+}
+
+// Loads each bank involved once and picks out the pins of the batch.
+int GPIOMmapBackend::getValues(const int *pins, int count, uint32_t *values) {
+   uint32_t levels[AM335X_GPIO_BANKS] = {0};
+   bool loaded[AM335X_GPIO_BANKS] = {false};
+
+   uint32_t result = 0;
+   int index;
+   for (index = 0; index < count; ++index) {
+      if (!exportPin(pins[index])) {
+         return 0;
+      }
+
+      int bank = pins[index] / PINS_PER_BANK;
+      if (!loaded[bank]) {
+         uint32_t oe = *reg(bank, AM335X_GPIO_OE);
+         levels[bank] = (readBank(bank) & oe) | (readBankOutput(bank) & ~oe);
+         loaded[bank] = true;
+      }
+
+      result |= (levels[bank] >> (pins[index] % PINS_PER_BANK) & 1) << index;
+   }
+
+   *values = result;
+   return count;
+}
+
+// Collects the batch into per bank masks and updates each OE register once.
+int GPIOMmapBackend::setDirections(const int *pins, int count, int direction) {
+   uint32_t masks[AM335X_GPIO_BANKS] = {0};
+
+   int index;
+   for (index = 0; index < count; ++index) {
+      if (!exportPin(pins[index])) {
+         return 0;
+      }
+      masks[pins[index] / PINS_PER_BANK] |= 1U << (pins[index] % PINS_PER_BANK);
+   }
+
+   int bank;
+   for (bank = 0; bank < AM335X_GPIO_BANKS; ++bank) {
+      if (masks[bank] == 0) {
+         continue;
+      }
+
+      volatile uint32_t *oe = reg(bank, AM335X_GPIO_OE);
+      if (direction == GPIO_DIR_OUT) {
+         *oe &= ~masks[bank];
+      } else {
+         *oe |= masks[bank];
+      }
+   }
+   return count;
+}
+
+// Returns the bank of the pin and its bit within the bank.
+bool GPIOMmapBackend::getPort(int pin, int *port, int *bit) {
+   if (!exportPin(pin)) {
+      return false;
+   }
+   *port = pin / PINS_PER_BANK;
+   *bit = pin % PINS_PER_BANK;
+   return true;
+}
+
+// Writes the pins of a bank with one store per non-empty mask.
+int GPIOMmapBackend::writePort(int port, uint64_t mask, uint64_t bits) {
+   if (port < 0 || port >= AM335X_GPIO_BANKS || banks[port] == NULL) {
+      return 0;
+   }
+   writeBank(port, (uint32_t)(bits & mask), (uint32_t)(~bits & mask));
+   return 1;
+}
+
+// Reads the pins of a bank with one DATAIN/DATAOUT load each.
+int GPIOMmapBackend::readPort(int port, uint64_t mask, uint64_t *bits) {
+   if (port < 0 || port >= AM335X_GPIO_BANKS || banks[port] == NULL) {
+      return 0;
+   }
+   uint32_t oe = *reg(port, AM335X_GPIO_OE);
+   *bits = ((readBank(port) & oe) | (readBankOutput(port) & ~oe)) & mask;
+   return 1;
+}
+
+// Stores the set and clear masks of a bank.
+void GPIOMmapBackend::writeBank(int bank, uint32_t setMask, uint32_t clearMask) {
+   if (bank < 0 || bank >= AM335X_GPIO_BANKS || banks[bank] == NULL) {
+      return;
+   }
+   if (setMask) {
+      *reg(bank, AM335X_GPIO_SETDATAOUT) = setMask;
+   }
+   if (clearMask) {
+      *reg(bank, AM335X_GPIO_CLEARDATAOUT) = clearMask;
+   }
+}
+
+// Returns the DATAIN register of a bank.
+uint32_t GPIOMmapBackend::readBank(int bank) {
+   return *reg(bank, AM335X_GPIO_DATAIN);
+}
+
+// Returns the DATAOUT register of a bank.
+uint32_t GPIOMmapBackend::readBankOutput(int bank) {
+   return *reg(bank, AM335X_GPIO_DATAOUT);
+}
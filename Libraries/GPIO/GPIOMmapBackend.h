@@ -0,0 +1,96 @@
+#if !defined(GPIO_MMAP_BACKEND_H)
+#define GPIO_MMAP_BACKEND_H
+
+#include <sys/types.h>
+#include "GPIOBackend.h"
+
+#define GPIO_MEM_PATH "/dev/mem"
+
+// AM335x GPIO module layout (see the AM335x Technical Reference Manual, GPIO
+// registers). Each of the 4 banks controls 32 pins.
+#define AM335X_GPIO_BANKS 4
+#define AM335X_GPIO_BANK_SIZE 0x1000
+#define AM335X_GPIO0_BASE 0x44E07000
+#define AM335X_GPIO1_BASE 0x4804C000
+#define AM335X_GPIO2_BASE 0x481AC000
+#define AM335X_GPIO3_BASE 0x481AE000
+#define AM335X_GPIO_OE 0x134
+#define AM335X_GPIO_DATAIN 0x138
+#define AM335X_GPIO_DATAOUT 0x13C
+#define AM335X_GPIO_CLEARDATAOUT 0x190
+#define AM335X_GPIO_SETDATAOUT 0x194
+
+// Backend which drives pins by writing the AM335x GPIO bank registers directly
+// through a memory mapping, bypassing the kernel entirely. Setting or clearing
+// any set of pins of one bank is a single store to SETDATAOUT/CLEARDATAOUT.
+//
+// The backend does not configure pinmux or bank clocks: the pins must already
+// be muxed as GPIO and their bank enabled (exporting one pin of the bank
+// through sysfs once is enough). Direction changes read-modify-write the OE
+// register, so they must not race with other users of the same bank.
+class GPIOMmapBackend : public GPIOBackend {
+   public:
+      // Maps the 4 GPIO banks from /dev/mem at their physical addresses.
+      GPIOMmapBackend();
+
+      // Maps the 4 GPIO banks from path at bankOffsets[0..3]. This allows using
+      // another memory device, or a plain file to check the register writes
+      // without hardware.
+      GPIOMmapBackend(const char *path, const off_t *bankOffsets);
+
+      // Destructor, unmaps the banks.
+      ~GPIOMmapBackend();
+
+      // Returns true if every bank was mapped.
+      bool isMapped();
+
+      // Claims the pin. Returns true if the pin's bank is mapped.
+      bool exportPin(int pin);
+      bool unexportPin(int pin);
+
+      // Reads/writes the pin's bit of the OE register (set means input).
+      int getDirection(int pin);
+      int setDirection(int pin, int direction);
+
+      // Reads DATAIN for inputs and DATAOUT for outputs.
+      int getValue(int pin);
+
+      // Writes the pin's bit to SETDATAOUT or CLEARDATAOUT.
+      int setValue(int pin, int value);
+
+      // Writes the batch with at most one SETDATAOUT and one CLEARDATAOUT store
+      // per bank involved.
+      int setValues(const int *pins, int count, uint32_t values);
+
+      // Reads the batch with one DATAIN/DATAOUT load per bank involved.
+      int getValues(const int *pins, int count, uint32_t *values);
+
+      // Updates the OE register of each bank involved once.
+      int setDirections(const int *pins, int count, int direction);
+
+      // Ports are the 4 register banks, a pin's bit is its bit in the bank.
+      bool getPort(int pin, int *port, int *bit);
+      int writePort(int port, uint64_t mask, uint64_t bits);
+      int readPort(int port, uint64_t mask, uint64_t *bits);
+
+      // Drives the pins of bank in setMask high and the pins in clearMask low,
+      // with one store per non-empty mask.
+      void writeBank(int bank, uint32_t setMask, uint32_t clearMask);
+
+      // Returns the DATAIN register of bank.
+      uint32_t readBank(int bank);
+
+      // Returns the DATAOUT register of bank.
+      uint32_t readBankOutput(int bank);
+
+   private:
+      // Maps every bank from path at the given offsets.
+      void map(const char *path, const off_t *bankOffsets);
+
+      // Returns a pointer to register reg of bank.
+      volatile uint32_t *reg(int bank, int reg);
+
+      volatile unsigned char *banks[AM335X_GPIO_BANKS];
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include <pthread.h>
+#include <string.h>
+#include "GPIOBackend.h"
+#include "GPIOProfile.h"
+
+using namespace std;
+
+static __thread const char *threadTag = NULL;
+static pthread_mutex_t tagLock = PTHREAD_MUTEX_INITIALIZER;
+static GPIOTagStats tags[GPIO_PROFILE_MAX_TAGS];
+static int numTags = 0;
+
+// Returns the bucket of a duration.
+static int bucketOf(uint64_t ns) {
+   int bucket = ns == 0 ? 0 : 63 - __builtin_clzll(ns);
+   return bucket < GPIO_PROFILE_BUCKETS ? bucket : GPIO_PROFILE_BUCKETS - 1;
+}
+
+// Returns the upper bound of the bucket holding the given fraction of the
+// samples.
+static uint64_t percentile(const GPIOHistogram *histogram, double fraction) {
+   unsigned long target = (unsigned long)(histogram->count * fraction);
+   unsigned long seen = 0;
+
+   int bucket;
+   for (bucket = 0; bucket < GPIO_PROFILE_BUCKETS; ++bucket) {
+      seen += histogram->buckets[bucket];
+      if (seen > target) {
+         break;
+      }
+   }
+   return 2ULL << bucket;
+}
+
+// Returns the statistics slot of tag, claiming a new one if needed. Must be
+// called with tagLock held.
+static GPIOTagStats *tagSlot(const char *tag) {
+   int index;
+   for (index = 0; index < numTags; ++index) {
+      if (tags[index].name == tag) {
+         return &tags[index];
+      }
+   }
+
+   if (numTags == GPIO_PROFILE_MAX_TAGS) {
+      return NULL;
+   }
+
+   GPIOTagStats *slot = &tags[numTags++];
+   memset(slot, 0, sizeof(*slot));
+   slot->name = tag;
+   return slot;
+}
+
+// Adds a duration to a histogram.
+void gpioHistogramAdd(GPIOHistogram *histogram, uint64_t ns) {
+   ++histogram->count;
+   histogram->totalNs += ns;
+   if (ns > histogram->maxNs) {
+      histogram->maxNs = ns;
+   }
+   ++histogram->buckets[bucketOf(ns)];
+}
+
+// Prints a one line summary of a histogram.
+void gpioHistogramPrint(FILE *out, const char *label,
+      const GPIOHistogram *histogram) {
+   if (histogram->count == 0) {
+      fprintf(out, "%-20s count 0\n", label);
+      return;
+   }
+
+   fprintf(out, "%-20s count %lu mean %lluns max %lluns p50 <%lluns "
+         "p99 <%lluns\n", label, histogram->count,
+         (unsigned long long)(histogram->totalNs / histogram->count),
+         (unsigned long long)histogram->maxNs,
+         (unsigned long long)percentile(histogram, 0.5),
+         (unsigned long long)percentile(histogram, 0.99));
+}
+
+// Makes tag the current tag of the thread.
+GPIOProfileScope::GPIOProfileScope(const char *tag) {
+   previous = threadTag;
+   threadTag = tag;
+   start = GPIOBackend::monotonicNow();
+}
+
+// Records the duration of the scope and restores the previous tag.
+GPIOProfileScope::~GPIOProfileScope() {
+   uint64_t elapsed = GPIOBackend::monotonicNow() - start;
+
+   pthread_mutex_lock(&tagLock);
+   GPIOTagStats *slot = tagSlot(threadTag);
+   if (slot != NULL) {
+      gpioHistogramAdd(&slot->latency, elapsed);
+   }
+   pthread_mutex_unlock(&tagLock);
+
+   threadTag = previous;
+}
+
+// Returns the current tag of the calling thread.
+const char *GPIOProfileScope::currentTag() {
+   return threadTag;
+}
+
+// Attributes one backend call to the current tag.
+void GPIOProfileScope::countBackendCall() {
+   if (threadTag == NULL) {
+      return;
+   }
+
+   pthread_mutex_lock(&tagLock);
+   GPIOTagStats *slot = tagSlot(threadTag);
+   if (slot != NULL) {
+      ++slot->backendCalls;
+   }
+   pthread_mutex_unlock(&tagLock);
+}
+
+// Copies the statistics of the tags.
+int GPIOProfileScope::getTagStats(GPIOTagStats *stats, int maxTags) {
+   pthread_mutex_lock(&tagLock);
+   int count = numTags < maxTags ? numTags : maxTags;
+   memcpy(stats, tags, count * sizeof(GPIOTagStats));
+   pthread_mutex_unlock(&tagLock);
+   return count;
+}
+
+// Clears the statistics of every tag.
+void GPIOProfileScope::resetTagStats() {
+   pthread_mutex_lock(&tagLock);
+   numTags = 0;
+   pthread_mutex_unlock(&tagLock);
+}
+
+// Prints the statistics of every tag.
+void GPIOProfileScope::dumpTagStats(FILE *out) {
+   GPIOTagStats stats[GPIO_PROFILE_MAX_TAGS];
+   int count = getTagStats(stats, GPIO_PROFILE_MAX_TAGS);
+
+   int index;
+   for (index = 0; index < count; ++index) {
+      char label[64];
+      snprintf(label, sizeof(label), "%s (%lu gpio ops)", stats[index].name,
+            stats[index].backendCalls);
+      gpioHistogramPrint(out, label, &stats[index].latency);
+   }
+}
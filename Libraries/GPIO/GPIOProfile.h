@@ -0,0 +1,79 @@
+#if !defined(GPIO_PROFILE_H)
+#define GPIO_PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Number of latency buckets, bucket i counts durations in [2^i, 2^(i+1)) ns.
+#define GPIO_PROFILE_BUCKETS 32
+
+// Largest number of distinct operation tags tracked.
+#define GPIO_PROFILE_MAX_TAGS 32
+
+// Log2-bucketed latency histogram.
+typedef struct {
+   unsigned long count;
+   uint64_t totalNs;
+   uint64_t maxNs;
+   unsigned long buckets[GPIO_PROFILE_BUCKETS];
+} GPIOHistogram;
+
+// Statistics of one operation tag: how often the tagged operation ran, how
+// long it took and how many backend calls it caused.
+typedef struct {
+   const char *name;
+   unsigned long backendCalls;
+   GPIOHistogram latency;
+} GPIOTagStats;
+
+// Adds a duration to a histogram.
+void gpioHistogramAdd(GPIOHistogram *histogram, uint64_t ns);
+
+// Prints a one line summary of a histogram (count, mean, max, p50, p99).
+void gpioHistogramPrint(FILE *out, const char *label,
+      const GPIOHistogram *histogram);
+
+// Tags the operations of the enclosing scope with a higher-level call name
+// (such as "print" or "readAcceleration"). Backend calls made while the scope
+// is alive are attributed to the tag by GPIOProfiledBackend, and the duration
+// of the scope is recorded in the tag's histogram. Scopes nest, the innermost
+// tag wins. The tag name must be a string literal (it is compared by address).
+class GPIOProfileScope {
+   public:
+      // Constructor, makes tag the current tag of the thread.
+      GPIOProfileScope(const char *tag);
+
+      // Destructor, records the scope's duration and restores the previous
+      // tag.
+      ~GPIOProfileScope();
+
+      // Returns the current tag of the calling thread, or NULL.
+      static const char *currentTag();
+
+      // Attributes one backend call to the current tag of the calling thread.
+      static void countBackendCall();
+
+      // Copies the statistics of up to maxTags tags into stats. Returns the
+      // number of tags copied.
+      static int getTagStats(GPIOTagStats *stats, int maxTags);
+
+      // Clears the statistics of every tag.
+      static void resetTagStats();
+
+      // Prints the statistics of every tag.
+      static void dumpTagStats(FILE *out);
+
+   private:
+      const char *previous;
+      uint64_t start;
+};
+
+// Tagging compiles to nothing unless the build defines GPIO_PROFILE (make
+// PROFILE=1), so instrumented call sites cost nothing in normal builds.
+#if defined(GPIO_PROFILE)
+#define GPIO_PROFILE_SCOPE(tag) GPIOProfileScope gpioProfileScope(tag)
+#else
+#define GPIO_PROFILE_SCOPE(tag)
+#endif
+
+#endif
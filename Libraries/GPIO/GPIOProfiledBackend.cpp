@@ -0,0 +1,360 @@
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include "GPIOProfiledBackend.h"
+
+using namespace std;
+
+static const char *opNames[GPIO_OPS] = {
+   "read", "write", "direction", "export", "edge"
+};
+
+// Constructor.
+GPIOProfiledBackend::GPIOProfiledBackend(GPIOBackend *innerBackend) {
+   inner = innerBackend;
+   pthread_mutex_init(&lock, NULL);
+   pthread_condattr_t attr;
+   pthread_condattr_init(&attr);
+   pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+   pthread_cond_init(&dumpCond, &attr);
+   pthread_condattr_destroy(&attr);
+   dumping = false;
+   dumpOut = NULL;
+   dumpIntervalMs = 0;
+   memset(portPins, 0xFF, sizeof(portPins));
+   reset();
+}
+
+// Destructor.
+GPIOProfiledBackend::~GPIOProfiledBackend() {
+   stopPeriodicDump();
+   pthread_cond_destroy(&dumpCond);
+   pthread_mutex_destroy(&lock);
+}
+
+// Records the latency of a call and attributes it to the current tag.
+void GPIOProfiledBackend::record(int op, uint64_t start) {
+   uint64_t elapsed = monotonicNow() - start;
+
+   pthread_mutex_lock(&lock);
+   gpioHistogramAdd(&ops[op], elapsed);
+   pthread_mutex_unlock(&lock);
+
+   GPIOProfileScope::countBackendCall();
+}
+
+// Counts an operation on each pin of a batch.
+void GPIOProfiledBackend::countPins(const int *pins, int count,
+      unsigned long GPIOPinStats::*field) {
+   pthread_mutex_lock(&lock);
+   int index;
+   for (index = 0; index < count; ++index) {
+      if (pins[index] >= 0 && pins[index] < GPIO_MAX_PINS) {
+         ++(pinStats[pins[index]].*field);
+      }
+   }
+   pthread_mutex_unlock(&lock);
+}
+
+// Counts an operation on each pin of a port selected by mask.
+void GPIOProfiledBackend::countPort(int port, uint64_t mask,
+      unsigned long GPIOPinStats::*field) {
+   if (port < 0 || port >= GPIO_PROFILE_MAX_PORTS) {
+      return;
+   }
+
+   pthread_mutex_lock(&lock);
+   while (mask != 0) {
+      int bit = __builtin_ctzll(mask);
+      mask &= mask - 1;
+      if (portPins[port][bit] >= 0) {
+         ++(pinStats[portPins[port][bit]].*field);
+      }
+   }
+   pthread_mutex_unlock(&lock);
+}
+
+// Exports a pin.
+bool GPIOProfiledBackend::exportPin(int pin) {
+   uint64_t start = monotonicNow();
+   bool result = inner->exportPin(pin);
+   record(GPIO_OP_EXPORT, start);
+   return result;
+}
+
+// Exports several pins.
+bool GPIOProfiledBackend::exportPins(const int *pins, int count) {
+   uint64_t start = monotonicNow();
+   bool result = inner->exportPins(pins, count);
+   record(GPIO_OP_EXPORT, start);
+   return result;
+}
+
+// Unexports a pin.
+bool GPIOProfiledBackend::unexportPin(int pin) {
+   uint64_t start = monotonicNow();
+   bool result = inner->unexportPin(pin);
+   record(GPIO_OP_EXPORT, start);
+   return result;
+}
+
+// Reads the direction of a pin.
+int GPIOProfiledBackend::getDirection(int pin) {
+   uint64_t start = monotonicNow();
+   int result = inner->getDirection(pin);
+   record(GPIO_OP_READ, start);
+   countPins(&pin, 1, &GPIOPinStats::reads);
+   return result;
+}
+
+// Sets the direction of a pin.
+int GPIOProfiledBackend::setDirection(int pin, int direction) {
+   uint64_t start = monotonicNow();
+   int result = inner->setDirection(pin, direction);
+   record(GPIO_OP_DIRECTION, start);
+   countPins(&pin, 1, &GPIOPinStats::directionChanges);
+   return result;
+}
+
+// Reads the value of a pin.
+int GPIOProfiledBackend::getValue(int pin) {
+   uint64_t start = monotonicNow();
+   int result = inner->getValue(pin);
+   record(GPIO_OP_READ, start);
+   countPins(&pin, 1, &GPIOPinStats::reads);
+   return result;
+}
+
+// Sets the value of a pin.
+int GPIOProfiledBackend::setValue(int pin, int value) {
+   uint64_t start = monotonicNow();
+   int result = inner->setValue(pin, value);
+   record(GPIO_OP_WRITE, start);
+   countPins(&pin, 1, &GPIOPinStats::writes);
+   return result;
+}
+
+// Makes a pin an output driving value.
+int GPIOProfiledBackend::setOutput(int pin, int value) {
+   uint64_t start = monotonicNow();
+   int result = inner->setOutput(pin, value);
+   record(GPIO_OP_DIRECTION, start);
+   countPins(&pin, 1, &GPIOPinStats::directionChanges);
+   countPins(&pin, 1, &GPIOPinStats::writes);
+   return result;
+}
+
+// Sets the values of several pins.
+int GPIOProfiledBackend::setValues(const int *pins, int count,
+      uint32_t values) {
+   uint64_t start = monotonicNow();
+   int result = inner->setValues(pins, count, values);
+   record(GPIO_OP_WRITE, start);
+   countPins(pins, count, &GPIOPinStats::writes);
+   return result;
+}
+
+// Reads the values of several pins.
+int GPIOProfiledBackend::getValues(const int *pins, int count,
+      uint32_t *values) {
+   uint64_t start = monotonicNow();
+   int result = inner->getValues(pins, count, values);
+   record(GPIO_OP_READ, start);
+   countPins(pins, count, &GPIOPinStats::reads);
+   return result;
+}
+
+// Sets the direction of several pins.
+int GPIOProfiledBackend::setDirections(const int *pins, int count,
+      int direction) {
+   uint64_t start = monotonicNow();
+   int result = inner->setDirections(pins, count, direction);
+   record(GPIO_OP_DIRECTION, start);
+   countPins(pins, count, &GPIOPinStats::directionChanges);
+   return result;
+}
+
+// Locates a pin's port, remembering the pin of each port bit.
+bool GPIOProfiledBackend::getPort(int pin, int *port, int *bit) {
+   if (!inner->getPort(pin, port, bit)) {
+      return false;
+   }
+
+   if (*port >= 0 && *port < GPIO_PROFILE_MAX_PORTS && *bit >= 0 &&
+         *bit < 64 && pin >= 0 && pin < GPIO_MAX_PINS) {
+      pthread_mutex_lock(&lock);
+      portPins[*port][*bit] = pin;
+      pthread_mutex_unlock(&lock);
+   }
+   return true;
+}
+
+// Writes the bits of a port.
+int GPIOProfiledBackend::writePort(int port, uint64_t mask, uint64_t bits) {
+   uint64_t start = monotonicNow();
+   int result = inner->writePort(port, mask, bits);
+   record(GPIO_OP_WRITE, start);
+   countPort(port, mask, &GPIOPinStats::writes);
+   return result;
+}
+
+// Reads the bits of a port.
+int GPIOProfiledBackend::readPort(int port, uint64_t mask, uint64_t *bits) {
+   uint64_t start = monotonicNow();
+   int result = inner->readPort(port, mask, bits);
+   record(GPIO_OP_READ, start);
+   countPort(port, mask, &GPIOPinStats::reads);
+   return result;
+}
+
+// Sets the edge a pin reports.
+int GPIOProfiledBackend::setEdge(int pin, int edge) {
+   uint64_t start = monotonicNow();
+   int result = inner->setEdge(pin, edge);
+   record(GPIO_OP_EDGE, start);
+   return result;
+}
+
+// Returns the event descriptor of a pin.
+int GPIOProfiledBackend::getEventFd(int pin, short *pollEvents) {
+   return inner->getEventFd(pin, pollEvents);
+}
+
+// Reads a pending edge event of a pin.
+int GPIOProfiledBackend::readEvent(int pin, GPIOEvent *event) {
+   uint64_t start = monotonicNow();
+   int result = inner->readEvent(pin, event);
+   record(GPIO_OP_EDGE, start);
+   return result;
+}
+
+// Copies the counts of a pin.
+void GPIOProfiledBackend::getPinStats(int pin, GPIOPinStats *stats) {
+   if (pin < 0 || pin >= GPIO_MAX_PINS) {
+      memset(stats, 0, sizeof(*stats));
+      return;
+   }
+
+   pthread_mutex_lock(&lock);
+   *stats = pinStats[pin];
+   pthread_mutex_unlock(&lock);
+}
+
+// Copies the histogram of a kind of call.
+void GPIOProfiledBackend::getOpStats(int op, GPIOHistogram *histogram) {
+   if (op < 0 || op >= GPIO_OPS) {
+      memset(histogram, 0, sizeof(*histogram));
+      return;
+   }
+
+   pthread_mutex_lock(&lock);
+   *histogram = ops[op];
+   pthread_mutex_unlock(&lock);
+}
+
+// Clears the counts and histograms.
+void GPIOProfiledBackend::reset() {
+   pthread_mutex_lock(&lock);
+   memset(ops, 0, sizeof(ops));
+   memset(pinStats, 0, sizeof(pinStats));
+   pthread_mutex_unlock(&lock);
+   GPIOProfileScope::resetTagStats();
+}
+
+// Prints the statistics.
+void GPIOProfiledBackend::dump(FILE *out) {
+   GPIOHistogram opCopy[GPIO_OPS];
+   GPIOPinStats pinCopy[GPIO_MAX_PINS];
+
+   pthread_mutex_lock(&lock);
+   memcpy(opCopy, ops, sizeof(ops));
+   memcpy(pinCopy, pinStats, sizeof(pinStats));
+   pthread_mutex_unlock(&lock);
+
+   fprintf(out, "gpio backend calls:\n");
+   int index;
+   for (index = 0; index < GPIO_OPS; ++index) {
+      gpioHistogramPrint(out, opNames[index], &opCopy[index]);
+   }
+
+   fprintf(out, "gpio pins:\n");
+   for (index = 0; index < GPIO_MAX_PINS; ++index) {
+      GPIOPinStats *stats = &pinCopy[index];
+      if (stats->reads != 0 || stats->writes != 0 ||
+            stats->directionChanges != 0) {
+         fprintf(out, "gpio%-4d reads %lu writes %lu direction changes %lu\n",
+               index, stats->reads, stats->writes, stats->directionChanges);
+      }
+   }
+
+   fprintf(out, "gpio tags:\n");
+   GPIOProfileScope::dumpTagStats(out);
+   fflush(out);
+}
+
+// Dumps the statistics until stopped.
+void *GPIOProfiledBackend::dumpLoop(void *arg) {
+   GPIOProfiledBackend *profiled = (GPIOProfiledBackend *)arg;
+
+   pthread_mutex_lock(&profiled->lock);
+   struct timespec deadline;
+   clock_gettime(CLOCK_MONOTONIC, &deadline);
+   while (profiled->dumping) {
+      deadline.tv_sec += profiled->dumpIntervalMs / 1000;
+      deadline.tv_nsec += (profiled->dumpIntervalMs % 1000) * 1000000L;
+      if (deadline.tv_nsec >= 1000000000L) {
+         ++deadline.tv_sec;
+         deadline.tv_nsec -= 1000000000L;
+      }
+
+      int result = 0;
+      while (profiled->dumping && result != ETIMEDOUT) {
+         result = pthread_cond_timedwait(&profiled->dumpCond, &profiled->lock,
+               &deadline);
+      }
+
+      if (profiled->dumping) {
+         pthread_mutex_unlock(&profiled->lock);
+         profiled->dump(profiled->dumpOut);
+         pthread_mutex_lock(&profiled->lock);
+      }
+   }
+   pthread_mutex_unlock(&profiled->lock);
+   return NULL;
+}
+
+// Starts the periodic dump thread.
+bool GPIOProfiledBackend::startPeriodicDump(FILE *out, int intervalMs) {
+   if (intervalMs <= 0) {
+      fprintf(stderr, "The dump interval must be positive.\n");
+      return false;
+   }
+
+   stopPeriodicDump();
+
+   pthread_mutex_lock(&lock);
+   dumpOut = out;
+   dumpIntervalMs = intervalMs;
+   dumping = true;
+   pthread_mutex_unlock(&lock);
+
+   if (pthread_create(&dumpThread, NULL, dumpLoop, this) != 0) {
+      fprintf(stderr, "Unable to start the gpio statistics thread.\n");
+      dumping = false;
+      return false;
+   }
+   return true;
+}
+
+// Stops the periodic dump thread.
+void GPIOProfiledBackend::stopPeriodicDump() {
+   pthread_mutex_lock(&lock);
+   bool running = dumping;
+   dumping = false;
+   pthread_cond_signal(&dumpCond);
+   pthread_mutex_unlock(&lock);
+
+   if (running) {
+      pthread_join(dumpThread, NULL);
+   }
+}
@@ -0,0 +1,107 @@
+#if !defined(GPIO_PROFILED_BACKEND_H)
+#define GPIO_PROFILED_BACKEND_H
+
+#include <pthread.h>
+#include "GPIOBackend.h"
+#include "GPIOProfile.h"
+
+// Kinds of backend call timed by GPIOProfiledBackend.
+#define GPIO_OP_READ 0
+#define GPIO_OP_WRITE 1
+#define GPIO_OP_DIRECTION 2
+#define GPIO_OP_EXPORT 3
+#define GPIO_OP_EDGE 4
+#define GPIO_OPS 5
+
+// Largest number of ports whose pins are attributed by port operations.
+#define GPIO_PROFILE_MAX_PORTS 8
+
+// Operation counts of one pin. A batched call counts once for every pin in it.
+typedef struct {
+   unsigned long reads;
+   unsigned long writes;
+   unsigned long directionChanges;
+} GPIOPinStats;
+
+// Backend which wraps another backend and records, for every call, per-pin
+// operation counts and a latency histogram per kind of call. Calls are also
+// attributed to the caller's GPIOProfileScope tag. Profiling is opt-in: GPIO
+// objects only pay for it when constructed with (or defaulted to) a profiled
+// backend, e.g.
+//
+//    GPIOProfiledBackend profiled(GPIOBackend::getDefault());
+//    GPIOBackend::setDefault(&profiled);
+class GPIOProfiledBackend : public GPIOBackend {
+   public:
+      // Constructor, forwards every call to inner.
+      GPIOProfiledBackend(GPIOBackend *inner);
+
+      // Destructor, stops the periodic dump.
+      ~GPIOProfiledBackend();
+
+      bool exportPin(int pin);
+      bool exportPins(const int *pins, int count);
+      bool unexportPin(int pin);
+      int getDirection(int pin);
+      int setDirection(int pin, int direction);
+      int getValue(int pin);
+      int setValue(int pin, int value);
+      int setOutput(int pin, int value);
+      int setValues(const int *pins, int count, uint32_t values);
+      int getValues(const int *pins, int count, uint32_t *values);
+      int setDirections(const int *pins, int count, int direction);
+      bool getPort(int pin, int *port, int *bit);
+      int writePort(int port, uint64_t mask, uint64_t bits);
+      int readPort(int port, uint64_t mask, uint64_t *bits);
+      int setEdge(int pin, int edge);
+      int getEventFd(int pin, short *pollEvents);
+      int readEvent(int pin, GPIOEvent *event);
+
+      // Copies the operation counts of pin into stats.
+      void getPinStats(int pin, GPIOPinStats *stats);
+
+      // Copies the latency histogram of a kind of call (GPIO_OP_*) into
+      // histogram.
+      void getOpStats(int op, GPIOHistogram *histogram);
+
+      // Clears every count and histogram.
+      void reset();
+
+      // Prints the per call latency, per pin counts and per tag statistics.
+      void dump(FILE *out);
+
+      // Starts a thread which calls dump(out) every intervalMs milliseconds.
+      // Returns true if the thread was started.
+      bool startPeriodicDump(FILE *out, int intervalMs);
+
+      // Stops the periodic dump thread, if running.
+      void stopPeriodicDump();
+
+   private:
+      // Records a call of kind op which started at start.
+      void record(int op, uint64_t start);
+
+      // Adds to the per pin counts of the pins of a batch.
+      void countPins(const int *pins, int count, unsigned long GPIOPinStats::*field);
+
+      // Adds to the per pin counts of the pins of a port selected by mask. Port
+      // bits are mapped back to pins through the getPort calls seen so far.
+      void countPort(int port, uint64_t mask, unsigned long GPIOPinStats::*field);
+
+      // Entry point of the periodic dump thread.
+      static void *dumpLoop(void *arg);
+
+      GPIOBackend *inner;
+      pthread_mutex_t lock;
+      GPIOHistogram ops[GPIO_OPS];
+      GPIOPinStats pinStats[GPIO_MAX_PINS];
+      short portPins[GPIO_PROFILE_MAX_PORTS][64];
+
+      pthread_t dumpThread;
+      pthread_cond_t dumpCond;
+      bool dumping;
+      FILE *dumpOut;
+      int dumpIntervalMs;
+};
+
+#endif
@@ -0,0 +1,421 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "GPIOSysfsBackend.h"
+
+using namespace std;
+
+static const char *directions[] = {"in", "out"};
+static const char *values[] = {"0", "1"};
+static const char *edges[] = {"none", "rising", "falling", "both"};
+static const char *outputs[] = {"low", "high"};
+static const char *pinFiles[] = {"direction", "value"};
+
+// Returns true if pin can be tracked by this backend.
+static bool validPin(int pin) {
+   if (pin < 0 || pin >= GPIO_MAX_PINS) {
+      fprintf(stderr, "Pin %d is outside of the supported range 0 - %d.\n",
+            pin, GPIO_MAX_PINS - 1);
+      return false;
+   }
+   return true;
+}
+
+// Checks to see if a directory exists for the given pin number. Returns true if
+// the directory exists.
+static bool dirExists(int pinNum) {
+   char gpioDirPath[STR_LEN] = {0};
+   sprintf(gpioDirPath, GPIO_PATH "gpio%d", pinNum);
+
+   return access(gpioDirPath, F_OK) == 0;
+}
+
+// Returns true if the direction and value files of the pin can be read and
+// written by this process.
+static bool filesAccessible(int pinNum) {
+   char path[STR_LEN] = {0};
+
+   int file;
+   for (file = 0; file < 2; ++file) {
+      sprintf(path, GPIO_PATH "gpio%d/%s", pinNum, pinFiles[file]);
+      if (access(path, R_OK | W_OK) != 0) {
+         return false;
+      }
+   }
+   return true;
+}
+
+// Waits until udev has granted access to the files of every pin, watching the
+// files for attribute changes with inotify. Returns true if all of the pins
+// became accessible within GPIO_UDEV_TIMEOUT_MS.
+static bool waitForAccess(const int *pins, int count) {
+   int pending[GPIO_MAX_BATCH];
+   int numPending = 0;
+
+   int index;
+   for (index = 0; index < count && numPending < GPIO_MAX_BATCH; ++index) {
+      // Pins whose export failed will never become accessible.
+      if (dirExists(pins[index]) && !filesAccessible(pins[index])) {
+         pending[numPending++] = pins[index];
+      }
+   }
+
+   if (numPending == 0) {
+      return true;
+   }
+
+   int notifyFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+   if (notifyFd < 0) {
+      fprintf(stderr, "Could not create inotify instance.\n");
+      return false;
+   }
+
+   char path[STR_LEN] = {0};
+   for (index = 0; index < numPending; ++index) {
+      int file;
+      for (file = 0; file < 2; ++file) {
+         sprintf(path, GPIO_PATH "gpio%d/%s", pending[index], pinFiles[file]);
+         inotify_add_watch(notifyFd, path, IN_ATTRIB);
+      }
+   }
+
+   uint64_t deadline = GPIOBackend::monotonicNow() +
+      GPIO_UDEV_TIMEOUT_MS * 1000000ULL;
+
+   // Checking after the watches are added means a permission change made
+   // before the watch existed is not missed.
+   while (true) {
+      int remaining = 0;
+      for (index = 0; index < numPending; ++index) {
+         if (!filesAccessible(pending[index])) {
+            pending[remaining++] = pending[index];
+         }
+      }
+      numPending = remaining;
+
+      uint64_t now = GPIOBackend::monotonicNow();
+      if (numPending == 0 || now >= deadline) {
+         break;
+      }
+
+      struct pollfd notify = {notifyFd, POLLIN, 0};
+      poll(&notify, 1, (int)((deadline - now + 999999ULL) / 1000000ULL));
+
+      char events[STR_LEN * 16];
+      while (read(notifyFd, events, sizeof(events)) > 0) {
+      }
+   }
+
+   close(notifyFd);
+
+   for (index = 0; index < numPending; ++index) {
+      fprintf(stderr, "Timed out waiting for access to gpio%d.\n",
+            pending[index]);
+   }
+   return numPending == 0;
+}
+
+// Opens the file specified in path using the specified flags. Returns the file
+// descriptor which references the file.
+static int openFile(const char *path, int flags) {
+   int fd = open(path, flags);
+
+   if (fd < 0) {
+      fprintf(stderr, "Could not open file %s\n", path);
+   }
+
+   return fd;
+}
+
+// Reads numBytes from the front of the file specified by the file descriptor fd
+// and stores that contents in buf. Returns the number of bytes read.
+static int readFile(int fd, char *buf, int numBytes) {
+   lseek(fd, 0, SEEK_SET);
+   int numRead = read(fd, buf, numBytes);
+
+   if (numRead <= 0) {
+      fprintf(stderr, "Could not read from file\n");
+   }
+
+   return numRead;
+}
+
+// Writes numBytes from the content referenced by  data to the file referenced
+// by the file descriptor fd. Returns the number of bytes written. Writes to a
+// sysfs attribute are passed to the driver synchronously, so no fsync is
+// needed afterwards.
+static int writeFile(int fd, const void *data, int numBytes) {
+   lseek(fd, 0, SEEK_SET);
+   int written = write(fd, data, numBytes);
+
+   if (written <= 0) {
+      fprintf(stderr, "Could not write to file\n");
+   }
+
+   return written;
+}
+
+// Writes the number of pin into the sysfs control file at controlPath.
+static void writePinNumber(const char *controlPath, int pin) {
+   char num[STR_LEN] = {0};
+   sprintf(num, "%d", pin);
+
+   int fd = openFile(controlPath, O_WRONLY);
+   if (fd >= 0) {
+      writeFile(fd, num, strlen(num));
+      close(fd);
+   }
+}
+
+// Constructor.
+GPIOSysfsBackend::GPIOSysfsBackend() {
+   int index;
+   for (index = 0; index < GPIO_MAX_PINS; ++index) {
+      dirFds[index] = -1;
+      valFds[index] = -1;
+   }
+}
+
+// Destructor.
+GPIOSysfsBackend::~GPIOSysfsBackend() {
+   int index;
+   for (index = 0; index < GPIO_MAX_PINS; ++index) {
+      if (dirFds[index] >= 0) {
+         close(dirFds[index]);
+      }
+      if (valFds[index] >= 0) {
+         close(valFds[index]);
+      }
+   }
+}
+
+// Opens the direction and value files of the pin.
+bool GPIOSysfsBackend::openPinFiles(int pin) {
+   char path[STR_LEN] = {0};
+
+   if (dirFds[pin] < 0) {
+      sprintf(path, GPIO_PATH "gpio%d/direction", pin);
+      dirFds[pin] = openFile(path, O_RDWR);
+   }
+   if (valFds[pin] < 0) {
+      sprintf(path, GPIO_PATH "gpio%d/value", pin);
+      valFds[pin] = openFile(path, O_RDWR);
+   }
+
+   return dirFds[pin] >= 0 && valFds[pin] >= 0;
+}
+
+// Exports the gpio pin by writing the number of the pin to the file
+// /sys/class/gpio/export. Returns true if the directory is created/exists.
+bool GPIOSysfsBackend::exportPin(int pin) {
+   return exportPins(&pin, 1);
+}
+
+// Exports every missing pin through a single open of the export file, then
+// waits for udev and opens the pins' files. Only pins written to the export
+// file count as exported.
+bool GPIOSysfsBackend::exportPins(const int *pins, int count) {
+   GPIOStartupStats *stats = getStartupStats();
+   uint64_t start = monotonicNow();
+   int exportFd = -1;
+   bool ready = true;
+
+   int index;
+   for (index = 0; index < count; ++index) {
+      int pin = pins[index];
+      if (!validPin(pin)) {
+         ready = false;
+         continue;
+      }
+      if (valFds[pin] >= 0 || dirExists(pin)) {
+         continue;
+      }
+
+      if (exportFd < 0) {
+         exportFd = openFile(GPIO_PATH "export", O_WRONLY);
+         if (exportFd < 0) {
+            return false;
+         }
+      }
+
+      // The export file takes one pin number per write.
+      char num[STR_LEN] = {0};
+      sprintf(num, "%d", pin);
+      if (write(exportFd, num, strlen(num)) <= 0) {
+         fprintf(stderr, "Could not export gpio%d\n", pin);
+         ready = false;
+      } else {
+         ++stats->pinsExported;
+      }
+   }
+
+   if (exportFd >= 0) {
+      close(exportFd);
+   }
+
+   uint64_t exported = monotonicNow();
+   stats->exportNs += exported - start;
+
+   if (!waitForAccess(pins, count)) {
+      ready = false;
+   }
+
+   uint64_t accessible = monotonicNow();
+   stats->udevWaitNs += accessible - exported;
+
+   for (index = 0; index < count; ++index) {
+      if (validPin(pins[index])) {
+         ready = openPinFiles(pins[index]) && ready;
+      }
+   }
+
+   stats->openNs += monotonicNow() - accessible;
+   return ready;
+}
+
+// Unexports the gpio pin and closes its files.
+bool GPIOSysfsBackend::unexportPin(int pin) {
+   if (!validPin(pin)) {
+      return false;
+   }
+
+   if (dirFds[pin] >= 0) {
+      close(dirFds[pin]);
+      dirFds[pin] = -1;
+   }
+   if (valFds[pin] >= 0) {
+      close(valFds[pin]);
+      valFds[pin] = -1;
+   }
+
+   if (dirExists(pin)) {
+      writePinNumber(GPIO_PATH "unexport", pin);
+   }
+
+   return !dirExists(pin);
+}
+
+// Reads the direction file of the pin.
+int GPIOSysfsBackend::getDirection(int pin) {
+   if (!validPin(pin)) {
+      return -1;
+   }
+
+   int dir = -1;
+   char buffer[STR_LEN] = {0};
+
+   if (readFile(dirFds[pin], buffer, STR_LEN - 1) > 0) {
+
+      // Drop random newline added to end of buffer during read
+      buffer[strlen(buffer) - 1] = '\0';
+
+      if (strcmp(buffer, directions[GPIO_DIR_IN]) == 0) {
+         dir = GPIO_DIR_IN;
+      } else if (strcmp(buffer, directions[GPIO_DIR_OUT]) == 0) {
+         dir = GPIO_DIR_OUT;
+      }
+   }
+
+   return dir;
+}
+
+// Writes "in" or "out" to the direction file of the pin.
+int GPIOSysfsBackend::setDirection(int pin, int direction) {
+   if (!validPin(pin)) {
+      return 0;
+   }
+
+   const char *dir = directions[direction == GPIO_DIR_OUT];
+   return writeFile(dirFds[pin], dir, strlen(dir));
+}
+
+// Writes "low" or "high" to the direction file of the pin.
+int GPIOSysfsBackend::setOutput(int pin, int value) {
+   if (!validPin(pin)) {
+      return 0;
+   }
+
+   const char *output = outputs[value != 0];
+   return writeFile(dirFds[pin], output, strlen(output));
+}
+
+// Reads the value file of the pin.
+int GPIOSysfsBackend::getValue(int pin) {
+   if (!validPin(pin)) {
+      return -1;
+   }
+
+   int val = -1;
+   char buffer[STR_LEN] = {0};
+   if (readFile(valFds[pin], buffer, STR_LEN - 1) > 0) {
+      val = atoi(buffer);
+   }
+   return val;
+}
+
+// Writes "0" or "1" to the value file of the pin.
+int GPIOSysfsBackend::setValue(int pin, int newValue) {
+   if (!validPin(pin)) {
+      return 0;
+   }
+
+   const char *value = newValue == 0 ? values[0] : values[1];
+   return writeFile(valFds[pin], value, strlen(value));
+}
+
+// Writes the edge setting of the pin and clears any stale pending edge.
+int GPIOSysfsBackend::setEdge(int pin, int edge) {
+   if (!validPin(pin) || edge < GPIO_EDGE_NONE || edge > GPIO_EDGE_BOTH) {
+      return 0;
+   }
+
+   char path[STR_LEN] = {0};
+   sprintf(path, GPIO_PATH "gpio%d/edge", pin);
+
+   int edgeFd = openFile(path, O_WRONLY);
+   if (edgeFd < 0) {
+      return 0;
+   }
+   int written = writeFile(edgeFd, edges[edge], strlen(edges[edge]));
+   close(edgeFd);
+
+   // The value file reports POLLPRI until it is read once after the edge file
+   // is configured.
+   char buffer[STR_LEN] = {0};
+   readFile(valFds[pin], buffer, STR_LEN - 1);
+
+   return written;
+}
+
+// Returns the value file of the pin.
+int GPIOSysfsBackend::getEventFd(int pin, short *pollEvents) {
+   if (!validPin(pin)) {
+      return -1;
+   }
+   *pollEvents = POLLPRI | POLLERR;
+   return valFds[pin];
+}
+
+// Checks for a pending edge and consumes it by reading the value file. Sysfs
+// does not timestamp edges, so the time of the read is used.
+int GPIOSysfsBackend::readEvent(int pin, GPIOEvent *event) {
+   if (!validPin(pin) || valFds[pin] < 0) {
+      return -1;
+   }
+
+   struct pollfd pending = {valFds[pin], POLLPRI | POLLERR, 0};
+   if (poll(&pending, 1, 0) <= 0) {
+      return 0;
+   }
+
+   event->pin = pin;
+   event->value = getValue(pin);
+   event->timestamp = monotonicNow();
+
+   return event->value < 0 ? -1 : 1;
+}
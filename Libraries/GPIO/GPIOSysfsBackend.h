@@ -0,0 +1,70 @@
+#if !defined(GPIO_SYSFS_BACKEND_H)
+#define GPIO_SYSFS_BACKEND_H
+
+#include "GPIOBackend.h"
+
+#define GPIO_PATH "/sys/class/gpio/"
+#define STR_LEN 64
+
+// Longest time to wait for udev to grant access to a newly exported pin.
+#define GPIO_UDEV_TIMEOUT_MS 1000
+
+// Backend which drives pins through the /sys/class/gpio/ files. Every pin is
+// exported by writing its number to /sys/class/gpio/export and is then
+// controlled through its own direction and value files. If this backend is to
+// be ported to other devices, the export path should be confirmed/altered for
+// the new hardware.
+//
+// Newly exported pins are owned by root until udev applies its permission
+// rules, so exporting waits (with inotify, not by retrying) until the pin's
+// files are accessible before opening them.
+class GPIOSysfsBackend : public GPIOBackend {
+   public:
+      // Constructor
+      GPIOSysfsBackend();
+
+      // Destructor, closes the files of every pin still open.
+      ~GPIOSysfsBackend();
+
+      // Exports the pin by writing its number to /sys/class/gpio/export and
+      // opens its direction and value files. Returns true if the directory is
+      // created/exists.
+      bool exportPin(int pin);
+
+      // Exports every pin which is not exported yet through one open of
+      // /sys/class/gpio/export, waits for udev once for all of them and opens
+      // their files. Returns true if every pin is ready for use.
+      bool exportPins(const int *pins, int count);
+
+      // Unexports the pin. Returns true if the directory is unexported or if
+      // the directory did not exist to begin with.
+      bool unexportPin(int pin);
+
+      int getDirection(int pin);
+      int setDirection(int pin, int direction);
+      int getValue(int pin);
+      int setValue(int pin, int value);
+
+      // Writes "low" or "high" to the direction file, which sets direction and
+      // value in one write.
+      int setOutput(int pin, int value);
+
+      // Writes "none", "rising", "falling" or "both" to the pin's edge file.
+      int setEdge(int pin, int edge);
+
+      // Returns the pin's value file, which signals POLLPRI on an edge.
+      int getEventFd(int pin, short *pollEvents);
+
+      // Consumes a pending edge by re-reading the value file.
+      int readEvent(int pin, GPIOEvent *event);
+
+   private:
+      // Opens the direction and value files of pin if they are not open yet.
+      // Returns true if both are open.
+      bool openPinFiles(int pin);
+
+      int dirFds[GPIO_MAX_PINS];
+      int valFds[GPIO_MAX_PINS];
+};
+
+#endif
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "AsyncLCD.h"
+
+#define CMD_ANCHOR 0
+#define CMD_BLINK 1
+#define CMD_CLEAR 2
+#define CMD_COMMAND 3
+#define CMD_CURSOR 4
+#define CMD_DISPLAY 5
+#define CMD_DRAW 6
+#define CMD_MOVE 7
+#define CMD_PRINT 8
+#define CMD_REVERSE 9
+#define CMD_SYNC 10
+#define CMD_STOP 11
+
+// Address which no cursor can be at, marks the display cursor as unknown.
+#define UNKNOWN_ADDRESS 0xFF
+
+// Time to wait for the render thread when the queue is full.
+#define QUEUE_FULL_WAIT_US 200
+
+using namespace std;
+
+// Constructor.
+AsyncLCD::AsyncLCD(LCD *display) {
+   lcd = display;
+   cursorAddress = 0x00;
+   anchorAddress = 0x00;
+   placedAddress = UNKNOWN_ADDRESS;
+   anchorFlag = false;
+   cursorFlag = false;
+   blinkFlag = false;
+   displayFlag = true;
+   reverseFlag = false;
+   shownCursor = false;
+   shownBlink = false;
+   shownDisplay = true;
+   shownReverse = false;
+   optionsKnown = false;
+
+   sem_init(&ready, 0, 0);
+   sem_init(&synced, 0, 0);
+
+   running = pthread_create(&thread, NULL, renderLoop, this) == 0;
+   if (!running) {
+      fprintf(stderr, "Unable to start the LCD render thread, drawing "
+            "synchronously.\n");
+   }
+}
+
+// Destructor.
+AsyncLCD::~AsyncLCD() {
+   if (running) {
+      post(CMD_STOP, 0);
+      pthread_join(thread, NULL);
+   }
+   sem_destroy(&ready);
+   sem_destroy(&synced);
+}
+
+// Anchors the cursor.
+void AsyncLCD::anchorCursor(bool enable) {
+   post(CMD_ANCHOR, enable);
+}
+
+// Changes the blink state of the cursor.
+void AsyncLCD::blink(bool enable) {
+   post(CMD_BLINK, enable);
+}
+
+// Clears the display.
+void AsyncLCD::clear() {
+   post(CMD_CLEAR, 0);
+}
+
+// Queues a raw command.
+void AsyncLCD::command(LCDpins *cmd) {
+   AsyncLCDCommand queued;
+   memset(&queued, 0, sizeof(queued));
+   queued.type = CMD_COMMAND;
+   queued.arg = cmd->rs;
+   queued.line = cmd->rw;
+   memcpy(queued.text, cmd->ctrlPins, 8);
+   post(&queued);
+}
+
+// Changes the state of the cursor.
+void AsyncLCD::cursor(bool enable) {
+   post(CMD_CURSOR, enable);
+}
+
+// Changes the state of the display.
+void AsyncLCD::display(bool enable) {
+   post(CMD_DISPLAY, enable);
+}
+
+// Queues text for a cell position.
+void AsyncLCD::draw(unsigned char line, unsigned char column,
+      const char *text) {
+   AsyncLCDCommand queued;
+   queued.type = CMD_DRAW;
+   queued.arg = column;
+   queued.line = line;
+   queued.length = strnlen(text, ASYNC_LCD_TEXT);
+   memcpy(queued.text, text, queued.length);
+   queued.text[queued.length] = '\0';
+   post(&queued);
+}
+
+// Moves the cursor.
+void AsyncLCD::moveCursor(unsigned short address) {
+   post(CMD_MOVE, address);
+}
+
+// Queues text for the cursor, in pieces of at most ASYNC_LCD_TEXT characters.
+void AsyncLCD::print(const char *message) {
+   AsyncLCDCommand queued;
+   queued.type = CMD_PRINT;
+   queued.line = 0;
+
+   size_t remaining = strlen(message);
+   do {
+      queued.length = remaining < ASYNC_LCD_TEXT ? remaining : ASYNC_LCD_TEXT;
+      memcpy(queued.text, message, queued.length);
+      queued.text[queued.length] = '\0';
+      message += queued.length;
+      remaining -= queued.length;
+
+      // The last piece returns the cursor to the anchor.
+      queued.arg = remaining == 0;
+      post(&queued);
+   } while (remaining > 0);
+}
+
+// Sends the cursor home on a line.
+void AsyncLCD::returnHome(unsigned char line) {
+   post(CMD_MOVE, line * ROW_SHIFT);
+}
+
+// Changes the print direction.
+void AsyncLCD::reversePrint(bool enable) {
+   post(CMD_REVERSE, enable);
+}
+
+// Waits for the render thread to catch up.
+void AsyncLCD::sync() {
+   post(CMD_SYNC, 0);
+   if (running) {
+      while (sem_wait(&synced) != 0) {
+      }
+   }
+}
+
+// Queues a command for the render thread.
+void AsyncLCD::post(const AsyncLCDCommand *cmd) {
+   if (!running) {
+      apply(cmd);
+      render();
+      return;
+   }
+
+   while (!queue.push(*cmd)) {
+      sem_post(&ready);
+      usleep(QUEUE_FULL_WAIT_US);
+   }
+   sem_post(&ready);
+}
+
+// Queues a command without text.
+void AsyncLCD::post(unsigned char type, unsigned char arg) {
+   AsyncLCDCommand queued;
+   queued.type = type;
+   queued.arg = arg;
+   queued.line = 0;
+   queued.length = 0;
+   queued.text[0] = '\0';
+   post(&queued);
+}
+
+// Applies a command to the framebuffer and the render state.
+bool AsyncLCD::apply(const AsyncLCDCommand *cmd) {
+   switch (cmd->type) {
+      case CMD_ANCHOR:
+         anchorFlag = cmd->arg;
+         anchorAddress = cursorAddress;
+         break;
+      case CMD_BLINK:
+         blinkFlag = cmd->arg;
+         break;
+      case CMD_CLEAR:
+         // Erasing the framebuffer lets flush() skip cells which are redrawn
+         // with the same text before the display catches up. Like the clear
+         // instruction, this homes the cursor and restores increment mode.
+         lcd->clearFrame();
+         cursorAddress = 0x00;
+         reverseFlag = false;
+         break;
+      case CMD_COMMAND: {
+         // Raw commands may depend on what was queued before them.
+         render();
+         unsigned char dataPins[8];
+         memcpy(dataPins, cmd->text, sizeof(dataPins));
+         LCDpins pins = {cmd->arg, cmd->line, 0, dataPins};
+         lcd->command(&pins);
+         placedAddress = UNKNOWN_ADDRESS;
+         break;
+      }
+      case CMD_CURSOR:
+         cursorFlag = cmd->arg;
+         break;
+      case CMD_DISPLAY:
+         displayFlag = cmd->arg;
+         break;
+      case CMD_DRAW:
+         lcd->draw(cmd->line, cmd->arg, cmd->text);
+         break;
+      case CMD_MOVE:
+         cursorAddress = cmd->arg;
+         break;
+      case CMD_PRINT:
+         cursorAddress = lcd->drawAddress(cursorAddress, cmd->text,
+               reverseFlag);
+         if (cmd->arg && anchorFlag) {
+            cursorAddress = anchorAddress;
+         }
+         break;
+      case CMD_REVERSE:
+         reverseFlag = cmd->arg;
+         break;
+      case CMD_SYNC:
+         render();
+         if (running) {
+            sem_post(&synced);
+         }
+         break;
+      case CMD_STOP:
+         render();
+         return false;
+   }
+   return true;
+}
+
+// Sends the changed options and cells.
+void AsyncLCD::render() {
+   if (!optionsKnown || reverseFlag != shownReverse) {
+      lcd->reversePrint(reverseFlag);
+      shownReverse = reverseFlag;
+   }
+
+   // Each option is its own display control command, only send those which
+   // changed.
+   if (!optionsKnown || displayFlag != shownDisplay) {
+      lcd->display(displayFlag);
+      shownDisplay = displayFlag;
+   }
+   if (!optionsKnown || cursorFlag != shownCursor) {
+      lcd->cursor(cursorFlag);
+      shownCursor = cursorFlag;
+   }
+   if (!optionsKnown || blinkFlag != shownBlink) {
+      lcd->blink(blinkFlag);
+      shownBlink = blinkFlag;
+   }
+   optionsKnown = true;
+
+   if (lcd->flush() > 0) {
+      placedAddress = UNKNOWN_ADDRESS;
+   }
+
+   // The display cursor only needs to follow the software one while visible.
+   if ((cursorFlag || blinkFlag) && placedAddress != cursorAddress) {
+      lcd->moveCursor(cursorAddress);
+      placedAddress = cursorAddress;
+   }
+}
+
+// Drains the queue and renders until stopped.
+void *AsyncLCD::renderLoop(void *arg) {
+   AsyncLCD *async = (AsyncLCD *)arg;
+
+   while (true) {
+      while (sem_wait(&async->ready) != 0) {
+      }
+
+      AsyncLCDCommand cmd;
+      bool pending = false;
+      while (async->queue.pop(&cmd)) {
+         if (!async->apply(&cmd)) {
+            return NULL;
+         }
+         pending = true;
+      }
+
+      if (pending) {
+         async->render();
+      }
+   }
+}
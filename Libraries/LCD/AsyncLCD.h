@@ -0,0 +1,127 @@
+#if !defined(ASYNC_LCD_H)
+#define ASYNC_LCD_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include "LCD.h"
+#include "../Util/RingBuffer.h"
+
+// Number of commands which can be queued for the render thread.
+#define ASYNC_LCD_QUEUE 64
+
+// Characters of text carried inline by one queued command, enough for the
+// whole display data RAM. Longer print text is split over several commands.
+#define ASYNC_LCD_TEXT LCD_DDRAM_SIZE
+
+// A queued LCD call.
+typedef struct {
+   unsigned char type;
+   unsigned char arg;
+   unsigned char line;
+   unsigned char length;
+   char text[ASYNC_LCD_TEXT + 1];
+} AsyncLCDCommand;
+
+// Runs an LCD from a dedicated render thread. The calls mirror those of LCD
+// but only post a command into a lock-free queue and return immediately.
+//
+// The render thread drains every queued command before touching the display:
+// text is drawn into the LCD's framebuffer at a cursor tracked in software,
+// and display options keep only their latest value. It then sends the result
+// with one LCD::flush(), so text which is overwritten before the display
+// caught up, or which did not change, is never transferred.
+//
+// The calls must all be made from one thread (the queue has a single
+// producer), and the LCD must not be used directly while an AsyncLCD drives
+// it. If the queue is full the caller waits for the render thread to make
+// room. Should the render thread fail to start, the calls are carried out
+// synchronously.
+class AsyncLCD {
+   public:
+      // Constructor, starts the render thread for lcd. lcd must outlive this
+      // object.
+      AsyncLCD(LCD *lcd);
+
+      // Destructor, sends the queued commands and stops the render thread.
+      ~AsyncLCD();
+
+      // Anchors the cursor at its current location, see LCD::anchorCursor.
+      void anchorCursor(bool enable);
+
+      // Enables cursor blinking, pass true to enable, false to disable.
+      void blink(bool enable);
+
+      // Clears the LCD screen and sends the cursor home.
+      void clear();
+
+      // Sends a raw command, see LCD::command. The queued text before it is
+      // displayed first.
+      void command(LCDpins *cmd);
+
+      // Enables the cursor, pass true to enable, false to disable.
+      void cursor(bool enable);
+
+      // Enables the display, pass true to enable, false to disable.
+      void display(bool enable);
+
+      // Draws text starting at column of line, see LCD::draw. The cursor does
+      // not move.
+      void draw(unsigned char line, unsigned char column, const char *text);
+
+      // Moves the cursor to the set display address.
+      void moveCursor(unsigned short address);
+
+      // Prints the input string at the cursor (or the anchor).
+      void print(const char *message);
+
+      // Sends the cursor home on the designated line (line 0 is the first row).
+      void returnHome(unsigned char line);
+
+      // Enables reverse printing, pass true to enable, false otherwise.
+      void reversePrint(bool enable);
+
+      // Waits until every command posted so far has reached the display.
+      void sync();
+
+   private:
+      // Queues a command, waiting for room if the queue is full.
+      void post(const AsyncLCDCommand *cmd);
+
+      // Queues a command without text.
+      void post(unsigned char type, unsigned char arg);
+
+      // Applies one command to the render state. Returns false when the
+      // thread must stop.
+      bool apply(const AsyncLCDCommand *cmd);
+
+      // Sends the pending display options and framebuffer changes.
+      void render();
+
+      // Entry point of the render thread.
+      static void *renderLoop(void *arg);
+
+      LCD *lcd;
+      RingBuffer<AsyncLCDCommand, ASYNC_LCD_QUEUE> queue;
+      pthread_t thread;
+      bool running;
+      sem_t ready;
+      sem_t synced;
+
+      // Render thread state: the cursor, anchor and options as the caller
+      // set them, and the options last sent to the display.
+      unsigned char cursorAddress;
+      unsigned char anchorAddress;
+      unsigned char placedAddress;
+      bool anchorFlag;
+      bool cursorFlag;
+      bool blinkFlag;
+      bool displayFlag;
+      bool reverseFlag;
+      bool shownCursor;
+      bool shownBlink;
+      bool shownDisplay;
+      bool shownReverse;
+      bool optionsKnown;
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include <string.h>
+#include "BigDigits.h"
+
+// Cell contents of the font besides the 8 segment glyphs.
+#define FULL 8
+#define BLANK 9
+
+// ROM codes of the full block and the middle dot used for the colon.
+#define FULL_BLOCK 0xFF
+#define MIDDLE_DOT 0xA5
+
+using namespace std;
+
+// Segment glyphs: rounded corners, bars and middle bars.
+static const unsigned char segments[LCD_GLYPH_SLOTS][LCD_GLYPH_ROWS] = {
+   {0x07, 0x0F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F},
+   {0x1F, 0x1F, 0x1F, 0x00, 0x00, 0x00, 0x00, 0x00},
+   {0x1C, 0x1E, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F},
+   {0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x0F, 0x07},
+   {0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x1F, 0x1F},
+   {0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1E, 0x1C},
+   {0x1F, 0x1F, 0x1F, 0x00, 0x00, 0x00, 0x1F, 0x1F},
+   {0x1F, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x1F, 0x1F}
+};
+
+// Top then bottom row of each digit.
+static const unsigned char font[10][2][BIG_DIGIT_WIDTH] = {
+   {{0, 1, 2}, {3, 4, 5}},
+   {{1, 2, BLANK}, {4, FULL, 4}},
+   {{6, 6, 2}, {3, 4, 4}},
+   {{6, 6, 2}, {4, 4, 5}},
+   {{3, 4, FULL}, {BLANK, BLANK, FULL}},
+   {{FULL, 6, 6}, {4, 4, 5}},
+   {{0, 6, 6}, {3, 4, 5}},
+   {{1, 1, 2}, {BLANK, BLANK, FULL}},
+   {{0, 6, 2}, {3, 4, 5}},
+   {{0, 6, 2}, {BLANK, BLANK, FULL}}
+};
+
+// Constructor.
+BigDigits::BigDigits(LCD *display, unsigned char startColumn) {
+   lcd = display;
+   column = startColumn;
+   invalidate();
+}
+
+// Returns the number of columns text takes.
+static int textWidth(const char *text) {
+   int width = 0;
+   for (; *text; ++text) {
+      width += *text == ':' ? BIG_COLON_WIDTH : BIG_DIGIT_WIDTH;
+   }
+   return width;
+}
+
+// Draws the characters which changed, and blanks the columns the last text
+// took beyond the end of this one.
+int BigDigits::draw(const char *text) {
+   int length = strnlen(text, BIG_DIGITS_MAX);
+   int lastLength = strlen(last);
+   int lastEnd = column + textWidth(last);
+   bool moved = false;
+   int col = column;
+
+   int index;
+   for (index = 0; index < length; ++index) {
+      char character = text[index];
+      int width = character == ':' ? BIG_COLON_WIDTH : BIG_DIGIT_WIDTH;
+
+      // A change of width moves every following character.
+      if (index >= lastLength ||
+            (last[index] == ':') != (character == ':')) {
+         moved = true;
+      }
+
+      if (moved || last[index] != character) {
+         drawCharacter(character, col);
+      }
+      col += width;
+   }
+
+   int blank;
+   for (blank = col; blank < lastEnd; ++blank) {
+      lcd->drawChar(0, blank, ' ');
+      lcd->drawChar(1, blank, ' ');
+   }
+
+   memcpy(last, text, length);
+   last[length] = '\0';
+   return col - column;
+}
+
+// Draws one big character.
+void BigDigits::drawCharacter(char character, int col) {
+   if (character == ':') {
+      lcd->drawChar(0, col, MIDDLE_DOT);
+      lcd->drawChar(1, col, MIDDLE_DOT);
+      return;
+   }
+
+   // Blank the cells first so the glyphs they showed can be replaced.
+   int line;
+   int cell;
+   for (line = 0; line < 2; ++line) {
+      for (cell = 0; cell < BIG_DIGIT_WIDTH; ++cell) {
+         lcd->drawChar(line, col + cell, ' ');
+      }
+   }
+
+   if (character < '0' || character > '9') {
+      return;
+   }
+
+   for (line = 0; line < 2; ++line) {
+      for (cell = 0; cell < BIG_DIGIT_WIDTH; ++cell) {
+         unsigned char part = font[character - '0'][line][cell];
+         int code = part == BLANK ? ' ' : part == FULL ? FULL_BLOCK :
+            lcd->glyph(segments[part]);
+         lcd->drawChar(line, col + cell, code < 0 ? FULL_BLOCK : code);
+      }
+   }
+}
+
+// Forgets the last drawn text.
+void BigDigits::invalidate() {
+   last[0] = '\0';
+}
@@ -0,0 +1,41 @@
+#if !defined(BIG_DIGITS_H)
+#define BIG_DIGITS_H
+
+#include "LCD.h"
+
+// Columns taken by a big digit and by a big colon.
+#define BIG_DIGIT_WIDTH 3
+#define BIG_COLON_WIDTH 1
+
+// Longest text BigDigits draws.
+#define BIG_DIGITS_MAX 16
+
+// Renders digits two lines tall and three cells wide, readable from across
+// the room, using the 8 custom glyphs of the LCD's character generator RAM.
+// Text is drawn into the LCD framebuffer, so it reaches the display with the
+// next LCD::flush(). Only the characters which changed since the last draw
+// are redrawn; once the glyphs are resident, redraws cost no glyph uploads.
+class BigDigits {
+   public:
+      // Constructor, draws on lines 0 and 1 of lcd starting at column.
+      BigDigits(LCD *lcd, unsigned char column);
+
+      // Draws text made of the digits 0 - 9, ':' and ' ' (a blank digit),
+      // blanking what is left of longer text drawn before. Returns the number
+      // of columns used.
+      int draw(const char *text);
+
+      // Makes the next draw redraw every character, e.g. after the
+      // framebuffer was cleared.
+      void invalidate();
+
+   private:
+      // Draws one character at column col.
+      void drawCharacter(char character, int col);
+
+      LCD *lcd;
+      unsigned char column;
+      char last[BIG_DIGITS_MAX + 1];
+};
+
+#endif
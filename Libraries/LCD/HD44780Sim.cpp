@@ -0,0 +1,449 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "HD44780Sim.h"
+
+#define LINE_CELLS (LCD_DDRAM_SIZE / 2)
+#define SECOND_LINE 0x40
+
+using namespace std;
+
+// Constructor, the controller starts as after power on: 8-bit interface, one
+// line, display off and the data RAM filled with spaces.
+HD44780Sim::HD44780Sim(const LCDpins *pins, int numDataPins,
+      const LCDTiming *execTiming) {
+   rsPin = pins->rs;
+   rwPin = pins->rw;
+   ePin = pins->e;
+
+   numData = numDataPins == 8 ? 8 : 4;
+   if (numDataPins != 4 && numDataPins != 8) {
+      fprintf(stderr, "Improper mode, must enter a mode of 4 or 8!\n");
+   }
+
+   int index;
+   for (index = 0; index < numData; ++index) {
+      dataPins[index] = pins->ctrlPins[index];
+   }
+
+   if (execTiming != NULL) {
+      timing = *execTiming;
+   } else {
+      timing.clearNs = LCD_CLEAR_NS;
+      timing.commandNs = LCD_COMMAND_NS;
+   }
+
+   memset(ddram, ' ', sizeof(ddram));
+   memset(cgram, 0, sizeof(cgram));
+   address = 0;
+   cgramSelected = false;
+   eightBitBus = true;
+   twoLines = false;
+   increment = true;
+   shiftOnWrite = false;
+   displayOn = false;
+   cursorOn = false;
+   blinkOn = false;
+   shift = 0;
+   busyUntil = 0;
+
+   nibblePending = false;
+   pendingRead = false;
+   pendingRs = 0;
+   pendingHigh = 0;
+   readLatch = 0;
+   eRiseAt = 0;
+
+   violationText[0] = '\0';
+   resetStats();
+}
+
+// Writes the pins and decodes the resulting bus transition.
+int HD44780Sim::setValues(const int *pins, int count, uint32_t values) {
+   int oldE = outputs[ePin];
+   int oldRs = outputs[rsPin];
+   int oldRw = outputs[rwPin];
+
+   int result = GPIOFakeBackend::setValues(pins, count, values);
+   if (result > 0) {
+      busChanged(oldE, oldRs, oldRw);
+   }
+   return result;
+}
+
+// Reads the pins, data pins seeing what the controller drives.
+int HD44780Sim::getValues(const int *pins, int count, uint32_t *values) {
+   if (outputs[ePin] && outputs[rwPin]) {
+      presentRead();
+   }
+   return GPIOFakeBackend::getValues(pins, count, values);
+}
+
+// Changes the direction of a pin, checking for bus contention.
+int HD44780Sim::setDirection(int pin, int direction) {
+   return setDirections(&pin, 1, direction);
+}
+
+// Changes the direction of several pins, checking for bus contention.
+int HD44780Sim::setDirections(const int *pins, int count, int direction) {
+   int result = GPIOFakeBackend::setDirections(pins, count, direction);
+   if (result <= 0 || direction != GPIO_DIR_OUT || !outputs[ePin] ||
+         !outputs[rwPin]) {
+      return result;
+   }
+
+   int index;
+   int data;
+   for (index = 0; index < count; ++index) {
+      for (data = 0; data < numData; ++data) {
+         if (pins[index] == dataPins[data]) {
+            violation("data pin %d driven by the host during a read",
+                  pins[index]);
+         }
+      }
+   }
+   return result;
+}
+
+// Decodes a change of the bus.
+void HD44780Sim::busChanged(int oldE, int oldRs, int oldRw) {
+   int eValue = outputs[ePin];
+   int rsValue = outputs[rsPin];
+   int rwValue = outputs[rwPin];
+   uint64_t now = monotonicNow();
+
+   if (oldE && (rsValue != oldRs || rwValue != oldRw)) {
+      violation("RS or RW changed while E was high");
+   }
+
+   if (!oldE && eValue) {
+      if (eRiseAt != 0 && now - eRiseAt < HD44780_ENABLE_CYCLE_NS) {
+         violation("E cycle of %lluns is shorter than %dns",
+               (unsigned long long)(now - eRiseAt), HD44780_ENABLE_CYCLE_NS);
+      }
+      eRiseAt = now;
+
+      if (rwValue) {
+         int data;
+         for (data = 0; data < numData; ++data) {
+            if (directions[dataPins[data]] == GPIO_DIR_OUT) {
+               violation("data pin %d driven by the host during a read",
+                     dataPins[data]);
+               break;
+            }
+         }
+
+         if (nibblePending && !pendingRead) {
+            violation("read started between the nibbles of a write");
+            nibblePending = false;
+         }
+
+         // The value is latched at the start of the first (or only) nibble
+         // so both nibbles of a 4-bit read belong together.
+         if (!nibblePending && rsValue) {
+            readLatch = cgramSelected ? cgram[address] : getDDRAM(address);
+         } else if (!nibblePending) {
+            readLatch = (busy() ? 0x80 : 0x00) | (address & 0x7F);
+         }
+         presentRead();
+      }
+      return;
+   }
+
+   if (!oldE || eValue) {
+      return;
+   }
+
+   // Falling edge of E.
+   if (now - eRiseAt < HD44780_ENABLE_PULSE_NS) {
+      violation("E pulse of %lluns is shorter than %dns",
+            (unsigned long long)(now - eRiseAt), HD44780_ENABLE_PULSE_NS);
+   }
+
+   if (rwValue) {
+      if (!eightBitBus && !nibblePending) {
+         nibblePending = true;
+         pendingRead = true;
+         pendingRs = rsValue;
+         return;
+      }
+
+      if (nibblePending && pendingRs != rsValue) {
+         violation("RS changed between the nibbles of a read");
+      }
+      nibblePending = false;
+      ++busReads;
+      if (rsValue) {
+         advance();
+      }
+      return;
+   }
+
+   unsigned char value = dataByte();
+   if (eightBitBus) {
+      execute(rsValue, value);
+      return;
+   }
+
+   if (nibblePending && pendingRead) {
+      violation("write started between the nibbles of a read");
+      nibblePending = false;
+   }
+
+   if (!nibblePending) {
+      nibblePending = true;
+      pendingRead = false;
+      pendingRs = rsValue;
+      pendingHigh = value & 0xF0;
+      return;
+   }
+
+   nibblePending = false;
+   if (pendingRs != rsValue) {
+      violation("RS changed between the nibbles of a write");
+   }
+   execute(rsValue, pendingHigh | value >> 4);
+}
+
+// Drives the data pins with the value being read.
+void HD44780Sim::presentRead() {
+   unsigned char value = readLatch;
+   if (!eightBitBus && nibblePending && pendingRead) {
+      value <<= 4;
+   }
+
+   int data;
+   for (data = 0; data < numData; ++data) {
+      inputs[dataPins[data]] = value >> (7 - data) & 1;
+   }
+}
+
+// Handles a written byte.
+void HD44780Sim::execute(int rsValue, unsigned char value) {
+   if (busy()) {
+      violation("%s 0x%02X written while busy for another %lluns",
+            rsValue ? "data" : "instruction", value,
+            (unsigned long long)(busyUntil - monotonicNow()));
+   }
+
+   if (!rsValue) {
+      ++instructions;
+      instruction(value);
+      return;
+   }
+
+   ++dataWrites;
+   busyUntil = monotonicNow() + timing.commandNs;
+   if (cgramSelected) {
+      cgram[address] = value;
+   } else {
+      int index = ddramIndex(address);
+      if (index >= 0) {
+         ddram[index] = value;
+      }
+      if (shiftOnWrite) {
+         int cells = twoLines ? LINE_CELLS : LCD_DDRAM_SIZE;
+         shift = (shift + (increment ? 1 : -1) + cells) % cells;
+      }
+   }
+   advance();
+}
+
+// Executes an instruction.
+void HD44780Sim::instruction(unsigned char value) {
+   uint64_t duration = timing.commandNs;
+
+   if (value & 0x80) {
+      if (ddramIndex(value & 0x7F) < 0) {
+         violation("set DDRAM address 0x%02X is not a valid address",
+               value & 0x7F);
+      }
+      address = value & 0x7F;
+      cgramSelected = false;
+   } else if (value & 0x40) {
+      address = value & 0x3F;
+      cgramSelected = true;
+   } else if (value & 0x20) {
+      eightBitBus = (value & 0x10) != 0;
+      twoLines = (value & 0x08) != 0;
+   } else if (value & 0x10) {
+      if (value & 0x08) {
+         int cells = twoLines ? LINE_CELLS : LCD_DDRAM_SIZE;
+         shift = (shift + (value & 0x04 ? -1 : 1) + cells) % cells;
+      } else {
+         bool saved = increment;
+         increment = (value & 0x04) != 0;
+         advance();
+         increment = saved;
+      }
+   } else if (value & 0x08) {
+      displayOn = (value & 0x04) != 0;
+      cursorOn = (value & 0x02) != 0;
+      blinkOn = (value & 0x01) != 0;
+   } else if (value & 0x04) {
+      increment = (value & 0x02) != 0;
+      shiftOnWrite = (value & 0x01) != 0;
+   } else if (value & 0x02) {
+      address = 0;
+      cgramSelected = false;
+      shift = 0;
+      duration = timing.clearNs;
+   } else if (value & 0x01) {
+      memset(ddram, ' ', sizeof(ddram));
+      address = 0;
+      cgramSelected = false;
+      shift = 0;
+      increment = true;
+      duration = timing.clearNs;
+   }
+
+   busyUntil = monotonicNow() + duration;
+}
+
+// Returns the RAM index of a data address.
+int HD44780Sim::ddramIndex(unsigned char ddramAddress) {
+   if (!twoLines) {
+      return ddramAddress < LCD_DDRAM_SIZE ? ddramAddress : -1;
+   }
+
+   int column = ddramAddress & (SECOND_LINE - 1);
+   if (column >= LINE_CELLS || ddramAddress >= 2 * SECOND_LINE) {
+      return -1;
+   }
+   return (ddramAddress >= SECOND_LINE ? LINE_CELLS : 0) + column;
+}
+
+// Moves the address counter, wrapping like the controller.
+void HD44780Sim::advance() {
+   if (cgramSelected) {
+      address = (address + (increment ? 1 : -1)) & (HD44780_CGRAM_SIZE - 1);
+      return;
+   }
+
+   int index = ddramIndex(address);
+   if (index < 0) {
+      index = 0;
+   }
+   index = (index + (increment ? 1 : -1) + LCD_DDRAM_SIZE) % LCD_DDRAM_SIZE;
+   address = twoLines ? index / LINE_CELLS * SECOND_LINE + index % LINE_CELLS :
+      index;
+}
+
+// Returns the byte the host drives on the data pins.
+unsigned char HD44780Sim::dataByte() {
+   unsigned char value = 0;
+   int data;
+   for (data = 0; data < numData; ++data) {
+      value |= outputs[dataPins[data]] << (7 - data);
+   }
+   return value;
+}
+
+// Returns true while an instruction executes.
+bool HD44780Sim::busy() {
+   return monotonicNow() < busyUntil;
+}
+
+// Records a protocol violation.
+void HD44780Sim::violation(const char *format, ...) {
+   va_list args;
+   va_start(args, format);
+   vsnprintf(violationText, sizeof(violationText), format, args);
+   va_end(args);
+
+   ++violations;
+   fprintf(stderr, "HD44780: %s.\n", violationText);
+}
+
+// Copies the visible text of a line.
+void HD44780Sim::readLine(int line, char *text, int width) {
+   int cells = twoLines ? LINE_CELLS : LCD_DDRAM_SIZE;
+   int base = twoLines && line == 1 ? LINE_CELLS : 0;
+
+   int column;
+   for (column = 0; column < width; ++column) {
+      text[column] = ddram[base + (column + shift) % cells];
+   }
+   text[width] = '\0';
+}
+
+// Returns a display data RAM byte.
+unsigned char HD44780Sim::getDDRAM(unsigned char ddramAddress) {
+   int index = ddramIndex(ddramAddress);
+   return index < 0 ? 0 : ddram[index];
+}
+
+// Returns the rows of a glyph.
+const unsigned char *HD44780Sim::getGlyph(int slot) {
+   return &cgram[(slot & 7) * 8];
+}
+
+// Returns the address counter.
+unsigned char HD44780Sim::getAddress() {
+   return address;
+}
+
+// Returns the display shift.
+int HD44780Sim::getShift() {
+   return shift;
+}
+
+// Returns true if the display is on.
+bool HD44780Sim::isDisplayOn() {
+   return displayOn;
+}
+
+// Returns true if the cursor is shown.
+bool HD44780Sim::isCursorOn() {
+   return cursorOn;
+}
+
+// Returns true if the cursor blinks.
+bool HD44780Sim::isBlinkOn() {
+   return blinkOn;
+}
+
+// Returns true if the address counter increments.
+bool HD44780Sim::isIncrement() {
+   return increment;
+}
+
+// Returns true in the 4-bit interface mode.
+bool HD44780Sim::isFourBit() {
+   return !eightBitBus;
+}
+
+// Returns the number of instructions executed.
+unsigned long HD44780Sim::instructionCount() {
+   return instructions;
+}
+
+// Returns the number of data bytes written.
+unsigned long HD44780Sim::dataWriteCount() {
+   return dataWrites;
+}
+
+// Returns the number of completed reads.
+unsigned long HD44780Sim::busReadCount() {
+   return busReads;
+}
+
+// Returns the number of protocol violations.
+unsigned long HD44780Sim::violationCount() {
+   return violations;
+}
+
+// Returns the last protocol violation.
+const char *HD44780Sim::lastViolation() {
+   return violationText;
+}
+
+// Resets the counters.
+void HD44780Sim::resetStats() {
+   instructions = 0;
+   dataWrites = 0;
+   busReads = 0;
+   violations = 0;
+   violationText[0] = '\0';
+   resetCounts();
+}
@@ -0,0 +1,150 @@
+#if !defined(HD44780_SIM_H)
+#define HD44780_SIM_H
+
+#include "LCD.h"
+#include "../GPIO/GPIOFakeBackend.h"
+
+// Bytes of character generator RAM: 8 glyphs of 8 rows.
+#define HD44780_CGRAM_SIZE 64
+
+// Minimum width of an E pulse and of a whole E cycle.
+#define HD44780_ENABLE_PULSE_NS 230
+#define HD44780_ENABLE_CYCLE_NS 500
+
+// Software model of a HD44780 controller wired to fake pins. LCD (or any
+// other code) drives RS, RW, E and the data pins through the GPIO layer as
+// it would on hardware, and the model decodes the transitions: a write is
+// latched on the falling edge of E, a read puts the busy flag and address
+// counter (RS low) or RAM contents (RS high) on the data pins while E is high.
+//
+// The model starts in the 8-bit interface mode like a freshly powered
+// controller and follows function set into 4-bit mode, where transfers come
+// in high/low nibble pairs on DB7-DB4. It keeps the display data RAM,
+// character generator RAM, address counter, entry mode, display control and
+// display shift state. The busy flag stays set for the execution time of
+// each instruction, measured on the monotonic clock.
+//
+// Protocol violations are counted and printed to stderr: writing while the
+// controller is busy, E pulses or cycles which are too short, RS or RW
+// changing while E is high, the host driving data pins the controller is
+// driving, nibble pairs which are broken up and invalid addresses.
+class HD44780Sim : public GPIOFakeBackend {
+   public:
+      // Constructor, pins->ctrlPins holds the numDataPins (4 or 8) data pins
+      // starting with DB7. timing gives the execution times, NULL selects
+      // the HD44780 defaults.
+      HD44780Sim(const LCDpins *pins, int numDataPins,
+            const LCDTiming *timing);
+
+      int setValues(const int *pins, int count, uint32_t values);
+      int getValues(const int *pins, int count, uint32_t *values);
+      int setDirection(int pin, int direction);
+      int setDirections(const int *pins, int count, int direction);
+
+      // Copies the width characters of line (0 or 1) currently visible, taking
+      // the display shift into account, into text and terminates it.
+      void readLine(int line, char *text, int width);
+
+      // Returns the display data RAM byte at address.
+      unsigned char getDDRAM(unsigned char address);
+
+      // Returns the 8 rows of the glyph in character generator slot.
+      const unsigned char *getGlyph(int slot);
+
+      // Returns the address counter.
+      unsigned char getAddress();
+
+      // Returns the display shift, in cells to the left.
+      int getShift();
+
+      // Returns the state set by display control and entry mode set.
+      bool isDisplayOn();
+      bool isCursorOn();
+      bool isBlinkOn();
+      bool isIncrement();
+
+      // Returns true once function set selected the 4-bit interface.
+      bool isFourBit();
+
+      // Returns the number of instructions and data bytes written and the
+      // number of busy flag/address and data reads completed.
+      unsigned long instructionCount();
+      unsigned long dataWriteCount();
+      unsigned long busReadCount();
+
+      // Returns the number of protocol violations and the message of the last
+      // one (empty if there was none).
+      unsigned long violationCount();
+      const char *lastViolation();
+
+      // Resets the instruction, data, read and violation counters along with
+      // the backend's operation counters.
+      void resetStats();
+
+   private:
+      // Reacts to the control and data pins after the host changed them.
+      void busChanged(int oldE, int oldRs, int oldRw);
+
+      // Puts the value being read on the data pins.
+      void presentRead();
+
+      // Handles a complete byte written with RS at rsValue.
+      void execute(int rsValue, unsigned char value);
+
+      // Handles an instruction byte.
+      void instruction(unsigned char value);
+
+      // Returns the RAM index of a display data address, or -1 if the address
+      // is not valid in the current line mode.
+      int ddramIndex(unsigned char address);
+
+      // Moves the address counter one step in the entry mode direction.
+      void advance();
+
+      // Returns the level the host drives on the data pins as a byte, DB7 in
+      // bit 7.
+      unsigned char dataByte();
+
+      // Returns true while an instruction is executing.
+      bool busy();
+
+      // Records a protocol violation.
+      void violation(const char *format, ...)
+         __attribute__((format(printf, 2, 3)));
+
+      int rsPin;
+      int rwPin;
+      int ePin;
+      int dataPins[8];
+      int numData;
+      LCDTiming timing;
+
+      unsigned char ddram[LCD_DDRAM_SIZE];
+      unsigned char cgram[HD44780_CGRAM_SIZE];
+      unsigned char address;
+      bool cgramSelected;
+      bool eightBitBus;
+      bool twoLines;
+      bool increment;
+      bool shiftOnWrite;
+      bool displayOn;
+      bool cursorOn;
+      bool blinkOn;
+      int shift;
+      uint64_t busyUntil;
+
+      bool nibblePending;
+      bool pendingRead;
+      int pendingRs;
+      unsigned char pendingHigh;
+      unsigned char readLatch;
+      uint64_t eRiseAt;
+
+      unsigned long instructions;
+      unsigned long dataWrites;
+      unsigned long busReads;
+      unsigned long violations;
+      char violationText[128];
+};
+
+#endif
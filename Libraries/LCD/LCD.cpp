@@ -1,36 +1,121 @@
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include "LCD.h"
+#include "LCDBus.h"
 
 #define FOUR_BIT_MODE 4
 #define EIGHT_BIT_MODE 8
-#define ROW_SHIFT 0x40
 
 using namespace std;
 
-// Constructor.
+// Constructor, waits on the busy flag.
 LCD::LCD(LCDpins *layout, unsigned char xferMode, unsigned char numLines) {
+   init(layout, NULL, xferMode, numLines, LCD_WAIT_BUSY_FLAG, NULL);
+}
+
+// Constructor, uses the specified wait mode and timing.
+LCD::LCD(LCDpins *layout, unsigned char xferMode, unsigned char numLines,
+      unsigned char wait, const LCDTiming *execTiming) {
+   init(layout, NULL, xferMode, numLines, wait, execTiming);
+}
+
+// Constructor, drives a display on a shared bus.
+LCD::LCD(LCDBus *shared, unsigned char ePin, unsigned char numLines,
+      unsigned char wait, const LCDTiming *execTiming) {
+   LCDpins layout = {0, 0, ePin, NULL};
+   init(&layout, shared, shared->mode, numLines, wait, execTiming);
+}
+
+// Sets up the pins and initializes the controller.
+void LCD::init(LCDpins *layout, LCDBus *shared, unsigned char xferMode,
+      unsigned char numLines, unsigned char wait,
+      const LCDTiming *execTiming) {
+   if (wait > LCD_WAIT_HYBRID) {
+      fprintf(stderr, "Unknown wait mode %d, using the busy flag.\n", wait);
+      wait = LCD_WAIT_BUSY_FLAG;
+   }
+   waitMode = wait;
+   sharedBus = NULL;
+   readyAt = 0;
+   nibbleBus = false;
+   enableRaisedAt = 0;
+   setTiming(execTiming);
+
    lineCount = numLines;
    mode = xferMode == FOUR_BIT_MODE || xferMode == EIGHT_BIT_MODE ? xferMode : 0;
    anchorFlag = false;
    blinkFlag = false;
    cursorFlag = false; 
    displayFlag = true;
+   normalPrint = true;
    anchorAddress = 0x00;
+   lineCells = numLines == 0 ? LCD_DDRAM_SIZE : LCD_DDRAM_SIZE / 2;
+   memset(frame, ' ', sizeof(frame));
+   memset(shown, ' ', sizeof(shown));
+   shownValid = false;
+   displayShift = 0;
+   memset(glyphValid, 0, sizeof(glyphValid));
+   memset(glyphPending, 0, sizeof(glyphPending));
+   memset(glyphUsed, 0, sizeof(glyphUsed));
+   memset(glyphPrinted, 0, sizeof(glyphPrinted));
+   glyphClock = 0;
+   glyphUploads = 0;
+   charset = LCD_ROM_A00;
 
    if (mode == 0) {
       fprintf(stderr, "Improper mode, must enter a mode of 4 or 8!\n");
+   } else if (shared != NULL && !shared->attach(this, layout->e)) {
+      mode = 0;
    } else {
-      rs = new GPIO(layout->rs);
-      rw = new GPIO(layout->rw);
+      int index;
+      if (shared != NULL) {
+         sharedBus = shared;
+         bus = shared->bank;
+      } else {
+         // RS, RW and the data pins form one bank so that every transfer is a
+         // single bank write.
+         int busPins[LCD_DATA_SHIFT + EIGHT_BIT_MODE];
+         busPins[LCD_RS_BIT] = layout->rs;
+         busPins[LCD_RW_BIT] = layout->rw;
+
+         for (index = 0; index < mode; ++index) {
+            busPins[LCD_DATA_SHIFT + index] = layout->ctrlPins[index];
+         }
+
+         // Export every pin in one batch so they share the wait for udev.
+         int allPins[LCD_DATA_SHIFT + EIGHT_BIT_MODE + 1];
+         memcpy(allPins, busPins, (LCD_DATA_SHIFT + mode) * sizeof(int));
+         allPins[LCD_DATA_SHIFT + mode] = layout->e;
+         GPIO::exportPins(allPins, LCD_DATA_SHIFT + mode + 1, NULL);
+
+         bus = new GPIOBank(busPins, LCD_DATA_SHIFT + mode);
+      }
+
+      rs = bus->getPin(LCD_RS_BIT);
+      rw = bus->getPin(LCD_RW_BIT);
       e = new GPIO(layout->e);
 
       ctrlPins = (GPIO **)calloc(mode, sizeof(GPIO *));
-      int index;
       for (index = 0; index < mode; ++index) {
-         ctrlPins[index] = new GPIO(layout->ctrlPins[index]);
+         ctrlPins[index] = bus->getPin(LCD_DATA_SHIFT + index);
+      }
+
+      // Precompute the bus word of every data value, ctrlPins[0] receiving
+      // the most significant of the mode bits.
+      dataMask = ((1U << mode) - 1) << LCD_DATA_SHIFT;
+      unsigned int value;
+      for (value = 0; value < 256; ++value) {
+         uint32_t word = 0;
+         for (index = 0; index < mode; ++index) {
+            word |= (uint32_t)(value >> (mode - 1 - index) & 1) <<
+               (LCD_DATA_SHIFT + index);
+         }
+         dataWords[value] = word;
       }
 
       if (mode == FOUR_BIT_MODE) {
@@ -38,6 +123,9 @@ LCD::LCD(LCDpins *layout, unsigned char xferMode, unsigned char numLines) {
       } else {
          eightBitInit();
       }
+
+      // The initialization clears the display data RAM.
+      shownValid = true;
    }
 }
 
@@ -53,29 +141,27 @@ void LCD::eightBitInit() {
       writePins(10);
    }
    clearPins();
+   markBusy(0, 0x30);
 
    // Function set
-   while (busyFlag()) {
-   }
+   waitReady();
    ctrlPins[2]->setValue(1);
    ctrlPins[3]->setValue(1);
    ctrlPins[4]->setValue(lineCount);
    writePins();
    clearPins();
+   markBusy(0, 0x30);
 
    // Display on/off control
-   while (busyFlag()) {
-   }
+   waitReady();
    convertToPins(0x04);
 
    // Display on/off control
-   while (busyFlag()) {
-   }
+   waitReady();
    convertToPins(0x01);
 
    // Entry mode set
-   while (busyFlag()) {
-   }
+   waitReady();
    convertToPins(0x06);
 
    cursor(false);
@@ -93,39 +179,36 @@ void LCD::fourBitInit() {
       writePins(10);
    }
    clearPins();
+   markBusy(0, 0x30);
 
    // Function set number of bits
-   while (busyFlag()) {
-   }
+   waitReady();
    ctrlPins[2]->setValue(1);
    writePins();
    clearPins();
+   markBusy(0, 0x20);
+   nibbleBus = true;
 
    // Function set of lines
-   while (busyFlag()) {
-   }
+   waitReady();
    ctrlPins[2]->setValue(1);
    writePins();
    clearPins();
-   while (busyFlag()) {
-   }
    ctrlPins[0]->setValue(lineCount);
    writePins();
    clearPins();
+   markBusy(0, 0x20);
 
    // Display on/off control
-   while (busyFlag()) {
-   }
+   waitReady();
    convertToPins(0x08);
 
    // Display on/off control
-   while (busyFlag()) {
-   }
+   waitReady();
    convertToPins(0x01);
 
    // Entry mode set
-   while (busyFlag()) {
-   }
+   waitReady();
    convertToPins(0x06);
 
    cursor(false);
@@ -133,15 +216,15 @@ void LCD::fourBitInit() {
 
 // Destructor.
 LCD::~LCD() {
-   delete(rs);
-   delete(rw);
-   delete(e);
-
-   int index;
-   for (index = 0; index < mode; ++index) {
-      delete(ctrlPins[index]);
+   if (mode != 0) {
+      if (sharedBus != NULL) {
+         sharedBus->detach(this);
+      } else {
+         delete(bus);
+      }
+      delete(e);
+      free(ctrlPins);
    }
-   free(ctrlPins);
 }
 
 // Enables the anchor cursor option.
@@ -158,17 +241,25 @@ void LCD::blink(bool enable) {
 
 // Checks the current state of the busy flag.
 bool LCD::busyFlag() {
+   GPIO_PROFILE_SCOPE("busyFlag");
    clearPins();
    rw->setValue(1);
 
-   ctrlPins[0]->setDirection("in");
+   // The controller drives the whole data bus during a read.
+   bus->setDirectionMask(dataMask, "in");
 
-   unsigned char busyFlag = 0;
-   e->setValue(1);
-   busyFlag = ctrlPins[0]->getValue();
-   e->setValue(0);
+   raiseEnable();
+   unsigned char busyFlag = ctrlPins[0]->getValue();
+   lowerEnable();
 
-   ctrlPins[0]->setDirection("out");
+   // In the 4-bit interface the low nibble of the address counter follows
+   // and must be clocked out as well to keep the transfers paired.
+   if (nibbleBus) {
+      raiseEnable();
+      lowerEnable();
+   }
+
+   bus->setDirectionMask(dataMask, "out");
    clearPins();
 
    return busyFlag == 1;
@@ -176,68 +267,62 @@ bool LCD::busyFlag() {
 
 // Clears the display.
 void LCD::clear() {
+   GPIO_PROFILE_SCOPE("clear");
    unsigned char dataPins[] = {0, 0, 0, 0, 0, 0, 0, 1};
    LCDpins pins = {0, 0, 0, dataPins}; 
    command(&pins);
+
+   // Clearing fills the data RAM with spaces, undoes the display shift and
+   // restores increment mode.
+   memset(shown, ' ', sizeof(shown));
+   shownValid = true;
+   normalPrint = true;
+   displayShift = 0;
+   memset(glyphPrinted, 0, sizeof(glyphPrinted));
+}
+
+// Fills the framebuffer with spaces.
+void LCD::clearFrame() {
+   memset(frame, ' ', sizeof(frame));
 }
 
 // Set all pins equal to 0.
 void LCD::clearPins() {
-   rs->setValue(0);
-   rw->setValue(0);
-   int index;
-   for (index = 0; index < mode; ++index) {
-      ctrlPins[index]->setValue(0);
-   }
+   setBus(0, 0, 0);
 }
 
 // Sends the command specified to the LCD.
 void LCD::command(LCDpins *cmd) {
+   GPIO_PROFILE_SCOPE("command");
    signed char count = mode == FOUR_BIT_MODE ? 2 : 1;
    signed char index = 0;
    signed char pinIndex;
+   unsigned char instruction = 0;
 
+   waitReady();
    for (; count > 0; --count) {
-      while (busyFlag()) {
-      }
-
-      rs->setValue(cmd->rs);
-      rw->setValue(cmd->rw);
-
+      unsigned char data = 0;
       for (pinIndex = 0; pinIndex < mode; ++pinIndex) {
-         ctrlPins[pinIndex]->setValue(cmd->ctrlPins[index++]);
+         data = data << 1 | (cmd->ctrlPins[index++] != 0);
       }
+      instruction = instruction << mode | data;
+      setBus(cmd->rs, cmd->rw, data);
       writePins();
    }
    clearPins();
+   markBusy(cmd->rs, instruction);
+
+   if (cmd->rs) {
+      shownValid = false;
+   }
 }
 
 // Converts |character| into pin signals for output.
 void LCD::convertToPins(unsigned char character) {
-   unsigned char mask = 1;
-   unsigned char shift = 8;
-   unsigned char pin;
-   unsigned char count = mode == FOUR_BIT_MODE ? 2 : 1;
-
    unsigned char rsValue = rs->getValue();
-   unsigned char rwValue = rw->getValue();
-
-   while (busyFlag()) {
-   }
-
-   for (; count > 0; --count) {
-
-      rs->setValue(rsValue);
-      rw->setValue(rwValue);
-
-      for (pin = 0; pin < mode; ++pin) {
-         ctrlPins[pin]->setValue(character >> --shift & mask); 
-      }
 
-      writePins();
-   }
-
-   clearPins();
+   waitReady();
+   writeByte(rsValue, character);
 }
 
 // Changes the state of the cursor.
@@ -259,28 +344,510 @@ void LCD::displayOptions() {
    command(&pins);
 }
 
+// Draws text into the framebuffer.
+void LCD::draw(unsigned char line, unsigned char column, const char *text) {
+   draw(line, column, std::string_view(text));
+}
+
+// Draws a piece of text into the framebuffer.
+void LCD::draw(unsigned char line, unsigned char column,
+      std::string_view text) {
+   int index = frameIndex(line, column);
+   if (index < 0) {
+      return;
+   }
+
+   int end = index - column + lineCells;
+   size_t position;
+   for (position = 0; position < text.size() && index < end; ++position) {
+      frame[index++] = text[position];
+   }
+}
+
+// Draws text into the framebuffer at a data RAM address.
+unsigned char LCD::drawAddress(unsigned char address, const char *text,
+      bool reverse) {
+   int index = lineCells == LCD_DDRAM_SIZE ? frameIndex(0, address) :
+      frameIndex(address / ROW_SHIFT, address % ROW_SHIFT);
+   if (index < 0) {
+      return address;
+   }
+
+   int step = reverse ? -1 : 1;
+   for (; *text != '\0'; ++text) {
+      frame[index] = *text;
+      index = (index + step + LCD_DDRAM_SIZE) % LCD_DDRAM_SIZE;
+   }
+   return frameAddress(index);
+}
+
+// Draws one character into the framebuffer.
+void LCD::drawChar(unsigned char line, unsigned char column,
+      unsigned char character) {
+   int index = frameIndex(line, column);
+   if (index >= 0) {
+      frame[index] = character;
+   }
+}
+
+// Draws translated characters into the framebuffer.
+void LCD::drawCodes(unsigned char line, unsigned char column,
+      const uint16_t *codes, size_t count) {
+   int index = frameIndex(line, column);
+   if (index < 0) {
+      return;
+   }
+
+   int end = index - column + lineCells;
+   size_t position;
+   for (position = 0; position < count && index < end; ++position) {
+      frame[index++] = glyphCode(codes[position]);
+   }
+}
+
+// Draws a fixed-point number into the framebuffer.
+void LCD::drawFixed(unsigned char line, unsigned char column, long value,
+      unsigned char decimals, unsigned char width) {
+   char text[LCD_DDRAM_SIZE + 1];
+   int length = formatNumber(text, value, decimals, width, false);
+   draw(line, column, std::string_view(text, length));
+}
+
+// Draws a padded integer into the framebuffer.
+void LCD::drawNumber(unsigned char line, unsigned char column, long value,
+      unsigned char width, bool zeroPad) {
+   char text[LCD_DDRAM_SIZE + 1];
+   int length = formatNumber(text, value, 0, width, zeroPad);
+   draw(line, column, std::string_view(text, length));
+}
+
+// Draws UTF-8 text into the framebuffer.
+void LCD::drawUtf8(unsigned char line, unsigned char column,
+      const char *text) {
+   uint16_t codes[LCD_DDRAM_SIZE];
+   size_t length = strlen(text);
+   size_t position = 0;
+   size_t count = 0;
+   while (position < length && count < LCD_DDRAM_SIZE) {
+      codes[count++] = lcdTranslate(lcdDecodeUtf8(text, length, &position),
+            charset);
+   }
+   drawCodes(line, column, codes, count);
+}
+
+// Draws formatted text into the framebuffer.
+void LCD::drawf(unsigned char line, unsigned char column, const char *format,
+      ...) {
+   char text[LCD_DDRAM_SIZE + 1];
+   va_list args;
+   va_start(args, format);
+   int length = vsnprintf(text, sizeof(text), format, args);
+   va_end(args);
+
+   if (length > 0) {
+      draw(line, column, std::string_view(text, length < (int)sizeof(text) ?
+               length : sizeof(text) - 1));
+   }
+}
+
+// Sends the changed framebuffer cells in runs.
+int LCD::flush() {
+   GPIO_PROFILE_SCOPE("flush");
+   if (mode == 0) {
+      return 0;
+   }
+
+   LCDTransfer transfers[LCD_FLUSH_MAX_TRANSFERS];
+   int cells = 0;
+   int count = planFlush(transfers, &cells);
+
+   int index;
+   for (index = 0; index < count; ++index) {
+      waitReady();
+      writeByte(transfers[index].rs, transfers[index].value);
+   }
+   return cells;
+}
+
+// Returns the data RAM address of a framebuffer cell.
+unsigned char LCD::frameAddress(int index) {
+   return index / lineCells * ROW_SHIFT + index % lineCells;
+}
+
+// Returns the framebuffer index of a cell.
+int LCD::frameIndex(unsigned char line, unsigned char column) {
+   if (line * lineCells >= LCD_DDRAM_SIZE || column >= lineCells) {
+      fprintf(stderr, "Cell %d,%d is off the display.\n", line, column);
+      return -1;
+   }
+   return line * lineCells + column;
+}
+
+// Formats a fixed-point number.
+int LCD::formatNumber(char *text, long value, unsigned char decimals,
+      unsigned char width, bool zeroPad) {
+   if (width > LCD_DDRAM_SIZE) {
+      width = LCD_DDRAM_SIZE;
+   }
+   if (decimals > LCD_MAX_DECIMALS) {
+      decimals = LCD_MAX_DECIMALS;
+   }
+
+   // Digits are produced backwards, least significant first: at most the
+   // 20 of an unsigned long, or a 0 and the decimals.
+   char digits[LCD_MAX_DECIMALS + 1 > 20 ? LCD_MAX_DECIMALS + 1 : 20];
+   int count = 0;
+   unsigned long magnitude = value < 0 ? 0UL - (unsigned long)value : value;
+   do {
+      digits[count++] = '0' + magnitude % 10;
+      magnitude /= 10;
+   } while (magnitude > 0 || count <= decimals);
+
+   int length = count + (decimals > 0) + (value < 0);
+   int padding = width > length ? width - length : 0;
+   if (length + padding > LCD_DDRAM_SIZE) {
+      length = LCD_DDRAM_SIZE;
+      padding = 0;
+   }
+
+   int out = 0;
+   if (!zeroPad) {
+      memset(text, ' ', padding);
+      out = padding;
+   }
+   if (value < 0) {
+      text[out++] = '-';
+   }
+   if (zeroPad) {
+      memset(text + out, '0', padding);
+      out += padding;
+   }
+   for (; count > 0 && out < LCD_DDRAM_SIZE; --count) {
+      if (count == decimals) {
+         text[out++] = '.';
+         if (out == LCD_DDRAM_SIZE) {
+            break;
+         }
+      }
+      text[out++] = digits[count - 1];
+   }
+   text[out] = '\0';
+   return out;
+}
+
+// Returns the display shift.
+int LCD::getDisplayShift() {
+   return displayShift;
+}
+
+// Returns the number of data RAM cells per line.
+unsigned char LCD::getLineCells() {
+   return lineCells;
+}
+
+// Returns the code of a glyph, claiming a slot for it if needed.
+int LCD::glyph(const unsigned char *rows) {
+   int slot = claimGlyph(rows);
+   if (slot < 0) {
+      fprintf(stderr, "Every glyph slot is on display.\n");
+   }
+   return slot;
+}
+
+// Finds or claims the slot of a glyph.
+int LCD::claimGlyph(const unsigned char *rows) {
+   int slot;
+   int victim = -1;
+   for (slot = 0; slot < LCD_GLYPH_SLOTS; ++slot) {
+      if ((glyphValid[slot] || glyphPending[slot]) &&
+            memcmp(glyphRows[slot], rows, LCD_GLYPH_ROWS) == 0) {
+         glyphUsed[slot] = ++glyphClock;
+         return slot;
+      }
+
+      // Slots never used come first, then the least recently used.
+      if ((victim < 0 || glyphUsed[slot] < glyphUsed[victim]) &&
+            !glyphPrinted[slot] && !glyphOnFrame(slot)) {
+         victim = slot;
+      }
+   }
+
+   if (victim < 0) {
+      return -1;
+   }
+
+   memcpy(glyphRows[victim], rows, LCD_GLYPH_ROWS);
+   glyphValid[victim] = false;
+   glyphPending[victim] = true;
+   glyphUsed[victim] = ++glyphClock;
+   return victim;
+}
+
+// Returns the character code of a translated character.
+unsigned char LCD::glyphCode(uint16_t code) {
+   if (code < LCD_CODE_GLYPH) {
+      return code;
+   }
+
+   int slot = glyph(lcdFallbackGlyphs[code - LCD_CODE_GLYPH].rows);
+   return slot < 0 ? LCD_CODE_UNKNOWN : slot;
+}
+
+// Returns true if a framebuffer cell shows the slot.
+bool LCD::glyphOnFrame(int slot) {
+   int index;
+   for (index = 0; index < LCD_DDRAM_SIZE; ++index) {
+      // Codes 8 - 15 mirror the 8 slots.
+      if (frame[index] < 2 * LCD_GLYPH_SLOTS &&
+            frame[index] % LCD_GLYPH_SLOTS == slot) {
+         return true;
+      }
+   }
+   return false;
+}
+
+// Returns the number of glyph uploads.
+unsigned long LCD::glyphUploadCount() {
+   return glyphUploads;
+}
+
+// Forgets the contents of the display.
+void LCD::invalidateFrame() {
+   shownValid = false;
+}
+
+// Returns true if the controller can take the next transfer now.
+bool LCD::isReady() {
+   if (waitMode != LCD_WAIT_BUSY_FLAG && GPIOBackend::monotonicNow() < readyAt) {
+      return false;
+   }
+   return waitMode == LCD_WAIT_TIMED || !busyFlag();
+}
+
+// Drives E low once the minimum pulse width has passed.
+void LCD::lowerEnable() {
+   while (GPIOBackend::monotonicNow() - enableRaisedAt < LCD_ENABLE_PULSE_NS) {
+   }
+   e->setValue(0);
+}
+
+// Starts the execution time of an instruction or data write which was just
+// sent.
+void LCD::markBusy(unsigned char rsValue, unsigned char value) {
+   // Clear display (0x01) and return home (0x02/0x03) are the slow ones.
+   bool slow = rsValue == 0 && (value == 0x01 || (value & 0xFE) == 0x02);
+   readyAt = GPIOBackend::monotonicNow() + (slow ? timing.clearNs :
+         timing.commandNs);
+}
+
 // Moves the cursor to the set address on the LCD.
 void LCD::moveCursor(unsigned short address) {
+   GPIO_PROFILE_SCOPE("moveCursor");
    anchorAddress = address;
-   convertToPins(anchorAddress | 0x80);
+   setAddress(anchorAddress);
 }
 
 // Prints the input string to the LCD on line |line|.
 void LCD::print(const char *message) {
-   signed char index;
-   signed char length = strlen(message);
+   print(std::string_view(message));
+}
 
-   for (index = 0; index < length; ++index) {
+// Prints a piece of text to the LCD.
+void LCD::print(std::string_view message) {
+   GPIO_PROFILE_SCOPE("print");
+   size_t index;
+   for (index = 0; index < message.size(); ++index) {
       printChar(message[index]);
    }
+   shownValid = false;
+
+   if (anchorFlag) {
+      moveCursor(anchorAddress);
+   }
+}
+
+// Prints translated characters to the LCD.
+void LCD::printCodes(const uint16_t *codes, size_t count) {
+   GPIO_PROFILE_SCOPE("print");
+
+   // Claim the glyphs first so their upload does not break up the text, and
+   // keep them from being evicted while the text is on display. Glyphs which
+   // find no slot are printed as LCD_CODE_UNKNOWN.
+   size_t position;
+   for (position = 0; position < count; ++position) {
+      if (codes[position] >= LCD_CODE_GLYPH) {
+         int slot = claimGlyph(
+               lcdFallbackGlyphs[codes[position] - LCD_CODE_GLYPH].rows);
+         if (slot >= 0) {
+            glyphPrinted[slot] = true;
+         }
+      }
+   }
+
+   LCDTransfer transfers[LCD_GLYPH_SLOTS * (LCD_GLYPH_ROWS + 1)];
+   int uploads = planGlyphs(transfers);
+   if (uploads > 0) {
+      unsigned char address = readCurrentAddress();
+      int index;
+      for (index = 0; index < uploads; ++index) {
+         waitReady();
+         writeByte(transfers[index].rs, transfers[index].value);
+      }
+      setAddress(address);
+   }
+
+   // Every slot is claimed or reserved now, so glyphs which found none
+   // still find none.
+   for (position = 0; position < count; ++position) {
+      int code = codes[position];
+      if (code >= LCD_CODE_GLYPH) {
+         int slot = claimGlyph(lcdFallbackGlyphs[code - LCD_CODE_GLYPH].rows);
+         code = slot < 0 ? LCD_CODE_UNKNOWN : slot;
+      }
+      printChar(code);
+   }
+   shownValid = false;
 
    if (anchorFlag) {
       moveCursor(anchorAddress);
    }
 }
 
+// Prints a fixed-point number.
+void LCD::printFixed(long value, unsigned char decimals, unsigned char width) {
+   char text[LCD_DDRAM_SIZE + 1];
+   int length = formatNumber(text, value, decimals, width, false);
+   print(std::string_view(text, length));
+}
+
+// Prints a padded integer.
+void LCD::printNumber(long value, unsigned char width, bool zeroPad) {
+   char text[LCD_DDRAM_SIZE + 1];
+   int length = formatNumber(text, value, 0, width, zeroPad);
+   print(std::string_view(text, length));
+}
+
+// Prints UTF-8 text to the LCD.
+void LCD::printUtf8(const char *text) {
+   uint16_t codes[LCD_DDRAM_SIZE];
+   size_t length = strlen(text);
+   size_t position = 0;
+   size_t count = 0;
+   while (position < length && count < LCD_DDRAM_SIZE) {
+      codes[count++] = lcdTranslate(lcdDecodeUtf8(text, length, &position),
+            charset);
+   }
+   printCodes(codes, count);
+}
+
+// Prints formatted text.
+void LCD::printf(const char *format, ...) {
+   char text[LCD_DDRAM_SIZE + 1];
+   va_list args;
+   va_start(args, format);
+   int length = vsnprintf(text, sizeof(text), format, args);
+   va_end(args);
+
+   if (length > 0) {
+      print(std::string_view(text, length < (int)sizeof(text) ? length :
+               sizeof(text) - 1));
+   }
+}
+
+// Plans the transfers of a flush.
+int LCD::planFlush(LCDTransfer *transfers, int *cells) {
+   // Glyphs go first.
+   int count = planGlyphs(transfers);
+   bool uploaded = count > 0;
+
+   // Rewriting every cell replaces text printed directly, freeing its glyphs.
+   if (!shownValid) {
+      memset(glyphPrinted, 0, sizeof(glyphPrinted));
+   }
+
+   // Cells are visited in the direction the address counter moves, next
+   // being the cell it points at (-1 while unknown).
+   int step = normalPrint ? 1 : -1;
+   int next = -1;
+   int written = 0;
+   int position;
+   for (position = 0; position < LCD_DDRAM_SIZE; ++position) {
+      int index = step > 0 ? position : LCD_DDRAM_SIZE - 1 - position;
+      if (shownValid && frame[index] == shown[index]) {
+         continue;
+      }
+
+      if (index != next) {
+         // Rewriting a single unchanged cell costs the same as moving the
+         // cursor and keeps the run going.
+         if (next >= 0 && (next + step + LCD_DDRAM_SIZE) % LCD_DDRAM_SIZE ==
+               index) {
+            transfers[count].rs = 1;
+            transfers[count++].value = frame[next];
+            ++written;
+         } else {
+            transfers[count].rs = 0;
+            transfers[count++].value = 0x80 | frameAddress(index);
+         }
+      }
+
+      transfers[count].rs = 1;
+      transfers[count++].value = frame[index];
+      shown[index] = frame[index];
+      ++written;
+      next = (index + step + LCD_DDRAM_SIZE) % LCD_DDRAM_SIZE;
+   }
+
+   shownValid = true;
+
+   // An upload leaves the address counter in character generator RAM.
+   if ((written > 0 && anchorFlag) || (uploaded && written == 0)) {
+      transfers[count].rs = 0;
+      transfers[count++].value = 0x80 | anchorAddress;
+   }
+
+   *cells = written;
+   return count;
+}
+
+// Plans the glyph uploads.
+int LCD::planGlyphs(LCDTransfer *transfers) {
+   int count = 0;
+
+   // The rows are written in the direction the address counter moves.
+   int slot;
+   for (slot = 0; slot < LCD_GLYPH_SLOTS; ++slot) {
+      if (!glyphPending[slot]) {
+         continue;
+      }
+
+      int row;
+      transfers[count].rs = 0;
+      if (normalPrint) {
+         transfers[count++].value = 0x40 | slot * LCD_GLYPH_ROWS;
+         for (row = 0; row < LCD_GLYPH_ROWS; ++row) {
+            transfers[count].rs = 1;
+            transfers[count++].value = glyphRows[slot][row] & 0x1F;
+         }
+      } else {
+         transfers[count++].value = 0x40 | (slot * LCD_GLYPH_ROWS +
+               LCD_GLYPH_ROWS - 1);
+         for (row = LCD_GLYPH_ROWS - 1; row >= 0; --row) {
+            transfers[count].rs = 1;
+            transfers[count++].value = glyphRows[slot][row] & 0x1F;
+         }
+      }
+
+      glyphPending[slot] = false;
+      glyphValid[slot] = true;
+      ++glyphUploads;
+   }
+   return count;
+}
+
 // Converts a character into pin signals.
 void LCD::printChar(unsigned char character) {
+   GPIO_PROFILE_SCOPE("printChar");
    rs->setDirection("out");
    rs->setValue(1);
    rw->setDirection("out");
@@ -300,30 +867,43 @@ void LCD::printLCDPins() {
    }
 }
 
+// Drives E high once the minimum cycle time since the last pulse has passed.
+void LCD::raiseEnable() {
+   while (GPIOBackend::monotonicNow() - enableRaisedAt < LCD_ENABLE_CYCLE_NS) {
+   }
+   e->setValue(1);
+   enableRaisedAt = GPIOBackend::monotonicNow();
+}
+
 // Returns the current address of the cursor.
 unsigned char LCD::readCurrentAddress() {
+   GPIO_PROFILE_SCOPE("readCurrentAddress");
+   if (waitMode == LCD_WAIT_TIMED) {
+      // RW is held low, so the address is not read back.
+      return anchorAddress;
+   }
+
    signed char count = mode == FOUR_BIT_MODE ? 2 : 1;
    rw->setValue(1);
 
-   int index;
-   for (index = 0; index < mode; ++index) {
-      ctrlPins[index]->setDirection("in");
-   }
+   bus->setDirectionMask(dataMask, "in");
 
    unsigned char address = 0x00;
    for (; count > 0; --count) {
-      e->setValue(1);
+      raiseEnable();
 
+      uint32_t word = 0;
+      bus->readWord(&word);
+
+      int index;
       for (index = 0; index < mode; ++index) {
-         address = address << 1 | ctrlPins[index]->getValue(); 
+         address = address << 1 | (word >> (LCD_DATA_SHIFT + index) & 1);
       }
 
-      e->setValue(0);
+      lowerEnable();
    }
 
-   for (index = 0; index < mode; ++index) {
-      ctrlPins[index]->setDirection("out");
-   }
+   bus->setDirectionMask(dataMask, "out");
 
    clearPins();
 
@@ -345,18 +925,111 @@ void LCD::reversePrint(bool enable) {
    unsigned char dataPins[] = {0, 0, 0, 0, 0, 1, !enable, 0};
    LCDpins pins = {0, 0, 0, dataPins}; 
    command(&pins);
+   normalPrint = !enable;
+}
+
+// Sets the data RAM address.
+void LCD::setAddress(unsigned char address) {
+   convertToPins(address | 0x80);
+}
+
+// Drives RS, RW and the data pins in one batch.
+void LCD::setBus(unsigned char rsValue, unsigned char rwValue,
+      unsigned char data) {
+   uint32_t word = (rsValue != 0) << LCD_RS_BIT | (rwValue != 0) << LCD_RW_BIT;
+   bus->writeWord(word | dataWords[data & ((1U << mode) - 1)]);
+}
+
+// Selects the character ROM.
+void LCD::setCharset(unsigned char rom) {
+   if (rom > LCD_ROM_A02) {
+      fprintf(stderr, "Unknown character ROM %d.\n", rom);
+      return;
+   }
+   charset = rom;
+}
+
+// Sets the instruction execution times.
+void LCD::setTiming(const LCDTiming *execTiming) {
+   if (execTiming != NULL) {
+      timing = *execTiming;
+   } else {
+      timing.clearNs = LCD_CLEAR_NS;
+      timing.commandNs = LCD_COMMAND_NS;
+   }
+}
+
+// Shifts the display by one cell.
+void LCD::shiftDisplay(bool left) {
+   GPIO_PROFILE_SCOPE("shiftDisplay");
+   unsigned char dataPins[] = {0, 0, 0, 1, 1, !left, 0, 0};
+   LCDpins pins = {0, 0, 0, dataPins};
+   command(&pins);
+   displayShift = (displayShift + (left ? 1 : -1) + lineCells) % lineCells;
+}
+
+// Waits for deadlineNs, spinning through short waits.
+void LCD::waitUntil(uint64_t deadlineNs) {
+   uint64_t now = GPIOBackend::monotonicNow();
+   if (now >= deadlineNs) {
+      return;
+   }
+
+   if (deadlineNs - now <= LCD_SPIN_NS) {
+      while (GPIOBackend::monotonicNow() < deadlineNs) {
+      }
+      return;
+   }
+
+   struct timespec deadline;
+   deadline.tv_sec = deadlineNs / 1000000000ULL;
+   deadline.tv_nsec = deadlineNs % 1000000000ULL;
+   while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+            NULL) == EINTR) {
+   }
+}
+
+// Waits until the controller can take the next transfer.
+void LCD::waitReady() {
+   if (waitMode == LCD_WAIT_BUSY_FLAG) {
+      while (busyFlag()) {
+      }
+      return;
+   }
+
+   waitUntil(readyAt);
+
+   // The model is normally right, so the busy flag is read once to confirm.
+   if (waitMode == LCD_WAIT_HYBRID) {
+      while (busyFlag()) {
+      }
+   }
+}
+
+// Writes a byte to the controller without waiting for it.
+void LCD::writeByte(unsigned char rsValue, unsigned char value) {
+   unsigned char shift = 8;
+   unsigned char count = mode == FOUR_BIT_MODE ? 2 : 1;
+
+   for (; count > 0; --count) {
+      shift -= mode;
+      setBus(rsValue, 0, value >> shift);
+      writePins();
+   }
+
+   clearPins();
+   markBusy(rsValue, value);
 }
 
 // Writes the current state of pins to LCD.
 void LCD::writePins() {
-   e->setValue(1);
-   usleep(50);
-   e->setValue(0);
+   raiseEnable();
+   lowerEnable();
 }
 
 // Writes the current state of pins to LCD.
 void LCD::writePins(unsigned char delay) {
-   e->setValue(1);
+   raiseEnable();
    usleep(delay * 10);
-   e->setValue(0);
+   lowerEnable();
 }
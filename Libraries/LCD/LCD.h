@@ -1,7 +1,74 @@
 #if !defined(LCD_H)
 #define LCD_H
 
+#include <stdarg.h>
+#include <string_view>
 #include "../GPIO/GPIO.h"
+#include "../GPIO/GPIOBank.h"
+#include "../GPIO/GPIOProfile.h"
+#include "LCDCharset.h"
+
+// Bits of the LCD bus word: RS, RW and then the data pins, ctrlPins[0] first.
+#define LCD_RS_BIT 0
+#define LCD_RW_BIT 1
+#define LCD_DATA_SHIFT 2
+
+// Data RAM address of the start of the second line. To adjust for different
+// size LCD displays, edit ROW_SHIFT.
+#define ROW_SHIFT 0x40
+
+// Number of cells of display data RAM: one line of 80 or two lines of 40.
+#define LCD_DDRAM_SIZE 80
+
+// Most decimals of a fixed-point number, so "0." and its digits fit the data
+// RAM.
+#define LCD_MAX_DECIMALS (LCD_DDRAM_SIZE - 2)
+
+// How LCD waits for the controller to finish an instruction: by polling the
+// busy flag, by sleeping for the instruction's modelled execution time (RW may
+// then be tied low), or by sleeping and then confirming with the busy flag.
+#define LCD_WAIT_BUSY_FLAG 0
+#define LCD_WAIT_TIMED 1
+#define LCD_WAIT_HYBRID 2
+
+// Execution times of a HD44780 at 270kHz.
+#define LCD_CLEAR_NS 1520000
+#define LCD_COMMAND_NS 37000
+
+// Number of custom glyphs in character generator RAM and rows of each glyph.
+#define LCD_GLYPH_SLOTS 8
+#define LCD_GLYPH_ROWS 8
+
+// Minimum width of an E pulse and of a whole E cycle. The pulses are timed by
+// spinning since they are far shorter than a sleep.
+#define LCD_ENABLE_PULSE_NS 450
+#define LCD_ENABLE_CYCLE_NS 1000
+
+// Longest wait for an instruction which is spun rather than slept. A sleep
+// overshoots by the timer slack (50us by default), which more than doubles
+// the 37us of most instructions, so only clear and home are slept.
+#define LCD_SPIN_NS 100000
+
+// Instruction execution times, in nanoseconds, used by the timed and hybrid
+// wait modes. Controllers with a slower oscillator or compatible chips with
+// different timing need larger values.
+typedef struct {
+   unsigned int clearNs;
+   unsigned int commandNs;
+} LCDTiming;
+
+// Most transfers one flush() can need: every glyph upload, and every cell
+// preceded by an address.
+#define LCD_FLUSH_MAX_TRANSFERS (LCD_GLYPH_SLOTS * (LCD_GLYPH_ROWS + 1) + \
+      2 * LCD_DDRAM_SIZE + 1)
+
+// One byte for the controller, an instruction (rs 0) or data (rs 1).
+typedef struct {
+   unsigned char rs;
+   unsigned char value;
+} LCDTransfer;
+
+class LCDBus;
 
 // Struct to hold all of the four main pins for the LCD panel.
 typedef struct {
@@ -12,13 +79,26 @@ typedef struct {
 } LCDpins;
 
 // Encapsulates all of the functionality of an LCD display. Supports both 4 bit
-// and 8 bit operation. To adjust for different sizes LCD displays, edit the
-// global variable ROW_SHIFT in the LCD.cpp source file.
+// and 8 bit operation.
 class LCD {
+   friend class LCDBus;
+
    public:
-      // Constructor.
+      // Constructor, waits on the busy flag.
       LCD(LCDpins *pins, unsigned char mode, unsigned char lineCount);
 
+      // Constructor, waits according to waitMode (LCD_WAIT_*). timing gives
+      // the execution times for the timed and hybrid modes, NULL selects the
+      // HD44780 defaults.
+      LCD(LCDpins *pins, unsigned char mode, unsigned char lineCount,
+            unsigned char waitMode, const LCDTiming *timing);
+
+      // Constructor, drives a display which shares the RS, RW and data pins of
+      // bus and is selected by its own E pin e. The display attaches to bus,
+      // which must outlive it.
+      LCD(LCDBus *bus, unsigned char e, unsigned char lineCount,
+            unsigned char waitMode, const LCDTiming *timing);
+
       // Destructor.
       ~LCD();
 
@@ -36,6 +116,9 @@ class LCD {
       // Clears the LCD screen.
       void clear();
 
+      // Fills the framebuffer with spaces. Nothing is sent until flush().
+      void clearFrame();
+
       // Sends the command specified to LCD. A command is a set of pin states
       // that the LCD interprets as an instruction. Many of these instructions
       // have been wrapped by functions in this library, but for the ones that
@@ -46,17 +129,125 @@ class LCD {
       // Enables the display, pass true to enable, false to disable.
       void display(bool enable);
 
+      // Draws text into the framebuffer starting at column of line. Text past
+      // the end of the line is dropped. Nothing is sent until flush().
+      void draw(unsigned char line, unsigned char column, const char *text);
+      void draw(unsigned char line, unsigned char column,
+            std::string_view text);
+
+      // Draws text into the framebuffer starting at a display data RAM
+      // address, advancing (or with reverse, retreating) like the controller's
+      // address counter including its wrap between lines. Returns the address
+      // following the text.
+      unsigned char drawAddress(unsigned char address, const char *text,
+            bool reverse);
+
+      // Draws one character into the framebuffer at column of line.
+      void drawChar(unsigned char line, unsigned char column,
+            unsigned char character);
+
+      // Draws value / 10^decimals as a fixed-point number (e.g. 235 with 1
+      // decimal as 23.5) right aligned in width cells, padded with spaces.
+      // decimals is limited to LCD_MAX_DECIMALS.
+      void drawFixed(unsigned char line, unsigned char column, long value,
+            unsigned char decimals, unsigned char width);
+
+      // Draws value right aligned in width cells, padded with zeros (e.g. 7
+      // in 2 cells as 07 for times) or spaces.
+      void drawNumber(unsigned char line, unsigned char column, long value,
+            unsigned char width, bool zeroPad);
+
+      // Draws text translated at compile time by lcdText() like draw().
+      // Characters missing from the ROM take glyphs as drawUtf8() does.
+      template <size_t Size>
+      void drawText(unsigned char line, unsigned char column,
+            const LCDText<Size> &text) {
+         drawCodes(line, column, text.codes, text.length);
+      }
+
+      // Draws UTF-8 text like draw(), translated to the character ROM chosen
+      // with setCharset(). Characters missing from the ROM are shown with a
+      // glyph from character generator RAM (see glyph()) if there is one in
+      // lcdFallbackGlyphs, as LCD_CODE_UNKNOWN otherwise.
+      void drawUtf8(unsigned char line, unsigned char column,
+            const char *text);
+
+      // Draws printf style formatted text like draw(). The text is formatted
+      // into a buffer on the stack, nothing is allocated.
+      void drawf(unsigned char line, unsigned char column, const char *format,
+            ...) __attribute__((format(printf, 4, 5)));
+
+      // Sends the framebuffer cells which differ from what the display shows.
+      // Contiguous changed cells are written as one run relying on the
+      // controller's address auto-increment, so the cursor is only moved at
+      // the start of each run. Glyphs requested with glyph() are uploaded
+      // first. Returns the number of cells written.
+      int flush();
+
+      // Returns the number of cells the display is shifted to the left by
+      // shiftDisplay(), between 0 and getLineCells() - 1.
+      int getDisplayShift();
+
+      // Returns the number of display data RAM cells of each line: 80 on a
+      // one line display, 40 otherwise.
+      unsigned char getLineCells();
+
+      // Returns the character code (0 - 7) of a custom 5x8 glyph given as
+      // LCD_GLYPH_ROWS rows of 5 bits, for use in the framebuffer. A glyph
+      // already in character generator RAM is reused; otherwise it takes the
+      // least recently used slot no framebuffer cell shows and is uploaded by
+      // the next flush(). Slots of glyphs printed directly by printUtf8() or
+      // printText() are not taken either, until clear() or a flush() which
+      // rewrites every cell. Returns -1 if every slot is on display.
+      int glyph(const unsigned char *rows);
+
+      // Returns the number of glyphs uploaded to character generator RAM.
+      unsigned long glyphUploadCount();
+
+      // Forgets what the display shows so that the next flush() rewrites
+      // every cell, e.g. after the display was reset externally.
+      void invalidateFrame();
+
       // Moves the cursor to the set display address.
       void moveCursor(unsigned short address);
 
       // Prints the input string to the LCD, the printing begins where the
       // cursor is currently anchored or located (if unanchored).
       void print(const char *message);
+      void print(std::string_view message);
+
+      // Prints value / 10^decimals as a fixed-point number, see drawFixed.
+      void printFixed(long value, unsigned char decimals, unsigned char width);
+
+      // Prints value padded to width, see drawNumber.
+      void printNumber(long value, unsigned char width, bool zeroPad);
+
+      // Prints text translated at compile time by lcdText() like print(),
+      // see printUtf8().
+      template <size_t Size>
+      void printText(const LCDText<Size> &text) {
+         printCodes(text.codes, text.length);
+      }
+
+      // Prints UTF-8 text like print(), translated as by drawUtf8(). Glyphs
+      // the text needs are uploaded before it is printed, which needs the
+      // cursor address to be read back: in the timed wait mode such text must
+      // start at the last address the cursor was moved to. Glyphs which find
+      // no free slot (more than 8 distinct ones on display together) are
+      // printed as LCD_CODE_UNKNOWN.
+      void printUtf8(const char *text);
+
+      // Prints printf style formatted text like print(). At most
+      // LCD_DDRAM_SIZE characters are printed and nothing is allocated.
+      void printf(const char *format, ...)
+         __attribute__((format(printf, 2, 3)));
 
       // Prints the current state of the LCD pins.
       void printLCDPins();
 
-      // Returns the current address of the cursor
+      // Returns the current address of the cursor. In the timed wait mode
+      // nothing is read back and the last address the cursor was moved to is
+      // returned.
       unsigned char readCurrentAddress();
 
       // Sends the cursor home on the designated line (line 0 is the first row).
@@ -65,6 +256,25 @@ class LCD {
       // Enables reverse printing, pass true to enable, false otherwise.
       void reversePrint(bool enable);
 
+      // Selects the character ROM of the controller, LCD_ROM_A00 (the
+      // default) or LCD_ROM_A02, for drawUtf8() and printUtf8().
+      void setCharset(unsigned char rom);
+
+      // Changes the execution times of the timed and hybrid wait modes, NULL
+      // selects the HD44780 defaults.
+      void setTiming(const LCDTiming *timing);
+
+      // Shifts the whole display one cell to the left (or right) with a single
+      // instruction, without touching the data RAM. Every line moves and the
+      // lines wrap around within their data RAM. The framebuffer keeps
+      // addressing data RAM, so what is visible at column c of a line is cell
+      // (getDisplayShift() + c) % getLineCells().
+      void shiftDisplay(bool left);
+
+      // Returns once CLOCK_MONOTONIC reaches deadlineNs, spinning if that is
+      // at most LCD_SPIN_NS away and sleeping otherwise.
+      static void waitUntil(uint64_t deadlineNs);
+
    private:
       // Checks the current state of the busy flag, returns true if the LCD
       // controller is busy (must wait for it to be idle before issuing more
@@ -81,16 +291,94 @@ class LCD {
       // Method for updating display state.
       void displayOptions();
 
+      // Draws translated characters (see lcdTranslate()) like draw().
+      void drawCodes(unsigned char line, unsigned char column,
+            const uint16_t *codes, size_t count);
+
       // Eight bit initialization routine.
       void eightBitInit();
 
       // Four bit initialization routine.
       void fourBitInit();
 
+      // Returns the display data RAM address of framebuffer cell index.
+      unsigned char frameAddress(int index);
+
+      // Returns the framebuffer index of column of line, or -1 if it is off
+      // the display data RAM.
+      int frameIndex(unsigned char line, unsigned char column);
+
+      // Writes value / 10^decimals right aligned in width characters into
+      // text (at least LCD_DDRAM_SIZE + 1 long) and terminates it, clamping
+      // decimals to LCD_MAX_DECIMALS. Returns the length.
+      static int formatNumber(char *text, long value, unsigned char decimals,
+            unsigned char width, bool zeroPad);
+
+      // Sets up the pins and initializes the controller. The RS, RW and data
+      // pins are taken from sharedBus when it is not NULL, and from pins
+      // otherwise.
+      void init(LCDpins *pins, LCDBus *sharedBus, unsigned char mode,
+            unsigned char lineCount, unsigned char waitMode,
+            const LCDTiming *timing);
+
+      // Returns true if the controller can take the next transfer now, as the
+      // wait mode tells.
+      bool isReady();
+
+      // Returns the character code showing a translated character, claiming
+      // a glyph for it if needed.
+      unsigned char glyphCode(uint16_t code);
+
+      // Returns the slot of a glyph like glyph(), -1 without an error message
+      // if every slot is on display.
+      int claimGlyph(const unsigned char *rows);
+
+      // Returns true if a framebuffer cell shows glyph slot.
+      bool glyphOnFrame(int slot);
+
+      // Drives E low, waiting for the minimum pulse width first.
+      void lowerEnable();
+
+      // Starts the execution time of the instruction (rsValue 0) or data write
+      // (rsValue 1) of value which was just sent.
+      void markBusy(unsigned char rsValue, unsigned char value);
+
+      // Stores the transfers which bring the display up to date with the
+      // framebuffer in transfers (at least LCD_FLUSH_MAX_TRANSFERS long) and
+      // records them as shown. Returns their number, cells receives the
+      // number of cells among them.
+      int planFlush(LCDTransfer *transfers, int *cells);
+
+      // Stores the transfers which upload the glyphs waiting for upload in
+      // transfers and records them as uploaded. Returns their number.
+      int planGlyphs(LCDTransfer *transfers);
+
+      // Prints translated characters (see lcdTranslate()) like print().
+      void printCodes(const uint16_t *codes, size_t count);
+
       // Writes the specified character to the LCD screen at the current cursor
       // location.
       void printChar(unsigned char character);
 
+      // Drives E high, waiting for the minimum cycle time first.
+      void raiseEnable();
+
+      // Sets the display data RAM address without moving the anchor.
+      void setAddress(unsigned char address);
+
+      // Drives RS, RW and the data pins with a single bank write. The lowest
+      // mode bits of data are placed on the data pins with the most
+      // significant of them on ctrlPins[0].
+      void setBus(unsigned char rsValue, unsigned char rwValue,
+            unsigned char data);
+
+      // Waits until the controller is ready for the next transfer, as the
+      // wait mode dictates.
+      void waitReady();
+
+      // Writes a byte with RS at rsValue without waiting for the controller.
+      void writeByte(unsigned char rsValue, unsigned char value);
+
       // Writes the current state of the object's pins to the LCD.
       void writePins();
 
@@ -110,6 +398,28 @@ class LCD {
       GPIO *rw;
       GPIO *e;
       GPIO **ctrlPins;
+      GPIOBank *bus;
+      LCDBus *sharedBus;
+      uint32_t dataMask;
+      uint32_t dataWords[256];
+      unsigned char lineCells;
+      unsigned char frame[LCD_DDRAM_SIZE];
+      unsigned char shown[LCD_DDRAM_SIZE];
+      bool shownValid;
+      int displayShift;
+      bool nibbleBus;
+      uint64_t enableRaisedAt;
+      unsigned char waitMode;
+      LCDTiming timing;
+      uint64_t readyAt;
+      unsigned char glyphRows[LCD_GLYPH_SLOTS][LCD_GLYPH_ROWS];
+      bool glyphValid[LCD_GLYPH_SLOTS];
+      bool glyphPending[LCD_GLYPH_SLOTS];
+      unsigned long glyphUsed[LCD_GLYPH_SLOTS];
+      bool glyphPrinted[LCD_GLYPH_SLOTS];
+      unsigned long glyphClock;
+      unsigned long glyphUploads;
+      unsigned char charset;
 };
 
 #endif
@@ -0,0 +1,159 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "LCDBus.h"
+
+using namespace std;
+
+// Constructor.
+LCDBus::LCDBus(unsigned char rs, unsigned char rw, unsigned char *dataPins,
+      unsigned char xferMode, const unsigned char *ePins, int ePinCount) {
+   mode = xferMode == 4 || xferMode == 8 ? xferMode : 0;
+   bank = NULL;
+   enableCount = 0;
+   displayCount = 0;
+
+   if (mode == 0) {
+      fprintf(stderr, "Improper mode, must enter a mode of 4 or 8!\n");
+      return;
+   }
+   if (ePinCount > LCD_BUS_MAX_DISPLAYS) {
+      fprintf(stderr, "At most %d displays can share a bus.\n",
+            LCD_BUS_MAX_DISPLAYS);
+      ePinCount = LCD_BUS_MAX_DISPLAYS;
+   }
+
+   int busPins[LCD_DATA_SHIFT + 8];
+   busPins[LCD_RS_BIT] = rs;
+   busPins[LCD_RW_BIT] = rw;
+
+   int index;
+   for (index = 0; index < mode; ++index) {
+      busPins[LCD_DATA_SHIFT + index] = dataPins[index];
+   }
+
+   // Export every pin in one batch so they share the wait for udev.
+   int allPins[LCD_DATA_SHIFT + 8 + LCD_BUS_MAX_DISPLAYS];
+   memcpy(allPins, busPins, (LCD_DATA_SHIFT + mode) * sizeof(int));
+   for (index = 0; index < ePinCount; ++index) {
+      enablePins[index] = ePins[index];
+      allPins[LCD_DATA_SHIFT + mode + index] = ePins[index];
+   }
+   enableCount = ePinCount;
+   GPIO::exportPins(allPins, LCD_DATA_SHIFT + mode + enableCount, NULL);
+
+   bank = new GPIOBank(busPins, LCD_DATA_SHIFT + mode);
+}
+
+// Destructor.
+LCDBus::~LCDBus() {
+   if (displayCount > 0) {
+      fprintf(stderr, "%d displays still use the LCD bus.\n", displayCount);
+   }
+   delete(bank);
+}
+
+// Sends the framebuffer changes of every display, interleaved.
+int LCDBus::flush() {
+   GPIO_PROFILE_SCOPE("busFlush");
+   LCDTransfer transfers[LCD_BUS_MAX_DISPLAYS][LCD_FLUSH_MAX_TRANSFERS];
+   int counts[LCD_BUS_MAX_DISPLAYS];
+   int sent[LCD_BUS_MAX_DISPLAYS];
+   int cells = 0;
+   int remaining = 0;
+
+   int display;
+   for (display = 0; display < displayCount; ++display) {
+      int displayCells = 0;
+      counts[display] = displays[display]->planFlush(transfers[display],
+            &displayCells);
+      sent[display] = 0;
+      cells += displayCells;
+      remaining += counts[display];
+   }
+
+   while (remaining > 0) {
+      bool progress = false;
+      bool polling = false;
+      uint64_t wakeAt = UINT64_MAX;
+
+      for (display = 0; display < displayCount; ++display) {
+         if (sent[display] == counts[display]) {
+            continue;
+         }
+
+         LCD *lcd = displays[display];
+         if (lcd->isReady()) {
+            LCDTransfer *next = &transfers[display][sent[display]++];
+            lcd->writeByte(next->rs, next->value);
+            --remaining;
+            progress = true;
+         } else if (lcd->waitMode == LCD_WAIT_BUSY_FLAG ||
+               GPIOBackend::monotonicNow() >= lcd->readyAt) {
+            // Only the busy flag tells when this one is done.
+            polling = true;
+         } else if (lcd->readyAt < wakeAt) {
+            wakeAt = lcd->readyAt;
+         }
+      }
+
+      // Every display is executing for a known time, wait until the first
+      // one is done.
+      if (!progress && !polling) {
+         LCD::waitUntil(wakeAt);
+      }
+   }
+
+   return cells;
+}
+
+// Returns the number of displays on the bus.
+int LCDBus::getDisplayCount() {
+   return displayCount;
+}
+
+// Adds a display to the bus.
+bool LCDBus::attach(LCD *lcd, unsigned char ePin) {
+   if (mode == 0) {
+      return false;
+   }
+   if (displayCount == LCD_BUS_MAX_DISPLAYS) {
+      fprintf(stderr, "At most %d displays can share a bus.\n",
+            LCD_BUS_MAX_DISPLAYS);
+      return false;
+   }
+
+   int index;
+   for (index = 0; index < displayCount; ++index) {
+      if (displayEnables[index] == ePin) {
+         fprintf(stderr, "E pin %d is already used on the LCD bus.\n", ePin);
+         return false;
+      }
+   }
+
+   // Pins not given to the constructor are exported on their own.
+   for (index = 0; index < enableCount && enablePins[index] != ePin;
+         ++index) {
+   }
+   if (index == enableCount) {
+      int pin = ePin;
+      GPIO::exportPins(&pin, 1, NULL);
+   }
+
+   displays[displayCount] = lcd;
+   displayEnables[displayCount++] = ePin;
+   return true;
+}
+
+// Removes a display from the bus.
+void LCDBus::detach(LCD *lcd) {
+   int index;
+   for (index = 0; index < displayCount; ++index) {
+      if (displays[index] == lcd) {
+         --displayCount;
+         displays[index] = displays[displayCount];
+         displayEnables[index] = displayEnables[displayCount];
+         return;
+      }
+   }
+}
@@ -0,0 +1,59 @@
+#if !defined(LCD_BUS_H)
+#define LCD_BUS_H
+
+#include "LCD.h"
+
+// Largest number of displays which can share one bus.
+#define LCD_BUS_MAX_DISPLAYS 4
+
+// RS, RW and data pins shared by several HD44780 displays, each selected by
+// its own E pin. A controller ignores the bus while its E is low, so one set
+// of pins can drive a clock panel and a status panel alike. The bus owns the
+// shared pins once; each display is an LCD constructed on the bus with its E
+// pin, and is then used like any other LCD.
+//
+// flush() sends the framebuffer changes of every display at once. It plans
+// the transfers of each display and then hands out one byte at a time to
+// whichever display is ready, so the execution time of one controller is
+// spent sending to the others instead of waiting. With the timed wait mode the
+// aggregate throughput approaches that of one display times the number of
+// displays, as long as sending a byte is quicker than executing it.
+class LCDBus {
+   friend class LCD;
+
+   public:
+      // Constructor, exports rs, rw, the mode (4 or 8) data pins in dataPins
+      // (DB7 first, like LCDpins::ctrlPins) and the enableCount E pins of the
+      // displays in one batch.
+      LCDBus(unsigned char rs, unsigned char rw, unsigned char *dataPins,
+            unsigned char mode, const unsigned char *enablePins,
+            int enableCount);
+
+      // Destructor, the displays must be deleted first.
+      ~LCDBus();
+
+      // Sends the framebuffer changes of every display on the bus, interleaving
+      // the transfers of the displays. Returns the number of cells written.
+      int flush();
+
+      // Returns the number of displays on the bus.
+      int getDisplayCount();
+
+   private:
+      // Adds a display selected by ePin. Returns false if the bus is full or
+      // another display uses ePin.
+      bool attach(LCD *lcd, unsigned char ePin);
+
+      // Removes a display.
+      void detach(LCD *lcd);
+
+      unsigned char mode;
+      GPIOBank *bank;
+      int enablePins[LCD_BUS_MAX_DISPLAYS];
+      int enableCount;
+      LCD *displays[LCD_BUS_MAX_DISPLAYS];
+      unsigned char displayEnables[LCD_BUS_MAX_DISPLAYS];
+      int displayCount;
+};
+
+#endif
@@ -0,0 +1,204 @@
+#if !defined(LCD_CHARSET_H)
+#define LCD_CHARSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Character ROMs (code pages) a HD44780 is made with: A00 holds ASCII, the
+// katakana of JIS X 0201 and some Greek and math symbols, A02 holds ASCII and
+// the Latin-1 letters.
+#define LCD_ROM_A00 0
+#define LCD_ROM_A02 1
+
+// Translated characters at or above LCD_CODE_GLYPH are not in the ROM and
+// stand for lcdFallbackGlyphs[code - LCD_CODE_GLYPH], to be shown from
+// character generator RAM.
+#define LCD_CODE_GLYPH 0x100
+
+// ROM code of characters which are neither in the ROM nor have a glyph.
+#define LCD_CODE_UNKNOWN '?'
+
+// A character of a ROM outside the ASCII range it shares with Unicode.
+typedef struct {
+   uint32_t codePoint;
+   unsigned char code;
+} LCDRomEntry;
+
+// A character missing from the ROMs, drawn as 8 rows of 5 bits like the
+// glyphs of LCD::glyph().
+typedef struct {
+   uint32_t codePoint;
+   unsigned char rows[8];
+} LCDFallbackGlyph;
+
+constexpr LCDRomEntry lcdRomA00[] = {
+   {0x00A2, 0xEC}, // cent
+   {0x00A5, 0x5C}, // yen, in place of the backslash
+   {0x00B0, 0xDF}, // degree
+   {0x00B5, 0xE4}, // micro
+   {0x00B7, 0xA5}, // middle dot
+   {0x00DF, 0xE2}, // sharp s, shown as beta
+   {0x00E4, 0xE1}, // a umlaut
+   {0x00F1, 0xEE}, // n tilde
+   {0x00F6, 0xEF}, // o umlaut
+   {0x00F7, 0xFD}, // division
+   {0x00FC, 0xF5}, // u umlaut
+   {0x03A3, 0xF6}, // Sigma
+   {0x03A9, 0xF4}, // Omega
+   {0x03B1, 0xE0}, // alpha
+   {0x03B2, 0xE2}, // beta
+   {0x03B5, 0xE3}, // epsilon
+   {0x03B8, 0xF2}, // theta
+   {0x03BC, 0xE4}, // mu
+   {0x03C0, 0xF7}, // pi
+   {0x03C1, 0xE6}, // rho
+   {0x03C3, 0xE5}, // sigma
+   {0x2190, 0x7F}, // left arrow
+   {0x2192, 0x7E}, // right arrow, in place of the tilde
+   {0x221A, 0xE8}, // square root
+   {0x221E, 0xF3}, // infinity
+   {0x2588, 0xFF}, // full block
+   {0x30FB, 0xA5}, // katakana middle dot
+};
+
+constexpr LCDFallbackGlyph lcdFallbackGlyphs[] = {
+   {0x005C, {0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00, 0x00}}, // backslash
+   {0x007E, {0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00, 0x00}}, // tilde
+   {0x00C4, {0x0A, 0x00, 0x0E, 0x11, 0x1F, 0x11, 0x11, 0x00}}, // A umlaut
+   {0x00D6, {0x0A, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E, 0x00}}, // O umlaut
+   {0x00DC, {0x0A, 0x00, 0x11, 0x11, 0x11, 0x11, 0x0E, 0x00}}, // U umlaut
+   {0x00E0, {0x08, 0x04, 0x0E, 0x01, 0x0F, 0x11, 0x0F, 0x00}}, // a grave
+   {0x00E5, {0x04, 0x0A, 0x0E, 0x01, 0x0F, 0x11, 0x0F, 0x00}}, // a ring
+   {0x00E7, {0x00, 0x0E, 0x10, 0x10, 0x11, 0x0E, 0x04, 0x0C}}, // c cedilla
+   {0x00E8, {0x08, 0x04, 0x0E, 0x11, 0x1F, 0x10, 0x0E, 0x00}}, // e grave
+   {0x00E9, {0x02, 0x04, 0x0E, 0x11, 0x1F, 0x10, 0x0E, 0x00}}, // e acute
+   {0x00EA, {0x04, 0x0A, 0x0E, 0x11, 0x1F, 0x10, 0x0E, 0x00}}, // e circumflex
+   {0x20AC, {0x06, 0x09, 0x1C, 0x08, 0x1C, 0x09, 0x06, 0x00}}, // euro
+   {0x2190, {0x00, 0x04, 0x08, 0x1F, 0x08, 0x04, 0x00, 0x00}}, // left arrow
+   {0x2191, {0x04, 0x0E, 0x15, 0x04, 0x04, 0x04, 0x04, 0x00}}, // up arrow
+   {0x2192, {0x00, 0x04, 0x02, 0x1F, 0x02, 0x04, 0x00, 0x00}}, // right arrow
+   {0x2193, {0x04, 0x04, 0x04, 0x04, 0x15, 0x0E, 0x04, 0x00}}, // down arrow
+};
+
+// Translation of the code points below 0x100 for one ROM, built at compile
+// time so that the common characters take a single lookup.
+struct LCDCharsetTable {
+   uint16_t latin[256];
+
+   constexpr LCDCharsetTable(unsigned char rom) : latin() {
+      uint32_t codePoint = 0;
+      for (codePoint = 0; codePoint < 256; ++codePoint) {
+         latin[codePoint] = lookup(rom, codePoint);
+      }
+   }
+
+   // Translates a code point by searching the ROM and glyph lists.
+   static constexpr uint16_t lookup(unsigned char rom, uint32_t codePoint) {
+      // Codes 0 - 15 are the character generator RAM glyphs of LCD::glyph()
+      // and pass through.
+      if (codePoint < 0x10) {
+         return codePoint;
+      }
+
+      bool ascii = codePoint >= 0x20 && codePoint < 0x7F;
+      if (rom == LCD_ROM_A02) {
+         if (ascii || (codePoint >= 0xA0 && codePoint < 0x100)) {
+            return codePoint;
+         }
+      } else {
+         if (ascii && codePoint != 0x5C && codePoint != 0x7E) {
+            return codePoint;
+         }
+
+         // Halfwidth katakana follow JIS X 0201.
+         if (codePoint >= 0xFF61 && codePoint <= 0xFF9F) {
+            return codePoint - 0xFF61 + 0xA1;
+         }
+
+         size_t index = 0;
+         for (index = 0; index < sizeof(lcdRomA00) / sizeof(lcdRomA00[0]);
+               ++index) {
+            if (lcdRomA00[index].codePoint == codePoint) {
+               return lcdRomA00[index].code;
+            }
+         }
+      }
+
+      size_t index = 0;
+      for (index = 0; index < sizeof(lcdFallbackGlyphs) /
+            sizeof(lcdFallbackGlyphs[0]); ++index) {
+         if (lcdFallbackGlyphs[index].codePoint == codePoint) {
+            return LCD_CODE_GLYPH + index;
+         }
+      }
+      return LCD_CODE_UNKNOWN;
+   }
+};
+
+constexpr LCDCharsetTable lcdCharsets[] = {
+   LCDCharsetTable(LCD_ROM_A00),
+   LCDCharsetTable(LCD_ROM_A02),
+};
+
+// Translates a code point for rom (LCD_ROM_*) into a ROM code (0 - 255) or
+// LCD_CODE_GLYPH plus the index of a fallback glyph.
+constexpr uint16_t lcdTranslate(uint32_t codePoint, unsigned char rom) {
+   return codePoint < 256 ? lcdCharsets[rom].latin[codePoint] :
+      LCDCharsetTable::lookup(rom, codePoint);
+}
+
+// Decodes the UTF-8 sequence at text[*position] (text being length bytes long)
+// and advances *position past it. Malformed sequences decode to U+FFFD one
+// byte at a time.
+constexpr uint32_t lcdDecodeUtf8(const char *text, size_t length,
+      size_t *position) {
+   unsigned char lead = text[*position];
+   ++*position;
+   if (lead < 0x80) {
+      return lead;
+   }
+
+   int extra = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : -1;
+   if (extra < 0 || *position + extra > length) {
+      return 0xFFFD;
+   }
+
+   uint32_t codePoint = lead & (0x3F >> extra);
+   int index = 0;
+   for (index = 0; index < extra; ++index) {
+      unsigned char next = text[*position + index];
+      if ((next & 0xC0) != 0x80) {
+         return 0xFFFD;
+      }
+      codePoint = codePoint << 6 | (next & 0x3F);
+   }
+   *position += extra;
+   return codePoint;
+}
+
+// Text translated for a ROM, see lcdText().
+template <size_t Size>
+struct LCDText {
+   uint16_t codes[Size];
+   size_t length;
+};
+
+// Translates a UTF-8 string literal for the ROM at compile time when used to
+// initialize a constexpr variable, e.g.
+//
+//    constexpr auto label = lcdText<LCD_ROM_A00>("Küche 21°C");
+//    lcd.drawText(0, 0, label);
+//
+// so printing the text does no decoding.
+template <unsigned char Rom, size_t Size>
+constexpr LCDText<Size> lcdText(const char (&utf8)[Size]) {
+   LCDText<Size> text = {};
+   size_t position = 0;
+   while (position < Size - 1 && utf8[position] != '\0') {
+      text.codes[text.length++] = lcdTranslate(lcdDecodeUtf8(utf8, Size - 1,
+               &position), Rom);
+   }
+   return text;
+}
+
+#endif
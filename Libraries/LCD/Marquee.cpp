@@ -0,0 +1,190 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "Marquee.h"
+
+using namespace std;
+
+// Constructor.
+Marquee::Marquee(LCD *display, unsigned char visibleWidth) {
+   lcd = display;
+   width = visibleWidth < lcd->getLineCells() ? visibleWidth :
+      lcd->getLineCells();
+   timerFd = -1;
+   hardwareLine = -1;
+   memset(used, 0, sizeof(used));
+   memset(scrolling, 0, sizeof(scrolling));
+   memset(offsets, 0, sizeof(offsets));
+   memset(texts, 0, sizeof(texts));
+}
+
+// Destructor.
+Marquee::~Marquee() {
+   stop();
+}
+
+// Sets the text of a line.
+void Marquee::setLine(unsigned char line, const char *text, bool scroll) {
+   int lines = LCD_DDRAM_SIZE / lcd->getLineCells();
+   if (line >= lines || line >= MARQUEE_MAX_LINES) {
+      fprintf(stderr, "Line %d exceeds max LCD lines of %d (starting from 0).\n",
+            line, lines - 1);
+      return;
+   }
+
+   used[line] = true;
+   scrolling[line] = scroll;
+   offsets[line] = 0;
+   strncpy(texts[line], text, MARQUEE_MAX_TEXT);
+   texts[line][MARQUEE_MAX_TEXT] = '\0';
+
+   layout(line);
+   render();
+}
+
+// Starts the frame timer.
+bool Marquee::start(int framesPerSecond) {
+   if (framesPerSecond <= 0) {
+      fprintf(stderr, "The frame rate must be positive.\n");
+      return false;
+   }
+
+   if (timerFd < 0) {
+      timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+      if (timerFd < 0) {
+         fprintf(stderr, "Unable to create the marquee timer.\n");
+         return false;
+      }
+   }
+
+   struct itimerspec period;
+   period.it_interval.tv_sec = 0;
+   period.it_interval.tv_nsec = 1000000000L / framesPerSecond;
+   if (framesPerSecond == 1) {
+      period.it_interval.tv_sec = 1;
+      period.it_interval.tv_nsec = 0;
+   }
+   period.it_value = period.it_interval;
+
+   if (timerfd_settime(timerFd, 0, &period, NULL) < 0) {
+      fprintf(stderr, "Unable to start the marquee timer.\n");
+      return false;
+   }
+   return true;
+}
+
+// Stops the frame timer.
+void Marquee::stop() {
+   if (timerFd >= 0) {
+      close(timerFd);
+      timerFd = -1;
+   }
+}
+
+// Returns the timer descriptor.
+int Marquee::getFd() {
+   return timerFd;
+}
+
+// Advances by the frames which are due.
+int Marquee::update() {
+   uint64_t expirations = 0;
+   if (timerFd < 0 || read(timerFd, &expirations, sizeof(expirations)) !=
+         sizeof(expirations)) {
+      return 0;
+   }
+
+   // After a long stall, catching up by more than a whole turn is pointless.
+   int frames = expirations < lcd->getLineCells() ? (int)expirations :
+      lcd->getLineCells();
+   advance(frames);
+   return frames;
+}
+
+// Advances by one frame.
+void Marquee::step() {
+   advance(1);
+}
+
+// Moves every scrolling line and redraws the software lines.
+void Marquee::advance(int frames) {
+   int frame;
+   for (frame = 0; frame < frames; ++frame) {
+      if (hardwareLine >= 0) {
+         lcd->shiftDisplay(true);
+      }
+   }
+
+   int line;
+   for (line = 0; line < MARQUEE_MAX_LINES; ++line) {
+      if (used[line] && scrolling[line] && line != hardwareLine) {
+         offsets[line] += frames;
+      }
+   }
+
+   render();
+}
+
+// Chooses the line moved by the display shift and writes its text once.
+void Marquee::layout(int changedLine) {
+   int cells = lcd->getLineCells();
+   int previousLine = hardwareLine;
+   hardwareLine = -1;
+
+   int line;
+   for (line = 0; line < MARQUEE_MAX_LINES; ++line) {
+      if (used[line] && scrolling[line] && (int)strlen(texts[line]) <= cells) {
+         hardwareLine = line;
+         break;
+      }
+   }
+
+   // A line already on the shift keeps its position unless its text changed.
+   if (hardwareLine < 0 || (hardwareLine == previousLine &&
+            hardwareLine != changedLine)) {
+      return;
+   }
+
+   // The text starts at the visible left edge and the rest of the data RAM
+   // line is padded, so the shift wraps around to the start of the text.
+   int shift = lcd->getDisplayShift();
+   int length = strlen(texts[hardwareLine]);
+   int cell;
+   for (cell = 0; cell < cells; ++cell) {
+      lcd->drawChar(hardwareLine, (shift + cell) % cells,
+            cell < length ? texts[hardwareLine][cell] : ' ');
+   }
+}
+
+// Draws the software lines at the columns currently visible.
+void Marquee::render() {
+   int cells = lcd->getLineCells();
+   int shift = lcd->getDisplayShift();
+
+   int line;
+   for (line = 0; line < MARQUEE_MAX_LINES; ++line) {
+      if (!used[line] || line == hardwareLine) {
+         continue;
+      }
+
+      const char *text = texts[line];
+      int length = strlen(text);
+      int period = length + MARQUEE_GAP;
+
+      int column;
+      for (column = 0; column < cells; ++column) {
+         char character = ' ';
+         if (column < width && scrolling[line]) {
+            int position = (offsets[line] + column) % period;
+            character = position < length ? text[position] : ' ';
+         } else if (column < width && column < length) {
+            character = text[column];
+         }
+         lcd->drawChar(line, (shift + column) % cells, character);
+      }
+   }
+
+   lcd->flush();
+}
@@ -0,0 +1,72 @@
+#if !defined(MARQUEE_H)
+#define MARQUEE_H
+
+#include "LCD.h"
+
+// Lines a marquee manages and the longest text of a line.
+#define MARQUEE_MAX_LINES 2
+#define MARQUEE_MAX_TEXT LCD_DDRAM_SIZE
+
+// Spaces between the end of a software scrolled text and its next repetition.
+#define MARQUEE_GAP 4
+
+// Scrolls text across an LCD at a fixed frame rate using the controller's
+// display shift, so a frame costs one instruction instead of a rewrite of the
+// line. The first scrolling line which fits into its data RAM line is written
+// once and then moved with LCD::shiftDisplay(). Since the shift moves every
+// line, the other lines (static ones, or scrolling ones which do not fit) are
+// redrawn relative to the shift through the LCD framebuffer each frame, which
+// only sends the cells that change.
+//
+// Frames are paced by a timerfd. Either call update() whenever getFd() polls
+// readable, or call step() directly.
+class Marquee {
+   public:
+      // Constructor, width is the number of visible columns of lcd.
+      Marquee(LCD *lcd, unsigned char width);
+
+      // Destructor, stops the timer.
+      ~Marquee();
+
+      // Shows text on line, scrolling it one cell to the left per frame if
+      // scroll is true and keeping it in place otherwise.
+      void setLine(unsigned char line, const char *text, bool scroll);
+
+      // Starts the frame timer. Returns true on success.
+      bool start(int framesPerSecond);
+
+      // Stops the frame timer.
+      void stop();
+
+      // Returns the timer descriptor, readable when frames are due.
+      int getFd();
+
+      // Advances by the frames which are due (possibly none). Returns their
+      // number.
+      int update();
+
+      // Advances by one frame.
+      void step();
+
+   private:
+      // Advances by frames frames and redraws the software lines once.
+      void advance(int frames);
+
+      // Picks the line moved by the display shift and writes it out, unless
+      // it already was on the shift and changedLine is another line.
+      void layout(int changedLine);
+
+      // Draws the software lines for the current display shift.
+      void render();
+
+      LCD *lcd;
+      unsigned char width;
+      int timerFd;
+      int hardwareLine;
+      bool used[MARQUEE_MAX_LINES];
+      bool scrolling[MARQUEE_MAX_LINES];
+      int offsets[MARQUEE_MAX_LINES];
+      char texts[MARQUEE_MAX_LINES][MARQUEE_MAX_TEXT + 1];
+};
+
+#endif
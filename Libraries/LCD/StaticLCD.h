@@ -0,0 +1,382 @@
+#if !defined(STATIC_LCD_H)
+#define STATIC_LCD_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "LCD.h"
+
+// Bus tables of a StaticLCD, generated at compile time from the pin map.
+// busPins lists RS, RW and the data pins in LCD bus word order, and writes holds
+// the bus words of the 8 / Mode transfers of every byte (high nibble first).
+// reads turns the data pins read as a word back into the bits they carry.
+template <unsigned char Mode, typename PinMap>
+struct StaticLCDTables {
+   int busPins[LCD_DATA_SHIFT + Mode];
+   int dataPins[Mode];
+   uint32_t writes[256][8 / Mode];
+   unsigned char reads[1 << Mode];
+
+   constexpr StaticLCDTables() : busPins(), dataPins(), writes(), reads() {
+      busPins[LCD_RS_BIT] = PinMap::rs;
+      busPins[LCD_RW_BIT] = PinMap::rw;
+
+      int index = 0;
+      for (index = 0; index < Mode; ++index) {
+         busPins[LCD_DATA_SHIFT + index] = PinMap::data[index];
+         dataPins[index] = PinMap::data[index];
+      }
+
+      // As in LCD, data[0] receives the most significant bit of a transfer.
+      int value = 0;
+      for (value = 0; value < 256; ++value) {
+         int transfer = 0;
+         for (transfer = 0; transfer < 8 / Mode; ++transfer) {
+            int bits = value >> (8 - (transfer + 1) * Mode) & ((1 << Mode) - 1);
+            uint32_t word = 0;
+            for (index = 0; index < Mode; ++index) {
+               word |= (uint32_t)(bits >> (Mode - 1 - index) & 1) <<
+                  (LCD_DATA_SHIFT + index);
+            }
+            writes[value][transfer] = word;
+         }
+      }
+
+      for (value = 0; value < (1 << Mode); ++value) {
+         for (index = 0; index < Mode; ++index) {
+            reads[value] |= (value >> index & 1) << (Mode - 1 - index);
+         }
+      }
+   }
+};
+
+// An HD44780 display whose bus width (Mode, 4 or 8), number of lines (Lines,
+// 1 or 2), pins and wait mode (LCD_WAIT_*) are fixed at compile time. PinMap
+// is a type with static constexpr members rs, rw, e and data[Mode], the data
+// pins starting with DB7 like LCDpins::ctrlPins, e.g.
+//
+//    struct BoardPins {
+//       static constexpr int rs = 30, rw = 31, e = 48;
+//       static constexpr int data[4] = {60, 61, 62, 63};
+//    };
+//    StaticLCD<4, 2, BoardPins> lcd;
+//
+// The pin numbers and the byte to bus word tables are compile time constants,
+// so a transfer is a table lookup and one backend call per nibble or byte,
+// with the mode checks folded away. There are no GPIO objects: the pins are
+// driven straight through the backend, with a shadow copy of the bus word
+// eliding writes which change nothing. Nothing is allocated.
+//
+// The calls mirror the instruction level ones of LCD. The framebuffer and
+// glyph cache stay with LCD, which remains the choice when the pins are only
+// known at run time.
+template <unsigned char Mode, unsigned char Lines, typename PinMap,
+         unsigned char WaitMode = LCD_WAIT_BUSY_FLAG>
+class StaticLCD {
+   static_assert(Mode == 4 || Mode == 8, "Mode must be 4 or 8");
+   static_assert(Lines == 1 || Lines == 2, "Lines must be 1 or 2");
+   static_assert(WaitMode <= LCD_WAIT_HYBRID, "Unknown wait mode");
+
+   public:
+      // Number of display data RAM cells of each line.
+      static constexpr unsigned char lineCells = LCD_DDRAM_SIZE / Lines;
+
+      // Constructor, drives the pins through the default backend.
+      StaticLCD() {
+         init(GPIOBackend::getDefault());
+      }
+
+      // Constructor, drives the pins through the specified backend.
+      StaticLCD(GPIOBackend *gpioBackend) {
+         init(gpioBackend);
+      }
+
+      // Anchors the cursor at its current location such that it will always
+      // print starting from that location, pass true to anchor, false to
+      // unanchor.
+      void anchorCursor(bool enable) {
+         anchorFlag = enable;
+         anchorAddress = readCurrentAddress();
+      }
+
+      // Enables cursor blinking, pass true to enable, false to disable.
+      void blink(bool enable) {
+         blinkFlag = enable;
+         displayOptions();
+      }
+
+      // Clears the LCD screen.
+      void clear() {
+         GPIO_PROFILE_SCOPE("clear");
+         transfer(0, 0x01);
+         anchorAddress = 0x00;
+      }
+
+      // Sends a raw command, see LCD::command.
+      void command(const LCDpins *cmd) {
+         GPIO_PROFILE_SCOPE("command");
+         unsigned char value = 0;
+         int index;
+         for (index = 0; index < 8; ++index) {
+            value = value << 1 | (cmd->ctrlPins[index] != 0);
+         }
+         transfer(cmd->rs, value);
+      }
+
+      // Enables the cursor, pass true to enable, false to disable.
+      void cursor(bool enable) {
+         cursorFlag = enable;
+         displayOptions();
+      }
+
+      // Enables the display, pass true to enable, false to disable.
+      void display(bool enable) {
+         displayFlag = enable;
+         displayOptions();
+      }
+
+      // Moves the cursor to the set display address.
+      void moveCursor(unsigned char address) {
+         GPIO_PROFILE_SCOPE("moveCursor");
+         anchorAddress = address;
+         transfer(0, 0x80 | address);
+      }
+
+      // Prints the input string at the anchor or the cursor.
+      void print(const char *message) {
+         GPIO_PROFILE_SCOPE("print");
+         for (; *message != '\0'; ++message) {
+            transfer(1, *message);
+         }
+
+         if (anchorFlag) {
+            moveCursor(anchorAddress);
+         }
+      }
+
+      // Returns the current address of the cursor. In the timed wait mode
+      // nothing is read back and the last address the cursor was moved to is
+      // returned.
+      unsigned char readCurrentAddress() {
+         GPIO_PROFILE_SCOPE("readCurrentAddress");
+         if (WaitMode == LCD_WAIT_TIMED) {
+            return anchorAddress;
+         }
+         return readByte(0) & 0x7F;
+      }
+
+      // Sends the cursor home on the designated line (line 0 is the first row).
+      void returnHome(unsigned char line) {
+         if (line < Lines) {
+            moveCursor(line * ROW_SHIFT);
+         } else {
+            fprintf(stderr, "Line %d exceeds max LCD lines of %d (starting "
+                  "from 0).\n", line, Lines - 1);
+         }
+      }
+
+      // Enables reverse printing, pass true to enable, false otherwise.
+      void reversePrint(bool enable) {
+         transfer(0, enable ? 0x04 : 0x06);
+      }
+
+      // Changes the execution times of the timed and hybrid wait modes, NULL
+      // selects the HD44780 defaults.
+      void setTiming(const LCDTiming *execTiming) {
+         if (execTiming != NULL) {
+            timing = *execTiming;
+         } else {
+            timing.clearNs = LCD_CLEAR_NS;
+            timing.commandNs = LCD_COMMAND_NS;
+         }
+      }
+
+      // Shifts the whole display one cell to the left (or right), see
+      // LCD::shiftDisplay.
+      void shiftDisplay(bool left) {
+         GPIO_PROFILE_SCOPE("shiftDisplay");
+         transfer(0, left ? 0x18 : 0x1C);
+      }
+
+   private:
+      static constexpr StaticLCDTables<Mode, PinMap> tables = {};
+      static constexpr int busCount = LCD_DATA_SHIFT + Mode;
+
+      // Exports the pins and initializes the controller.
+      void init(GPIOBackend *gpioBackend) {
+         backend = gpioBackend;
+         busWord = 0;
+         dataInput = false;
+         enableRaisedAt = 0;
+         readyAt = 0;
+         anchorAddress = 0x00;
+         anchorFlag = false;
+         blinkFlag = false;
+         cursorFlag = false;
+         displayFlag = true;
+         setTiming(NULL);
+
+         int allPins[busCount + 1];
+         memcpy(allPins, tables.busPins, sizeof(tables.busPins));
+         allPins[busCount] = PinMap::e;
+         if (!backend->exportPins(allPins, busCount + 1) ||
+               backend->setDirections(allPins, busCount + 1, GPIO_DIR_OUT) <= 0 ||
+               backend->setValues(allPins, busCount + 1, 0) <= 0) {
+            fprintf(stderr, "Unable to set up the LCD pins.\n");
+         }
+
+         // Reset by instruction: three 8-bit function sets whatever the
+         // interface was in, with the busy flag not yet usable.
+         usleep(15 * 1000);
+         writeNibble(0x3);
+         usleep(4100);
+         writeNibble(0x3);
+         usleep(100);
+         writeNibble(0x3);
+         usleep(100);
+
+         unsigned char lineBit = Lines == 2 ? 0x08 : 0x00;
+         if (Mode == 4) {
+            writeNibble(0x2);
+            markBusy(0, 0x20);
+            transfer(0, 0x20 | lineBit);
+         } else {
+            transfer(0, 0x30 | lineBit);
+         }
+
+         transfer(0, 0x08);
+         transfer(0, 0x01);
+         transfer(0, 0x06);
+         displayOptions();
+      }
+
+      // Returns true while the controller reports it is busy.
+      bool busyFlag() {
+         GPIO_PROFILE_SCOPE("busyFlag");
+         return (readByte(0) & 0x80) != 0;
+      }
+
+      // Sends the display control instruction.
+      void displayOptions() {
+         transfer(0, 0x08 | displayFlag << 2 | cursorFlag << 1 | blinkFlag);
+      }
+
+      // Turns the data pins back into outputs after a read, with RW low
+      // first so the controller has stopped driving them.
+      void driveBus() {
+         if (dataInput) {
+            setBus(0);
+            backend->setDirections(tables.dataPins, Mode, GPIO_DIR_OUT);
+            dataInput = false;
+         }
+      }
+
+      // Drives E low, waiting for the minimum pulse width first.
+      void lowerEnable() {
+         while (GPIOBackend::monotonicNow() - enableRaisedAt <
+               LCD_ENABLE_PULSE_NS) {
+         }
+         backend->setValue(PinMap::e, 0);
+      }
+
+      // Starts the execution time of the byte which was just sent.
+      void markBusy(unsigned char rsValue, unsigned char value) {
+         bool slow = rsValue == 0 && (value == 0x01 || (value & 0xFE) == 0x02);
+         readyAt = GPIOBackend::monotonicNow() + (slow ? timing.clearNs :
+               timing.commandNs);
+      }
+
+      // Drives E high, waiting for the minimum cycle time first.
+      void raiseEnable() {
+         while (GPIOBackend::monotonicNow() - enableRaisedAt <
+               LCD_ENABLE_CYCLE_NS) {
+         }
+         backend->setValue(PinMap::e, 1);
+         enableRaisedAt = GPIOBackend::monotonicNow();
+      }
+
+      // Reads the busy flag and address counter (rsValue 0) or data RAM
+      // (rsValue 1), releasing the data pins while the controller drives them.
+      // The pins stay released until the next write, so polling the busy
+      // flag switches their direction once per wait rather than per read.
+      unsigned char readByte(unsigned char rsValue) {
+         setBus(rsValue << LCD_RS_BIT | 1 << LCD_RW_BIT);
+         if (!dataInput) {
+            backend->setDirections(tables.dataPins, Mode, GPIO_DIR_IN);
+            dataInput = true;
+         }
+
+         unsigned char value = 0;
+         int transferIndex;
+         for (transferIndex = 0; transferIndex < 8 / Mode; ++transferIndex) {
+            raiseEnable();
+            uint32_t word = 0;
+            backend->getValues(tables.dataPins, Mode, &word);
+            value = value << Mode | tables.reads[word];
+            lowerEnable();
+         }
+         return value;
+      }
+
+      // Drives RS, RW and the data pins to word unless they already are.
+      void setBus(uint32_t word) {
+         if (word != busWord) {
+            backend->setValues(tables.busPins, busCount, word);
+            busWord = word;
+         }
+      }
+
+      // Writes a byte as an instruction (rsValue 0) or data (rsValue 1).
+      void transfer(unsigned char rsValue, unsigned char value) {
+         waitReady();
+         driveBus();
+
+         uint32_t control = (uint32_t)(rsValue != 0) << LCD_RS_BIT;
+         int transferIndex;
+         for (transferIndex = 0; transferIndex < 8 / Mode; ++transferIndex) {
+            setBus(control | tables.writes[value][transferIndex]);
+            raiseEnable();
+            lowerEnable();
+         }
+         markBusy(rsValue, value);
+      }
+
+      // Waits until the controller can take the next transfer.
+      void waitReady() {
+         if (WaitMode == LCD_WAIT_BUSY_FLAG) {
+            while (busyFlag()) {
+            }
+            return;
+         }
+
+         LCD::waitUntil(readyAt);
+
+         if (WaitMode == LCD_WAIT_HYBRID) {
+            while (busyFlag()) {
+            }
+         }
+      }
+
+      // Writes the high 4 bits of an 8-bit instruction during the reset, when
+      // the controller still takes a single transfer per instruction.
+      void writeNibble(unsigned char high) {
+         setBus(tables.writes[high << 4][0]);
+         raiseEnable();
+         lowerEnable();
+      }
+
+      GPIOBackend *backend;
+      uint32_t busWord;
+      bool dataInput;
+      uint64_t enableRaisedAt;
+      LCDTiming timing;
+      uint64_t readyAt;
+      unsigned char anchorAddress;
+      bool anchorFlag;
+      bool cursorFlag;
+      bool blinkFlag;
+      bool displayFlag;
+};
+
+#endif
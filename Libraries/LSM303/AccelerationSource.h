@@ -0,0 +1,31 @@
+#ifndef ACCELERATION_SOURCE_H
+#define ACCELERATION_SOURCE_H
+
+#include <stdint.h>
+#include "LSM303.h"
+
+// An acceleration sample with the CLOCK_MONOTONIC time it was taken at.
+typedef struct LSM303Sample {
+   Acceleration value;
+   uint64_t timeNs;
+} LSM303Sample;
+
+// A stream of timestamped acceleration samples: the live sensor (see
+// LSM303Sampler) or a recording (see LSM303Replay). Code consuming samples
+// through this interface runs the same on either.
+class AccelerationSource {
+   public:
+      virtual ~AccelerationSource() {
+      }
+
+      // Moves up to max samples which are ready into samples, oldest first,
+      // without waiting. Returns the number moved, or -1 once the stream has
+      // ended.
+      virtual int read(LSM303Sample *samples, unsigned int max) = 0;
+
+      // Sleeps until more samples may be ready, or timeoutMs milliseconds
+      // pass.
+      virtual void wait(int timeoutMs) = 0;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include <fcntl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include "I2CDevTransport.h"
+
+// Largest number of messages the i2c-dev driver accepts in one I2C_RDWR.
+#define MAX_MESSAGES 42
+
+using namespace std;
+
+// Constructor.
+I2CDevTransport::I2CDevTransport() {
+   fd = -1;
+   address = 0;
+}
+
+// Destructor.
+I2CDevTransport::~I2CDevTransport() {
+   close();
+}
+
+// Opens /dev/i2c-N and selects the device for plain reads and writes.
+bool I2CDevTransport::open(int bus, int deviceAddress) {
+   close();
+
+   char filename[16];
+   snprintf(filename, sizeof(filename), "/dev/i2c-%d", bus);
+   fd = ::open(filename, O_RDWR);
+   if (fd < 0) {
+      fprintf(stderr, "Could not open file/dev/i2c-%d.\n", bus);
+      return false;
+   }
+
+   address = deviceAddress;
+   if (ioctl(fd, I2C_SLAVE, address) < 0) {
+      fprintf(stderr, "Could not establish i2c connection on i2cBus %d.\n",
+            bus);
+      return false;
+   }
+
+   return true;
+}
+
+// Closes the adapter.
+void I2CDevTransport::close() {
+   if (fd >= 0) {
+      ::close(fd);
+   }
+   fd = -1;
+}
+
+// Asks the adapter whether it can do plain I2C messages.
+bool I2CDevTransport::canCombine() {
+   unsigned long funcs = 0;
+   return ioctl(fd, I2C_FUNCS, &funcs) >= 0 && (funcs & I2C_FUNC_I2C);
+}
+
+// Sends the messages with one I2C_RDWR ioctl.
+bool I2CDevTransport::transfer(I2CMessage *messages, int count) {
+   if (count < 1 || count > MAX_MESSAGES) {
+      return false;
+   }
+
+   struct i2c_msg sent[MAX_MESSAGES];
+   int index;
+   for (index = 0; index < count; ++index) {
+      sent[index].addr = address;
+      sent[index].flags = messages[index].read ? I2C_M_RD : 0;
+      sent[index].len = messages[index].length;
+      sent[index].buf = messages[index].buf;
+   }
+
+   struct i2c_rdwr_ioctl_data data = {sent, (__u32) count};
+   return ioctl(fd, I2C_RDWR, &data) == count;
+}
+
+// Writes to the selected device.
+int I2CDevTransport::write(const unsigned char *buf, int count) {
+   return ::write(fd, buf, count);
+}
+
+// Reads from the selected device.
+int I2CDevTransport::read(unsigned char *buf, int count) {
+   return ::read(fd, buf, count);
+}
@@ -0,0 +1,33 @@
+#ifndef I2C_DEV_TRANSPORT_H
+#define I2C_DEV_TRANSPORT_H
+
+#include "I2CTransport.h"
+
+// Transport over the Linux i2c-dev interface. The adapter of bus N is assumed
+// to be /dev/i2c-N (true on the BeagleBoneBlack running Debian). Combined
+// transfers use the I2C_RDWR ioctl, plain reads and writes go to the device
+// selected with I2C_SLAVE.
+class I2CDevTransport : public I2CTransport {
+   public:
+      // Constructor.
+      I2CDevTransport();
+
+      // Destructor, closes the adapter.
+      ~I2CDevTransport();
+
+      bool open(int bus, int address);
+      void close();
+
+      // Returns true if the adapter reports I2C_FUNC_I2C.
+      bool canCombine();
+
+      bool transfer(I2CMessage *messages, int count);
+      int write(const unsigned char *buf, int count);
+      int read(unsigned char *buf, int count);
+
+   private:
+      int fd;
+      int address;
+};
+
+#endif
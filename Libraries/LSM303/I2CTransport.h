@@ -0,0 +1,43 @@
+#ifndef I2C_TRANSPORT_H
+#define I2C_TRANSPORT_H
+
+// One message of a combined transfer: length bytes written from or read into
+// buf.
+typedef struct I2CMessage {
+   unsigned char *buf;
+   unsigned short length;
+   bool read;
+} I2CMessage;
+
+// Interface to the bus an I2C device is reached over. LSM303 sends every
+// register access through a transport, which allows the same driver to run
+// on a Linux /dev/i2c-N adapter (I2CDevTransport) or on a simulated device
+// (LSM303Sim) without hardware.
+class I2CTransport {
+   public:
+      virtual ~I2CTransport() {
+      }
+
+      // Connects to the device at address on bus. Returns true on success.
+      virtual bool open(int bus, int address) = 0;
+
+      // Disconnects from the device.
+      virtual void close() = 0;
+
+      // Returns true if transfer() is supported.
+      virtual bool canCombine() = 0;
+
+      // Performs count messages as one transaction, joined by repeated starts.
+      // Returns true if every message was transferred.
+      virtual bool transfer(I2CMessage *messages, int count) = 0;
+
+      // Writes count bytes from buf as a transaction of its own. Returns the
+      // number of bytes written, or -1 on failure.
+      virtual int write(const unsigned char *buf, int count) = 0;
+
+      // Reads count bytes into buf as a transaction of its own. Returns the
+      // number of bytes read, or -1 on failure.
+      virtual int read(unsigned char *buf, int count) = 0;
+};
+
+#endif
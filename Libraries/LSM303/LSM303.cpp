@@ -1,18 +1,17 @@
 #include <assert.h>
 #include <errno.h>
-#include <fcntl.h>
 #include <iostream>
-#include <linux/i2c-dev.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
 #include <unistd.h>
 #include "LSM303.h"
+#include "I2CDevTransport.h"
+#include "../GPIO/GPIO.h"
+#include "../GPIO/GPIOProfile.h"
 
 #define ACCEL_VALUES 6
 #define BITS_PER_BYTE 8 
-#define ACCEL_CALIBRATION 8192 
 
 using namespace std;
 
@@ -20,37 +19,47 @@ using namespace std;
 LSM303::LSM303(UNSIGNED_BYTE bus) {
    assert(bus >= 0);
    i2cBus = bus;
+   transport = new I2CDevTransport();
+   ownsTransport = true;
+   fifoOverruns = 0;
+   fifoWatermark = 0;
+   combined = true;
+   resetTiming();
+}
+
+// Constructor with a transport.
+LSM303::LSM303(UNSIGNED_BYTE bus, I2CTransport *i2c) {
+   i2cBus = bus;
+   transport = i2c;
+   ownsTransport = false;
+   fifoOverruns = 0;
+   fifoWatermark = 0;
+   combined = true;
+   resetTiming();
 }
 
 // Destructor.
 LSM303::~LSM303() {
+   transport->close();
+   if (ownsTransport) {
+      delete transport;
+   }
 }
 
 // Initializes the accelerometer by establishing a connection between it
 // and the microcontroller. This method also enables the accelerometer.
 // The initMask is the mask to write to register CTRL_REG1_A of the LSM303
 // in order to enable its axes. To enable all 3, use the #define INIT_MASK.
-// Additionally, this initialization routine assumes that the i2cBus is located
-// at /dev/i2c-#, where the number is the i2cBus designation. This will not
-// likely be the same on other devices (this is true on the BeagleBoneBlack
-// running Debian). If this library is to be used with other microcontrollers,
-// this setting needs to be checked/adjusted.
+// The connection is opened through the transport, see I2CDevTransport for
+// where the default one expects the i2cBus.
 bool LSM303::init(UNSIGNED_BYTE initMask) {
 
-   bool rtn = true;;
-   char filename[16];
-   snprintf(filename, sizeof(filename), "/dev/i2c-%d", i2cBus);
-   fd = open(filename, O_RDWR); 
+   bool rtn = transport->open(i2cBus, ACCEL_ADDRESS);
 
-   if (fd < 0) {
-      fprintf(stderr, "Could not open file/dev/i2c-%d.\n", i2cBus);
-      rtn = false;
-   }
-
-   if (ioctl(fd, I2C_SLAVE, ACCEL_ADDRESS) < 0) {
-      fprintf(stderr, "Could not establish i2c connection on i2cBus %d.\n", 
-            i2cBus);
-      rtn = false;
+   if (rtn && combined && !transport->canCombine()) {
+      fprintf(stderr, "i2cBus %d cannot do combined transfers, using "
+            "write / read.\n", i2cBus);
+      combined = false;
    }
 
    rtn = enable(initMask) ? rtn : false;
@@ -60,13 +69,16 @@ bool LSM303::init(UNSIGNED_BYTE initMask) {
 
 // Enabls the accelerometer using the specified value of initMask. The value of
 // the mask is written to register CTRL_REG1_A of the LSM303. To enable data
-// collection on all 3 axes, use the #define INIT_MASK.
+// collection on all 3 axes, use the #define INIT_MASK. Both registers are
+// written in one transfer.
 bool LSM303::enable(UNSIGNED_BYTE initMask) {
 
-   bool status = writeReg(CTRL_REG1_A, initMask) > 0 ? true : false;
-   status = writeReg(CTRL_REG4_A, HIGH_SENSITIVITY) > 0 ? status : false;
+   LSM303Transfer transfers[2] = {
+      {CTRL_REG1_A, initMask, NULL, 1},
+      {CTRL_REG4_A, HIGH_SENSITIVITY, NULL, 1},
+   };
 
-   return status; 
+   return transfer(transfers, 2);
 }
 
 // Writes the contents of mask to register reg on the LSM303.
@@ -78,7 +90,7 @@ UNSIGNED_BYTE LSM303::writeReg(UNSIGNED_BYTE reg, UNSIGNED_BYTE mask) {
    UNSIGNED_BYTE bytesWritten = 0;
    if (validRegBounds(reg, 1)) {
       UNSIGNED_BYTE buffer[2] = {reg | READ_PAD_BYTES, mask};
-      bytesWritten = write(fd, buffer, 2);
+      bytesWritten = transact(buffer, 2, NULL, 0);
 
       if (!bytesWritten) {
          fprintf(stderr, "Unsuccessful write of %08X into regster %08X.\n", 
@@ -104,18 +116,7 @@ UNSIGNED_BYTE LSM303::readReg(UNSIGNED_BYTE startReg, UNSIGNED_BYTE *buf,
    UNSIGNED_BYTE bytesRead = 0;
 
    if (validRegBounds(startReg, count)) {
-      UNSIGNED_BYTE buffer = startReg | READ_PAD_BYTES;
-      if (write(fd, &buffer, 1)) {
-         bytesRead = read(fd, buf, count);
-      }
-
-      if (bytesRead != count) {
-         fprintf(stderr, "Unsuccessful read of registers %08X - %08X.\n", 
-               startReg, startReg + count);
-         char* error = strerror(errno);
-         fprintf(stderr, error);
-      }
-
+      bytesRead = readBurst(startReg, buf, count);
    } else {
       fprintf(stderr, "Invalid bounds, read aborted on registers %08X - %08x.\n",
             startReg, startReg + count);
@@ -124,12 +125,345 @@ UNSIGNED_BYTE LSM303::readReg(UNSIGNED_BYTE startReg, UNSIGNED_BYTE *buf,
    return bytesRead;
 }
 
+// Reads consecutive bytes with the register address auto-incrementing. Will
+// print an error message if fewer than count bytes were read.
+int LSM303::readBurst(UNSIGNED_BYTE startReg, UNSIGNED_BYTE *buf, int count) {
+   UNSIGNED_BYTE buffer = startReg | READ_PAD_BYTES;
+   int bytesRead = transact(&buffer, 1, buf, count);
+
+   if (bytesRead != count) {
+      fprintf(stderr, "Unsuccessful read of registers %08X - %08X.\n",
+            startReg, startReg + count);
+      fprintf(stderr, "%s\n", strerror(errno));
+   }
+
+   return bytesRead;
+}
+
+// Writes and then reads, either as two messages of one combined transfer
+// joined by a repeated start, or as a separate write and read.
+int LSM303::transact(UNSIGNED_BYTE *out, int outCount, UNSIGNED_BYTE *in,
+      int inCount) {
+   struct timespec start;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+
+   int result = 0;
+   if (combined) {
+      I2CMessage messages[2] = {
+         {out, (unsigned short) outCount, false},
+         {in, (unsigned short) inCount, true},
+      };
+      if (transport->transfer(messages, inCount ? 2 : 1)) {
+         result = inCount ? inCount : outCount;
+      }
+   } else {
+      int written = transport->write(out, outCount);
+      if (written == outCount) {
+         result = inCount ? transport->read(in, inCount) : written;
+      }
+      result = result < 0 ? 0 : result;
+   }
+
+   recordTiming(start, result == (inCount ? inCount : outCount));
+   return result;
+}
+
+// Adds the time since start to the statistics.
+void LSM303::recordTiming(const struct timespec &start, bool success) {
+   struct timespec end;
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   unsigned long long ns = (end.tv_sec - start.tv_sec) * 1000000000ULL +
+      end.tv_nsec - start.tv_nsec;
+
+   ++timing.transactions;
+   timing.failures += success ? 0 : 1;
+   timing.totalNs += ns;
+   timing.minNs = ns < timing.minNs ? ns : timing.minNs;
+   timing.maxNs = ns > timing.maxNs ? ns : timing.maxNs;
+}
+
+// Converts a threshold into register units, which are 16, 32, 62 or 186
+// milli-g depending on the full scale, rounding up and clamping to 7 bits.
+int LSM303::thresholdUnits(unsigned int thresholdMg) {
+   static const unsigned int mgPerUnit[4] = {16, 32, 62, 186};
+
+   UNSIGNED_BYTE scale = 0;
+   if (readReg(CTRL_REG4_A, &scale, 1) != 1) {
+      return -1;
+   }
+   unsigned int unit = mgPerUnit[(scale & FULL_SCALE_MASK) >> FULL_SCALE_SHIFT];
+   unsigned int threshold = (thresholdMg + unit - 1) / unit;
+
+   return threshold > INT_VALUE_MASK ? INT_VALUE_MASK : threshold;
+}
+
+// Arms the INT1 generator with the high-pass filter. The filter is reset by
+// reading REFERENCE_A so the current orientation does not count as motion.
+bool LSM303::enableMotionInterrupt(unsigned int thresholdMg,
+      UNSIGNED_BYTE duration, UNSIGNED_BYTE events) {
+   int threshold = thresholdUnits(thresholdMg);
+   if (threshold < 0) {
+      return false;
+   }
+
+   bool status = updateReg(CTRL_REG2_A, HPIS1, HPIS1);
+
+   UNSIGNED_BYTE reference = 0;
+   UNSIGNED_BYTE source = 0;
+   LSM303Transfer transfers[5] = {
+      {INT1_THS_A, (UNSIGNED_BYTE) threshold, NULL, 1},
+      {INT1_DURATION_A, (UNSIGNED_BYTE) (duration & INT_VALUE_MASK), NULL, 1},
+      {REFERENCE_A, 0, &reference, 1},
+      {INT1_CFG_A, (UNSIGNED_BYTE) (events & INT_SRC_EVENTS), NULL, 1},
+      {INT1_SOURCE_A, 0, &source, 1},
+   };
+   status = transfer(transfers, 5) && status;
+
+   status = updateReg(CTRL_REG5_A, LIR_INT1, LIR_INT1) && status;
+   status = updateReg(CTRL_REG3_A, I1_AOI1, I1_AOI1) && status;
+
+   return status;
+}
+
+// Disarms the INT1 generator.
+bool LSM303::disableMotionInterrupt() {
+   bool status = updateReg(CTRL_REG3_A, I1_AOI1, 0);
+   status = writeReg(INT1_CFG_A, 0) > 0 && status;
+   status = updateReg(CTRL_REG2_A, HPIS1, 0) && status;
+   status = updateReg(CTRL_REG5_A, LIR_INT1, 0) && status;
+
+   return status;
+}
+
+// Waits for INT1 to rise. Since the interrupt is latched, the line stays high
+// until INT1_SOURCE_A is read, so reading the source before each wait catches
+// motion which happened before the edge was armed.
+int LSM303::waitForMotion(GPIO *int1, int timeoutMs) {
+   UNSIGNED_BYTE source = 0;
+   int status = waitForSource(int1, timeoutMs, INT1_SOURCE_A, &source);
+
+   return status > 0 ? source & INT_SRC_EVENTS : status;
+}
+
+// Sets up the click engine. The click threshold uses the same units as the
+// INT1 threshold, and the high-pass filter keeps gravity from adding to it.
+bool LSM303::enableClick(UNSIGNED_BYTE clicks, unsigned int thresholdMg,
+      UNSIGNED_BYTE timeLimit, UNSIGNED_BYTE latency, UNSIGNED_BYTE window,
+      int pin) {
+   if (pin != LSM303_INT1 && pin != LSM303_INT2) {
+      fprintf(stderr, "Click interrupt pin %d is not INT1 or INT2.\n", pin);
+      return false;
+   }
+
+   int threshold = thresholdUnits(thresholdMg);
+   if (threshold < 0) {
+      return false;
+   }
+
+   bool status = updateReg(CTRL_REG2_A, HPCLICK, HPCLICK);
+
+   UNSIGNED_BYTE source = 0;
+   LSM303Transfer transfers[5] = {
+      {CLICK_THS_A, (UNSIGNED_BYTE) threshold, NULL, 1},
+      {TIME_LIMIT_A, (UNSIGNED_BYTE) (timeLimit & INT_VALUE_MASK), NULL, 1},
+      {TIME_LATENCY_A, latency, NULL, 1},
+      {TIME_WINDOW_A, window, NULL, 1},
+      {CLICK_CFG_A, (UNSIGNED_BYTE) (clicks & CLICK_CFG_MASK), NULL, 1},
+   };
+   status = transfer(transfers, 5) && status;
+   status = readReg(CLICK_SRC_A, &source, 1) == 1 && status;
+
+   status = updateReg(CTRL_REG3_A, I1_CLICK,
+         pin == LSM303_INT1 ? I1_CLICK : 0) && status;
+   status = updateReg(CTRL_REG6_A, I2_CLICKEN,
+         pin == LSM303_INT2 ? I2_CLICKEN : 0) && status;
+
+   return status;
+}
+
+// Stops click detection and its interrupts.
+bool LSM303::disableClick() {
+   bool status = updateReg(CTRL_REG3_A, I1_CLICK, 0);
+   status = updateReg(CTRL_REG6_A, I2_CLICKEN, 0) && status;
+   status = writeReg(CLICK_CFG_A, 0) > 0 && status;
+   status = updateReg(CTRL_REG2_A, HPCLICK, 0) && status;
+
+   return status;
+}
+
+// Decodes CLICK_SRC_A. A double click reports both the single and the double
+// click bits when both are enabled, the double click wins.
+static int decodeClick(UNSIGNED_BYTE source, LSM303Click *click) {
+   if (!(source & CLICK_SRC_IA)) {
+      return 0;
+   }
+
+   click->type = source & CLICK_SRC_DCLICK ? CLICK_DOUBLE : CLICK_SINGLE;
+   click->axes = source & CLICK_SRC_AXES;
+   click->negative = (source & CLICK_SRC_SIGN) != 0;
+   return 1;
+}
+
+// Reads the click source.
+int LSM303::readClick(LSM303Click *click) {
+   UNSIGNED_BYTE source = 0;
+   if (readReg(CLICK_SRC_A, &source, 1) != 1) {
+      return -1;
+   }
+
+   return decodeClick(source, click);
+}
+
+// Waits for the click interrupt and reads the click source.
+int LSM303::waitForClick(GPIO *pin, int timeoutMs, LSM303Click *click) {
+   UNSIGNED_BYTE source = 0;
+   int status = waitForSource(pin, timeoutMs, CLICK_SRC_A, &source);
+
+   return status > 0 ? decodeClick(source, click) : status;
+}
+
+// Waits for an interrupt source to become active, sleeping on the pin between
+// reads of the source register.
+int LSM303::waitForSource(GPIO *pin, int timeoutMs, UNSIGNED_BYTE reg,
+      UNSIGNED_BYTE *source) {
+   if (pin->setDirection("in") <= 0 || pin->setEdge("rising") <= 0) {
+      return -1;
+   }
+
+   uint64_t deadline = GPIOBackend::monotonicNow() +
+      (uint64_t) timeoutMs * 1000000ULL;
+
+   while (true) {
+      if (readReg(reg, source, 1) != 1) {
+         return -1;
+      }
+      if (*source & INT_SRC_IA) {
+         return 1;
+      }
+
+      int remaining = timeoutMs;
+      if (timeoutMs >= 0) {
+         uint64_t now = GPIOBackend::monotonicNow();
+         if (now >= deadline) {
+            return 0;
+         }
+         remaining = (int) ((deadline - now + 999999ULL) / 1000000ULL);
+      }
+
+      int status = pin->waitForEdge("rising", remaining, NULL);
+      if (status <= 0) {
+         return status;
+      }
+   }
+}
+
+// Performs a list of register operations. Combined, every write is one
+// message and every read a message with the register address followed by a
+// read message, all sent as a single transfer.
+bool LSM303::transfer(LSM303Transfer *transfers, int count) {
+   if (count < 1 || count > LSM303_MAX_TRANSFERS) {
+      fprintf(stderr, "Transfer of %d operations is not within 1 - %d.\n",
+            count, LSM303_MAX_TRANSFERS);
+      return false;
+   }
+
+   int index;
+   for (index = 0; index < count; ++index) {
+      UNSIGNED_BYTE length = transfers[index].buf ? transfers[index].count : 1;
+      if (!validRegBounds(transfers[index].reg, length)) {
+         fprintf(stderr, "Invalid register bounds, transfer aborted.\n");
+         return false;
+      }
+   }
+
+   if (!combined) {
+      bool status = true;
+      for (index = 0; index < count; ++index) {
+         LSM303Transfer *op = &transfers[index];
+         if (op->buf) {
+            status = readReg(op->reg, op->buf, op->count) == op->count &&
+               status;
+         } else {
+            status = writeReg(op->reg, op->value) > 0 && status;
+         }
+      }
+      return status;
+   }
+
+   UNSIGNED_BYTE headers[LSM303_MAX_TRANSFERS][2];
+   I2CMessage messages[LSM303_MAX_TRANSFERS * 2];
+   int messageCount = 0;
+   for (index = 0; index < count; ++index) {
+      LSM303Transfer *op = &transfers[index];
+      headers[index][0] = op->reg | READ_PAD_BYTES;
+      headers[index][1] = op->value;
+
+      I2CMessage *message = &messages[messageCount++];
+      message->buf = headers[index];
+      message->length = op->buf ? 1 : 2;
+      message->read = false;
+      if (op->buf) {
+         message = &messages[messageCount++];
+         message->buf = op->buf;
+         message->length = op->count;
+         message->read = true;
+      }
+   }
+
+   struct timespec start;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   bool status = transport->transfer(messages, messageCount);
+   recordTiming(start, status);
+
+   if (!status) {
+      fprintf(stderr, "Unsuccessful transfer of %d operations.\n", count);
+      fprintf(stderr, "%s\n", strerror(errno));
+   }
+
+   return status;
+}
+
+// Selects combined or separate write / read transfers.
+void LSM303::setCombined(bool useCombined) {
+   combined = useCombined;
+}
+
+// Returns true if transfers are combined.
+bool LSM303::isCombined() {
+   return combined;
+}
+
+// Returns the transaction statistics.
+LSM303Timing LSM303::getTiming() {
+   return timing;
+}
+
+// Clears the transaction statistics.
+void LSM303::resetTiming() {
+   timing.transactions = 0;
+   timing.failures = 0;
+   timing.totalNs = 0;
+   timing.minNs = ~0ULL;
+   timing.maxNs = 0;
+}
+
+// Sets some bits of a register, keeping the others.
+bool LSM303::updateReg(UNSIGNED_BYTE reg, UNSIGNED_BYTE mask,
+      UNSIGNED_BYTE bits) {
+   UNSIGNED_BYTE value = 0;
+   if (readReg(reg, &value, 1) != 1) {
+      return false;
+   }
+   return writeReg(reg, (value & ~mask) | (bits & mask)) > 0;
+}
+
 // Ensures that the read / write operation will not overrun the bounds of the
 // register space. From the datasheet, CTRL_REG1_A is the beginning of the valid
-// register block and TIME_WINDOW_A is the end of the valid register block.
+// register block and TIME_WINDOW_A is the last register of the valid register
+// block.
 bool LSM303::validRegBounds(UNSIGNED_BYTE startReg, UNSIGNED_BYTE count) {
 
-   if (startReg < CTRL_REG1_A || startReg + count > TIME_WINDOW_A) {
+   if (startReg < CTRL_REG1_A || startReg + count > TIME_WINDOW_A + 1) {
       return false; 
    }
 
@@ -140,13 +474,157 @@ bool LSM303::validRegBounds(UNSIGNED_BYTE startReg, UNSIGNED_BYTE count) {
 // the Acceleration struct accl. Since the acceleration values are broken up
 // over 2 registers per axis on the accelerometer there is some bitshifting
 // required to combine their values to create an accurate final acceleration.
-void LSM303::readAcceleration(Acceleration *accl) {
+bool LSM303::readAcceleration(Acceleration *accl) {
+   GPIO_PROFILE_SCOPE("readAcceleration");
 
    UNSIGNED_BYTE data[ACCEL_VALUES];
-   readReg(OUT_X_L_A, data, sizeof(data));
+   if (readReg(OUT_X_L_A, data, sizeof(data)) != sizeof(data)) {
+      return false;
+   }
    accl->xVal = data[1] << BITS_PER_BYTE | data[0];
    accl->yVal = data[3] << BITS_PER_BYTE | data[2];
    accl->zVal = data[5] << BITS_PER_BYTE | data[4];
+   return true;
+}
+
+// Starts the FIFO in stream mode. The mode is switched through bypass, which
+// empties the FIFO and clears an earlier overrun.
+bool LSM303::enableFifo(UNSIGNED_BYTE watermark, bool interrupt) {
+   if (watermark < 1 || watermark >= FIFO_DEPTH) {
+      fprintf(stderr, "FIFO watermark %d is not within 1 - %d.\n", watermark,
+            FIFO_DEPTH - 1);
+      return false;
+   }
+
+   bool status = writeReg(FIFO_CTRL_REG_A, FIFO_MODE_BYPASS) > 0;
+   status = updateReg(CTRL_REG5_A, FIFO_ENABLE, FIFO_ENABLE) && status;
+   status = updateReg(CTRL_REG3_A, I1_WTM, interrupt ? I1_WTM : 0) && status;
+   status = writeReg(FIFO_CTRL_REG_A, FIFO_MODE_STREAM |
+         (watermark & FIFO_WATERMARK_MASK)) > 0 && status;
+   fifoWatermark = status ? watermark : 0;
+
+   return status;
+}
+
+// Stops the FIFO.
+bool LSM303::disableFifo() {
+   fifoWatermark = 0;
+   bool status = writeReg(FIFO_CTRL_REG_A, FIFO_MODE_BYPASS) > 0;
+   status = updateReg(CTRL_REG3_A, I1_WTM, 0) && status;
+   status = updateReg(CTRL_REG5_A, FIFO_ENABLE, 0) && status;
+
+   return status;
+}
+
+// Reads the fill level of the FIFO from FIFO_SRC_REG_A.
+int LSM303::fifoLevel(bool *overrun) {
+   UNSIGNED_BYTE source = 0;
+   if (readReg(FIFO_SRC_REG_A, &source, 1) != 1) {
+      return -1;
+   }
+   return sourceLevel(source, overrun);
+}
+
+// Decodes the fill level from a FIFO_SRC_REG_A value.
+int LSM303::sourceLevel(UNSIGNED_BYTE source, bool *overrun) {
+   // The sample count only has 5 bits, a full FIFO is flagged as overrun.
+   bool lost = (source & FIFO_SRC_OVRN) != 0;
+   if (lost) {
+      ++fifoOverruns;
+   }
+   if (overrun != NULL) {
+      *overrun = lost;
+   }
+
+   if (source & FIFO_SRC_EMPTY) {
+      return 0;
+   }
+   return lost ? FIFO_DEPTH : source & FIFO_SRC_FSS;
+}
+
+// Unpacks count samples of 6 bytes read from the OUT registers.
+static void unpackSamples(const UNSIGNED_BYTE *data, Acceleration *samples,
+      int count) {
+   int index;
+   for (index = 0; index < count; ++index) {
+      const UNSIGNED_BYTE *sample = &data[index * ACCEL_VALUES];
+      samples[index].xVal = sample[1] << BITS_PER_BYTE | sample[0];
+      samples[index].yVal = sample[3] << BITS_PER_BYTE | sample[2];
+      samples[index].zVal = sample[5] << BITS_PER_BYTE | sample[4];
+   }
+}
+
+// Drains the FIFO with one burst read. With the FIFO enabled, the register
+// address rolls over from OUT_Z_H_A to OUT_X_L_A, so a read of 6 bytes per
+// sample starting at OUT_X_L_A returns the samples oldest first.
+int LSM303::readFifo(Acceleration *samples, int max, bool *overrun) {
+   GPIO_PROFILE_SCOPE("readFifo");
+
+   int count = fifoLevel(overrun);
+   if (count <= 0) {
+      return count;
+   }
+   count = count < max ? count : max;
+
+   UNSIGNED_BYTE data[FIFO_DEPTH * ACCEL_VALUES];
+   int bytesRead = readBurst(OUT_X_L_A, data, count * ACCEL_VALUES);
+   count = bytesRead / ACCEL_VALUES;
+
+   unpackSamples(data, samples, count);
+
+   return bytesRead > 0 ? count : -1;
+}
+
+// Drains the FIFO after its watermark interrupt. The interrupt means more
+// than watermark samples are waiting, so FIFO_SRC_REG_A and that many
+// samples are read in one combined transfer, without waiting for the level
+// first. Samples which arrived beyond them are left for the next drain,
+// unless they are above the watermark again and would keep INT1 raised.
+int LSM303::drainFifo(Acceleration *samples, int max, bool *overrun) {
+   GPIO_PROFILE_SCOPE("drainFifo");
+
+   int count = fifoWatermark + 1;
+   if (!combined || fifoWatermark == 0 || count > max) {
+      return readFifo(samples, max, overrun);
+   }
+
+   UNSIGNED_BYTE sourceReg = FIFO_SRC_REG_A;
+   UNSIGNED_BYTE dataReg = OUT_X_L_A | READ_PAD_BYTES;
+   UNSIGNED_BYTE source = 0;
+   UNSIGNED_BYTE data[FIFO_DEPTH * ACCEL_VALUES];
+   I2CMessage messages[4] = {
+      {&sourceReg, 1, false},
+      {&source, 1, true},
+      {&dataReg, 1, false},
+      {data, (unsigned short) (count * ACCEL_VALUES), true},
+   };
+
+   struct timespec start;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   bool status = transport->transfer(messages, 4);
+   recordTiming(start, status);
+   if (!status) {
+      fprintf(stderr, "Unsuccessful drain of the FIFO.\n");
+      fprintf(stderr, "%s\n", strerror(errno));
+      return -1;
+   }
+
+   // Only the samples below the level read are valid.
+   int level = sourceLevel(source, overrun);
+   int rest = level - count;
+   count = level < count ? level : count;
+   unpackSamples(data, samples, count);
+
+   if (rest > fifoWatermark) {
+      int more = readFifo(samples + count, max - count, NULL);
+      count += more > 0 ? more : 0;
+   }
+   return count;
+}
+
+// Returns the number of overruns seen.
+unsigned long LSM303::getFifoOverruns() {
+   return fifoOverruns;
 }
 
 // Disables the accelerometer by writing the disable mask to CTRL_REG1_A.
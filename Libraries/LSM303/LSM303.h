@@ -1,6 +1,9 @@
 #ifndef LSM303_H
 #define LSM303_H
 
+#include <time.h>
+#include "I2CTransport.h"
+
 #define CTRL_REG1_A 0x20
 #define CTRL_REG2_A 0x21
 #define CTRL_REG3_A 0x22
@@ -38,8 +41,100 @@
 #define HIGH_SENSITIVITY 0x18
 #define READ_PAD_BYTES 0x80
 
+// Acceleration counts per g at the full scale selected by HIGH_SENSITIVITY.
+#define ACCEL_CALIBRATION 8192
+
+// CTRL_REG2_A: high-pass filter for the click engine and the INT1 generator.
+#define HPCLICK 0x04
+#define HPIS1 0x01
+
+// CTRL_REG3_A: click, INT1 generator and FIFO watermark interrupts on INT1.
+#define I1_CLICK 0x80
+#define I1_AOI1 0x40
+#define I1_WTM 0x04
+
+// CTRL_REG4_A: full scale selection.
+#define FULL_SCALE_MASK 0x30
+#define FULL_SCALE_SHIFT 4
+
+// CTRL_REG5_A: FIFO enable, and INT1 latched until INT1_SOURCE_A is read.
+#define FIFO_ENABLE 0x40
+#define LIR_INT1 0x08
+
+// INT1_CFG_A: interrupt on the high (above threshold) and low events of each
+// axis, the events being OR combined. INT_CFG_HIGH_ALL detects motion along
+// any axis.
+#define INT_CFG_ZHIE 0x20
+#define INT_CFG_ZLIE 0x10
+#define INT_CFG_YHIE 0x08
+#define INT_CFG_YLIE 0x04
+#define INT_CFG_XHIE 0x02
+#define INT_CFG_XLIE 0x01
+#define INT_CFG_HIGH_ALL 0x2A
+
+// INT1_SOURCE_A: interrupt active, and the events which raised it (the same
+// bits as in INT1_CFG_A).
+#define INT_SRC_IA 0x40
+#define INT_SRC_EVENTS 0x3F
+
+// CTRL_REG6_A: click interrupt on INT2.
+#define I2_CLICKEN 0x80
+
+// INT1_THS_A, INT1_DURATION_A, CLICK_THS_A and TIME_LIMIT_A take 7 bit values.
+#define INT_VALUE_MASK 0x7F
+
+// CLICK_CFG_A: double and single click detection for each axis.
+#define CLICK_CFG_ZD 0x20
+#define CLICK_CFG_ZS 0x10
+#define CLICK_CFG_YD 0x08
+#define CLICK_CFG_YS 0x04
+#define CLICK_CFG_XD 0x02
+#define CLICK_CFG_XS 0x01
+#define CLICK_CFG_MASK 0x3F
+
+// CLICK_SRC_A: interrupt active, double click, single click, negative
+// direction and the axes which clicked.
+#define CLICK_SRC_IA 0x40
+#define CLICK_SRC_DCLICK 0x20
+#define CLICK_SRC_SCLICK 0x10
+#define CLICK_SRC_SIGN 0x08
+#define CLICK_SRC_Z 0x04
+#define CLICK_SRC_Y 0x02
+#define CLICK_SRC_X 0x01
+#define CLICK_SRC_AXES 0x07
+
+// Kinds of LSM303Click.
+#define CLICK_SINGLE 1
+#define CLICK_DOUBLE 2
+
+// Interrupt pins of the accelerometer.
+#define LSM303_INT1 1
+#define LSM303_INT2 2
+
+// FIFO_CTRL_REG_A: FIFO mode (bits 7 - 6) and watermark level (bits 4 - 0).
+#define FIFO_MODE_BYPASS 0x00
+#define FIFO_MODE_FIFO 0x40
+#define FIFO_MODE_STREAM 0x80
+#define FIFO_MODE_TRIGGER 0xC0
+#define FIFO_WATERMARK_MASK 0x1F
+
+// FIFO_SRC_REG_A: watermark reached, overrun, empty and the number of unread
+// samples (bits 4 - 0).
+#define FIFO_SRC_WTM 0x80
+#define FIFO_SRC_OVRN 0x40
+#define FIFO_SRC_EMPTY 0x20
+#define FIFO_SRC_FSS 0x1F
+
+// Number of samples the FIFO holds.
+#define FIFO_DEPTH 32
+
+// Maximum number of register operations LSM303::transfer() takes at once.
+#define LSM303_MAX_TRANSFERS 16
+
 #define UNSIGNED_BYTE unsigned char
 
+class GPIO;
+
 // Struct to hold all 3 axis acceleration values.
 typedef struct Acceleration {
    short xVal;
@@ -47,6 +142,35 @@ typedef struct Acceleration {
    short zVal;
 } Acceleration;
 
+// One register operation of LSM303::transfer(). Writes value into reg if buf
+// is NULL, otherwise reads count consecutive registers starting at reg into
+// buf.
+typedef struct LSM303Transfer {
+   UNSIGNED_BYTE reg;
+   UNSIGNED_BYTE value;
+   UNSIGNED_BYTE *buf;
+   UNSIGNED_BYTE count;
+} LSM303Transfer;
+
+// A click decoded from CLICK_SRC_A. type is CLICK_SINGLE or CLICK_DOUBLE,
+// axes holds CLICK_SRC_X / Y / Z bits, and negative is true if the click
+// was in the negative direction.
+typedef struct LSM303Click {
+   int type;
+   UNSIGNED_BYTE axes;
+   bool negative;
+} LSM303Click;
+
+// Durations of the bus transactions (a combined ioctl, or a write and read
+// pair) since the last LSM303::resetTiming().
+typedef struct LSM303Timing {
+   unsigned long transactions;
+   unsigned long failures;
+   unsigned long long totalNs;
+   unsigned long long minNs;
+   unsigned long long maxNs;
+} LSM303Timing;
+
 // Class to wrap the major functionality of the LSM303 accelerometer. The
 // accelerometer has a data and a clock line, and both need to be connected
 // correctly in order to use the device. Additionally, data line is
@@ -56,12 +180,17 @@ typedef struct Acceleration {
 // first construct an LSM303 object and then initialize it. The initialization
 // routine will enable the accelerometer which will begin transferring x,y,z
 // acceleration data. The data stream can be stopped by calling disable(), and
-// restarted with a call to enable().
+// restarted with a call to enable(). All bus traffic goes through an
+// I2CTransport, by default the i2c-dev adapter of the bus.
 class LSM303 {
    public:
       // Constructor
       LSM303(UNSIGNED_BYTE i2cBus);
 
+      // Constructor, talks to the device through i2c, which must outlive this
+      // object (e.g. an LSM303Sim to run without hardware).
+      LSM303(UNSIGNED_BYTE i2cBus, I2CTransport *i2c);
+
       // Destructor
       ~LSM303();
 
@@ -88,15 +217,148 @@ class LSM303 {
 
       // Reads the contents of the accelerometer, combines the appropriate
       // register values and places the updated values into the Acceleration
-      // struct pointed to by accl. 
-      void readAcceleration(Acceleration *accl);
+      // struct pointed to by accl. Returns true on success, accl is left
+      // unchanged on failure.
+      bool readAcceleration(Acceleration *accl);
+
+      // Arms the INT1 threshold interrupt: INT1 rises (and stays high until
+      // the source is read) once the high-pass filtered acceleration exceeds
+      // thresholdMg milli-g for duration samples on any of the events in
+      // events (INT_CFG_* bits, e.g. INT_CFG_HIGH_ALL). The filter removes
+      // gravity, so the interrupt reacts to movement whatever the
+      // orientation. Returns true on success.
+      bool enableMotionInterrupt(unsigned int thresholdMg,
+            UNSIGNED_BYTE duration, UNSIGNED_BYTE events);
+
+      // Disarms the INT1 threshold interrupt. Returns true on success.
+      bool disableMotionInterrupt();
+
+      // Sleeps until the INT1 line, wired to int1, signals motion or
+      // timeoutMs milliseconds pass (a negative timeout waits forever), without
+      // touching the bus in between. Returns the events which fired (INT_CFG_*
+      // bits), 0 on timeout or -1 on failure.
+      int waitForMotion(GPIO *int1, int timeoutMs);
+
+      // Sets up the click engine to detect the clicks in clicks (CLICK_CFG_*
+      // bits, single and / or double per axis) and signal them on pin
+      // (LSM303_INT1 or LSM303_INT2). A click is a high-pass filtered spike
+      // above thresholdMg milli-g lasting at most timeLimit samples. For a
+      // double click the second spike must start after latency samples and
+      // within window samples of that. The detection runs on the sensor,
+      // the host only hears about finished clicks. Returns true on success.
+      bool enableClick(UNSIGNED_BYTE clicks, unsigned int thresholdMg,
+            UNSIGNED_BYTE timeLimit, UNSIGNED_BYTE latency,
+            UNSIGNED_BYTE window, int pin);
+
+      // Stops click detection. Returns true on success.
+      bool disableClick();
+
+      // Reads and decodes CLICK_SRC_A into click. Returns 1 if a click was
+      // detected, 0 if none or -1 on failure.
+      int readClick(LSM303Click *click);
+
+      // Sleeps until the interrupt line set with enableClick(), wired to pin,
+      // signals a click or timeoutMs milliseconds pass (a negative timeout
+      // waits forever) and decodes it into click. Returns 1 on a click, 0 on
+      // timeout or -1 on failure.
+      int waitForClick(GPIO *pin, int timeoutMs, LSM303Click *click);
+
+      // Performs the count register operations of transfers (up to
+      // LSM303_MAX_TRANSFERS) as a single combined I2C transaction, or one
+      // after the other when not combining. Returns true if all succeeded.
+      bool transfer(LSM303Transfer *transfers, int count);
+
+      // Selects whether transfers are combined, sending the register address
+      // and the data with a repeated start in one transaction (one I2C_RDWR
+      // ioctl, the default), or as plain writes and reads. init() falls back
+      // to the latter if the transport cannot do combined transfers.
+      void setCombined(bool combined);
+
+      // Returns true if transfers are combined.
+      bool isCombined();
+
+      // Returns the transaction statistics.
+      LSM303Timing getTiming();
+
+      // Clears the transaction statistics.
+      void resetTiming();
 
       // Disables the accelerometer.
       bool disable();
 
+      // Starts buffering samples in the 32 level FIFO in stream mode: once
+      // full, the oldest samples are overwritten. watermark (1 - 31) is the
+      // fill level which sets the watermark flag, and if interrupt is true
+      // also raises INT1, so a reader only needs to wake up every watermark
+      // samples. Returns true on success.
+      bool enableFifo(UNSIGNED_BYTE watermark, bool interrupt);
+
+      // Stops the FIFO and returns to reading single samples. Returns true on
+      // success.
+      bool disableFifo();
+
+      // Returns the number of samples waiting in the FIFO (0 - 32), or -1 on
+      // failure. overrun, if not NULL, receives true if the FIFO filled up
+      // and samples were lost since it was last drained.
+      int fifoLevel(bool *overrun);
+
+      // Drains the samples waiting in the FIFO, at most max of them, into
+      // samples with a single burst read. Returns the number of samples read,
+      // or -1 on failure. overrun is as for fifoLevel().
+      int readFifo(Acceleration *samples, int max, bool *overrun);
+
+      // Drains the FIFO once its watermark interrupt was raised, reading
+      // FIFO_SRC_REG_A and the watermark + 1 samples then known to be waiting
+      // in a single combined transfer, rather than the two readFifo() needs.
+      // Must only be called after the interrupt, as samples arriving during
+      // the transfer are otherwise lost. Falls back to readFifo() when
+      // transfers are not combined. Returns as readFifo().
+      int drainFifo(Acceleration *samples, int max, bool *overrun);
+
+      // Returns the number of times readFifo() or fifoLevel() found the FIFO
+      // overrun.
+      unsigned long getFifoOverruns();
+
    private:
-      int fd;
+      I2CTransport *transport;
+      bool ownsTransport;
       UNSIGNED_BYTE i2cBus;
+      unsigned long fifoOverruns;
+      UNSIGNED_BYTE fifoWatermark;
+      bool combined;
+      LSM303Timing timing;
+
+      // Returns the fill level encoded in a FIFO_SRC_REG_A value, counting
+      // an overrun as for fifoLevel().
+      int sourceLevel(UNSIGNED_BYTE source, bool *overrun);
+
+      // Reads count consecutive bytes starting at startReg without checking
+      // the register bounds. Returns the number of bytes read.
+      int readBurst(UNSIGNED_BYTE startReg, UNSIGNED_BYTE *buf, int count);
+
+      // Writes outCount bytes from out and then, if inCount is not 0, reads
+      // inCount bytes into in, as one transaction. Returns the number of
+      // bytes read, or written if there is nothing to read, and 0 on failure.
+      int transact(UNSIGNED_BYTE *out, int outCount, UNSIGNED_BYTE *in,
+            int inCount);
+
+      // Adds a transaction which began at start to the statistics.
+      void recordTiming(const struct timespec &start, bool success);
+
+      // Converts thresholdMg milli-g into 7 bit threshold register units for
+      // the full scale in use. Returns -1 on failure.
+      int thresholdUnits(unsigned int thresholdMg);
+
+      // Reads the interrupt source register reg and, until its active bit
+      // (INT_SRC_IA, which is also CLICK_SRC_IA) is set, waits for a rising
+      // edge on pin and reads it again. Returns 1 with the register in
+      // *source, 0 on timeout or -1 on failure.
+      int waitForSource(GPIO *pin, int timeoutMs, UNSIGNED_BYTE reg,
+            UNSIGNED_BYTE *source);
+
+      // Sets the bits of register reg selected by mask to those of bits,
+      // keeping the others. Returns true on success.
+      bool updateReg(UNSIGNED_BYTE reg, UNSIGNED_BYTE mask, UNSIGNED_BYTE bits);
 
       // Ensures that the read / write operation will not overrun the bounds of
       // the register space. Returns true if the supplied register range is
@@ -0,0 +1,432 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "LSM303Recording.h"
+
+// Largest encoding of a sample: a 10 byte time varint and three 3 byte axis
+// varints.
+#define MAX_SAMPLE_BYTES 19
+
+// Most samples a block can hold, bounded by its count field.
+#define MAX_BLOCK_SAMPLES 0xFFFF
+
+#define NS_PER_US 1000ULL
+#define NS_PER_MS 1000000ULL
+#define NS_PER_SEC 1000000000ULL
+
+using namespace std;
+
+// Returns CLOCK_MONOTONIC in nanoseconds.
+static uint64_t monotonicNs() {
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+// Appends value as a zigzag varint: 7 bits per byte, low bits first, with the
+// sign folded into bit 0 so small negative values stay short.
+static unsigned char *putVarint(unsigned char *out, int64_t value) {
+   uint64_t folded = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+   while (folded >= 0x80) {
+      *out++ = (folded & 0x7F) | 0x80;
+      folded >>= 7;
+   }
+   *out++ = folded;
+   return out;
+}
+
+// Decodes a zigzag varint which must end before end. Returns NULL if it does
+// not.
+static const unsigned char *getVarint(const unsigned char *in,
+      const unsigned char *end, int64_t *value) {
+   uint64_t folded = 0;
+   int shift;
+   for (shift = 0; in < end && shift < 64; shift += 7) {
+      unsigned char byte = *in++;
+      folded |= (uint64_t)(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) {
+         *value = (int64_t)(folded >> 1) ^ -(int64_t)(folded & 1);
+         return in;
+      }
+   }
+   return NULL;
+}
+
+// Constructor.
+LSM303Recorder::LSM303Recorder(AccelerationSource *samples) {
+   source = samples;
+   fd = -1;
+   failed = false;
+   block = (LSM303BlockHeader *)buffer;
+   used = 0;
+   previousUs = 0;
+   memset(&header, 0, sizeof(header));
+   memset(&previous, 0, sizeof(previous));
+}
+
+// Destructor.
+LSM303Recorder::~LSM303Recorder() {
+   close();
+}
+
+// Creates the file and writes a provisional header, which close() completes.
+bool LSM303Recorder::open(const char *path, unsigned int periodUs,
+      unsigned int countsPerG) {
+   if (fd >= 0) {
+      close();
+   }
+
+   fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0) {
+      fprintf(stderr, "Could not create recording %s: %s.\n", path,
+            strerror(errno));
+      return false;
+   }
+
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+   header.version = RECORDING_VERSION;
+   header.blockBytes = RECORDING_BLOCK_BYTES;
+   header.periodUs = periodUs;
+   header.countsPerG = countsPerG;
+   index.clear();
+   failed = false;
+   used = 0;
+
+   if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+      fprintf(stderr, "Could not write recording %s: %s.\n", path,
+            strerror(errno));
+      failed = true;
+   }
+   return !failed;
+}
+
+// Taps the source.
+int LSM303Recorder::read(LSM303Sample *samples, unsigned int max) {
+   int count = source != NULL ? source->read(samples, max) : -1;
+   if (count > 0) {
+      append(samples, count);
+   }
+   return count;
+}
+
+// Waits on the source.
+void LSM303Recorder::wait(int timeoutMs) {
+   if (source != NULL) {
+      source->wait(timeoutMs);
+   }
+}
+
+// Encodes samples into the current block, starting a new block when the next
+// sample might not fit.
+bool LSM303Recorder::append(const LSM303Sample *samples, int count) {
+   if (fd < 0 || failed) {
+      return false;
+   }
+
+   int sample;
+   for (sample = 0; sample < count; ++sample) {
+      const LSM303Sample *current = &samples[sample];
+      uint64_t timeUs = current->timeNs / NS_PER_US;
+
+      if (used > 0 && (used + MAX_SAMPLE_BYTES > RECORDING_BLOCK_BYTES ||
+               block->count == MAX_BLOCK_SAMPLES)) {
+         if (!writeBlock()) {
+            return false;
+         }
+      }
+
+      if (used == 0) {
+         memset(buffer, 0, sizeof(buffer));
+         block->timeUs = timeUs;
+         block->x = current->value.xVal;
+         block->y = current->value.yVal;
+         block->z = current->value.zVal;
+         block->count = 1;
+         used = sizeof(LSM303BlockHeader);
+
+         LSM303IndexEntry entry = {header.sampleCount, timeUs};
+         index.push_back(entry);
+         if (header.sampleCount == 0) {
+            header.startUs = timeUs;
+         }
+      } else {
+         unsigned char *out = &buffer[used];
+         out = putVarint(out, (int64_t)(timeUs - previousUs) -
+               (int64_t)header.periodUs);
+         out = putVarint(out, current->value.xVal - previous.value.xVal);
+         out = putVarint(out, current->value.yVal - previous.value.yVal);
+         out = putVarint(out, current->value.zVal - previous.value.zVal);
+         used = out - buffer;
+         ++block->count;
+      }
+
+      previous = *current;
+      previousUs = timeUs;
+      ++header.sampleCount;
+   }
+
+   return true;
+}
+
+// Pads the block to its full size and writes it.
+bool LSM303Recorder::writeBlock() {
+   block->bytes = used - sizeof(LSM303BlockHeader);
+   if (write(fd, buffer, sizeof(buffer)) != sizeof(buffer)) {
+      fprintf(stderr, "Could not write recording block: %s.\n",
+            strerror(errno));
+      failed = true;
+      return false;
+   }
+
+   ++header.blockCount;
+   used = 0;
+   return true;
+}
+
+// Completes the recording.
+bool LSM303Recorder::close() {
+   if (fd < 0) {
+      return false;
+   }
+
+   if (used > 0 && !failed) {
+      writeBlock();
+   }
+
+   header.indexOffset = sizeof(header) +
+      header.blockCount * RECORDING_BLOCK_BYTES;
+   ssize_t indexBytes = index.size() * sizeof(LSM303IndexEntry);
+   if (!failed && (write(fd, index.data(), indexBytes) != indexBytes ||
+            pwrite(fd, &header, sizeof(header), 0) != sizeof(header))) {
+      fprintf(stderr, "Could not complete recording: %s.\n", strerror(errno));
+      failed = true;
+   }
+
+   ::close(fd);
+   fd = -1;
+   return !failed;
+}
+
+// Returns the number of samples recorded.
+uint64_t LSM303Recorder::getSampleCount() {
+   return header.sampleCount;
+}
+
+// Constructor.
+LSM303Replay::LSM303Replay() {
+   map = NULL;
+   mapSize = 0;
+   header = NULL;
+   speed = REPLAY_UNLIMITED;
+   ended = true;
+   block = 0;
+   remaining = 0;
+   cursor = NULL;
+   blockEnd = NULL;
+   nextUs = 0;
+   originUs = 0;
+   originNs = 0;
+}
+
+// Destructor.
+LSM303Replay::~LSM303Replay() {
+   close();
+}
+
+// Maps the file and checks that its header, blocks and index lie within it.
+bool LSM303Replay::open(const char *path, double replaySpeed) {
+   close();
+
+   int fd = ::open(path, O_RDONLY);
+   if (fd < 0) {
+      fprintf(stderr, "Could not open recording %s: %s.\n", path,
+            strerror(errno));
+      return false;
+   }
+
+   struct stat status;
+   if (fstat(fd, &status) < 0 ||
+         (uint64_t)status.st_size < sizeof(LSM303RecordingHeader)) {
+      fprintf(stderr, "Recording %s is too short.\n", path);
+      ::close(fd);
+      return false;
+   }
+
+   mapSize = status.st_size;
+   void *mapped = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+   ::close(fd);
+   if (mapped == MAP_FAILED) {
+      fprintf(stderr, "Could not map recording %s: %s.\n", path,
+            strerror(errno));
+      return false;
+   }
+   map = (const unsigned char *)mapped;
+   madvise(mapped, mapSize, MADV_SEQUENTIAL);
+
+   // A block count which cannot fit in the file is rejected before it is
+   // multiplied, so a corrupt header cannot wrap blocksEnd back into range.
+   header = (const LSM303RecordingHeader *)map;
+   bool fits = header->blockCount <=
+      (mapSize - sizeof(LSM303RecordingHeader)) / RECORDING_BLOCK_BYTES;
+   uint64_t blocksEnd = fits ? sizeof(LSM303RecordingHeader) +
+      header->blockCount * RECORDING_BLOCK_BYTES : 0;
+   if (memcmp(header->magic, RECORDING_MAGIC, sizeof(header->magic)) != 0 ||
+         header->version != RECORDING_VERSION ||
+         header->blockBytes != RECORDING_BLOCK_BYTES || !fits ||
+         header->indexOffset != blocksEnd ||
+         header->blockCount * sizeof(LSM303IndexEntry) >
+         mapSize - blocksEnd) {
+      fprintf(stderr, "%s is not a complete recording.\n", path);
+      close();
+      return false;
+   }
+
+   speed = replaySpeed;
+   ended = header->blockCount == 0 || !loadBlock(0);
+   originUs = nextUs;
+   originNs = monotonicNs();
+   return true;
+}
+
+// Unmaps the file.
+void LSM303Replay::close() {
+   if (map != NULL) {
+      munmap((void *)map, mapSize);
+   }
+   map = NULL;
+   header = NULL;
+   ended = true;
+}
+
+// Delivers samples until max are delivered, the next one is not yet due, or
+// the recording ends.
+int LSM303Replay::read(LSM303Sample *samples, unsigned int max) {
+   if (ended) {
+      return -1;
+   }
+
+   uint64_t now = speed > 0 ? monotonicNs() : 0;
+   unsigned int count = 0;
+   while (count < max && !ended && (speed <= 0 || dueNs() <= now)) {
+      samples[count++] = next;
+      ended = !advance();
+   }
+   return count;
+}
+
+// Sleeps until the next sample is due.
+void LSM303Replay::wait(int timeoutMs) {
+   if (ended || speed <= 0) {
+      return;
+   }
+
+   uint64_t wake = dueNs();
+   if (timeoutMs >= 0) {
+      uint64_t limit = monotonicNs() + timeoutMs * NS_PER_MS;
+      wake = wake < limit ? wake : limit;
+   }
+
+   struct timespec deadline;
+   deadline.tv_sec = wake / NS_PER_SEC;
+   deadline.tv_nsec = wake % NS_PER_SEC;
+   while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) ==
+         EINTR) {
+   }
+}
+
+// Binary searches the index for the last block starting at or before the
+// target, then decodes up to the target within it.
+bool LSM303Replay::seek(uint64_t offsetUs) {
+   if (header == NULL || header->blockCount == 0) {
+      return false;
+   }
+
+   const LSM303IndexEntry *entries =
+      (const LSM303IndexEntry *)&map[header->indexOffset];
+   uint64_t target = header->startUs + offsetUs;
+   uint64_t low = 0;
+   uint64_t high = header->blockCount;
+   while (high - low > 1) {
+      uint64_t middle = low + (high - low) / 2;
+      if (entries[middle].timeUs <= target) {
+         low = middle;
+      } else {
+         high = middle;
+      }
+   }
+
+   ended = !loadBlock(low);
+   while (!ended && nextUs < target) {
+      ended = !advance();
+   }
+
+   originUs = nextUs;
+   originNs = monotonicNs();
+   return !ended;
+}
+
+// Returns the recording's header.
+const LSM303RecordingHeader *LSM303Replay::getHeader() {
+   return header;
+}
+
+// Starts decoding a block.
+bool LSM303Replay::loadBlock(uint64_t newBlock) {
+   const unsigned char *start = &map[sizeof(LSM303RecordingHeader) +
+      newBlock * RECORDING_BLOCK_BYTES];
+   const LSM303BlockHeader *blockHeader = (const LSM303BlockHeader *)start;
+   if (blockHeader->count == 0 || blockHeader->bytes >
+         RECORDING_BLOCK_BYTES - sizeof(LSM303BlockHeader)) {
+      fprintf(stderr, "Recording block %llu is damaged.\n",
+            (unsigned long long)newBlock);
+      return false;
+   }
+
+   block = newBlock;
+   remaining = blockHeader->count - 1;
+   cursor = start + sizeof(LSM303BlockHeader);
+   blockEnd = cursor + blockHeader->bytes;
+   nextUs = blockHeader->timeUs;
+   next.timeNs = nextUs * NS_PER_US;
+   next.value.xVal = blockHeader->x;
+   next.value.yVal = blockHeader->y;
+   next.value.zVal = blockHeader->z;
+   return true;
+}
+
+// Decodes the next sample from the current or the following block.
+bool LSM303Replay::advance() {
+   if (remaining == 0) {
+      return block + 1 < header->blockCount && loadBlock(block + 1);
+   }
+
+   int64_t deltas[4];
+   int field;
+   for (field = 0; field < 4 && cursor != NULL; ++field) {
+      cursor = getVarint(cursor, blockEnd, &deltas[field]);
+   }
+   if (cursor == NULL) {
+      fprintf(stderr, "Recording block %llu is damaged.\n",
+            (unsigned long long)block);
+      return false;
+   }
+
+   --remaining;
+   nextUs += deltas[0] + header->periodUs;
+   next.timeNs = nextUs * NS_PER_US;
+   next.value.xVal += deltas[1];
+   next.value.yVal += deltas[2];
+   next.value.zVal += deltas[3];
+   return true;
+}
+
+// Scales the time since the playback origin by the speed.
+uint64_t LSM303Replay::dueNs() {
+   return originNs + (uint64_t)((nextUs - originUs) * NS_PER_US / speed);
+}
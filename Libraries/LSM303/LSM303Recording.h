@@ -0,0 +1,182 @@
+#ifndef LSM303_RECORDING_H
+#define LSM303_RECORDING_H
+
+#include <stdint.h>
+#include <vector>
+#include "AccelerationSource.h"
+
+// Recording file format. All fields are little-endian.
+//
+//    LSM303RecordingHeader
+//    blockCount blocks of RECORDING_BLOCK_BYTES each:
+//       LSM303BlockHeader, holding the first sample in full
+//       the other samples, each as four zigzag varints: its time since the
+//       previous sample minus the period, and its x, y and z minus those of
+//       the previous sample
+//       zero padding
+//    blockCount LSM303IndexEntry, the time and number of each block's first
+//    sample
+//
+// Times are stored in microseconds. A still sensor sampled on time takes 4 to
+// 7 bytes per sample, against 14 for the raw values and time.
+#define RECORDING_MAGIC "SQKACCL"
+#define RECORDING_VERSION 1
+#define RECORDING_BLOCK_BYTES 4096
+
+// Replay speeds for LSM303Replay::open(): as fast as samples are read, or at
+// the pace they were recorded at.
+#define REPLAY_UNLIMITED 0.0
+#define REPLAY_REAL_TIME 1.0
+
+// Start of a recording file.
+typedef struct LSM303RecordingHeader {
+   char magic[8];
+   uint32_t version;
+   uint32_t blockBytes;
+   uint32_t periodUs;
+   uint32_t countsPerG;
+   uint64_t startUs;
+   uint64_t sampleCount;
+   uint64_t blockCount;
+   uint64_t indexOffset;
+   uint64_t reserved;
+} LSM303RecordingHeader;
+
+// Start of a block.
+typedef struct LSM303BlockHeader {
+   uint64_t timeUs;
+   int16_t x;
+   int16_t y;
+   int16_t z;
+   uint16_t count;
+   uint32_t bytes;
+   uint32_t reserved;
+} LSM303BlockHeader;
+
+// Entry of the block index.
+typedef struct LSM303IndexEntry {
+   uint64_t firstSample;
+   uint64_t timeUs;
+} LSM303IndexEntry;
+
+// Records the samples of an AccelerationSource into a file while passing them
+// on. It sits in the sample path as a tap: read() reads from the source
+// straight into the caller's buffer and encodes the samples from there. Each
+// full block is written with one write() call.
+class LSM303Recorder : public AccelerationSource {
+   public:
+      // Constructor, records from source, which may be NULL when samples are
+      // only given through append().
+      LSM303Recorder(AccelerationSource *source);
+
+      // Destructor, closes the recording.
+      ~LSM303Recorder();
+
+      // Creates the recording file at path, noting the sample period and the
+      // counts per g of the full scale in use (ACCEL_CALIBRATION). Returns
+      // true on success.
+      bool open(const char *path, unsigned int periodUs,
+            unsigned int countsPerG);
+
+      // Reads samples from the source and records them. Returns as
+      // AccelerationSource::read.
+      int read(LSM303Sample *samples, unsigned int max);
+
+      // Waits on the source.
+      void wait(int timeoutMs);
+
+      // Records count samples. Returns true on success.
+      bool append(const LSM303Sample *samples, int count);
+
+      // Writes the last block, the index and the final header and closes the
+      // file. Returns true on success.
+      bool close();
+
+      // Returns the number of samples recorded.
+      uint64_t getSampleCount();
+
+   private:
+      // Writes the current block out and starts a new one.
+      bool writeBlock();
+
+      AccelerationSource *source;
+      int fd;
+      bool failed;
+      LSM303RecordingHeader header;
+      std::vector<LSM303IndexEntry> index;
+      LSM303BlockHeader *block;
+      unsigned int used;
+      LSM303Sample previous;
+      uint64_t previousUs;
+      unsigned char buffer[RECORDING_BLOCK_BYTES];
+};
+
+// Plays a recording back through the AccelerationSource interface. The file
+// is mapped into memory and decoded in place, with no read() calls or
+// copies. Samples are delivered either as fast as they are read or paced
+// like the recording (optionally sped up), and keep their recorded times.
+class LSM303Replay : public AccelerationSource {
+   public:
+      // Constructor.
+      LSM303Replay();
+
+      // Destructor, closes the recording.
+      ~LSM303Replay();
+
+      // Opens the recording at path. speed is REPLAY_UNLIMITED, or how many
+      // times faster than recorded to replay, e.g. REPLAY_REAL_TIME. Returns
+      // true if the file is a valid recording.
+      bool open(const char *path, double speed);
+
+      // Unmaps the recording.
+      void close();
+
+      // Moves the samples which are due into samples. Returns as
+      // AccelerationSource::read.
+      int read(LSM303Sample *samples, unsigned int max);
+
+      // Sleeps until the next sample is due, or timeoutMs milliseconds pass.
+      void wait(int timeoutMs);
+
+      // Continues playback from the first sample at or after offsetUs
+      // microseconds into the recording, found through the block index.
+      // Returns true on success.
+      bool seek(uint64_t offsetUs);
+
+      // Returns the header of the open recording.
+      const LSM303RecordingHeader *getHeader();
+
+   private:
+      // Makes the first sample of block the next one. Returns false if the
+      // block is damaged.
+      bool loadBlock(uint64_t block);
+
+      // Decodes the sample following the next one into next. Returns false
+      // at the end of the recording.
+      bool advance();
+
+      // Returns the CLOCK_MONOTONIC time at which next is due.
+      uint64_t dueNs();
+
+      const unsigned char *map;
+      uint64_t mapSize;
+      const LSM303RecordingHeader *header;
+      double speed;
+      bool ended;
+
+      // Decoding position: the block, its remaining samples and bytes, and
+      // the next sample to deliver.
+      uint64_t block;
+      unsigned int remaining;
+      const unsigned char *cursor;
+      const unsigned char *blockEnd;
+      LSM303Sample next;
+      uint64_t nextUs;
+
+      // Pacing: the time of the sample at which playback (re)started, and
+      // when that was.
+      uint64_t originUs;
+      uint64_t originNs;
+};
+
+#endif
@@ -0,0 +1,194 @@
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "LSM303Sampler.h"
+#include "../GPIO/GPIOProfile.h"
+
+#define ODR_SHIFT 4
+#define NS_PER_US 1000ULL
+#define NS_PER_SEC 1000000000ULL
+
+using namespace std;
+
+// Returns CLOCK_MONOTONIC in nanoseconds.
+static uint64_t monotonicNs() {
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+// Constructor.
+LSM303Sampler::LSM303Sampler(LSM303 *accel, unsigned int periodUs) {
+   sensor = accel;
+   periodNs = periodUs * NS_PER_US;
+   started = false;
+   running = false;
+   samples = 0;
+   dropped = 0;
+   missed = 0;
+   failed = 0;
+   maxJitterNs = 0;
+   totalJitterNs = 0;
+}
+
+// Destructor.
+LSM303Sampler::~LSM303Sampler() {
+   stop();
+}
+
+// Starts the acquisition thread, with real-time priority if asked for and
+// permitted.
+bool LSM303Sampler::start(int priority, int cpu) {
+   if (started || periodNs == 0) {
+      return false;
+   }
+
+   running = true;
+   int status = EPERM;
+   if (priority > 0) {
+      pthread_attr_t attr;
+      struct sched_param param;
+      memset(&param, 0, sizeof(param));
+      param.sched_priority = priority;
+
+      pthread_attr_init(&attr);
+      pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+      pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+      pthread_attr_setschedparam(&attr, &param);
+      status = pthread_create(&thread, &attr, sampleLoop, this);
+      pthread_attr_destroy(&attr);
+
+      if (status != 0) {
+         fprintf(stderr, "Unable to run the sampler under SCHED_FIFO: %s.\n",
+               strerror(status));
+      }
+   }
+
+   if (status != 0) {
+      status = pthread_create(&thread, NULL, sampleLoop, this);
+   }
+   if (status != 0) {
+      fprintf(stderr, "Unable to start the sampler thread: %s.\n",
+            strerror(status));
+      running = false;
+      return false;
+   }
+   started = true;
+
+   if (cpu >= 0) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(cpu, &cpus);
+      status = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+      if (status != 0) {
+         fprintf(stderr, "Unable to pin the sampler to CPU %d: %s.\n", cpu,
+               strerror(status));
+      }
+   }
+
+   return true;
+}
+
+// Stops the acquisition thread.
+void LSM303Sampler::stop() {
+   if (started) {
+      running = false;
+      pthread_join(thread, NULL);
+      started = false;
+   }
+}
+
+// Drains queued samples.
+int LSM303Sampler::read(LSM303Sample *out, unsigned int max) {
+   return queue.pop(out, max);
+}
+
+// Sleeps until the next sample is due.
+void LSM303Sampler::wait(int timeoutMs) {
+   uint64_t sleepNs = periodNs;
+   if (timeoutMs >= 0 && (uint64_t)timeoutMs * 1000000ULL < sleepNs) {
+      sleepNs = (uint64_t)timeoutMs * 1000000ULL;
+   }
+
+   struct timespec pause;
+   pause.tv_sec = sleepNs / NS_PER_SEC;
+   pause.tv_nsec = sleepNs % NS_PER_SEC;
+   clock_nanosleep(CLOCK_MONOTONIC, 0, &pause, NULL);
+}
+
+// Returns the number of queued samples.
+unsigned int LSM303Sampler::available() {
+   return queue.count();
+}
+
+// Returns the statistics.
+LSM303SamplerStats LSM303Sampler::getStats() {
+   LSM303SamplerStats stats;
+   stats.samples = samples.load(memory_order_relaxed);
+   stats.dropped = dropped.load(memory_order_relaxed);
+   stats.missed = missed.load(memory_order_relaxed);
+   stats.failed = failed.load(memory_order_relaxed);
+   stats.maxJitterNs = maxJitterNs.load(memory_order_relaxed);
+   stats.meanJitterNs = stats.samples ?
+      totalJitterNs.load(memory_order_relaxed) / stats.samples : 0;
+   return stats;
+}
+
+// Looks up the output data rate bits (7 - 4) of CTRL_REG1_A. Rate 9 is
+// 1344 Hz in normal mode.
+unsigned int LSM303Sampler::periodFor(UNSIGNED_BYTE initMask) {
+   static const unsigned int periods[16] = {0, 1000000, 100000, 40000, 20000,
+      10000, 5000, 2500, 617, 744, 0, 0, 0, 0, 0, 0};
+
+   return periods[initMask >> ODR_SHIFT];
+}
+
+// Sleeps until each deadline and takes a sample. A wake up which is a whole
+// period or more late skips the deadlines it slept through rather than
+// sampling in a burst to catch up, so samples stay evenly spaced. A read
+// which fails is counted and produces no sample.
+void *LSM303Sampler::sampleLoop(void *arg) {
+   LSM303Sampler *sampler = (LSM303Sampler *)arg;
+   uint64_t period = sampler->periodNs;
+   uint64_t deadline = monotonicNs();
+
+   while (sampler->running.load(memory_order_relaxed)) {
+      deadline += period;
+      struct timespec wake;
+      wake.tv_sec = deadline / NS_PER_SEC;
+      wake.tv_nsec = deadline % NS_PER_SEC;
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) ==
+            EINTR) {
+      }
+
+      GPIO_PROFILE_SCOPE("sample");
+
+      LSM303Sample sample;
+      sample.timeNs = monotonicNs();
+      bool read = sampler->sensor->readAcceleration(&sample.value);
+
+      uint64_t jitter = sample.timeNs - deadline;
+      if (jitter >= period) {
+         uint64_t skipped = jitter / period;
+         sampler->missed.fetch_add(skipped, memory_order_relaxed);
+         deadline += skipped * period;
+      }
+      if (!read) {
+         sampler->failed.fetch_add(1, memory_order_relaxed);
+         continue;
+      }
+      if (jitter > sampler->maxJitterNs.load(memory_order_relaxed)) {
+         sampler->maxJitterNs.store(jitter, memory_order_relaxed);
+      }
+      sampler->totalJitterNs.fetch_add(jitter, memory_order_relaxed);
+      sampler->samples.fetch_add(1, memory_order_relaxed);
+
+      if (!sampler->queue.push(sample)) {
+         sampler->dropped.fetch_add(1, memory_order_relaxed);
+      }
+   }
+
+   return NULL;
+}
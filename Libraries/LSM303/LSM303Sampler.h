@@ -0,0 +1,98 @@
+#ifndef LSM303_SAMPLER_H
+#define LSM303_SAMPLER_H
+
+#include <atomic>
+#include <pthread.h>
+#include <stdint.h>
+#include "AccelerationSource.h"
+#include "../Util/RingBuffer.h"
+
+// Number of samples which can be queued for the consumer, 2.5 seconds at
+// 100 Hz.
+#define SAMPLER_QUEUE 256
+
+// Sampling statistics since the sampler started. jitter is how late the
+// thread woke up for a sample. Periods the thread slept through entirely are
+// counted as missed, samples the consumer did not make room for as dropped
+// and reads which failed on the bus as failed.
+typedef struct LSM303SamplerStats {
+   unsigned long samples;
+   unsigned long dropped;
+   unsigned long missed;
+   unsigned long failed;
+   uint64_t maxJitterNs;
+   uint64_t meanJitterNs;
+} LSM303SamplerStats;
+
+// Reads an LSM303 from a dedicated acquisition thread at a fixed period, so
+// the sampling times do not depend on what the rest of the program is doing.
+// The thread sleeps until absolute deadlines, one period apart, and so does
+// not drift. It can run with SCHED_FIFO priority and be pinned to a CPU.
+//
+// Each sample is timestamped and pushed into a lock-free queue, which the
+// consumer drains in batches with read(). Neither side ever waits for the
+// other: when the queue is full, new samples are dropped and counted. The
+// queue is read through the AccelerationSource interface.
+//
+// While the sampler runs it owns the LSM303, which must not be used by any
+// other thread.
+class LSM303Sampler : public AccelerationSource {
+   public:
+      // Constructor, samples sensor every periodUs microseconds once started.
+      // The period should match the data rate the sensor was enabled with,
+      // see periodFor().
+      LSM303Sampler(LSM303 *sensor, unsigned int periodUs);
+
+      // Destructor, stops the thread.
+      ~LSM303Sampler();
+
+      // Starts the acquisition thread. If priority is above 0 the thread runs
+      // under SCHED_FIFO at that priority, and if cpu is not negative it is
+      // pinned to that CPU. When either cannot be set up (usually for lack of
+      // privileges) the thread runs without it. Returns true if the thread
+      // started.
+      bool start(int priority, int cpu);
+
+      // Stops the acquisition thread, which may take up to one period.
+      void stop();
+
+      // Moves up to max of the oldest queued samples into samples. Returns the
+      // number moved, the stream never ends. Must be called from one thread
+      // only.
+      int read(LSM303Sample *samples, unsigned int max);
+
+      // Sleeps for one sample period, or timeoutMs milliseconds if shorter.
+      void wait(int timeoutMs);
+
+      // Returns the number of queued samples.
+      unsigned int available();
+
+      // Returns the statistics so far.
+      LSM303SamplerStats getStats();
+
+      // Returns the sample period in microseconds of the data rate selected by
+      // initMask (the value written to CTRL_REG1_A, see LSM303::enable), or 0
+      // if it powers the accelerometer down.
+      static unsigned int periodFor(UNSIGNED_BYTE initMask);
+
+   private:
+      // Entry point of the acquisition thread.
+      static void *sampleLoop(void *arg);
+
+      LSM303 *sensor;
+      uint64_t periodNs;
+      RingBuffer<LSM303Sample, SAMPLER_QUEUE> queue;
+      pthread_t thread;
+      bool started;
+      std::atomic<bool> running;
+
+      // Statistics, written by the acquisition thread only.
+      std::atomic<unsigned long> samples;
+      std::atomic<unsigned long> dropped;
+      std::atomic<unsigned long> missed;
+      std::atomic<unsigned long> failed;
+      std::atomic<uint64_t> maxJitterNs;
+      std::atomic<uint64_t> totalJitterNs;
+};
+
+#endif
@@ -0,0 +1,789 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "LSM303Sim.h"
+
+#define NS_PER_SEC 1000000000ULL
+#define ODR_SHIFT 4
+#define LPEN 0x08
+#define AOI 0x80
+#define I1_OVERRUN 0x02
+#define I2_INT1 0x40
+#define H_LACTIVE 0x02
+#define BOOT 0x80
+#define FIFO_MODE_MASK 0xC0
+#define STATUS_ZYXDA 0x08
+#define STATUS_ZYXOR 0x80
+#define AXES 3
+#define ACCEL_VALUES 6
+
+// States of the click engine: waiting for a spike, in the first spike, in
+// the latency and window after it, in the second spike, and in a spike held
+// too long to be a click.
+#define CLICK_STATE_IDLE 0
+#define CLICK_STATE_SPIKE 1
+#define CLICK_STATE_LATENCY 2
+#define CLICK_STATE_WINDOW 3
+#define CLICK_STATE_SECOND 4
+#define CLICK_STATE_HELD 5
+
+// The click high-pass filter moves its baseline by 1 / 2^CLICK_FILTER_SHIFT
+// of the difference each sample.
+#define CLICK_FILTER_SHIFT 3
+
+// Samples produced in a burst at most when the device was left alone for a
+// while, enough to refill the FIFO. Older ones are counted but not produced.
+#define MAX_CATCH_UP FIFO_DEPTH
+
+// Time the sample thread sleeps while the device is powered down.
+#define IDLE_NS 10000000ULL
+
+using namespace std;
+
+// Returns the sample period of the data rate selected in CTRL_REG1_A, or 0 if
+// the device is powered down.
+static uint64_t periodNs(unsigned char ctrl1) {
+   static const uint64_t periods[16] = {0, 1000000000, 100000000, 40000000,
+      20000000, 10000000, 5000000, 2500000, 617284, 744048, 0, 0, 0, 0, 0, 0};
+
+   int odr = ctrl1 >> ODR_SHIFT;
+   if (odr == 9 && (ctrl1 & LPEN)) {
+      return 186012;
+   }
+   return periods[odr];
+}
+
+// Returns the number of counts per g at the full scale selected in
+// CTRL_REG4_A.
+static int countsPerG(unsigned char ctrl4) {
+   static const int counts[4] = {16384, 8192, 4096, 1365};
+
+   return counts[(ctrl4 & FULL_SCALE_MASK) >> FULL_SCALE_SHIFT];
+}
+
+// Returns the mg per LSB of the INT1 and click thresholds at the full scale
+// selected in CTRL_REG4_A.
+static int thresholdMg(unsigned char ctrl4) {
+   static const int units[4] = {16, 32, 62, 186};
+
+   return units[(ctrl4 & FULL_SCALE_MASK) >> FULL_SCALE_SHIFT];
+}
+
+// Returns byte index (0 - 5, low byte first) of value as read from the OUT
+// registers.
+static unsigned char registerByte(const Acceleration &value, int index) {
+   short axes[AXES] = {value.xVal, value.yVal, value.zVal};
+   unsigned short axis = (unsigned short) axes[index / 2];
+   return index & 1 ? axis >> 8 : axis & 0xFF;
+}
+
+// Constructor.
+LSM303Sim::LSM303Sim() {
+   pthread_mutex_init(&lock, NULL);
+   pthread_condattr_t attributes;
+   pthread_condattr_init(&attributes);
+   pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+   pthread_cond_init(&wake, &attributes);
+   pthread_condattr_destroy(&attributes);
+   running = false;
+
+   memset(registers, 0, sizeof(registers));
+   registers[CTRL_REG1_A] = DISABLE_ACCEL;
+   pointer = 0;
+   increment = false;
+
+   waveform = NULL;
+   waveformContext = NULL;
+   source = NULL;
+   memset(&current, 0, sizeof(current));
+   memset(&reference, 0, sizeof(reference));
+   samples = 0;
+   lost = 0;
+   nextSampleNs = 0;
+
+   fifoHead = 0;
+   fifoCount = 0;
+
+   int1Duration = 0;
+   int1Active = false;
+   int1Source = 0;
+   memset(clickBase, 0, sizeof(clickBase));
+   clickState = CLICK_STATE_IDLE;
+   clickSamples = 0;
+   clickAxes = 0;
+   clickNegative = false;
+   int line;
+   for (line = 0; line < 2; ++line) {
+      lineBackends[line] = NULL;
+      linePins[line] = -1;
+      lineLevels[line] = -1;
+   }
+
+   transactionNs = 0;
+   byteNs = 0;
+   errorRate = 0;
+   random = 1;
+   transactions = 0;
+   bytes = 0;
+   errors = 0;
+}
+
+// Destructor.
+LSM303Sim::~LSM303Sim() {
+   close();
+   pthread_cond_destroy(&wake);
+   pthread_mutex_destroy(&lock);
+}
+
+// Starts the thread which produces samples in the background.
+bool LSM303Sim::open(int bus, int address) {
+   if (address != ACCEL_ADDRESS) {
+      fprintf(stderr, "No simulated device at address 0x%02x.\n", address);
+      return false;
+   }
+
+   pthread_mutex_lock(&lock);
+   bool started = running;
+   running = true;
+   pthread_mutex_unlock(&lock);
+   if (started) {
+      return true;
+   }
+
+   if (pthread_create(&thread, NULL, sampleLoop, this) != 0) {
+      fprintf(stderr, "Could not start the simulated LSM303.\n");
+      running = false;
+      return false;
+   }
+   return true;
+}
+
+// Stops the sample thread.
+void LSM303Sim::close() {
+   pthread_mutex_lock(&lock);
+   bool started = running;
+   running = false;
+   pthread_cond_signal(&wake);
+   pthread_mutex_unlock(&lock);
+
+   if (started) {
+      pthread_join(thread, NULL);
+   }
+}
+
+// The simulated bus always supports combined transfers.
+bool LSM303Sim::canCombine() {
+   return true;
+}
+
+// Handles the messages as one transaction.
+bool LSM303Sim::transfer(I2CMessage *messages, int count) {
+   uint64_t start = GPIOBackend::monotonicNow();
+   int length = 0;
+
+   pthread_mutex_lock(&lock);
+   ++transactions;
+   bool failed = injectError();
+   if (!failed) {
+      catchUp(start);
+      int index;
+      for (index = 0; index < count; ++index) {
+         if (messages[index].read) {
+            readMessage(messages[index].buf, messages[index].length);
+         } else {
+            writeMessage(messages[index].buf, messages[index].length);
+         }
+         length += messages[index].length;
+      }
+      bytes += length;
+   }
+   uint64_t duration = busTime(count, length);
+   pthread_mutex_unlock(&lock);
+
+   busWait(start, duration);
+   if (failed) {
+      errno = EIO;
+   }
+   return !failed;
+}
+
+// Handles a write transaction.
+int LSM303Sim::write(const unsigned char *buf, int count) {
+   I2CMessage message = {(unsigned char *) buf, (unsigned short) count, false};
+   return transfer(&message, 1) ? count : -1;
+}
+
+// Handles a read transaction.
+int LSM303Sim::read(unsigned char *buf, int count) {
+   I2CMessage message = {buf, (unsigned short) count, true};
+   return transfer(&message, 1) ? count : -1;
+}
+
+// Selects the waveform samples are produced from.
+void LSM303Sim::setWaveform(LSM303Waveform newWaveform, void *context) {
+   pthread_mutex_lock(&lock);
+   waveform = newWaveform;
+   waveformContext = context;
+   pthread_mutex_unlock(&lock);
+}
+
+// Selects the source samples are produced from.
+void LSM303Sim::setSource(AccelerationSource *newSource) {
+   pthread_mutex_lock(&lock);
+   source = newSource;
+   pthread_mutex_unlock(&lock);
+}
+
+// Connects an interrupt line to a fake pin.
+void LSM303Sim::connectInterrupt(int line, GPIOFakeBackend *backend,
+      int pin) {
+   if (line != LSM303_INT1 && line != LSM303_INT2) {
+      fprintf(stderr, "There is no interrupt line %d.\n", line);
+      return;
+   }
+
+   pthread_mutex_lock(&lock);
+   lineBackends[line - 1] = backend;
+   linePins[line - 1] = pin;
+   lineLevels[line - 1] = -1;
+   updateLines();
+   pthread_mutex_unlock(&lock);
+}
+
+// Sets the bus time added to each transaction.
+void LSM303Sim::setLatency(uint64_t newTransactionNs, uint64_t newByteNs) {
+   pthread_mutex_lock(&lock);
+   transactionNs = newTransactionNs;
+   byteNs = newByteNs;
+   pthread_mutex_unlock(&lock);
+}
+
+// Sets the probability of a transaction failing.
+void LSM303Sim::setErrorRate(double rate) {
+   pthread_mutex_lock(&lock);
+   errorRate = rate;
+   pthread_mutex_unlock(&lock);
+}
+
+// Returns a register without its read side effects.
+unsigned char LSM303Sim::getRegister(unsigned char reg) {
+   pthread_mutex_lock(&lock);
+   unsigned char value = registers[reg % LSM303_SIM_REGISTERS];
+   pthread_mutex_unlock(&lock);
+   return value;
+}
+
+// Returns the number of samples produced.
+uint64_t LSM303Sim::getSampleCount() {
+   pthread_mutex_lock(&lock);
+   uint64_t count = samples;
+   pthread_mutex_unlock(&lock);
+   return count;
+}
+
+// Returns the number of samples lost to a full FIFO.
+uint64_t LSM303Sim::getLostCount() {
+   pthread_mutex_lock(&lock);
+   uint64_t count = lost;
+   pthread_mutex_unlock(&lock);
+   return count;
+}
+
+// Returns the number of transactions.
+unsigned long LSM303Sim::getTransactionCount() {
+   pthread_mutex_lock(&lock);
+   unsigned long count = transactions;
+   pthread_mutex_unlock(&lock);
+   return count;
+}
+
+// Returns the number of bytes transferred.
+unsigned long LSM303Sim::getByteCount() {
+   pthread_mutex_lock(&lock);
+   unsigned long count = bytes;
+   pthread_mutex_unlock(&lock);
+   return count;
+}
+
+// Returns the number of injected failures.
+unsigned long LSM303Sim::getErrorCount() {
+   pthread_mutex_lock(&lock);
+   unsigned long count = errors;
+   pthread_mutex_unlock(&lock);
+   return count;
+}
+
+// Resets the bus counters.
+void LSM303Sim::resetStats() {
+   pthread_mutex_lock(&lock);
+   transactions = 0;
+   bytes = 0;
+   errors = 0;
+   pthread_mutex_unlock(&lock);
+}
+
+// Produces the samples due by now. After a long gap only the last
+// MAX_CATCH_UP are produced; the ones before are counted, and lost if the
+// FIFO was collecting them, as they would have been pushed out anyway.
+void LSM303Sim::catchUp(uint64_t now) {
+   uint64_t period = periodNs(registers[CTRL_REG1_A]);
+   if (period == 0) {
+      nextSampleNs = 0;
+      return;
+   }
+   if (nextSampleNs == 0) {
+      nextSampleNs = now + period;
+      return;
+   }
+   if (now < nextSampleNs) {
+      return;
+   }
+
+   uint64_t due = (now - nextSampleNs) / period + 1;
+   if (due > MAX_CATCH_UP) {
+      uint64_t skipped = due - MAX_CATCH_UP;
+      if (source) {
+         LSM303Sample discard[FIFO_DEPTH];
+         uint64_t left = skipped;
+         while (left > 0) {
+            int read = source->read(discard, left < FIFO_DEPTH ? left :
+                  FIFO_DEPTH);
+            if (read <= 0) {
+               break;
+            }
+            left -= read;
+         }
+      }
+      samples += skipped;
+      if (fifoEnabled()) {
+         lost += skipped;
+      }
+      nextSampleNs += skipped * period;
+   }
+
+   while (nextSampleNs <= now) {
+      produce();
+      nextSampleNs += period;
+   }
+}
+
+// Produces the next sample from the recording, the waveform or a still
+// sensor.
+void LSM303Sim::produce() {
+   LSM303Sample sample;
+   if (source) {
+      if (source->read(&sample, 1) == 1) {
+         current = sample.value;
+      }
+   } else if (waveform) {
+      waveform(samples, &current, waveformContext);
+   } else {
+      current.xVal = 0;
+      current.yVal = 0;
+      current.zVal = countsPerG(registers[CTRL_REG4_A]);
+   }
+   ++samples;
+
+   int index;
+   for (index = 0; index < ACCEL_VALUES; ++index) {
+      registers[OUT_X_L_A + index] = registerByte(current, index);
+   }
+   if (registers[STATUS_REG_A] & STATUS_ZYXDA) {
+      registers[STATUS_REG_A] |= STATUS_ZYXOR;
+   }
+   registers[STATUS_REG_A] |= STATUS_ZYXDA;
+
+   if (fifoEnabled()) {
+      if (fifoCount == FIFO_DEPTH) {
+         ++lost;
+         if ((registers[FIFO_CTRL_REG_A] & FIFO_MODE_MASK) == FIFO_MODE_FIFO) {
+            evaluateInt1();
+            evaluateClick();
+            updateLines();
+            return;
+         }
+         fifoHead = (fifoHead + 1) % FIFO_DEPTH;
+         --fifoCount;
+      }
+      fifo[(fifoHead + fifoCount) % FIFO_DEPTH] = current;
+      ++fifoCount;
+   }
+
+   evaluateInt1();
+   evaluateClick();
+   updateLines();
+}
+
+// Compares the newest sample, less the reference if the high-pass filter is
+// applied, against the threshold on each axis. Events must hold for the
+// duration in samples; with LIR_INT1 the interrupt then stays active until
+// INT1_SOURCE_A is read.
+void LSM303Sim::evaluateInt1() {
+   unsigned char config = registers[INT1_CFG_A];
+   bool latched = registers[CTRL_REG5_A] & LIR_INT1;
+   if (latched && int1Active) {
+      return;
+   }
+
+   bool filtered = registers[CTRL_REG2_A] & HPIS1;
+   short values[AXES] = {current.xVal, current.yVal, current.zVal};
+   short references[AXES] = {reference.xVal, reference.yVal, reference.zVal};
+   int counts = countsPerG(registers[CTRL_REG4_A]);
+   int threshold = (registers[INT1_THS_A] & INT_VALUE_MASK) *
+      thresholdMg(registers[CTRL_REG4_A]);
+
+   unsigned char events = 0;
+   int axis;
+   for (axis = 0; axis < AXES; ++axis) {
+      int value = values[axis] - (filtered ? references[axis] : 0);
+      int mg = abs(value) * 1000 / counts;
+      events |= (mg > threshold ? 2 : 1) << (axis * 2);
+   }
+
+   unsigned char enabled = config & INT_SRC_EVENTS;
+   unsigned char matched = events & enabled;
+   bool condition = enabled && (config & AOI ? matched == enabled :
+         matched != 0);
+
+   int1Duration = condition ? int1Duration + 1 : 0;
+   int1Active = condition &&
+      int1Duration >= (registers[INT1_DURATION_A] & INT_VALUE_MASK);
+   int1Source = (int1Active ? INT_SRC_IA : 0) | events;
+   registers[INT1_SOURCE_A] = int1Source;
+}
+
+// Compares the newest sample, less the high-pass baseline if HPCLICK is set,
+// against the click threshold on each enabled axis. A spike ending within
+// TIME_LIMIT_A samples is a click; a second one starting after TIME_LATENCY_A
+// samples and within TIME_WINDOW_A samples of that makes it a double click.
+// The sign is that of the largest axis at the start of the spike.
+void LSM303Sim::evaluateClick() {
+   unsigned char config = registers[CLICK_CFG_A] & CLICK_CFG_MASK;
+   bool filtered = registers[CTRL_REG2_A] & HPCLICK;
+   short values[AXES] = {current.xVal, current.yVal, current.zVal};
+   int counts = countsPerG(registers[CTRL_REG4_A]);
+   int threshold = (registers[CLICK_THS_A] & INT_VALUE_MASK) *
+      thresholdMg(registers[CTRL_REG4_A]);
+
+   unsigned char singles = 0;
+   unsigned char doubles = 0;
+   unsigned char over = 0;
+   bool negative = false;
+   int peak = 0;
+   int axis;
+   for (axis = 0; axis < AXES; ++axis) {
+      int value = values[axis] - (filtered ? clickBase[axis] : 0);
+      clickBase[axis] += (values[axis] - clickBase[axis]) /
+         (1 << CLICK_FILTER_SHIFT);
+
+      singles |= (config >> (axis * 2) & 1) << axis;
+      doubles |= (config >> (axis * 2 + 1) & 1) << axis;
+      int mg = abs(value) * 1000 / counts;
+      if (((singles | doubles) >> axis & 1) && mg > threshold) {
+         over |= 1 << axis;
+         if (mg > peak) {
+            peak = mg;
+            negative = value < 0;
+         }
+      }
+   }
+
+   unsigned char kind = 0;
+   unsigned char kindAxes = 0;
+   ++clickSamples;
+   switch (clickState) {
+      case CLICK_STATE_IDLE:
+      case CLICK_STATE_WINDOW:
+         if (over) {
+            clickState = clickState == CLICK_STATE_IDLE ? CLICK_STATE_SPIKE :
+               CLICK_STATE_SECOND;
+            clickSamples = 1;
+            clickAxes = over;
+            clickNegative = negative;
+         } else if (clickState == CLICK_STATE_WINDOW &&
+               clickSamples >= registers[TIME_WINDOW_A]) {
+            clickState = CLICK_STATE_IDLE;
+         }
+         break;
+
+      case CLICK_STATE_SPIKE:
+      case CLICK_STATE_SECOND:
+         if (over) {
+            clickAxes |= over;
+            if (clickSamples > (registers[TIME_LIMIT_A] & INT_VALUE_MASK)) {
+               clickState = CLICK_STATE_HELD;
+            }
+         } else if (clickState == CLICK_STATE_SECOND) {
+            kind = CLICK_SRC_DCLICK | (clickAxes & singles ? CLICK_SRC_SCLICK :
+                  0);
+            kindAxes = doubles;
+            clickState = CLICK_STATE_IDLE;
+         } else {
+            if (clickAxes & singles) {
+               kind = CLICK_SRC_SCLICK;
+               kindAxes = singles;
+            }
+            clickState = clickAxes & doubles ? CLICK_STATE_LATENCY :
+               CLICK_STATE_IDLE;
+            clickSamples = 0;
+         }
+         break;
+
+      case CLICK_STATE_LATENCY:
+         if (clickSamples >= registers[TIME_LATENCY_A]) {
+            clickState = CLICK_STATE_WINDOW;
+            clickSamples = 0;
+         }
+         break;
+
+      case CLICK_STATE_HELD:
+         if (!over) {
+            clickState = CLICK_STATE_IDLE;
+         }
+         break;
+   }
+
+   if (kind) {
+      registers[CLICK_SRC_A] = CLICK_SRC_IA | kind |
+         (clickNegative ? CLICK_SRC_SIGN : 0) | (clickAxes & kindAxes);
+   }
+}
+
+// Routes the INT1 generator, click engine and FIFO flags onto the lines
+// selected in CTRL_REG3_A and CTRL_REG6_A, and drives the connected pins where
+// the level changed.
+void LSM303Sim::updateLines() {
+   unsigned char ctrl3 = registers[CTRL_REG3_A];
+   unsigned char ctrl6 = registers[CTRL_REG6_A];
+   int level = fifoLevel();
+   bool watermark = level > (registers[FIFO_CTRL_REG_A] & FIFO_WATERMARK_MASK);
+   bool click = registers[CLICK_SRC_A] & CLICK_SRC_IA;
+
+   bool active[2];
+   active[0] = ((ctrl3 & I1_AOI1) && int1Active) ||
+      ((ctrl3 & I1_CLICK) && click) || ((ctrl3 & I1_WTM) && watermark) ||
+      ((ctrl3 & I1_OVERRUN) && level == FIFO_DEPTH);
+   active[1] = ((ctrl6 & I2_INT1) && int1Active) ||
+      ((ctrl6 & I2_CLICKEN) && click);
+
+   int line;
+   for (line = 0; line < 2; ++line) {
+      int value = active[line] != ((ctrl6 & H_LACTIVE) != 0);
+      if (lineBackends[line] && value != lineLevels[line]) {
+         lineBackends[line]->drive(linePins[line], value);
+         lineLevels[line] = value;
+      }
+   }
+}
+
+// Returns the number of samples in the FIFO.
+int LSM303Sim::fifoLevel() {
+   return fifoEnabled() ? fifoCount : 0;
+}
+
+// Returns true if the FIFO is enabled and not bypassed.
+bool LSM303Sim::fifoEnabled() {
+   return (registers[CTRL_REG5_A] & FIFO_ENABLE) &&
+      (registers[FIFO_CTRL_REG_A] & FIFO_MODE_MASK) != FIFO_MODE_BYPASS;
+}
+
+// Sets the register pointer from the first byte and writes the rest.
+void LSM303Sim::writeMessage(const unsigned char *buf, int count) {
+   if (count < 1) {
+      return;
+   }
+
+   pointer = buf[0] & ~READ_PAD_BYTES;
+   increment = buf[0] & READ_PAD_BYTES;
+   int index;
+   for (index = 1; index < count; ++index) {
+      writeRegister(pointer, buf[index]);
+      if (increment) {
+         pointer = (pointer + 1) % LSM303_SIM_REGISTERS;
+      }
+   }
+}
+
+// Reads from the register pointer. With the FIFO enabled the pointer wraps
+// from OUT_Z_H_A to OUT_X_L_A so a burst reads consecutive samples.
+void LSM303Sim::readMessage(unsigned char *buf, int count) {
+   int index;
+   for (index = 0; index < count; ++index) {
+      buf[index] = readRegister(pointer);
+      if (!increment) {
+         continue;
+      }
+      if (pointer == OUT_Z_H_A && fifoEnabled()) {
+         pointer = OUT_X_L_A;
+      } else {
+         pointer = (pointer + 1) % LSM303_SIM_REGISTERS;
+      }
+   }
+}
+
+// Reads a register. The OUT registers read the oldest FIFO sample while
+// there is one, and reading OUT_Z_H_A moves on to the next.
+unsigned char LSM303Sim::readRegister(unsigned char reg) {
+   unsigned char value;
+   switch (reg) {
+      case OUT_X_L_A: case OUT_X_H_A: case OUT_Y_L_A:
+      case OUT_Y_H_A: case OUT_Z_L_A: case OUT_Z_H_A:
+         if (fifoLevel() > 0) {
+            value = registerByte(fifo[fifoHead], reg - OUT_X_L_A);
+            if (reg == OUT_Z_H_A) {
+               fifoHead = (fifoHead + 1) % FIFO_DEPTH;
+               --fifoCount;
+               updateLines();
+            }
+         } else {
+            value = registers[reg];
+         }
+         if (reg == OUT_Z_H_A) {
+            registers[STATUS_REG_A] &= ~(STATUS_ZYXDA | STATUS_ZYXOR);
+         }
+         return value;
+
+      case FIFO_SRC_REG_A: {
+         int level = fifoLevel();
+         value = level == FIFO_DEPTH ? FIFO_SRC_OVRN | FIFO_SRC_FSS : level;
+         if (level > (registers[FIFO_CTRL_REG_A] & FIFO_WATERMARK_MASK)) {
+            value |= FIFO_SRC_WTM;
+         }
+         if (level == 0) {
+            value |= FIFO_SRC_EMPTY;
+         }
+         return value;
+      }
+
+      case REFERENCE_A:
+         reference = current;
+         return registers[reg];
+
+      case INT1_SOURCE_A:
+         value = int1Source;
+         if (registers[CTRL_REG5_A] & LIR_INT1) {
+            int1Active = false;
+            int1Duration = 0;
+            int1Source &= ~INT_SRC_IA;
+            registers[INT1_SOURCE_A] = int1Source;
+            updateLines();
+         }
+         return value;
+
+      case CLICK_SRC_A:
+         value = registers[reg];
+         registers[reg] = 0;
+         updateLines();
+         return value;
+
+      default:
+         return registers[reg % LSM303_SIM_REGISTERS];
+   }
+}
+
+// Writes a register. Writes to read only and reserved registers are ignored.
+void LSM303Sim::writeRegister(unsigned char reg, unsigned char value) {
+   switch (reg) {
+      case STATUS_REG_A: case FIFO_SRC_REG_A: case INT1_SOURCE_A:
+      case INT2_SOURCE_A: case CLICK_SRC_A:
+         return;
+
+      case CTRL_REG1_A:
+         if ((value ^ registers[reg]) >> ODR_SHIFT) {
+            nextSampleNs = 0;
+         }
+         break;
+
+      case CTRL_REG5_A:
+         value &= ~BOOT;
+         if (!(value & FIFO_ENABLE)) {
+            fifoCount = 0;
+         }
+         break;
+
+      case FIFO_CTRL_REG_A:
+         if ((value & FIFO_MODE_MASK) == FIFO_MODE_BYPASS) {
+            fifoCount = 0;
+         }
+         break;
+
+      case CLICK_CFG_A:
+         clickBase[0] = current.xVal;
+         clickBase[1] = current.yVal;
+         clickBase[2] = current.zVal;
+         clickState = CLICK_STATE_IDLE;
+         break;
+
+      default:
+         if (reg < CTRL_REG1_A || reg > TIME_WINDOW_A ||
+               (reg >= OUT_X_L_A && reg <= OUT_Z_H_A)) {
+            return;
+         }
+         break;
+   }
+
+   registers[reg] = value;
+   if (reg == CTRL_REG1_A) {
+      catchUp(GPIOBackend::monotonicNow());
+   }
+   updateLines();
+   pthread_cond_signal(&wake);
+}
+
+// Returns the bus time of a transaction: its start, address bytes and data.
+uint64_t LSM303Sim::busTime(int messages, int length) {
+   return transactionNs + (uint64_t) (messages + length) * byteNs;
+}
+
+// Sleeps until the transaction's bus time is over.
+void LSM303Sim::busWait(uint64_t start, uint64_t duration) {
+   if (duration == 0) {
+      return;
+   }
+
+   uint64_t deadline = start + duration;
+   struct timespec until;
+   until.tv_sec = deadline / NS_PER_SEC;
+   until.tv_nsec = deadline % NS_PER_SEC;
+   while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) ==
+         EINTR) {
+   }
+}
+
+// Draws from a fixed sequence so every run fails the same transactions.
+bool LSM303Sim::injectError() {
+   if (errorRate <= 0) {
+      return false;
+   }
+
+   random = random * 1664525u + 1013904223u;
+   if ((random >> 8) * (1.0 / (1 << 24)) >= errorRate) {
+      return false;
+   }
+   ++errors;
+   return true;
+}
+
+// Produces samples as they come due, sleeping in between on the condition
+// variable so register writes which change the data rate wake it early.
+void *LSM303Sim::sampleLoop(void *arg) {
+   LSM303Sim *sim = (LSM303Sim *)arg;
+
+   pthread_mutex_lock(&sim->lock);
+   while (sim->running) {
+      uint64_t now = GPIOBackend::monotonicNow();
+      sim->catchUp(now);
+
+      uint64_t deadline = sim->nextSampleNs ? sim->nextSampleNs :
+         now + IDLE_NS;
+      struct timespec until;
+      until.tv_sec = deadline / NS_PER_SEC;
+      until.tv_nsec = deadline % NS_PER_SEC;
+      pthread_cond_timedwait(&sim->wake, &sim->lock, &until);
+   }
+   pthread_mutex_unlock(&sim->lock);
+
+   return NULL;
+}
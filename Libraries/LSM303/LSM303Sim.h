@@ -0,0 +1,194 @@
+#ifndef LSM303_SIM_H
+#define LSM303_SIM_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "AccelerationSource.h"
+#include "I2CTransport.h"
+#include "../GPIO/GPIOFakeBackend.h"
+
+// Size of the simulated register space.
+#define LSM303_SIM_REGISTERS 0x40
+
+// Bus timing of a 400 kHz I2C bus: start, address and stop, and each further
+// byte of 9 clocks.
+#define LSM303_SIM_400KHZ_TRANSACTION_NS 25000
+#define LSM303_SIM_400KHZ_BYTE_NS 22500
+
+// Produces the raw value (as read from the OUT registers) of sample number
+// sample. context is passed through from setWaveform().
+typedef void (*LSM303Waveform)(uint64_t sample, Acceleration *value,
+      void *context);
+
+// Software model of the LSM303 accelerometer behind an I2C transport, so the
+// LSM303 driver (or any other code) can run without hardware. It implements
+// the accelerometer's register map:
+//
+//    - sub-address auto-increment (bit 7 of the register address), wrapping
+//      from OUT_Z_H_A back to OUT_X_L_A while the FIFO is enabled,
+//    - samples produced at the data rate set in CTRL_REG1_A, paced by the
+//      monotonic clock, from a waveform or a recording,
+//    - the FIFO in bypass, FIFO and stream mode with watermark and overrun
+//      flags,
+//    - the INT1 threshold generator (high-pass filter reset by reading
+//      REFERENCE_A, OR / AND combination, duration, latching), and the INT1
+//      and INT2 lines driven on fake GPIO pins, also for the FIFO watermark,
+//    - the click engine (single and double clicks per axis, time limit,
+//      latency and window), with a high-pass filter which settles within a
+//      few samples, reporting in CLICK_SRC_A until it is read.
+//
+// Bus latency can be added per transaction and per byte, and transactions can
+// be made to fail at random, as a NACK would.
+//
+// A thread keeps producing samples while no one talks to the device, so the
+// interrupt lines change on time. All calls are thread safe.
+class LSM303Sim : public I2CTransport {
+   public:
+      // Constructor, the device starts powered down with every register at
+      // its reset value, producing a still sensor lying flat.
+      LSM303Sim();
+
+      // Destructor, stops the sample thread.
+      ~LSM303Sim();
+
+      // Starts the sample thread. The bus number is ignored, address must be
+      // ACCEL_ADDRESS.
+      bool open(int bus, int address);
+
+      // Stops the sample thread.
+      void close();
+
+      bool canCombine();
+      bool transfer(I2CMessage *messages, int count);
+      int write(const unsigned char *buf, int count);
+      int read(unsigned char *buf, int count);
+
+      // Produces samples from waveform. Passing NULL restores the still
+      // sensor.
+      void setWaveform(LSM303Waveform waveform, void *context);
+
+      // Produces samples from source (e.g. an LSM303Replay at
+      // REPLAY_UNLIMITED speed), ignoring its timestamps. Once the source ends
+      // its last sample repeats. Passing NULL returns to the waveform.
+      void setSource(AccelerationSource *source);
+
+      // Drives interrupt line (1 or 2) on pin of backend.
+      void connectInterrupt(int line, GPIOFakeBackend *backend, int pin);
+
+      // Adds transactionNs to every transaction and byteNs to every byte
+      // (including address bytes) as bus time, e.g. the
+      // LSM303_SIM_400KHZ_* values.
+      void setLatency(uint64_t transactionNs, uint64_t byteNs);
+
+      // Makes each transaction fail with probability rate (0 - 1).
+      void setErrorRate(double rate);
+
+      // Returns the current value of register reg.
+      unsigned char getRegister(unsigned char reg);
+
+      // Returns the number of samples produced, and of those lost to a full
+      // FIFO.
+      uint64_t getSampleCount();
+      uint64_t getLostCount();
+
+      // Returns the number of transactions, bytes transferred (without
+      // address bytes) and injected failures.
+      unsigned long getTransactionCount();
+      unsigned long getByteCount();
+      unsigned long getErrorCount();
+
+      // Resets the transaction, byte and failure counters.
+      void resetStats();
+
+   private:
+      // Produces the samples which came due by now.
+      void catchUp(uint64_t now);
+
+      // Produces one sample into the output registers and FIFO.
+      void produce();
+
+      // Evaluates the INT1 generator for the newest sample.
+      void evaluateInt1();
+
+      // Runs the click engine on the newest sample.
+      void evaluateClick();
+
+      // Drives the interrupt lines from the interrupt state.
+      void updateLines();
+
+      // Returns the FIFO level.
+      int fifoLevel();
+
+      // Returns true if the FIFO collects samples.
+      bool fifoEnabled();
+
+      // Handles a written message: a sub-address and data.
+      void writeMessage(const unsigned char *buf, int count);
+
+      // Handles a read message from the register pointer.
+      void readMessage(unsigned char *buf, int count);
+
+      // Returns the value of register reg, with its read side effects.
+      unsigned char readRegister(unsigned char reg);
+
+      // Writes value into register reg, with its side effects.
+      void writeRegister(unsigned char reg, unsigned char value);
+
+      // Returns the time one transaction of count messages carrying bytes
+      // bytes takes on the bus.
+      uint64_t busTime(int messages, int bytes);
+
+      // Waits until the bus time of a transaction which started at start has
+      // passed.
+      void busWait(uint64_t start, uint64_t duration);
+
+      // Decides whether the next transaction fails.
+      bool injectError();
+
+      // Entry point of the sample thread.
+      static void *sampleLoop(void *arg);
+
+      pthread_mutex_t lock;
+      pthread_cond_t wake;
+      pthread_t thread;
+      bool running;
+
+      unsigned char registers[LSM303_SIM_REGISTERS];
+      unsigned char pointer;
+      bool increment;
+
+      LSM303Waveform waveform;
+      void *waveformContext;
+      AccelerationSource *source;
+      Acceleration current;
+      Acceleration reference;
+      uint64_t samples;
+      uint64_t lost;
+      uint64_t nextSampleNs;
+
+      Acceleration fifo[FIFO_DEPTH];
+      int fifoHead;
+      int fifoCount;
+
+      int int1Duration;
+      bool int1Active;
+      unsigned char int1Source;
+      int clickBase[3];
+      int clickState;
+      int clickSamples;
+      unsigned char clickAxes;
+      bool clickNegative;
+      GPIOFakeBackend *lineBackends[2];
+      int linePins[2];
+      int lineLevels[2];
+
+      uint64_t transactionNs;
+      uint64_t byteNs;
+      double errorRate;
+      uint32_t random;
+      unsigned long transactions;
+      unsigned long bytes;
+      unsigned long errors;
+};
+
+#endif
@@ -0,0 +1,316 @@
+#include <string.h>
+#include "MotionDetector.h"
+#include "../GPIO/GPIOProfile.h"
+
+// Lanes of a MotionVector.
+#define LANES 4
+
+// Converts acceleration counts into g.
+#define COUNTS_TO_G (1.0f / ACCEL_CALIBRATION)
+
+typedef float MotionVector __attribute__((vector_size(LANES * sizeof(float))));
+typedef short MotionShorts __attribute__((vector_size(LANES * sizeof(short))));
+
+using namespace std;
+
+// Loads LANES floats from a possibly unaligned address.
+static inline MotionVector loadVector(const float *address) {
+   MotionVector value;
+   memcpy(&value, address, sizeof(value));
+   return value;
+}
+
+// Stores LANES floats to a possibly unaligned address.
+static inline void storeVector(float *address, MotionVector value) {
+   memcpy(address, &value, sizeof(value));
+}
+
+// Adds up the lanes of a vector.
+static inline float sumLanes(MotionVector value) {
+   return value[0] + value[1] + value[2] + value[3];
+}
+
+// Returns the largest lane of a vector.
+static inline float maxLanes(MotionVector value) {
+   float first = value[0] > value[1] ? value[0] : value[1];
+   float second = value[2] > value[3] ? value[2] : value[3];
+   return first > second ? first : second;
+}
+
+// Converts counts into g, returning their sum.
+static float convertScalar(const short *in, float *out, int count) {
+   float sum = 0;
+   int index;
+   for (index = 0; index < count; ++index) {
+      out[index] = in[index] * COUNTS_TO_G;
+      sum += out[index];
+   }
+   return sum;
+}
+
+// Converts counts into g, LANES at a time, returning their sum.
+static float convertVector(const short *in, float *out, int count) {
+   MotionVector sums = {0, 0, 0, 0};
+   int index;
+   for (index = 0; index + LANES <= count; index += LANES) {
+      MotionShorts raw;
+      memcpy(&raw, &in[index], sizeof(raw));
+      MotionVector value = __builtin_convertvector(raw, MotionVector) *
+         COUNTS_TO_G;
+      storeVector(&out[index], value);
+      sums += value;
+   }
+
+   float sum = sumLanes(sums);
+   for (; index < count; ++index) {
+      out[index] = in[index] * COUNTS_TO_G;
+      sum += out[index];
+   }
+   return sum;
+}
+
+// Computes the energy of count samples. x, y and z hold the previous sample
+// followed by the block. Stores the sum and peak of the energies.
+static void energyScalar(const float *x, const float *y, const float *z,
+      const float *baseline, int metric, int count, float *energy,
+      float *sum, float *peak) {
+   float total = 0;
+   float largest = 0;
+   int index;
+   for (index = 0; index < count; ++index) {
+      float dx = x[index + 1] - (metric == MOTION_METRIC_JERK ? x[index] :
+            baseline[0]);
+      float dy = y[index + 1] - (metric == MOTION_METRIC_JERK ? y[index] :
+            baseline[1]);
+      float dz = z[index + 1] - (metric == MOTION_METRIC_JERK ? z[index] :
+            baseline[2]);
+      energy[index] = dx * dx + dy * dy + dz * dz;
+      total += energy[index];
+      largest = energy[index] > largest ? energy[index] : largest;
+   }
+   *sum = total;
+   *peak = largest;
+}
+
+// Computes the energy as energyScalar, LANES samples at a time, returning the
+// number of samples done. The jerk metric reads the previous samples as a
+// vector one sample behind. The metric is a template parameter so the loop
+// has no branch in it.
+template <bool Jerk>
+static int energyLanes(const float *x, const float *y, const float *z,
+      const float *baseline, int count, float *energy, MotionVector *sums,
+      MotionVector *peaks) {
+   int index;
+   for (index = 0; index + LANES <= count; index += LANES) {
+      MotionVector dx = loadVector(&x[index + 1]);
+      MotionVector dy = loadVector(&y[index + 1]);
+      MotionVector dz = loadVector(&z[index + 1]);
+      if (Jerk) {
+         dx -= loadVector(&x[index]);
+         dy -= loadVector(&y[index]);
+         dz -= loadVector(&z[index]);
+      } else {
+         dx -= baseline[0];
+         dy -= baseline[1];
+         dz -= baseline[2];
+      }
+
+      MotionVector value = dx * dx + dy * dy + dz * dz;
+      storeVector(&energy[index], value);
+      *sums += value;
+      *peaks = value > *peaks ? value : *peaks;
+   }
+   return index;
+}
+
+// Computes the energy as energyScalar, with the samples which do not fill a
+// vector done by energyScalar.
+static void energyVector(const float *x, const float *y, const float *z,
+      const float *baseline, int metric, int count, float *energy,
+      float *sum, float *peak) {
+   MotionVector sums = {0, 0, 0, 0};
+   MotionVector peaks = {0, 0, 0, 0};
+   int index = metric == MOTION_METRIC_JERK ?
+      energyLanes<true>(x, y, z, baseline, count, energy, &sums, &peaks) :
+      energyLanes<false>(x, y, z, baseline, count, energy, &sums, &peaks);
+
+   float tailSum = 0;
+   float tailPeak = 0;
+   energyScalar(&x[index], &y[index], &z[index], baseline, metric,
+         count - index, &energy[index], &tailSum, &tailPeak);
+
+   float largest = maxLanes(peaks);
+   *sum = sumLanes(sums) + tailSum;
+   *peak = tailPeak > largest ? tailPeak : largest;
+}
+
+// Constructor.
+MotionDetector::MotionDetector(const MotionConfig *config) {
+   settings = *config;
+   kernel = MOTION_KERNEL_VECTOR;
+   reset();
+}
+
+// Default tuning: a bump must stand 8 times above the noise floor and at least
+// 0.1 g out, and ends once it drops to 3 times the floor. Another bump can
+// follow half a second later.
+void MotionDetector::defaultConfig(MotionConfig *config) {
+   config->metric = MOTION_METRIC_MAGNITUDE;
+   config->baselineAlpha = 0.05f;
+   config->floorAlpha = 0.1f;
+   config->onFactor = 8.0f;
+   config->offFactor = 3.0f;
+   config->minEnergy = 0.01f;
+   config->refractory = 50;
+}
+
+// Selects the energy kernel.
+void MotionDetector::setKernel(int newKernel) {
+   kernel = newKernel == MOTION_KERNEL_SCALAR ? MOTION_KERNEL_SCALAR :
+      MOTION_KERNEL_VECTOR;
+}
+
+// Splits the input into blocks.
+int MotionDetector::process(const short *x, const short *y, const short *z,
+      int count, MotionEvent *events, int maxEvents) {
+   GPIO_PROFILE_SCOPE("motionProcess");
+
+   int fired = 0;
+   int offset;
+   for (offset = 0; offset < count; offset += MOTION_BLOCK) {
+      int length = count - offset < MOTION_BLOCK ? count - offset :
+         MOTION_BLOCK;
+      int room = maxEvents > fired ? maxEvents - fired : 0;
+      fired += processBlock(&x[offset], &y[offset], &z[offset], length,
+            &events[fired < maxEvents ? fired : 0], room);
+   }
+   return fired;
+}
+
+// Deinterleaves the samples block by block.
+int MotionDetector::process(const Acceleration *samples, int count,
+      MotionEvent *events, int maxEvents) {
+   short x[MOTION_BLOCK];
+   short y[MOTION_BLOCK];
+   short z[MOTION_BLOCK];
+
+   int fired = 0;
+   int offset;
+   for (offset = 0; offset < count; offset += MOTION_BLOCK) {
+      int length = count - offset < MOTION_BLOCK ? count - offset :
+         MOTION_BLOCK;
+      int index;
+      for (index = 0; index < length; ++index) {
+         x[index] = samples[offset + index].xVal;
+         y[index] = samples[offset + index].yVal;
+         z[index] = samples[offset + index].zVal;
+      }
+
+      int room = maxEvents > fired ? maxEvents - fired : 0;
+      fired += process(x, y, z, length, &events[fired < maxEvents ? fired : 0],
+            room);
+   }
+   return fired;
+}
+
+// Returns the noise floor.
+float MotionDetector::getNoiseFloor() {
+   return noiseFloor;
+}
+
+// Returns true during an event.
+bool MotionDetector::isActive() {
+   return active;
+}
+
+// Returns to the initial state.
+void MotionDetector::reset() {
+   primed = false;
+   active = false;
+   holdoff = 0;
+   position = 0;
+   baseline[0] = 0;
+   baseline[1] = 0;
+   baseline[2] = 0;
+   noiseFloor = 0;
+   bufferX[0] = 0;
+   bufferY[0] = 0;
+   bufferZ[0] = 0;
+}
+
+// Runs a block through the filter chain. The very first block only primes
+// the baseline and noise floor, no event fires during it.
+int MotionDetector::processBlock(const short *x, const short *y,
+      const short *z, int count, MotionEvent *events, int maxEvents) {
+   float (*convert)(const short *, float *, int) = kernel ==
+      MOTION_KERNEL_VECTOR ? convertVector : convertScalar;
+   float means[3];
+   means[0] = convert(x, &bufferX[1], count) / count;
+   means[1] = convert(y, &bufferY[1], count) / count;
+   means[2] = convert(z, &bufferZ[1], count) / count;
+
+   if (!primed) {
+      baseline[0] = means[0];
+      baseline[1] = means[1];
+      baseline[2] = means[2];
+      bufferX[0] = bufferX[1];
+      bufferY[0] = bufferY[1];
+      bufferZ[0] = bufferZ[1];
+   }
+
+   float sum = 0;
+   float peak = 0;
+   (kernel == MOTION_KERNEL_VECTOR ? energyVector : energyScalar)(bufferX,
+         bufferY, bufferZ, baseline, settings.metric, count, energy, &sum,
+         &peak);
+
+   float on = noiseFloor * settings.onFactor + settings.minEnergy;
+   float off = noiseFloor * settings.offFactor + settings.minEnergy;
+   int fired = 0;
+   bool quiet = !active;
+
+   if (!primed) {
+      noiseFloor = sum / count;
+      primed = true;
+      quiet = false;
+   } else if (active || peak > on) {
+      int index;
+      for (index = 0; index < count; ++index) {
+         if (active) {
+            if (energy[index] < off) {
+               active = false;
+               holdoff = settings.refractory;
+            }
+         } else if (holdoff > 0) {
+            --holdoff;
+         } else if (energy[index] > on) {
+            active = true;
+            quiet = false;
+            if (fired < maxEvents) {
+               events[fired].sample = position + index;
+               events[fired].energy = energy[index];
+            }
+            ++fired;
+         }
+      }
+   } else {
+      holdoff = holdoff > (unsigned int)count ? holdoff - count : 0;
+   }
+
+   // Blocks with a bump in them would drag the floor up, so only quiet ones
+   // feed it.
+   if (quiet && !active) {
+      noiseFloor += settings.floorAlpha * (sum / count - noiseFloor);
+   }
+
+   int axis;
+   for (axis = 0; axis < 3; ++axis) {
+      baseline[axis] += settings.baselineAlpha * (means[axis] - baseline[axis]);
+   }
+   bufferX[0] = bufferX[count];
+   bufferY[0] = bufferY[count];
+   bufferZ[0] = bufferZ[count];
+   position += count;
+
+   return fired;
+}
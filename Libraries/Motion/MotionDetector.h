@@ -0,0 +1,115 @@
+#if !defined(MOTION_DETECTOR_H)
+#define MOTION_DETECTOR_H
+
+#include "../LSM303/LSM303.h"
+
+// Number of samples processed as one block. Longer input is split into blocks.
+#define MOTION_BLOCK 64
+
+// Kernels computing the per-sample energy: plain C loops, or GCC vector
+// extensions, which compile to NEON on the BeagleBoneBlack and SSE / AVX on
+// x86 and fall back to scalar code elsewhere. Both give the same events.
+#define MOTION_KERNEL_SCALAR 0
+#define MOTION_KERNEL_VECTOR 1
+
+// Energy measures: the squared magnitude of the acceleration with its slowly
+// moving baseline (gravity, offsets) removed, or the squared magnitude of the
+// change between consecutive samples (jerk), which needs no baseline.
+#define MOTION_METRIC_MAGNITUDE 0
+#define MOTION_METRIC_JERK 1
+
+// Tuning of a MotionDetector. Energies are in g squared.
+typedef struct MotionConfig {
+   // MOTION_METRIC_*.
+   int metric;
+
+   // Weight (0 - 1) of each block's mean acceleration in the baseline.
+   float baselineAlpha;
+
+   // Weight (0 - 1) of each quiet block's mean energy in the noise floor.
+   float floorAlpha;
+
+   // An event fires once the energy exceeds floor * onFactor + minEnergy, and
+   // the detector re-arms once it falls below floor * offFactor + minEnergy.
+   float onFactor;
+   float offFactor;
+   float minEnergy;
+
+   // Samples after re-arming during which no new event can fire.
+   unsigned int refractory;
+} MotionConfig;
+
+// A detected bump: the index of the sample (counted from the first sample
+// processed) whose energy crossed the threshold, and that energy.
+typedef struct MotionEvent {
+   unsigned long sample;
+   float energy;
+} MotionEvent;
+
+// Streaming bump detector for accelerometer samples. Samples are fed in blocks
+// of any length and processed in MOTION_BLOCK pieces, each of which goes
+// through:
+//
+//    1. conversion to g in structure-of-arrays float buffers,
+//    2. removal of the baseline tracked from earlier blocks,
+//    3. the energy of each sample (MOTION_METRIC_*),
+//    4. a threshold derived from an adaptive noise floor, with hysteresis and
+//       a refractory period.
+//
+// Steps 1 - 3 run as branch-free loops in the selected kernel, and also yield
+// the block's sums and peak energy. Step 4 only walks the samples when the
+// peak is above the threshold or an event is in progress, so quiet blocks
+// cost no per-sample branching at all.
+class MotionDetector {
+   public:
+      // Constructor, copies config. Uses the vector kernel.
+      MotionDetector(const MotionConfig *config);
+
+      // Fills config with settings suited to bumps of a nightstand at 100 Hz.
+      static void defaultConfig(MotionConfig *config);
+
+      // Selects the energy kernel, MOTION_KERNEL_SCALAR or MOTION_KERNEL_VECTOR.
+      void setKernel(int kernel);
+
+      // Processes count samples given as separate x, y and z arrays. Up to
+      // maxEvents fired events are stored in events. Returns the number of
+      // events fired, which may exceed maxEvents.
+      int process(const short *x, const short *y, const short *z, int count,
+            MotionEvent *events, int maxEvents);
+
+      // Processes count samples as for the above.
+      int process(const Acceleration *samples, int count, MotionEvent *events,
+            int maxEvents);
+
+      // Returns the current noise floor in g squared.
+      float getNoiseFloor();
+
+      // Returns true while the energy has not fallen back since the last event.
+      bool isActive();
+
+      // Forgets the baseline, noise floor and trigger state.
+      void reset();
+
+   private:
+      // Processes one block of at most MOTION_BLOCK samples.
+      int processBlock(const short *x, const short *y, const short *z,
+            int count, MotionEvent *events, int maxEvents);
+
+      MotionConfig settings;
+      int kernel;
+      bool primed;
+      bool active;
+      unsigned int holdoff;
+      unsigned long position;
+      float baseline[3];
+      float noiseFloor;
+
+      // Block buffers in g. Index 0 holds the last sample of the previous
+      // block, for the jerk metric.
+      float bufferX[MOTION_BLOCK + 1];
+      float bufferY[MOTION_BLOCK + 1];
+      float bufferZ[MOTION_BLOCK + 1];
+      float energy[MOTION_BLOCK];
+};
+
+#endif
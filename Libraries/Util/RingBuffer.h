@@ -0,0 +1,73 @@
+#if !defined(RING_BUFFER_H)
+#define RING_BUFFER_H
+
+#include <atomic>
+
+// Lock-free single producer, single consumer queue of Size items (a power of
+// two). One thread may push and one other thread may pop concurrently without
+// locking; neither call ever blocks.
+template <typename T, unsigned int Size>
+class RingBuffer {
+   static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+
+   public:
+      // Constructor, creates an empty queue.
+      RingBuffer() : head(0), tail(0) {
+      }
+
+      // Appends item. Returns false if the queue is full. Producer only.
+      bool push(const T &item) {
+         unsigned int position = tail.load(std::memory_order_relaxed);
+         if (position - head.load(std::memory_order_acquire) == Size) {
+            return false;
+         }
+
+         items[position & (Size - 1)] = item;
+         tail.store(position + 1, std::memory_order_release);
+         return true;
+      }
+
+      // Removes the oldest item into item. Returns false if the queue is
+      // empty. Consumer only.
+      bool pop(T *item) {
+         unsigned int position = head.load(std::memory_order_relaxed);
+         if (position == tail.load(std::memory_order_acquire)) {
+            return false;
+         }
+
+         *item = items[position & (Size - 1)];
+         head.store(position + 1, std::memory_order_release);
+         return true;
+      }
+
+      // Removes up to max of the oldest items into items, oldest first.
+      // Returns the number removed. Consumer only.
+      unsigned int pop(T *out, unsigned int max) {
+         unsigned int position = head.load(std::memory_order_relaxed);
+         unsigned int queued = tail.load(std::memory_order_acquire) - position;
+         unsigned int taken = queued < max ? queued : max;
+
+         unsigned int index;
+         for (index = 0; index < taken; ++index) {
+            out[index] = items[(position + index) & (Size - 1)];
+         }
+         head.store(position + taken, std::memory_order_release);
+         return taken;
+      }
+
+      // Returns the number of queued items. Only a snapshot when called while
+      // the other thread is active.
+      unsigned int count() {
+         return tail.load(std::memory_order_acquire) -
+            head.load(std::memory_order_acquire);
+      }
+
+   private:
+      // head, tail and the items live on separate cache lines so the producer
+      // and consumer do not contend on them.
+      alignas(64) std::atomic<unsigned int> head;
+      alignas(64) std::atomic<unsigned int> tail;
+      alignas(64) T items[Size];
+};
+
+#endif